@@ -96,6 +96,38 @@ it has other attachments or it has been explicitly started independently.
 Attachments between a dependent and dependency are re-created if a dependency
 starts (or starts again) while the dependent is still started.
 .\"
+.SS SERVICE TEMPLATES
+.\"
+A service description file with a name ending in \fB@\fR (for example
+\fIgetty@\fR) is a \fItemplate\fR. A template cannot be loaded directly, but
+a service named \fItemplate\-name\fR\fB@\fR\fIargument\fR (for example
+\fIgetty@tty1\fR), for which there is no service description file of its own,
+is loaded as an \fIinstance\fR of the template. Within the template, each
+occurrence of \fB$1\fR in a setting value is replaced by the instance argument
+(in this example, \fItty1\fR); the argument is inserted literally, so that
+characters which would otherwise have special meaning (such as white space or
+quote marks) are not interpreted. \fB$1\fR may be used only in the following
+settings: \fBcommand\fR, \fBstop\-command\fR, \fBworking\-dir\fR,
+\fBenv\-file\fR, \fBsocket\-listen\fR, \fBpid\-file\fR, \fBdepends\-on\fR,
+\fBdepends\-ms\fR, \fBwaits\-for\fR, \fBwaits\-for.d\fR, \fBlogfile\fR,
+\fBchain\-to\fR, \fBready\-notification\fR, \fBinittab\-id\fR and
+\fBinittab\-line\fR. A template which uses it in any other setting is invalid.
+.LP
+For example, a template could specify:
+.LP
+.nf
+.ft CR
+command = /sbin/agetty $1 38400
+depends-on = dev@$1
+.ft
+.fi
+.LP
+A template is read from disk and parsed only once; its parsed settings are
+then shared by all its instances, each of which differs only in those settings
+which contain \fB$1\fR. The template is re-read when an instance is reloaded
+(see \fBdinitctl\fR(8)). Each instance can be started, stopped and reloaded
+independently of other instances.
+.\"
 .SS SERVICE PROPERTIES
 .\"
 This section described the various service properties that can be specified
@@ -161,6 +193,23 @@ minimum prevents Dinit from consuming a large number of process cycles in
 case a process continuously fails immediately after it is started. The
 default is 0.2 (200 milliseconds).
 .TP
+\fBrestart\-delay\-max\fR = \fIXXX.YYYY\fR
+Enables restart backoff: each successive automatic restart doubles the
+restart delay (as initially specified by \fBrestart\-delay\fR), up to
+the specified maximum. This avoids continuously restarting a process which
+fails repeatedly (for example because of a failing external resource). The
+default is 0, which disables backoff (the restart delay is fixed).
+.TP
+\fBrestart\-delay\-jitter\fR = \fINNN\fR
+Specifies a random variation, as a percentage (0-100), to be applied to the
+restart delay. This prevents a number of services which fail at the same time
+from repeatedly restarting simultaneously. The default is 0.
+.TP
+\fBrestart\-delay\-reset\fR = \fIXXX.YYYY\fR
+Specifies how long a process must run before it is considered stable, after
+which the restart backoff is reset (so that the next restart uses the initial
+\fBrestart\-delay\fR). The default is 10 seconds.
+.TP
 \fBrestart\-limit\-interval\fR = \fIXXX.YYYY\fR
 Sets the interval, in seconds, over which restarts are limited. If a process
 automatically restarts more than a certain number of times (specified by the
@@ -276,10 +325,10 @@ to terminate (applies to 'process' services only). SIGTERM is always
 sent along with the specified signal, unless the \fBno\-sigterm\fR option is
 specified via the \fBoptions\fR parameter.
 .TP
-\fBready\-notification\fR = {\fBpipefd:\fR\fIfd-number\fR | \fBpipevar:\fR\fIenv-var-name\fR}
+\fBready\-notification\fR = {\fBpipefd:\fR\fIfd-number\fR | \fBpipevar:\fR\fIenv-var-name\fR | \fBsocket\fR}
 Specifies the mechanism, if any, by which a process service will notify that it is ready
 (successfully started). If not specified, a process service is considered started as soon as it
-has begun execution. The two options are:
+has begun execution. The options are:
 .RS
 .IP \(bu
 \fBpipefd:\fR\fIfd-number\fR \(em the service will write a message to the specified file descriptor,
@@ -289,8 +338,23 @@ with the S6 supervision suite.
 \fBpipevar:\fR\fIenv-var-name\fR \(em the service will write a message to file descriptor identified
 using the contents of the specified environment variable, which will be set by \fBdinit\fR before
 execution to a file descriptor (chosen arbitrarily) attached to the write end of a pipe.
+.IP \(bu
+\fBsocket\fR \(em the service will send a \fBREADY=1\fR message to the datagram socket identified
+by the \fBNOTIFY_SOCKET\fR environment variable. This mechanism is compatible with the
+\fBsd_notify\fR protocol used by Systemd. A single socket is shared by all services, and messages
+are only accepted from the main process of a service. A \fBSTATUS=\fR message may be used to report
+a status description, and \fBWATCHDOG=1\fR messages serve as watchdog keep-alives (see
+\fBwatchdog\-timeout\fR).
 .RE
 .TP
+\fBwatchdog\-timeout\fR = \fIXXX.YYY\fR
+For services using \fBready\-notification = socket\fR only; specifies the time in seconds
+within which the service process must send each watchdog keep-alive message (\fBWATCHDOG=1\fR),
+once it has notified readiness. If a keep-alive is not received in time, the process is killed
+(via SIGKILL) and the service is treated as having terminated unexpectedly. The timeout is passed
+to the process, in microseconds, via the \fBWATCHDOG_USEC\fR environment variable. The default
+of 0 disables the watchdog.
+.TP
 \fBlogfile\fR = \fIlog-file-path\fR
 Specifies the log file for the service. Output from the service process
 will go this file.
@@ -313,6 +377,11 @@ When this service is started, if this setting (or the \fBinittab-line\fR setting
 specified value, an entry will be created in the system "utmp" database which tracks
 processes and logged-in users. Typically this database is used by the "who" command to
 list logged-in users. The entry will be cleared when the service terminates.
+For the system service manager, entries are not written until the root filesystem has been
+marked read-write (by a service with the \fBstarts-rwfs\fR option); entries for services started
+earlier are written at that point (or at shutdown, if it is never reached). If no service loaded
+at boot has the \fBstarts-rwfs\fR option, entries are written as soon as the boot services have
+been started.
 
 The \fBinittab-id\fR setting specifies the "inittab id" to be written in the entry for
 the process. The value is normally quite meaningless. However, it should be distinct
@@ -350,6 +419,38 @@ data and heap allocations. Precise meaning may vary between operating systems. S
 Specifies the maximum size of the address space of the process. See the \fBRESOURCE LIMITS\fR
 section. Note that some operating systems (notably OpenBSD) do not support this limit; the
 setting will be ignored on such systems.
+.TP
+\fBcpu-affinity\fR = \fIcpu-list\fR
+Specifies the CPUs on which the service process may run, as a list of CPU numbers and ranges
+separated by commas or spaces, for example "0-3,6". This setting is supported only on Linux.
+.TP
+\fBsched-policy\fR = {other | batch | idle | fifo | rr}
+Specifies the scheduling policy for the service process. The \fBbatch\fR and \fBidle\fR
+policies are Linux-specific. The \fBfifo\fR and \fBrr\fR policies are real-time policies,
+for which a priority must also be given via \fBsched-priority\fR.
+.TP
+\fBsched-priority\fR = \fInumber\fR
+Specifies the static scheduling priority (1-99) for use with a real-time scheduling policy
+(see \fBsched-policy\fR). For other policies the priority must be 0 (the default).
+This setting is only valid if \fBsched-policy\fR is also specified; an inconsistent
+combination of policy and priority is reported as an error when the service is loaded.
+.TP
+\fBnice\fR = \fInumber\fR
+Specifies the nice value (-20 to 19) of the service process.
+.TP
+\fBioprio\fR = {realtime:\fIlevel\fR | best-effort:\fIlevel\fR | idle}
+Specifies the I/O scheduling class and priority level (0-7, with 0 being the highest priority)
+of the service process. This setting is supported only on Linux.
+.TP
+\fBnuma-policy\fR = {default | local | bind \fInode-list\fR | preferred \fInode\fR | interleave \fInode-list\fR}
+Specifies the NUMA memory policy for the service process: allocate memory according to the system
+default policy, on the node local to the allocating CPU, only from the listed nodes, preferably
+from the given node, or interleaved across the listed nodes. Nodes are listed in the same
+format as for \fBcpu-affinity\fR. This setting is supported only on Linux.
+.sp
+The above settings are applied before the service command is executed (and before the user
+and group are changed as per \fBrun-as\fR). Failure to apply a setting causes the service
+to fail to start.
 .\"
 .SS OPTIONS
 .\"
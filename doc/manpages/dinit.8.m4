@@ -9,7 +9,15 @@ dinit \- supervise processes and manage services
 .B dinit
 [\fB\-s\fR|\fB\-\-system\fR|\fB\-u\fR|\fB\-\-user\fR] [\fB\-d\fR|\fB\-\-services\-dir\fR \fIdir\fR]
 [\fB\-p\fR|\fB\-\-socket\-path\fR \fIpath\fR] [\fB\-e\fR|\fB\-\-env\-file\fR \fIpath\fR]
+[\fB\-\-socket\-type\fR \fBstream\fR|\fBseqpacket\fR]
 [\fB\-l\fR|\fB\-\-log\-file\fR \fIpath\fR]
+[\fB\-\-shutdown\-timeout\fR \fIseconds\fR] [\fB\-\-shutdown\-term\-grace\fR \fImilliseconds\fR]
+[\fB\-\-stop\-times\-file\fR \fIpath\fR]
+[\fB\-\-boot\-history\-file\fR \fIpath\fR] [\fB\-\-log\-journal\fR \fIpath\fR]
+[\fB\-\-log\-journal\-max\-size\fR \fIKiB\fR]
+[\fB\-\-readahead\-profile\fR \fIpath\fR] [\fB\-\-readahead\-record\-time\fR \fIseconds\fR]
+[\fB\-\-lock\-memory\fR] [\fB\-\-lock\-memory\-pool\fR \fIKiB\fR]
+[\fB\-\-watch\-services\fR] [\fB\-\-lazy\-soft\-deps\fR]
 [\fIservice-name\fR...]
 .\"
 .SH DESCRIPTION
@@ -56,6 +64,12 @@ commands from the \fBdinitctl\fR program. The default for the system service
 manager is usually \fI/dev/dinitctl\fR (but can be configured at build time).
 For a user service manager the default is \fI$HOME/.dinitctl\fR.
 .TP
+\fB\-\-socket\-type\fR \fBstream\fR|\fBseqpacket\fR
+Specifies the type of the control socket: a stream socket (\fBstream\fR, the default) or a
+sequenced-packet socket (\fBseqpacket\fR). With a sequenced-packet socket, each message sent by a
+client is received whole, and must consist of complete request packets. Clients supplied with Dinit
+support either type of socket.
+.TP
 \fB\-l\fR \fIpath\fP, \fB\-\-log\-file\fR \fIpath\fP
 Species \fIpath\fP as the path to the log file, to which Dinit will log status
 and error messages. Note that when running as the system service manager, Dinit
@@ -89,6 +103,107 @@ the \fBshutdown\fR program.
 Run with no output to the terminal/console. This disables service status messages
 and sets the log level for the console log to \fBNONE\fR.
 .TP
+\fB\-\-shutdown\-timeout\fR \fIseconds\fP
+Specifies the time allowed for all services to stop once a shutdown has been
+initiated. If services have not stopped within this time, the processes of any
+services which have not yet stopped are killed (via \fBSIGKILL\fR). The default,
+0, allows services unlimited time to stop (subject to their individual stop
+timeouts). Regardless of this setting, the services that the shutdown is waiting
+for are logged every 5 seconds.
+.TP
+\fB\-\-shutdown\-term\-grace\fR \fImilliseconds\fP
+Specifies the time allowed, once services have stopped and the \fBshutdown\fR program has been
+executed to complete shutdown, for any remaining processes to terminate after they have been sent
+the TERM signal, before they are killed. This is passed to \fBshutdown\fR(8) via its
+\fB\-\-term\-grace\fR option. The default (if not specified) is that of \fBshutdown\fR,
+1000 milliseconds.
+.TP
+\fB\-\-stop\-times\-file\fR \fIpath\fP
+Specifies a file to which the time taken for each service to stop is written at
+shutdown. When Dinit next starts (for the system service manager, once the root
+filesystem has been marked read-write), it logs the total shutdown time and the
+services which were slowest to stop, and then removes the file.
+.TP
+\fB\-\-boot\-history\-file\fR \fIpath\fP
+Specifies a file in which to keep a history of service start times. The time taken for each service
+to start is recorded during boot, which is considered complete once no service remains in the
+process of starting (after the services specified on the command line have been started), or
+after 10 minutes if some service is still starting by then. The start times are then added to the
+file (for the system service manager, once the root filesystem has been marked read-write, if that
+happens later). The file is a compact binary file retaining the most recent 20 boots; it can be
+examined via \fBdinitctl boot-history\fR (see \fBdinitctl\fR(8)).
+.TP
+\fB\-\-log\-journal\fR \fIpath\fP
+Specifies a file in which to record \fBdinit\fR's own log messages (at the info level and above) as
+a structured journal. Each message is appended as a binary record giving the time, the log level, the
+service concerned (if any) and the message text, so that messages can be selected by service and time
+without parsing text; the journal can be examined via \fBdinitctl log\fR (see \fBdinitctl\fR(8)).
+The journal is in addition to any other logging. For the system service manager, the journal is
+opened once the root filesystem has been marked read-write; messages logged before then are buffered
+(up to a limit) and written when it is opened.
+.sp
+Each record is written to the journal as soon as the message is logged, using ordinary (blocking)
+file I/O, during which \fBdinit\fR cannot respond to other events. The journal should therefore be
+placed on a local filesystem; a network filesystem, or a slow or failing device, may cause
+\fBdinit\fR to stall.
+.TP
+\fB\-\-log\-journal\-max\-size\fR \fIKiB\fP
+Specifies the size at which the log journal (see \fB\-\-log\-journal\fR) is rotated: once
+adding a record would exceed this size, the journal is renamed, with \fI.old\fR appended to its
+name (replacing any previous such file), and a new journal is begun. \fBdinitctl log\fR shows the
+records in both files. The default is 4096 KiB; 0 allows the journal to grow without limit.
+.TP
+\fB\-\-readahead\-profile\fR \fIpath\fP
+Specifies a readahead profile, used to reduce boot time by reading the files needed during boot
+into the page cache before they are required. If the profile exists, then as boot begins a helper
+process reads each file listed in it (one path per line) into the page cache, in the background,
+while services start. If the profile does not exist, the files opened on the root filesystem during
+the first part of boot are recorded (using \fBfanotify\fR(7), which requires Linux and the
+\fBCAP_SYS_ADMIN\fR capability) and written to the profile, once the recording period has ended and
+the root filesystem is writable. The profile can be discarded, so that a new profile is recorded at
+the next boot, via \fBdinitctl regen-readahead\fR.
+.sp
+Recording requires the \fI/proc\fR filesystem, via which the path of each opened file is found.
+If it is not mounted when \fBdinit\fR starts, the record of opened files is held (by the kernel,
+up to its queue limit) until it has been mounted, which should therefore be done early in boot.
+If \fI/proc\fR is not mounted by the end of the recording period, no profile is written.
+.TP
+\fB\-\-readahead\-record\-time\fR \fIseconds\fP
+Specifies the duration of the recording period for a new readahead profile (see
+\fB\-\-readahead\-profile\fR). The default is 30 seconds.
+.TP
+\fB\-\-lock\-memory\fR
+Prefault and lock (see \fBmlockall\fR(2)) the memory used by \fBdinit\fR, including its code, heap
+and stack, so that it is not paged out when the system is under memory pressure. A heap pool
+(see \fB\-\-lock\-memory\-pool\fR) is prefaulted before locking, so that subsequent allocations
+need not fault. The amount of memory locked is logged. Locking memory requires suitable privileges
+or a sufficient \fBRLIMIT_MEMLOCK\fR resource limit; if it fails, a warning is logged.
+.TP
+\fB\-\-lock\-memory\-pool\fR \fIKiB\fP
+Specifies the size, in kibibytes, of the heap pool prefaulted when \fB\-\-lock\-memory\fR is
+given. The default is 1024.
+.TP
+\fB\-\-watch\-services\fR
+Watch the service description directories (using \fBinotify\fR(7)) for changes to
+service description files. When the description of a loaded service (or of the template
+from which it was instantiated) changes, the service is marked as changed; all such services
+can then be reloaded together via \fBdinitctl reload \-\-changed\fR (see \fBdinitctl\fR(8)).
+Only files directly within service directories which exist when \fBdinit\fR starts are
+watched; changes to the contents of dependency directories are not detected. This option is
+supported only on Linux.
+.TP
+\fB\-\-lazy\-soft\-deps\fR
+Load the soft dependencies of a service (those specified via \fBwaits-for\fR, \fBwaits-for.d\fR
+and \fBdepends-ms\fR) only when the service is first started, rather than when it is loaded. This
+avoids loading services which are only ever soft dependencies of services that are never started.
+A soft dependency which cannot be loaded when the dependent starts is logged and ignored, except for
+a \fBdepends-ms\fR dependency, in which case the dependent fails to start. Soft dependencies are loaded
+when the start is requested (including those of any stopped services that the started service depends
+on), before the start proceeds. A failure to load a dependency is remembered, and loading is not retried
+(nor the failure logged again) until the dependency's description changes (as detected via
+\fB\-\-watch\-services\fR) or the dependent is reloaded. A dependency which would create a dependency
+cycle is not added.
+.TP
 \fB\-\-help\fR
 Display brief help text and then exit.
 .TP
@@ -133,10 +248,25 @@ by Dinit when it starts. This can be used to order that a service be started
 or stopped, to determine service status, or to make certain configuration
 changes. See \fBdinitctl\fR(8) for details.
 
+Alongside the control socket, Dinit also creates a \fIstatus table\fR file,
+with the same path as the socket but with \fB.status\fR appended. This file
+can be mapped (read-only) into memory by monitoring tools, to obtain the state,
+target state, process ID, exit status, stop reason, restart count and time of
+the last state transition of every loaded service without communicating with
+Dinit. The format of the table is defined in the \fIstatus\-table.h\fR header of
+the Dinit source; each entry is protected by a sequence number which is odd while
+the entry is being updated. The file is removed when Dinit terminates.
+
 Process-based services are monitored and, if the process terminates, the
 service may be stopped or the process may be re-started, according to the
 configuration in the service description.  
 
+Log messages concerning a particular service are rate-limited, so that a service which fails (or
+restarts) repeatedly cannot flood the log. For each service and log level, a burst of up to 10
+messages is allowed, with a further message allowed for every 2 seconds that pass. Messages beyond
+this limit are discarded, and a single message reporting the number discarded is logged (for each
+service and level) after 10 seconds.
+
 Once all services stop, the \fBdinit\fR daemon will itself terminate (or, if
 running as PID 1, will perform the appropriate type of system shutdown).
 .\"
@@ -8,6 +8,7 @@ dinitcheck \- check service configuration
 .HP \w'\ 'u
 .B dinitcheck
 [\fB\-d\fR|\fB\-\-services\-dir\fR \fIdir\fR]
+[\fB\-\-stats\fR]
 [\fIservice-name\fR...]
 .\"
 .SH DESCRIPTION
@@ -25,6 +26,9 @@ Invalid parameter values
 .IP \(bu
 Service dependency cycles
 .LP
+All dependency cycles are reported (one cycle for each group of mutually dependent
+services). Service description files are read in parallel, using multiple threads.
+.LP
 Unless altered by options specified on the command line, this utility uses the
 same search paths (for service description files) as \fBdinit\fR.
 .\"
@@ -39,6 +43,11 @@ If not specified, the default is \fI$HOME/dinit.d\fR or, for the
 system service manager, each of \fI/etc/dinit.d/fR, \fI/usr/local/lib/dinit.d\fR,
 and \fI/lib/dinit.d\fR (searched in that order).
 .TP
+\fB\-\-stats\fR
+After checking, display the time taken to load each service description (along
+with the path of the file it was loaded from), the total number of services and
+dependencies checked, and the total load time.
+.TP
 \fB\-\-help\fR
 Display brief help text and then exit.
 .TP
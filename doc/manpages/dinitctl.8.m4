@@ -6,19 +6,22 @@ dinitctl \- control services supervised by Dinit
 .SH SYNOPSIS
 .\"
 .B dinitctl
-[\fIoptions\fR] \fBstart\fR [\fB\-\-no\-wait\fR] [\fB\-\-pin\fR] \fIservice-name\fR
+[\fIoptions\fR] \fBstart\fR [\fB\-\-no\-wait\fR] [\fB\-\-pin\fR] \fIservice-name\fR...
 .br
 .B dinitctl
-[\fIoptions\fR] \fBstop\fR [\fB\-\-no\-wait\fR] [\fB\-\-pin\fR] \fIservice-name\fR
+[\fIoptions\fR] \fBstop\fR [\fB\-\-no\-wait\fR] [\fB\-\-pin\fR] \fIservice-name\fR...
 .br
 .B dinitctl
-[\fIoptions\fR] \fBrestart\fR [\fB\-\-no\-wait\fR] \fIservice-name\fR
+[\fIoptions\fR] \fBrestart\fR [\fB\-\-no\-wait\fR] \fIservice-name\fR...
 .br
 .B dinitctl
-[\fIoptions\fR] \fBwake\fR [\fB\-\-no\-wait\fR] \fIservice-name\fR
+[\fIoptions\fR] \fBwake\fR [\fB\-\-no\-wait\fR] \fIservice-name\fR...
 .br
 .B dinitctl
-[\fIoptions\fR] \fBrelease\fR \fIservice-name\fR
+[\fIoptions\fR] \fBrelease\fR \fIservice-name\fR...
+.br
+.B dinitctl
+[\fIoptions\fR] \fBstatus\fR \fIservice-name\fR...
 .br
 .B dinitctl
 [\fIoptions\fR] \fBunpin\fR \fIservice-name\fR
@@ -30,6 +33,9 @@ dinitctl \- control services supervised by Dinit
 [\fIoptions\fR] \fBreload\fR \fIservice-name\fR
 .br
 .B dinitctl
+[\fIoptions\fR] \fBreload\fR \fB\-\-changed\fR
+.br
+.B dinitctl
 [\fIoptions\fR] \fBlist\fR
 .br
 .B dinitctl
@@ -46,6 +52,21 @@ dinitctl \- control services supervised by Dinit
 .br
 .B dinitctl
 [\fIoptions\fR] \fBdisable\fR [\fB\-\-from\fR \fIfrom-service\fR] \fIto-service\fR
+.br
+.B dinitctl
+[\fIoptions\fR] \fBsubscribe\fR [\fB\-\-event\fR \fIevent-type\fR]... [\fIservice-pattern\fR]
+.br
+.B dinitctl
+[\fIoptions\fR] \fBboot-history\fR [\fB\-\-threshold\fR \fIpercent\fR]
+.br
+.B dinitctl
+[\fIoptions\fR] \fBregen-readahead\fR
+.br
+.B dinitctl
+[\fIoptions\fR] \fBcontrol-stats\fR
+.br
+.B dinitctl
+[\fIoptions\fR] \fBlog\fR [\fB\-\-service\fR \fIservice-name\fR] [\fB\-\-since\fR \fItime\fR] [\fB\-\-until\fR \fItime\fR]
 .\"
 .SH DESCRIPTION
 .\"
@@ -77,6 +98,10 @@ Suppress status output, except for errors.
 .\"
 .SH COMMAND OPTIONS
 .TP
+\fB\-\-wait\fR
+Wait for issued command to complete before exiting (the default). If multiple services are specified,
+all services are waited for concurrently.
+.TP
 \fB\-\-no\-wait\fR
 Do not wait for issued command to complete; exit immediately.
 .TP
@@ -94,8 +119,20 @@ activated, and which has no active dependents, will automatically stop.
 \fB\-\-force\fR
 Stop the service even if it will require stopping other services which depend on the specified service.
 .TP
+\fB\-\-batch\fR
+When multiple services are specified to \fBstart\fR, \fBstop\fR, \fBrestart\fR, \fBwake\fR or
+\fBrelease\fR, issue the command for all services as a single batch. Each operation in the batch is
+checked before any is performed; if the command cannot be performed for any service (for example,
+stopping a service which has dependents that are not also being stopped, without \fB\-\-force\fR),
+then it is not performed for any of them. Otherwise, the operations are performed together, and
+the resulting state changes are processed in a single pass.
+.TP
 \fIservice-name\fR
-Specifies the name of the service to which the command applies.
+Specifies the name of the service to which the command applies. The \fBstart\fR, \fBstop\fR,
+\fBrestart\fR, \fBwake\fR, \fBrelease\fR and \fBstatus\fR commands accept multiple service names;
+the requests for all services are issued together, over a single connection. A service name of
+\fB\-\fR causes (whitespace-separated) service names to be read from standard input. If the command
+fails for any of the specified services, \fBdinitctl\fR exits with a non-zero status.
 .TP
 \fBstart\fR
 Start the specified service. The service is marked as explicitly activated and will not be stopped
@@ -145,6 +182,15 @@ restarted, and some cannot be changed at all while the service is running.
 In particular, the type of a running service cannot be changed; nor can the \fBinittab-id\fR, \fBinittab-line\fR,
 or \fBpid-file\fR settings, or the \fBruns-on-console\fR or \fBshares-console\fR flags. If any hard dependencies
 are added to a running service, the dependencies must already be started.
+
+With \fB\-\-changed\fR (instead of a service name), reload every loaded service whose description
+has changed since it was loaded, as detected by \fBdinit\fR when run with the \fB\-\-watch\-services\fR
+option. Descriptions which have not changed are not re-read. Each service is reloaded subject to the
+restrictions above; a service which cannot be reloaded is left unchanged (and remains marked as changed,
+so that it will be reloaded by a later \fBreload \-\-changed\fR). Each service is reloaded independently:
+the services are not reloaded as a single transaction, and a failure to reload one service does not undo
+the reload of others. Services that other control connections (for example monitoring clients) hold
+handles to are reloaded too; the handles remain valid.
 .TP
 \fBlist\fR
 List loaded services and their state. Before each service, one of the following state indicators is
@@ -167,9 +213,15 @@ means that the service failed to start, or that the service process unexpectedly
 error status or signal while running.
 
 Additional information, if available, will be printed after the service name: whether the service owns,
-or is waiting to acquire, the console; the process ID; the exit status or signal that caused termination.
+or is waiting to acquire, the console; the process ID; if an automatic restart is pending, the restart
+delay (which may be increased by restart backoff); the exit status or signal that caused termination.
 .RE
 .TP
+\fBstatus\fR
+Display the state (stopped, starting, started or stopping) of the specified services, and whether
+each will subsequently stop or start. Services which are not loaded are reported as such (and are
+not loaded).
+.TP
 \fBshutdown\fR
 Stop all services (without restart) and terminate Dinit. If issued to the system instance of Dinit,
 this will also shut down the system.
@@ -198,6 +250,47 @@ If the \fB--from\fR option is not used to specify the dependent, the dependency
 \fBdisable\fR
 Permanently disable a \fBwaits-for\fR dependency between two services. This is the complement of the
 \fBenable\fR command; see the description above for more information.
+.TP
+\fBsubscribe\fR
+Display events for all services (or, if a \fIservice-pattern\fR is given, for services with names
+matching the pattern, which may contain shell-style wildcards) as they occur, until Dinit terminates.
+Each event is displayed as a sequence number, the service name and the event type. The \fB\-\-event\fR
+option restricts the display to events of the given type: one of \fBstarted\fR, \fBstopped\fR,
+\fBfailed\fR, \fBstart-cancelled\fR or \fBstop-cancelled\fR; it may be specified more than once.
+Events which occur together are sent together. If events are generated faster than \fBdinitctl\fR
+reads them, some events are dropped, and the number of dropped events is reported.
+.TP
+\fBboot-history\fR
+Compare the time taken for each service to start during the most recent boot against a baseline,
+being the median time over the previous boots recorded in the boot history file (see the
+\fB\-\-boot\-history\-file\fR option in \fBdinit\fR(8)), and list the services whose start time
+regressed. A service is listed if its start time exceeds the baseline by more than the percentage
+given via \fB\-\-threshold\fR (25 by default), and by at least 100 milliseconds. The total boot time
+and its baseline are also displayed.
+.TP
+\fBregen-readahead\fR
+Discard the boot readahead profile (see the \fB\-\-readahead\-profile\fR option in \fBdinit\fR(8)),
+so that a new profile is recorded during the next boot. This is useful after software updates have
+changed the set of files used during boot.
+.TP
+\fBcontrol-stats\fR
+Display statistics for the control connections to \fBdinit\fR: the number of active connections,
+the amount of output queued for clients (currently, and at peak) and the output quotas, the number of
+times that \fBdinit\fR stopped reading requests from a connection because its queued output
+exceeded a quota, and the number of connections closed because the client did not read its output
+(while output, such as service event notifications, continued to be queued). Requests from a
+connection are read again once its queued output has drained.
+.TP
+\fBlog\fR
+Display the messages recorded in the log journal (see the \fB\-\-log\-journal\fR option in
+\fBdinit\fR(8)), with the time at which each was logged, its level, and the service concerned (if any).
+With \fB\-\-service\fR, only messages concerning the specified service are shown. With
+\fB\-\-since\fR and/or \fB\-\-until\fR, only messages logged at or after, and/or at or before, the
+specified time are shown; a time is given as a local date (\fIYYYY\fR-\fIMM\fR-\fIDD\fR) optionally
+followed by a time of day (\fIHH\fR:\fIMM\fR or \fIHH\fR:\fIMM\fR:\fISS\fR), or as a number of
+seconds since the epoch. The journal is read directly, without parsing message text. Messages
+from before the journal was last rotated (see the \fB\-\-log\-journal\-max\-size\fR option in
+\fBdinit\fR(8)) are shown first.
 .\"
 .SH SERVICE OPERATION
 .\"
@@ -7,7 +7,7 @@ shutdown, halt, reboot \- system shutdown
 .\"
 .B shutdown
 [\fB\-r\fR|\fB\-h\fR|\fB\-p\fR] [\fB\-\-use\-passed\-cfd\fR]
-[\fB\-\-system\fR]
+[\fB\-\-system\fR] [\fB\-\-term\-grace\fR \fImilliseconds\fR]
 .br
 \fBhalt\fR [\fIoptions...\fR]
 .br
@@ -55,6 +55,19 @@ the service manager has stopped responding.
 
 The service manager may invoke \fBshutdown\fR with this option in order to perform
 system shutdown after it has rolled back services.
+
+On Linux, swap devices are turned off and filesystems are unmounted directly, rather than
+via the \fBswapoff\fR and \fBumount\fR utilities. Filesystems which do not have other
+filesystems mounted on them are unmounted in parallel. A filesystem which cannot be unmounted
+is remounted read-only and then lazily detached.
+.TP
+\fB\-\-term\-grace\fR \fImilliseconds\fR
+When performing shutdown directly (\fB\-\-system\fR), specifies the maximum time to wait for
+processes to terminate after they have been sent the TERM signal. Any processes remaining
+after this time are reported (by process ID) and then sent the KILL signal. If all processes
+terminate before the time expires, shutdown proceeds immediately. The default is 1000
+milliseconds. When \fBdinit\fR invokes \fBshutdown\fR, this is set via the
+\fB\-\-shutdown\-term\-grace\fR option of \fBdinit\fR(8).
 .\"
 .SH SEE ALSO
 .\"
@@ -1,5 +1,6 @@
 #include <cstring>
 #include <cstdlib>
+#include <cstdint>
 
 #include <sys/un.h>
 #include <sys/socket.h>
@@ -11,6 +12,7 @@
 #include "dinit-log.h"
 #include "dinit-socket.h"
 #include "proc-service.h"
+#include "notify-socket.h"
 
 #include "baseproc-sys.h"
 
@@ -20,6 +22,42 @@
  * See proc-service.h for interface documentation.
  */
 
+namespace {
+    // Simple (xorshift) pseudo-random number generator, used for restart delay jitter. This need
+    // not be of high quality; it only serves to prevent services restarting in lockstep.
+    uint32_t restart_jitter_state = 0;
+
+    uint32_t restart_jitter_rand(const dasynq::time_val &seed) noexcept
+    {
+        uint32_t x = restart_jitter_state;
+        if (x == 0) {
+            x = (uint32_t)seed.nseconds() ^ ((uint32_t)getpid() << 16) ^ 0x9e3779b9u;
+            if (x == 0) x = 1;
+        }
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        restart_jitter_state = x;
+        return x;
+    }
+
+    // Apply a random variation, of up to +/- the given percentage, to a delay.
+    dasynq::time_val apply_jitter(const dasynq::time_val &delay, int percent,
+            const dasynq::time_val &seed) noexcept
+    {
+        using time_val = dasynq::time_val;
+        uint64_t delay_ns = (uint64_t)delay.seconds() * 1000000000u + delay.nseconds();
+        uint64_t range = delay_ns / 100u * percent;
+        if (range == 0) return delay;
+        uint64_t r = restart_jitter_rand(seed) % (range * 2 + 1);
+        delay_ns = delay_ns - range + r;
+        return time_val(delay_ns / 1000000000u, delay_ns % 1000000000u);
+    }
+
+    // Process settings used for a service which has none set
+    const process_exec_settings default_exec_settings {};
+}
+
 void base_process_service::do_smooth_recovery() noexcept
 {
     if (! restart_ps_process()) {
@@ -42,6 +80,7 @@ bool base_process_service::bring_up() noexcept
         }
 
         restart_interval_count = 0;
+        current_restart_delay = restart_delay;
         if (start_ps_process(exec_arg_parts,
                 onstart_flags.starts_on_console || onstart_flags.shares_console)) {
             // start_ps_process updates last_start_time, use it also for restart_interval_time:
@@ -71,9 +110,14 @@ bool base_process_service::start_ps_process(const std::vector<const char *> &cmd
 
     event_loop.get_time(last_start_time, clock_type::MONOTONIC);
 
+    if (notification_socket && ! notify_socket.open_socket()) {
+        log_service_msg(loglevel_t::ERROR, get_name(), "can't open notification socket");
+        return false;
+    }
+
     int pipefd[2];
     if (bp_sys::pipe2(pipefd, O_CLOEXEC)) {
-        log(loglevel_t::ERROR, get_name(), ": can't create status check pipe: ", strerror(errno));
+        log_service_msg(loglevel_t::ERROR, get_name(), "can't create status check pipe: ", strerror(errno));
         return false;
     }
 
@@ -93,7 +137,7 @@ bool base_process_service::start_ps_process(const std::vector<const char *> &cmd
 
     if (onstart_flags.pass_cs_fd) {
         if (dinit_socketpair(AF_UNIX, SOCK_STREAM, /* protocol */ 0, control_socket, SOCK_NONBLOCK)) {
-            log(loglevel_t::ERROR, get_name(), ": can't create control socket: ", strerror(errno));
+            log_service_msg(loglevel_t::ERROR, get_name(), "can't create control socket: ", strerror(errno));
             goto out_p;
         }
 
@@ -105,7 +149,7 @@ bool base_process_service::start_ps_process(const std::vector<const char *> &cmd
             control_conn = new control_conn_t(event_loop, services, control_socket[0]);
         }
         catch (std::exception &exc) {
-            log(loglevel_t::ERROR, get_name(), ": can't launch process; out of memory");
+            log_service_msg(loglevel_t::ERROR, get_name(), "can't launch process; out of memory");
             goto out_cs;
         }
     }
@@ -113,7 +157,8 @@ bool base_process_service::start_ps_process(const std::vector<const char *> &cmd
     if (have_notify) {
         // Create a notification pipe:
         if (bp_sys::pipe2(notify_pipe, 0) != 0) {
-            log(loglevel_t::ERROR, get_name(), ": can't create notification pipe: ", strerror(errno));
+            log_service_msg(loglevel_t::ERROR, get_name(), "can't create notification pipe: ",
+                    strerror(errno));
             goto out_cs_h;
         }
 
@@ -127,7 +172,7 @@ bool base_process_service::start_ps_process(const std::vector<const char *> &cmd
             ready_watcher_registered = true;
         }
         catch (std::exception &exc) {
-            log(loglevel_t::ERROR, get_name(), ": can't add notification watch: ", exc.what());
+            log_service_msg(loglevel_t::ERROR, get_name(), "can't add notification watch: ", exc.what());
         }
     }
 
@@ -147,15 +192,18 @@ bool base_process_service::start_ps_process(const std::vector<const char *> &cmd
         reserved_child_watch = true;
     }
     catch (std::exception &e) {
-        log(loglevel_t::ERROR, get_name(), ": Could not fork: ", e.what());
+        log_service_msg(loglevel_t::ERROR, get_name(), "Could not fork: ", e.what());
         goto out_cs_h;
     }
 
     if (forkpid == 0) {
+        const process_exec_settings &exec = (exec_settings != nullptr) ? *exec_settings
+                : default_exec_settings;
         const char * working_dir_c = nullptr;
-        if (! working_dir.empty()) working_dir_c = working_dir.c_str();
+        if (! exec.working_dir.empty()) working_dir_c = exec.working_dir.c_str();
         after_fork(getpid());
-        run_proc_params run_params{cmd.data(), working_dir_c, logfile, pipefd[1], run_as_uid, run_as_gid, rlimits};
+        run_proc_params run_params{cmd.data(), working_dir_c, logfile, pipefd[1], run_as_uid, run_as_gid,
+                exec.rlimits};
         run_params.on_console = on_console;
         run_params.in_foreground = !onstart_flags.shares_console;
         run_params.csfd = control_socket[1];
@@ -163,18 +211,29 @@ bool base_process_service::start_ps_process(const std::vector<const char *> &cmd
         run_params.notify_fd = notify_pipe[1];
         run_params.force_notify_fd = force_notification_fd;
         run_params.notify_var = notification_var.c_str();
-        run_params.env_file = env_file.c_str();
+        if (notification_socket) {
+            run_params.notify_socket = notify_socket.get_path();
+            run_params.watchdog_usec = (long long)watchdog_timeout.seconds() * 1000000
+                    + watchdog_timeout.nseconds() / 1000;
+        }
+        run_params.env_file = exec.env_file.c_str();
+        run_params.sched = &exec.sched;
         run_child_proc(run_params);
     }
     else {
         // Parent process
         pid = forkpid;
+        update_status();
 
         bp_sys::close(pipefd[1]); // close the 'other end' fd
         if (control_socket[1] != -1) bp_sys::close(control_socket[1]);
         if (notify_pipe[1] != -1) bp_sys::close(notify_pipe[1]);
         notification_fd = notify_pipe[0];
         waiting_for_execstat = true;
+        if (notification_socket) {
+            notified_ready = false;
+            notify_socket.add_service(this);
+        }
         return true;
     }
 
@@ -211,7 +270,7 @@ base_process_service::base_process_service(service_set *sset, string name,
         const std::list<std::pair<unsigned,unsigned>> &command_offsets,
         const std::list<prelim_dep> &deplist_p)
      : service_record(sset, name, service_type_p, deplist_p), child_listener(this),
-       child_status_listener(this), restart_timer(this)
+       child_status_listener(this), restart_timer(this), watchdog_timer(this)
 {
     program_name = std::move(command);
     exec_arg_parts = separate_args(program_name, command_offsets);
@@ -232,10 +291,24 @@ base_process_service::base_process_service(service_set *sset, string name,
     stop_timer_armed = false;
 }
 
+base_process_service::~base_process_service() noexcept
+{
+    if (reserved_child_watch) {
+        child_listener.unreserve(event_loop);
+    }
+    restart_timer.deregister(event_loop);
+    if (watchdog_timer_added) {
+        stop_watchdog();
+        watchdog_timer.deregister(event_loop);
+    }
+    notify_socket.remove_service(this);
+}
+
 void base_process_service::do_restart() noexcept
 {
     waiting_restart_timer = false;
     restart_interval_count++;
+    restart_count++;
     auto service_state = get_state();
 
     if (service_state == service_state_t::STARTING) {
@@ -271,7 +344,8 @@ bool base_process_service::restart_ps_process() noexcept
         time_val int_diff = current_time - restart_interval_time;
         if (int_diff < restart_interval) {
             if (restart_interval_count >= max_restart_interval_count) {
-                log(loglevel_t::ERROR, "Service ", get_name(), " restarting too quickly; stopping.");
+                log_about_service(loglevel_t::ERROR, get_name(), "Service ", get_name(),
+                        " restarting too quickly; stopping.");
                 return false;
             }
         }
@@ -281,14 +355,31 @@ bool base_process_service::restart_ps_process() noexcept
         }
     }
 
-    // Check if enough time has lapsed since the previous restart. If not, start a timer:
+    // Determine the restart delay. If the process ran stably for long enough, any backoff is reset;
+    // otherwise the delay increases with each restart (if backoff is enabled):
     time_val tdiff = current_time - last_start_time;
-    if (restart_delay <= tdiff) {
+    if (restart_delay_reset <= tdiff) {
+        current_restart_delay = restart_delay;
+    }
+    time_val delay = current_restart_delay;
+    if (restart_delay_jitter != 0) {
+        delay = apply_jitter(delay, restart_delay_jitter, current_time);
+    }
+    if (restart_delay < restart_delay_max) {
+        current_restart_delay <<= 1;
+        if (current_restart_delay > restart_delay_max) {
+            current_restart_delay = restart_delay_max;
+        }
+    }
+    pending_restart_delay = delay;
+
+    // Check if enough time has lapsed since the previous restart. If not, start a timer:
+    if (delay <= tdiff) {
         // > restart delay (normally 200ms)
         do_restart();
     }
     else {
-        time_val timeout = restart_delay - tdiff;
+        time_val timeout = delay - tdiff;
         restart_timer.arm_timer_rel(event_loop, timeout);
         waiting_restart_timer = true;
     }
@@ -303,8 +394,8 @@ bool base_process_service::interrupt_start() noexcept
         return service_record::interrupt_start();
     }
     else {
-        log(loglevel_t::WARN, "Interrupting start of service ", get_name(), " with pid ", pid,
-                " (with SIGINT).");
+        log_about_service(loglevel_t::WARN, get_name(), "Interrupting start of service ", get_name(),
+                " with pid ", pid, " (with SIGINT).");
         kill_pg(SIGINT);
 
         if (stop_timeout != time_val(0,0)) {
@@ -324,7 +415,7 @@ bool base_process_service::interrupt_start() noexcept
 void base_process_service::kill_with_fire() noexcept
 {
     if (pid != -1) {
-        log(loglevel_t::WARN, "Service ", get_name(), " with pid ", pid,
+        log_about_service(loglevel_t::WARN, get_name(), "Service ", get_name(), " with pid ", pid,
                 " exceeded allowed stop time; killing.");
         kill_pg(SIGKILL);
     }
@@ -360,7 +451,7 @@ void base_process_service::timer_expired() noexcept
     }
     else if (pid != -1) {
         // Starting, start timed out.
-        log(loglevel_t::WARN, "Service ", get_name(), " with pid ", pid,
+        log_about_service(loglevel_t::WARN, get_name(), "Service ", get_name(), " with pid ", pid,
                 " exceeded allowed start time; cancelling.");
         interrupt_start();
         stop_reason = stopped_reason_t::TIMEDOUT;
@@ -372,6 +463,52 @@ void base_process_service::timer_expired() noexcept
     }
 }
 
+void base_process_service::arm_watchdog() noexcept
+{
+    if (watchdog_timeout == time_val(0,0)) return;
+
+    if (! watchdog_timer_added) {
+        try {
+            watchdog_timer.add_timer(event_loop);
+            watchdog_timer_added = true;
+        }
+        catch (std::exception &exc) {
+            log_service_msg(loglevel_t::ERROR, get_name(), "can't set up watchdog timer: ", exc.what());
+            return;
+        }
+    }
+
+    watchdog_timer.arm_timer_rel(event_loop, watchdog_timeout);
+    watchdog_timer_armed = true;
+}
+
+void base_process_service::watchdog_expired() noexcept
+{
+    watchdog_timer_armed = false;
+    if (pid != -1) {
+        log_about_service(loglevel_t::ERROR, get_name(), "Service ", get_name(), " with pid ", pid,
+                " did not send watchdog keep-alive in time; killing.");
+        kill_pg(SIGKILL);
+    }
+}
+
+void base_process_service::end_notifications() noexcept
+{
+    notify_socket.remove_service(this);
+    stop_watchdog();
+}
+
+void base_process_service::notify_status(const char *status, size_t len) noexcept
+{
+    try {
+        status_text.assign(status, len);
+        log_about_service(loglevel_t::DEBUG, get_name(), "Service ", get_name(), " status: ", status_text);
+    }
+    catch (std::bad_alloc &) {
+        // Status is informational only; ignore.
+    }
+}
+
 void base_process_service::becoming_inactive() noexcept
 {
     if (socket_fd != -1) {
@@ -394,13 +531,14 @@ bool base_process_service::open_socket() noexcept
     if (stat(saddrname, &stat_buf) == 0) {
         if ((stat_buf.st_mode & S_IFSOCK) == 0) {
             // Not a socket
-            log(loglevel_t::ERROR, get_name(), ": Activation socket file exists (and is not a socket)");
+            log_service_msg(loglevel_t::ERROR, get_name(),
+                    "Activation socket file exists (and is not a socket)");
             return false;
         }
     }
     else if (errno != ENOENT) {
         // Other error
-        log(loglevel_t::ERROR, get_name(), ": Error checking activation socket: ", strerror(errno));
+        log_service_msg(loglevel_t::ERROR, get_name(), "Error checking activation socket: ", strerror(errno));
         return false;
     }
 
@@ -412,7 +550,7 @@ bool base_process_service::open_socket() noexcept
     uint sockaddr_size = offsetof(struct sockaddr_un, sun_path) + socket_path.length() + 1;
     struct sockaddr_un * name = static_cast<sockaddr_un *>(malloc(sockaddr_size));
     if (name == nullptr) {
-        log(loglevel_t::ERROR, get_name(), ": Opening activation socket: out of memory");
+        log_service_msg(loglevel_t::ERROR, get_name(), "Opening activation socket: out of memory");
         return false;
     }
 
@@ -421,13 +559,13 @@ bool base_process_service::open_socket() noexcept
 
     int sockfd = dinit_socket(AF_UNIX, SOCK_STREAM, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (sockfd == -1) {
-        log(loglevel_t::ERROR, get_name(), ": Error creating activation socket: ", strerror(errno));
+        log_service_msg(loglevel_t::ERROR, get_name(), "Error creating activation socket: ", strerror(errno));
         free(name);
         return false;
     }
 
     if (bind(sockfd, (struct sockaddr *) name, sockaddr_size) == -1) {
-        log(loglevel_t::ERROR, get_name(), ": Error binding activation socket: ", strerror(errno));
+        log_service_msg(loglevel_t::ERROR, get_name(), "Error binding activation socket: ", strerror(errno));
         close(sockfd);
         free(name);
         return false;
@@ -438,14 +576,14 @@ bool base_process_service::open_socket() noexcept
     // POSIX (1003.1, 2013) says that fchown and fchmod don't necessarily work on sockets. We have to
     // use chown and chmod instead.
     if (chown(saddrname, socket_uid, socket_gid)) {
-        log(loglevel_t::ERROR, get_name(), ": Error setting activation socket owner/group: ",
+        log_service_msg(loglevel_t::ERROR, get_name(), "Error setting activation socket owner/group: ",
                 strerror(errno));
         close(sockfd);
         return false;
     }
 
     if (chmod(saddrname, socket_perms) == -1) {
-        log(loglevel_t::ERROR, get_name(), ": Error setting activation socket permissions: ",
+        log_service_msg(loglevel_t::ERROR, get_name(), "Error setting activation socket permissions: ",
                 strerror(errno));
         close(sockfd);
         return false;
@@ -1,6 +1,9 @@
 #include <algorithm>
 #include <unordered_set>
 #include <climits>
+#include <cstdint>
+
+#include <fnmatch.h>
 
 #include "control.h"
 #include "service.h"
@@ -25,6 +28,8 @@ namespace {
     }
 }
 
+control_conn_stats_t control_conn_stats;
+
 bool control_conn_t::process_packet()
 {
     using std::string;
@@ -51,6 +56,9 @@ bool control_conn_t::process_packet()
             || pktType == DINIT_CP_WAKESERVICE || pktType == DINIT_CP_RELEASESERVICE) {
         return process_start_stop(pktType);
     }
+    if (pktType == DINIT_CP_STARTSTOPBATCH) {
+        return process_start_stop_batch();
+    }
     if (pktType == DINIT_CP_UNPINSERVICE) {
         return process_unpin_service();
     }
@@ -60,6 +68,9 @@ bool control_conn_t::process_packet()
     if (pktType == DINIT_CP_RELOADSERVICE) {
         return process_reload_service();
     }
+    if (pktType == DINIT_CP_RELOADCHANGED) {
+        return process_reload_changed();
+    }
     if (pktType == DINIT_CP_SHUTDOWN) {
         // Shutdown/reboot
         if (rbuf.get_length() < 2) {
@@ -95,12 +106,30 @@ bool control_conn_t::process_packet()
     if (pktType == DINIT_CP_QUERY_LOAD_MECH) {
         return query_load_mech();
     }
+    if (pktType == DINIT_CP_QUERYBOOTHISTORY) {
+        return process_query_path(DINIT_RP_BOOTHISTORY, services->get_boot_history_path());
+    }
+    if (pktType == DINIT_CP_QUERYLOGJOURNAL) {
+        return process_query_path(DINIT_RP_LOGJOURNAL, get_log_journal_path());
+    }
+    if (pktType == DINIT_CP_REGENREADAHEAD) {
+        char reply[] = { regenerate_readahead_profile() ? (char)DINIT_RP_ACK : (char)DINIT_RP_NAK };
+        if (! queue_packet(reply, 1)) return false;
+        rbuf.consume(1);
+        return true;
+    }
     if (pktType == DINIT_CP_ENABLESERVICE) {
         return add_service_dep(true);
     }
     if (pktType == DINIT_CP_QUERYSERVICENAME) {
         return process_query_name();
     }
+    if (pktType == DINIT_CP_SUBSCRIBE) {
+        return process_subscribe();
+    }
+    if (pktType == DINIT_CP_QUERYCONNSTATS) {
+        return process_query_conn_stats();
+    }
 
     // Unrecognized: give error response
     char outbuf[] = { DINIT_RP_BADREQ };
@@ -341,6 +370,236 @@ bool control_conn_t::process_start_stop(int pktType)
     return true;
 }
 
+bool control_conn_t::process_start_stop_batch()
+{
+    constexpr int hdr_size = 2 + sizeof(uint16_t);
+    constexpr int entry_size = 2 + sizeof(handle_t);
+
+    if (rbuf.get_length() < hdr_size) {
+        chklen = hdr_size;
+        return true;
+    }
+
+    // 1 byte: packet type
+    // 1 byte: flags (1 = more packets follow)
+    // 2 bytes: number of entries in this packet
+    // entries, each: 1 byte operation, 1 byte flags, 4 bytes service handle
+
+    bool more = (rbuf[1] & 1) == 1;
+    uint16_t count;
+    rbuf.extract((char *) &count, 2, sizeof(count));
+    int pkt_size = hdr_size + count * entry_size;
+
+    if (pkt_size > 1024 || batch_ops.size() + count > max_batch_ops) {
+        // Packet can't fit in buffer, or batch is too large
+        batch_ops.clear();
+        char badreqRep[] = { DINIT_RP_BADREQ };
+        if (! queue_packet(badreqRep, 1)) return false;
+        bad_conn_close = true;
+        iob.set_watches(OUT_EVENTS);
+        return true;
+    }
+
+    if (rbuf.get_length() < pkt_size) {
+        chklen = pkt_size;
+        return true;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int pos = hdr_size + i * entry_size;
+        batch_op bop;
+        bop.op = rbuf[pos];
+        bop.flags = rbuf[pos + 1];
+        rbuf.extract((char *) &bop.handle, pos + 2, sizeof(bop.handle));
+        batch_ops.push_back(bop);
+    }
+
+    rbuf.consume(pkt_size);
+    chklen = 0;
+
+    if (more) {
+        return true;
+    }
+
+    // The batch is complete. Resolve the handles; a bad handle or operation invalidates the request.
+    vector<batch_op> ops = std::move(batch_ops);
+    batch_ops.clear();
+
+    vector<service_record *> batch_services;
+    batch_services.reserve(ops.size());
+    for (batch_op &bop : ops) {
+        service_record *service = find_service_for_key(bop.handle);
+        if (service == nullptr || (bop.op != DINIT_CP_STARTSERVICE && bop.op != DINIT_CP_STOPSERVICE
+                && bop.op != DINIT_CP_WAKESERVICE && bop.op != DINIT_CP_RELEASESERVICE)) {
+            char badreqRep[] = { DINIT_RP_BADREQ };
+            if (! queue_packet(badreqRep, 1)) return false;
+            bad_conn_close = true;
+            iob.set_watches(OUT_EVENTS);
+            return true;
+        }
+        batch_services.push_back(service);
+    }
+
+    // Check all operations before performing any:
+    char reason;
+    int bad_index = check_batch(ops, batch_services, reason);
+    if (bad_index != -1) {
+        char rejectRep[4] = { DINIT_RP_BATCHREJECTED };
+        uint16_t bad_index16 = bad_index;
+        memcpy(rejectRep + 1, &bad_index16, sizeof(bad_index16));
+        rejectRep[3] = reason;
+        return queue_packet(rejectRep, sizeof(rejectRep));
+    }
+
+    // Perform all operations, and then process the resulting state changes together.
+    vector<char> reply_pkt(1 + sizeof(uint16_t) + ops.size(), DINIT_RP_ACK);
+    reply_pkt[0] = DINIT_RP_BATCHDONE;
+    uint16_t num_ops = ops.size();
+    memcpy(reply_pkt.data() + 1, &num_ops, sizeof(num_ops));
+    char *results = reply_pkt.data() + 1 + sizeof(uint16_t);
+
+    for (size_t i = 0; i < ops.size(); i++) {
+        service_record *service = batch_services[i];
+        bool do_pin = (ops[i].flags & 1) == 1;
+        switch (ops[i].op) {
+        case DINIT_CP_STARTSERVICE:
+            if (do_pin) service->pin_start();
+            service->start();
+            break;
+        case DINIT_CP_STOPSERVICE:
+            if ((ops[i].flags & 4) == 4) {
+                if (! service->restart()) {
+                    // (can happen if an earlier operation in the batch stopped the service)
+                    results[i] = DINIT_RP_NAK;
+                }
+            }
+            else {
+                if (do_pin) service->pin_stop();
+                service->stop(true);
+                service->forced_stop();
+            }
+            break;
+        case DINIT_CP_WAKESERVICE:
+            for (auto dpt : service->get_dependents()) {
+                auto from_state = dpt->get_from()->get_state();
+                if ((from_state == service_state_t::STARTED || from_state == service_state_t::STARTING)
+                        && ! dpt->holding_acq) {
+                    dpt->get_from()->start_dep(*dpt);
+                }
+            }
+            if (do_pin) service->pin_start();
+            break;
+        case DINIT_CP_RELEASESERVICE:
+            if (do_pin) service->pin_stop();
+            service->stop(false);
+            break;
+        }
+    }
+
+    services->process_queues();
+
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (results[i] != DINIT_RP_ACK) continue;
+        auto state = batch_services[i]->get_state();
+        if ((ops[i].op == DINIT_CP_STOPSERVICE && (ops[i].flags & 4) == 0)
+                || ops[i].op == DINIT_CP_RELEASESERVICE) {
+            if (state == service_state_t::STOPPED) results[i] = DINIT_RP_ALREADYSS;
+        }
+        else if (state == service_state_t::STARTED) {
+            results[i] = DINIT_RP_ALREADYSS;
+        }
+        else if (state == service_state_t::STOPPED) {
+            // Start (or restart) has already failed
+            results[i] = DINIT_RP_NAK;
+        }
+    }
+
+    return queue_packet(std::move(reply_pkt));
+}
+
+int control_conn_t::check_batch(const vector<batch_op> &ops, const vector<service_record *> &batch_services,
+        char &reason)
+{
+    // Services which the batch stops (not restarts). A dependent of a service being gently stopped
+    // does not prevent the stop if the dependent is itself stopped as part of the batch.
+    std::unordered_set<service_record *> stopped_by_batch;
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (ops[i].op == DINIT_CP_STOPSERVICE && (ops[i].flags & 4) == 0) {
+            stopped_by_batch.insert(batch_services[i]);
+        }
+    }
+
+    bool shutting_down = services->is_shutting_down();
+
+    for (size_t i = 0; i < ops.size(); i++) {
+        service_record *service = batch_services[i];
+        bool do_restart = (ops[i].flags & 4) == 4;
+        switch (ops[i].op) {
+        case DINIT_CP_STARTSERVICE:
+        case DINIT_CP_WAKESERVICE:
+        {
+            if (shutting_down) {
+                reason = DINIT_BATCH_SHUTTING_DOWN;
+                return i;
+            }
+            if (service->is_stop_pinned()) {
+                reason = DINIT_BATCH_PINNED;
+                return i;
+            }
+            if (ops[i].op == DINIT_CP_WAKESERVICE) {
+                bool found_dpt = false;
+                for (auto dpt : service->get_dependents()) {
+                    auto from_state = dpt->get_from()->get_state();
+                    if (from_state == service_state_t::STARTED || from_state == service_state_t::STARTING) {
+                        found_dpt = true;
+                        break;
+                    }
+                }
+                if (! found_dpt) {
+                    reason = DINIT_BATCH_NO_DEPENDENTS;
+                    return i;
+                }
+            }
+            break;
+        }
+        case DINIT_CP_STOPSERVICE:
+            if (do_restart) {
+                if (shutting_down) {
+                    reason = DINIT_BATCH_SHUTTING_DOWN;
+                    return i;
+                }
+                if (service->get_state() != service_state_t::STARTED) {
+                    reason = DINIT_BATCH_NOT_STARTED;
+                    return i;
+                }
+            }
+            else if (service->is_start_pinned()) {
+                reason = DINIT_BATCH_PINNED;
+                return i;
+            }
+            if ((ops[i].flags & 2) == 2 || do_restart) {
+                // gentle: check for dependents which would be affected
+                for (service_dep *dep : service->get_dependents()) {
+                    if (dep->dep_type == dependency_type::REGULAR && dep->holding_acq
+                            && stopped_by_batch.count(dep->get_from()) == 0) {
+                        reason = DINIT_BATCH_DEPENDENTS;
+                        return i;
+                    }
+                }
+            }
+            break;
+        case DINIT_CP_RELEASESERVICE:
+            if (service->is_start_pinned()) {
+                reason = DINIT_BATCH_PINNED;
+                return i;
+            }
+            break;
+        }
+    }
+
+    return -1;
+}
+
 bool control_conn_t::process_unpin_service()
 {
     using std::string;
@@ -432,6 +691,22 @@ bool control_conn_t::process_unload_service()
     return true;
 }
 
+// Reload a service. If reloading produces a new service record, it replaces the original in the service
+// set (and the original is deleted); listeners, including connections with handles to the service, are
+// transferred to the new record. Returns the (possibly new) record. May throw service_load_exc or
+// std::bad_alloc, in which case the service is unchanged.
+static service_record *reload_service_record(service_set *services, service_record *service)
+{
+    auto *new_service = services->reload_service(service);
+    if (new_service != service) {
+        service->prepare_for_unload();
+        services->replace_service(service, new_service);
+        delete service;
+    }
+    new_service->set_description_changed(false);
+    return new_service;
+}
+
 bool control_conn_t::process_reload_service()
 {
     using std::string;
@@ -467,19 +742,12 @@ bool control_conn_t::process_reload_service()
     else {
         try {
             // reload
-            auto *new_service = services->reload_service(service);
-            if (new_service != service) {
-                service->prepare_for_unload();
-                services->replace_service(service, new_service);
-                delete service;
-            }
-            else {
-                service->remove_listener(this);
-            }
+            auto *new_service = reload_service_record(services, service);
 
             // drop handle
             key_service_map.erase(handle);
-            service_key_map.erase(service);
+            service_key_map.erase(new_service);
+            new_service->remove_listener(this);
 
             services->process_queues();
 
@@ -501,6 +769,62 @@ bool control_conn_t::process_reload_service()
     return true;
 }
 
+bool control_conn_t::process_reload_changed()
+{
+    // 1 byte: packet type
+
+    rbuf.consume(1);
+    chklen = 0;
+
+    if (! services->is_tracking_changes()) {
+        char nak_rep[] = { DINIT_RP_NAK };
+        return queue_packet(nak_rep, 1);
+    }
+
+    // Reloading may load new services, so find the changed services first:
+    std::vector<service_record *> changed;
+    for (auto *sr : services->list_services()) {
+        if (sr->is_description_changed()) {
+            changed.push_back(sr);
+        }
+    }
+
+    // Reload each service, and then process the start/stop queues once for the whole batch. Each
+    // service is reloaded independently (a failure does not undo the reload of other services); if a
+    // reload fails, that service is left unchanged (and remains marked as changed). Handles open to a
+    // service whose record is replaced are updated to refer to the new record.
+    std::vector<std::pair<char, std::string>> results;
+    results.reserve(changed.size());
+    for (auto *service : changed) {
+        results.emplace_back(DINIT_RELOAD_OK, service->get_name());
+        try {
+            reload_service_record(services, service);
+        }
+        catch (service_load_exc &slexc) {
+            log(loglevel_t::ERROR, "Could not reload service ", slexc.service_name, ": ",
+                    slexc.exc_description);
+            results.back().first = DINIT_RELOAD_FAILED;
+        }
+    }
+
+    services->process_queues();
+
+    for (auto &result : results) {
+        const std::string &name = result.second;
+        size_t name_len = std::min(name.length(), (size_t)255);
+        std::vector<char> pkt_buf;
+        pkt_buf.reserve(3 + name_len);
+        pkt_buf.push_back(DINIT_RP_RELOADRESULT);
+        pkt_buf.push_back(result.first);
+        pkt_buf.push_back((char)name_len);
+        pkt_buf.insert(pkt_buf.end(), name.begin(), name.begin() + name_len);
+        if (! queue_packet(std::move(pkt_buf))) return false;
+    }
+
+    char done_rep[] = { DINIT_RP_LISTDONE };
+    return queue_packet(done_rep, 1);
+}
+
 bool control_conn_t::list_services()
 {
     rbuf.consume(1); // clear request packet
@@ -525,11 +849,20 @@ bool control_conn_t::list_services()
             char b0 = sptr->is_waiting_for_console() ? 1 : 0;
             b0 |= sptr->has_console() ? 2 : 0;
             b0 |= sptr->was_start_skipped() ? 4 : 0;
+
+            // If waiting to restart, the restart delay (in 1/10 seconds, capped to 16 bits):
+            unsigned restart_delay = 0;
+            dasynq::time_val delay_tv;
+            if (sptr->get_restart_delay(delay_tv)) {
+                b0 |= 8;
+                uint64_t ds = (uint64_t)delay_tv.seconds() * 10u + delay_tv.nseconds() / 100000000u;
+                restart_delay = std::min(ds, (uint64_t)0xFFFFu);
+            }
             pkt_buf[4] = b0;
             pkt_buf[5] = static_cast<char>(sptr->get_stop_reason());
 
-            pkt_buf[6] = 0; // reserved
-            pkt_buf[7] = 0;
+            pkt_buf[6] = restart_delay & 0xFFu;
+            pkt_buf[7] = restart_delay >> 8;
             
             // Next: either the exit status, or the process ID
             if (sptr->get_state() != service_state_t::STOPPED) {
@@ -770,6 +1103,45 @@ bool control_conn_t::process_query_name()
     return queue_packet(std::move(reply));
 }
 
+bool control_conn_t::process_query_path(char reply_type, const char *path)
+{
+    rbuf.consume(1);
+    chklen = 0;
+
+    if (path == nullptr) {
+        char nak_rep[] = { DINIT_RP_NAK };
+        return queue_packet(nak_rep, 1);
+    }
+
+    uint16_t path_len = std::min(strlen(path), (size_t) std::numeric_limits<uint16_t>::max());
+    std::vector<char> reply(1 + sizeof(path_len) + path_len);
+    reply[0] = reply_type;
+    memcpy(reply.data() + 1, &path_len, sizeof(path_len));
+    memcpy(reply.data() + 1 + sizeof(path_len), path, path_len);
+    return queue_packet(std::move(reply));
+}
+
+bool control_conn_t::process_query_conn_stats()
+{
+    rbuf.consume(1);
+    chklen = 0;
+
+    uint32_t stats[] = {
+        (uint32_t) active_control_conns,
+        (uint32_t) std::min(control_conn_stats.out_bytes, (size_t) UINT32_MAX),
+        (uint32_t) std::min(control_conn_stats.peak_out_bytes, (size_t) UINT32_MAX),
+        (uint32_t) out_quota,
+        (uint32_t) total_out_quota,
+        (uint32_t) std::min(control_conn_stats.throttled, (unsigned long) UINT32_MAX),
+        (uint32_t) std::min(control_conn_stats.quota_closed, (unsigned long) UINT32_MAX)
+    };
+
+    char reply[1 + sizeof(stats)];
+    reply[0] = DINIT_RP_CONNSTATS;
+    memcpy(reply + 1, stats, sizeof(stats));
+    return queue_packet(reply, sizeof(reply));
+}
+
 bool control_conn_t::query_load_mech()
 {
     rbuf.consume(1);
@@ -846,6 +1218,205 @@ bool control_conn_t::query_load_mech()
     }
 }
 
+bool control_conn_t::process_subscribe()
+{
+    // 1 byte packet type
+    // 1 byte event mask
+    // 2 byte pattern length
+    // N bytes pattern
+
+    constexpr int pkt_size = 4;
+
+    if (rbuf.get_length() < pkt_size) {
+        chklen = pkt_size;
+        return true;
+    }
+
+    uint16_t pattern_len;
+    rbuf.extract((char *)&pattern_len, 2, sizeof(pattern_len));
+    if (pattern_len > (1024 - pkt_size)) {
+        char badreq_rep[] = { DINIT_RP_BADREQ };
+        if (! queue_packet(badreq_rep, 1)) return false;
+        bad_conn_close = true;
+        iob.set_watches(OUT_EVENTS);
+        return true;
+    }
+
+    chklen = pkt_size + pattern_len;
+    if (rbuf.get_length() < chklen) {
+        return true;
+    }
+
+    sub_pattern = rbuf.extract_string(pkt_size, pattern_len);
+    sub_event_mask = (unsigned char)rbuf[1];
+    if (! subscribed) {
+        services->add_set_listener(this);
+        subscribed = true;
+    }
+
+    char ack_rep[] = { DINIT_RP_ACK };
+    if (! queue_packet(ack_rep, 1)) return false;
+    rbuf.consume(chklen);
+    chklen = 0;
+    return true;
+}
+
+void control_conn_t::service_set_event(service_record *service, service_event_t event, uint32_t seq) noexcept
+{
+    if (bad_conn_close) return;
+    if (sub_event_mask != 0 && (sub_event_mask & (1u << static_cast<int>(event))) == 0) return;
+
+    const std::string &name = service->get_name();
+    if (! sub_pattern.empty() && fnmatch(sub_pattern.c_str(), name.c_str(), 0) != 0) return;
+
+    try {
+        queue_sub_event(name, event, seq);
+    }
+    catch (std::bad_alloc &exc) {
+        do_oom_close();
+    }
+}
+
+void control_conn_t::queue_sub_event(const std::string &name, service_event_t event, uint32_t seq)
+{
+    constexpr size_t max_pkt_size = 255;
+    constexpr size_t entry_hdr_size = sizeof(seq) + 2;
+    constexpr size_t max_name_len = max_pkt_size - 2 - entry_hdr_size;
+
+    if (sub_lost_count != 0) {
+        if (outbuf.size() > max_sub_queue / 2 || out_bytes > out_quota / 2) {
+            sub_lost_count++;
+            return;
+        }
+        queue_events_lost();
+        if (bad_conn_close) return;
+    }
+
+    if (outbuf.size() >= max_sub_queue || out_bytes >= out_quota) {
+        sub_first_lost = seq;
+        sub_lost_count = 1;
+        return;
+    }
+
+    size_t name_len = std::min(name.length(), max_name_len);
+    size_t entry_size = entry_hdr_size + name_len;
+
+    // We can append to the last queued packet if it is an event batch with sufficient room, and
+    // it is not already (partially) sent:
+    bool can_append = sub_batch != nullptr && sub_batch == &outbuf.back()
+            && (outbuf.size() > 1 || outpkt_index == 0)
+            && sub_batch->size() + entry_size <= max_pkt_size;
+
+    if (! can_append) {
+        vector<char> pkt;
+        pkt.reserve(max_pkt_size);
+        pkt.push_back(DINIT_IP_SERVICEEVENTS);
+        pkt.push_back(2);
+        outbuf.emplace_back(std::move(pkt));
+        sub_batch = &outbuf.back();
+    }
+
+    // (space has been reserved, so the following can't throw):
+    vector<char> &pkt = *sub_batch;
+    const char *seq_p = (const char *) &seq;
+    pkt.insert(pkt.end(), seq_p, seq_p + sizeof(seq));
+    pkt.push_back(static_cast<char>(event));
+    pkt.push_back(static_cast<char>(name_len));
+    pkt.insert(pkt.end(), name.data(), name.data() + name_len);
+    pkt[1] = static_cast<char>(pkt.size());
+    account_output(can_append ? entry_size : pkt.size());
+
+    // We don't write immediately; events which occur together are sent together.
+    iob.set_watches(in_flag() | OUT_EVENTS);
+}
+
+void control_conn_t::queue_events_lost()
+{
+    vector<char> pkt;
+    pkt.reserve(2 + sizeof(sub_first_lost) + sizeof(sub_lost_count));
+    pkt.push_back(DINIT_IP_EVENTSLOST);
+    pkt.push_back(2 + sizeof(sub_first_lost) + sizeof(sub_lost_count));
+    const char *first_p = (const char *) &sub_first_lost;
+    pkt.insert(pkt.end(), first_p, first_p + sizeof(sub_first_lost));
+    const char *count_p = (const char *) &sub_lost_count;
+    pkt.insert(pkt.end(), count_p, count_p + sizeof(sub_lost_count));
+    outbuf.emplace_back(std::move(pkt));
+    sub_lost_count = 0;
+    account_output(outbuf.back().size());
+    iob.set_watches(in_flag() | OUT_EVENTS);
+}
+
+void control_conn_t::account_output(ptrdiff_t bytes) noexcept
+{
+    out_bytes += bytes;
+    control_conn_stats.out_bytes += bytes;
+    if (control_conn_stats.out_bytes > control_conn_stats.peak_out_bytes) {
+        control_conn_stats.peak_out_bytes = control_conn_stats.out_bytes;
+    }
+
+    if (out_bytes > out_hard_limit) {
+        // The client is not reading its output; discard the output and close the connection.
+        log(loglevel_t::WARN, "Control connection exceeded output limit; dropping connection");
+        control_conn_stats.out_bytes -= out_bytes;
+        control_conn_stats.quota_closed++;
+        out_bytes = 0;
+        outbuf.clear();
+        outpkt_index = 0;
+        sub_batch = nullptr;
+        sub_lost_count = 0;
+        in_throttled = false;
+        bad_conn_close = true;
+        oom_close = false;
+        quota_close = true;
+        iob.set_watches(OUT_EVENTS);
+        return;
+    }
+
+    if (! in_throttled) {
+        if (out_bytes > out_quota || (out_bytes != 0 && control_conn_stats.out_bytes > total_out_quota)) {
+            in_throttled = true;
+            control_conn_stats.throttled++;
+        }
+    }
+    else if (out_bytes <= out_quota / 2
+            && (out_bytes == 0 || control_conn_stats.out_bytes <= total_out_quota)) {
+        in_throttled = false;
+    }
+}
+
+void control_conn_t::service_replaced(service_record *service, service_record *replacement) noexcept
+{
+    try {
+        std::vector<handle_t> handles;
+        auto range = service_key_map.equal_range(service);
+        for (auto i = range.first; i != range.second; ++i) {
+            handles.push_back(i->second);
+        }
+        for (handle_t handle : handles) {
+            service_key_map.insert(std::make_pair(replacement, handle));
+        }
+        service_key_map.erase(service);
+        for (handle_t handle : handles) {
+            key_service_map.find(handle)->second = replacement;
+        }
+    }
+    catch (std::bad_alloc &exc) {
+        // Drop the handles instead, and close the connection.
+        for (auto i = key_service_map.begin(); i != key_service_map.end(); ) {
+            if (i->second == service || i->second == replacement) {
+                i = key_service_map.erase(i);
+            }
+            else {
+                ++i;
+            }
+        }
+        service_key_map.erase(service);
+        service_key_map.erase(replacement);
+        replacement->remove_listener(this);
+        do_oom_close();
+    }
+}
+
 control_conn_t::handle_t control_conn_t::allocate_service_handle(service_record *record)
 {
     // Try to find a unique handle (integer) in a single pass. Since the map is ordered, we can search until
@@ -881,7 +1452,8 @@ control_conn_t::handle_t control_conn_t::allocate_service_handle(service_record
 
 bool control_conn_t::queue_packet(const char *pkt, unsigned size) noexcept
 {
-    int in_flag = bad_conn_close ? 0 : IN_EVENTS;
+    if (quota_close) return true;
+
     bool was_empty = outbuf.empty();
 
     // If the queue is empty, we can try to write the packet out now rather than queueing it.
@@ -901,7 +1473,7 @@ bool control_conn_t::queue_packet(const char *pkt, unsigned size) noexcept
         else {
             if ((unsigned)wr == size) {
                 // Ok, all written.
-                iob.set_watches(in_flag);
+                iob.set_watches(in_flag());
                 return true;
             }
             pkt += wr;
@@ -912,7 +1484,8 @@ bool control_conn_t::queue_packet(const char *pkt, unsigned size) noexcept
     // Create a vector out of the (remaining part of the) packet:
     try {
         outbuf.emplace_back(pkt, pkt + size);
-        iob.set_watches(in_flag | OUT_EVENTS);
+        account_output(size);
+        iob.set_watches(in_flag() | OUT_EVENTS);
         return true;
     }
     catch (std::bad_alloc &baexc) {
@@ -936,7 +1509,8 @@ bool control_conn_t::queue_packet(const char *pkt, unsigned size) noexcept
 // make them extraordinary difficult to combine into a single method.
 bool control_conn_t::queue_packet(std::vector<char> &&pkt) noexcept
 {
-    int in_flag = bad_conn_close ? 0 : IN_EVENTS;
+    if (quota_close) return true;
+
     bool was_empty = outbuf.empty();
     
     if (was_empty) {
@@ -956,7 +1530,7 @@ bool control_conn_t::queue_packet(std::vector<char> &&pkt) noexcept
         else {
             if ((unsigned)wr == pkt.size()) {
                 // Ok, all written.
-                iob.set_watches(in_flag);
+                iob.set_watches(in_flag());
                 return true;
             }
             outpkt_index = wr;
@@ -965,7 +1539,8 @@ bool control_conn_t::queue_packet(std::vector<char> &&pkt) noexcept
     
     try {
         outbuf.emplace_back(pkt);
-        iob.set_watches(in_flag | OUT_EVENTS);
+        account_output(outbuf.back().size());
+        iob.set_watches(in_flag() | OUT_EVENTS);
         return true;
     }
     catch (std::bad_alloc &baexc) {
@@ -988,8 +1563,18 @@ bool control_conn_t::queue_packet(std::vector<char> &&pkt) noexcept
 bool control_conn_t::data_ready() noexcept
 {
     int fd = iob.get_watched_fd();
-    
-    int r = rbuf.fill(fd);
+
+    bool truncated = false;
+    int r;
+    if (seqpacket) {
+        if (rbuf.get_length() == 0) {
+            rbuf.reset();
+        }
+        r = rbuf.fill_msg(fd, truncated);
+    }
+    else {
+        r = rbuf.fill(fd);
+    }
     
     // Note file descriptor is non-blocking
     if (r == -1) {
@@ -1003,16 +1588,16 @@ bool control_conn_t::data_ready() noexcept
     if (r == 0) {
         return true;
     }
+
+    if (truncated) {
+        // The rest of the message has been lost; we can't process it correctly.
+        log(loglevel_t::WARN, "Received too-large control message; dropping connection");
+        return incomplete_message();
+    }
     
     // complete packet?
     if (rbuf.get_length() >= chklen) {
-        try {
-            return !process_packet();
-        }
-        catch (std::bad_alloc &baexc) {
-            do_oom_close();
-            return false;
-        }
+        return process_buffered();
     }
     else if (rbuf.get_length() == rbuf.get_size()) {
         // Too big packet
@@ -1020,6 +1605,9 @@ bool control_conn_t::data_ready() noexcept
         bad_conn_close = true;
         iob.set_watches(OUT_EVENTS);
     }
+    else if (seqpacket) {
+        return incomplete_message();
+    }
     else {
         int out_flags = (bad_conn_close || !outbuf.empty()) ? OUT_EVENTS : 0;
         iob.set_watches(IN_EVENTS | out_flags);
@@ -1028,6 +1616,39 @@ bool control_conn_t::data_ready() noexcept
     return false;
 }
 
+bool control_conn_t::process_buffered() noexcept
+{
+    // Process all complete packets in the buffer (the client may pipeline requests), until input
+    // is throttled:
+    try {
+        do {
+            int prev_length = rbuf.get_length();
+            if (! process_packet()) return true;
+            if (bad_conn_close || in_throttled || rbuf.get_length() == prev_length) break;
+        } while (rbuf.get_length() != 0 && rbuf.get_length() >= chklen);
+
+        if (seqpacket && rbuf.get_length() != 0 && ! bad_conn_close && ! in_throttled) {
+            return incomplete_message();
+        }
+    }
+    catch (std::bad_alloc &baexc) {
+        do_oom_close();
+    }
+    return false;
+}
+
+bool control_conn_t::incomplete_message() noexcept
+{
+    // A message on a SOCK_SEQPACKET connection ended part-way through a packet (the remainder
+    // can't follow in the next message), or was truncated: give error response and close.
+    rbuf.reset();
+    char badreqRep[] = { DINIT_RP_BADREQ };
+    if (! queue_packet(badreqRep, 1)) return true;
+    bad_conn_close = true;
+    iob.set_watches(OUT_EVENTS);
+    return false;
+}
+
 bool control_conn_t::send_data() noexcept
 {
     if (outbuf.empty() && bad_conn_close) {
@@ -1060,8 +1681,30 @@ bool control_conn_t::send_data() noexcept
     outpkt_index += written;
     if (outpkt_index == pkt.size()) {
         // We've finished this packet, move on to the next:
+        if (sub_batch == &outbuf.front()) {
+            sub_batch = nullptr;
+        }
+        size_t pkt_size = pkt.size();
         outbuf.pop_front();
         outpkt_index = 0;
+        bool was_throttled = in_throttled;
+        account_output(-(ptrdiff_t)pkt_size);
+        if (sub_lost_count != 0 && outbuf.size() <= max_sub_queue / 2 && out_bytes <= out_quota / 2
+                && ! bad_conn_close) {
+            try {
+                queue_events_lost();
+            }
+            catch (std::bad_alloc &exc) {
+                do_oom_close();
+            }
+        }
+        if (was_throttled && ! in_throttled && ! bad_conn_close) {
+            // Resume reading input, but first process any complete packets already received:
+            if (rbuf.get_length() != 0 && rbuf.get_length() >= chklen) {
+                if (process_buffered()) return true;
+            }
+            iob.set_watches(in_flag() | ((outbuf.empty() && ! bad_conn_close) ? 0 : OUT_EVENTS));
+        }
         if (outbuf.empty() && ! oom_close) {
             if (! bad_conn_close) {
                 iob.set_watches(IN_EVENTS);
@@ -1084,6 +1727,10 @@ control_conn_t::~control_conn_t() noexcept
     for (auto p : service_key_map) {
         p.first->remove_listener(this);
     }
-    
+    if (subscribed) {
+        services->remove_set_listener(this);
+    }
+
+    control_conn_stats.out_bytes -= out_bytes;
     active_control_conns--;
 }
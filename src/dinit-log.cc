@@ -1,15 +1,20 @@
 #include <algorithm>
+#include <ctime>
+#include <unordered_map>
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/syslog.h>
 #include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "dasynq.h"
 
 #include "service.h"
 #include "dinit-log.h"
 #include "cpbuffer.h"
+#include "log-journal.h"
 
 // Dinit logging subsystem.
 //
@@ -23,6 +28,17 @@
 // The console log stream needs to be able to release the console, if a service is waiting to acquire it.
 // This is accomplished by calling flush_for_release() which then completes the output of the current
 // message (if any) and then assigns the console to a waiting service.
+//
+// If the main log is a datagram socket (syslog), each message is sent as a separate datagram, without
+// the terminating newline; where possible several queued messages are sent at once (via sendmmsg).
+//
+// Messages concerning a particular service are rate-limited (see log_rate_limiter below), so that a
+// service which repeatedly fails and restarts cannot flood the log buffers.
+//
+// Optionally, messages are also recorded in a structured journal (see log-journal.h). Journal records
+// are written directly (with a blocking write) to the journal file, which is expected to reside on a
+// local filesystem. Once the journal reaches its maximum size, it is rotated: the current journal is
+// renamed (with ".old" appended, replacing any previous such file) and a new journal is begun.
 
 extern eventloop_t event_loop;
 extern bool external_log_open;
@@ -56,7 +72,14 @@ class buffered_log_stream : public eventloop_t::fd_watcher_impl<buffered_log_str
     int msg_index;     // index into special message
 
     cpbuffer<4096> log_buffer;
-    
+
+#ifdef __linux__
+    // Maximum number of messages sent at once to a datagram socket:
+    static constexpr int max_dgrams = 16;
+
+    bool is_dgram = false;    // if output is to a datagram socket
+#endif
+
     public:
     
     // Incoming:
@@ -64,10 +87,13 @@ class buffered_log_stream : public eventloop_t::fd_watcher_impl<buffered_log_str
 
     int fd = -1;
 
-    void init(int fd)
+    void init(int fd, bool dgram = false)
     {
         this->fd = fd;
         release = false;
+#ifdef __linux__
+        is_dgram = dgram;
+#endif
     }
     
     rearm fd_event(eventloop_t &loop, int fd, int flags) noexcept;
@@ -118,12 +144,389 @@ class buffered_log_stream : public eventloop_t::fd_watcher_impl<buffered_log_str
 
     private:
     void release_console();
+
+#ifdef __linux__
+    // Send buffered messages to a datagram socket.
+    rearm send_dgrams() noexcept;
+#endif
 };
 
 // Two log streams:
 // (One for main log, one for console)
 buffered_log_stream log_stream[2];
 
+// Messages below this level are not recorded in the journal:
+constexpr loglevel_t journal_min_level = loglevel_t::INFO;
+
+// Longer service names and messages are truncated in the journal:
+constexpr size_t journal_max_svc_name = 255;
+constexpr size_t journal_max_msg = 1024;
+
+// The log journal. A record is assembled as a message is logged, and then written out when the message
+// is complete. Until the journal file has been opened (at boot, the filesystem where it resides may not
+// yet be writable), complete records are held in a buffer instead.
+class log_journal_t
+{
+    const char *path = nullptr;
+    int fd = -1;
+    off_t size = 0;  // size of the (valid) journal contents
+    off_t max_size = log_journal_default_max_kib * 1024;  // size at which to rotate (0 = unlimited)
+
+    // Record being assembled:
+    bool current = false;
+    log_journal_record rec;
+    char svc_name[journal_max_svc_name];
+    char msg[journal_max_msg];
+
+    // Records logged before the journal was opened:
+    char pending[8192];
+    size_t pending_len = 0;
+
+    public:
+    void set_path(const char *path_p) noexcept { path = path_p; }
+    const char *get_path() noexcept { return path; }
+    void set_max_size(off_t max_size_p) noexcept { max_size = max_size_p; }
+
+    // Check whether messages of the given level are recorded.
+    bool is_recorded(loglevel_t lvl) noexcept
+    {
+        return path != nullptr && lvl >= journal_min_level;
+    }
+
+    // Open the journal file, discarding any partial record at its end. Returns false on failure.
+    bool open() noexcept;
+    void close() noexcept;
+
+    // Rotate the journal (see above). Returns false on failure, in which case the current journal
+    // remains in use.
+    bool rotate() noexcept;
+
+    // Begin a record (service name may be null); the message is built with append().
+    void begin(loglevel_t lvl, const char *svc) noexcept;
+    void append(const char *s) noexcept;
+    void commit() noexcept;
+
+    void record(loglevel_t lvl, const char *svc, const char *s) noexcept
+    {
+        begin(lvl, svc);
+        append(s);
+        commit();
+    }
+};
+
+log_journal_t log_journal;
+
+// Rate limiting of messages concerning services: each service has a token bucket per log level. A
+// message consumes a token, and tokens accrue over time (up to a limit, which is the number of messages
+// that can be logged in a burst). A message logged when no token is available is suppressed; the number
+// of suppressed messages is logged (for each service and level) some time after the first is suppressed.
+// Services are forgotten once their buckets have refilled; while any are tracked, the timer runs
+// periodically to check for this.
+
+constexpr unsigned log_rate_burst = 10;        // maximum tokens
+constexpr uint64_t log_rate_token_ms = 2000;   // time to accrue a token (milliseconds)
+constexpr int log_rate_report_secs = 10;       // delay before reporting suppressed messages
+
+constexpr int num_log_levels = (int)loglevel_t::ZERO;
+
+class log_rate_limiter : public eventloop_t::timer_impl<log_rate_limiter>
+{
+    struct bucket
+    {
+        unsigned tokens = log_rate_burst;
+        uint64_t last_ms = 0;     // time at which tokens last accrued
+        unsigned suppressed = 0;  // number of messages suppressed (not yet reported)
+    };
+
+    struct service_rates
+    {
+        bucket levels[num_log_levels];
+    };
+
+    std::unordered_map<std::string, service_rates> rates;
+    bool active = false;  // (timer added)
+    bool timer_armed = false;
+
+    static uint64_t current_ms() noexcept
+    {
+        dasynq::time_val now;
+        event_loop.get_time(now, clock_type::MONOTONIC);
+        return (uint64_t)now.seconds() * 1000 + now.nseconds() / 1000000;
+    }
+
+    static void accrue(bucket &b, uint64_t now) noexcept
+    {
+        uint64_t count = (now - b.last_ms) / log_rate_token_ms;
+        if (b.tokens + count >= log_rate_burst) {
+            b.tokens = log_rate_burst;
+            b.last_ms = now;
+        }
+        else {
+            b.tokens += count;
+            b.last_ms += count * log_rate_token_ms;
+        }
+    }
+
+    public:
+    // Potentially throws std::bad_alloc or std::system_error
+    void init()
+    {
+        if (! active) {
+            add_timer(event_loop);
+            active = true;
+        }
+    }
+
+    void close() noexcept
+    {
+        if (active) {
+            if (timer_armed) stop_timer(event_loop);
+            deregister(event_loop);
+            active = false;
+            timer_armed = false;
+            rates.clear();
+        }
+    }
+
+    // Check whether a message concerning the given service may be logged, consuming a token if so (and
+    // counting the message as suppressed otherwise).
+    bool check(const char *svc_name, loglevel_t lvl) noexcept;
+
+    // Get the number of services for which the rate is currently tracked.
+    size_t num_tracked() noexcept
+    {
+        return rates.size();
+    }
+
+    // Report suppressed messages, and forget idle services.
+    dasynq::rearm timer_expiry(eventloop_t &, int expiry_count) noexcept;
+};
+
+log_rate_limiter log_rate;
+
+bool log_rate_limiter::check(const char *svc_name, loglevel_t lvl) noexcept
+{
+    if (! active) return true;
+
+    uint64_t now = current_ms();
+    bucket *b;
+    try {
+        auto i = rates.find(svc_name);
+        if (i == rates.end()) {
+            i = rates.emplace(svc_name, service_rates()).first;
+            for (bucket &lb : i->second.levels) {
+                lb.last_ms = now;
+            }
+            if (! timer_armed) {
+                arm_timer_rel(event_loop, dasynq::time_val(log_rate_report_secs, 0));
+                timer_armed = true;
+            }
+        }
+        b = &i->second.levels[(int)lvl];
+    }
+    catch (std::bad_alloc &) {
+        // Can't track the rate; allow the message.
+        return true;
+    }
+
+    accrue(*b, now);
+    if (b->tokens != 0) {
+        --b->tokens;
+        return true;
+    }
+
+    ++b->suppressed;
+    if (! timer_armed) {
+        arm_timer_rel(event_loop, dasynq::time_val(log_rate_report_secs, 0));
+        timer_armed = true;
+    }
+    return false;
+}
+
+// Write the header of a new (empty) journal file.
+static bool write_journal_header(int fd) noexcept
+{
+    char hdr[log_journal_hdr_size] = {};
+    memcpy(hdr, log_journal_magic, sizeof(log_journal_magic));
+    return write(fd, hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr);
+}
+
+bool log_journal_t::open() noexcept
+{
+    if (path == nullptr || fd != -1) return true;
+
+    int new_fd = ::open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC | O_NOFOLLOW, 0644);
+    if (new_fd == -1) {
+        log(loglevel_t::WARN, "Couldn't open log journal ", path, ": ", strerror(errno));
+        return false;
+    }
+
+    auto fail = [&](const char *reason) -> bool {
+        log(loglevel_t::WARN, "Couldn't open log journal ", path, ": ", reason);
+        ::close(new_fd);
+        return false;
+    };
+
+    struct stat statbuf;
+    if (fstat(new_fd, &statbuf) == -1) return fail(strerror(errno));
+
+    size_t file_size = statbuf.st_size;
+    size_t valid_size = log_journal_hdr_size;
+    if (file_size == 0) {
+        if (! write_journal_header(new_fd)) {
+            ftruncate(new_fd, 0);
+            return fail(strerror(errno));
+        }
+    }
+    else {
+        // Find the end of the last complete record:
+        void *data = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, new_fd, 0);
+        if (data == MAP_FAILED) return fail(strerror(errno));
+        const char *cdata = static_cast<const char *>(data);
+        bool valid = log_journal_check_header(cdata, file_size);
+        if (valid) {
+            log_journal_record hdr;
+            size_t next;
+            while ((next = log_journal_read_record(cdata, file_size, valid_size, hdr)) != 0) {
+                valid_size = next;
+            }
+        }
+        munmap(data, file_size);
+        if (! valid) return fail("not a log journal");
+        if (valid_size != file_size && ftruncate(new_fd, valid_size) == -1) {
+            return fail(strerror(errno));
+        }
+    }
+
+    fd = new_fd;
+    size = valid_size;
+
+    if (pending_len != 0) {
+        if (write(fd, pending, pending_len) == (ssize_t)pending_len) {
+            size += pending_len;
+        }
+        else {
+            ftruncate(fd, size);
+        }
+        pending_len = 0;
+    }
+
+    return true;
+}
+
+void log_journal_t::close() noexcept
+{
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool log_journal_t::rotate() noexcept
+{
+    // (We can't log failures here, since this is done while committing a record.)
+    std::string old_path;
+    try {
+        old_path = std::string(path) + log_journal_old_suffix;
+    }
+    catch (std::bad_alloc &) {
+        return false;
+    }
+
+    if (rename(path, old_path.c_str()) == -1) return false;
+
+    int new_fd = ::open(path, O_RDWR | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC | O_NOFOLLOW, 0644);
+    if (new_fd != -1 && ! write_journal_header(new_fd)) {
+        ::close(new_fd);
+        unlink(path);
+        new_fd = -1;
+    }
+    if (new_fd == -1) {
+        // Continue with the current journal:
+        rename(old_path.c_str(), path);
+        return false;
+    }
+
+    ::close(fd);
+    fd = new_fd;
+    size = log_journal_hdr_size;
+    return true;
+}
+
+void log_journal_t::begin(loglevel_t lvl, const char *svc) noexcept
+{
+    current = is_recorded(lvl);
+    if (! current) return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    rec.level = (uint8_t)lvl;
+    rec.reserved = 0;
+    rec.svc_name_len = 0;
+    rec.msg_len = 0;
+    rec.time_sec = now.tv_sec;
+    rec.time_nsec = now.tv_nsec;
+
+    if (svc != nullptr) {
+        size_t len = std::min(strlen(svc), journal_max_svc_name);
+        memcpy(svc_name, svc, len);
+        rec.svc_name_len = len;
+    }
+}
+
+void log_journal_t::append(const char *s) noexcept
+{
+    if (! current) return;
+    size_t len = std::min(strlen(s), journal_max_msg - rec.msg_len);
+    memcpy(msg + rec.msg_len, s, len);
+    rec.msg_len += len;
+}
+
+void log_journal_t::commit() noexcept
+{
+    if (! current) return;
+    current = false;
+
+    static char padding[log_journal_align] = {};
+
+    rec.length = log_journal_record_length(rec.svc_name_len, rec.msg_len);
+    struct iovec iov[4];
+    iov[0].iov_base = &rec;
+    iov[0].iov_len = sizeof(rec);
+    iov[1].iov_base = svc_name;
+    iov[1].iov_len = rec.svc_name_len;
+    iov[2].iov_base = msg;
+    iov[2].iov_len = rec.msg_len;
+    iov[3].iov_base = padding;
+    iov[3].iov_len = rec.length - sizeof(rec) - rec.svc_name_len - rec.msg_len;
+
+    if (fd == -1) {
+        // Not yet open; keep the record (if there is room) until it is:
+        if (sizeof(pending) - pending_len >= rec.length) {
+            for (auto &part : iov) {
+                memcpy(pending + pending_len, part.iov_base, part.iov_len);
+                pending_len += part.iov_len;
+            }
+        }
+        return;
+    }
+
+    if (max_size != 0 && size + rec.length > max_size && size != log_journal_hdr_size) {
+        rotate();
+    }
+
+    ssize_t r = ::writev(fd, iov, 4);
+    if (r == (ssize_t)rec.length) {
+        size += r;
+    }
+    else if (r > 0) {
+        // Partial write (filesystem full?); remove the partial record, so that the journal remains
+        // valid:
+        ftruncate(fd, size);
+    }
+}
+
 void buffered_log_stream::release_console()
 {
     if (release) {
@@ -171,6 +574,10 @@ rearm buffered_log_stream::fd_event(eventloop_t &loop, int fd, int flags) noexce
         const char * start = special_buf + msg_index;
         const char * end = start;
         while (*end != '\n') end++;
+#ifdef __linux__
+        // (A datagram must contain the whole message, and no newline):
+        if (is_dgram) end--;
+#endif
         int r = bp_sys::write(fd, start, end - start + 1);
         if (r >= 0) {
             if (start + r > end) {
@@ -201,6 +608,12 @@ rearm buffered_log_stream::fd_event(eventloop_t &loop, int fd, int flags) noexce
             release_console();
             return rearm::DISARM;
         }
+
+#ifdef __linux__
+        if (is_dgram) {
+            return send_dgrams();
+        }
+#endif
         
         // We try to find a complete line (terminated by '\n') in the buffer, and write it
         // out. Since it may span the circular buffer end, it may consist of two distinct spans,
@@ -266,6 +679,78 @@ rearm buffered_log_stream::fd_event(eventloop_t &loop, int fd, int flags) noexce
     return rearm::REARM;
 }
 
+#ifdef __linux__
+
+rearm buffered_log_stream::send_dgrams() noexcept
+{
+    struct mmsghdr msgs[max_dgrams];
+    struct iovec iovs[max_dgrams][2];
+    int msg_lens[max_dgrams];  // length of each message in the buffer (including newline)
+
+    // Gather (complete) messages; a message may span the end of the circular buffer, in which case it
+    // consists of two distinct spans:
+    int count = 0;
+    int index = 0;
+    while (count < max_dgrams && index < current_index) {
+        char *ptr = log_buffer.get_ptr(index);
+        int len = std::min(log_buffer.get_contiguous_length(ptr), current_index - index);
+        char *eptr = std::find(ptr, ptr + len, '\n');
+
+        struct iovec *iov = iovs[count];
+        iov[0].iov_base = ptr;
+        int iovcnt = 1;
+        if (eptr != ptr + len) {
+            iov[0].iov_len = eptr - ptr;
+        }
+        else {
+            iov[0].iov_len = len;
+            ptr = log_buffer.get_buf_base();
+            eptr = std::find(ptr, ptr + (current_index - index - len), '\n');
+            iov[1].iov_base = ptr;
+            iov[1].iov_len = eptr - ptr;
+            iovcnt = 2;
+        }
+
+        memset(&msgs[count].msg_hdr, 0, sizeof(msgs[count].msg_hdr));
+        msgs[count].msg_hdr.msg_iov = iov;
+        msgs[count].msg_hdr.msg_iovlen = iovcnt;
+        msg_lens[count] = iov[0].iov_len + (iovcnt == 2 ? iov[1].iov_len : 0) + 1;
+        index += msg_lens[count];
+        ++count;
+    }
+
+    int r = bp_sys::sendmmsg(fd, msgs, count, 0);
+    if (r == -1) {
+        if (errno == EMSGSIZE) {
+            // The first message can't be sent (too large for the socket); skip just that message.
+            r = 1;
+        }
+        else if (errno == EAGAIN || errno == EINTR || errno == EWOULDBLOCK || errno == ENOBUFS) {
+            return rearm::REARM;
+        }
+        else {
+            // The socket is no longer usable (eg the syslog daemon has gone away). The messages
+            // remain buffered, and will be sent if the log is re-opened.
+            return rearm::REMOVE;
+        }
+    }
+
+    int sent_len = 0;
+    for (int i = 0; i < r; i++) {
+        sent_len += msg_lens[i];
+    }
+    log_buffer.consume(sent_len);
+    current_index -= sent_len;
+
+    if (current_index == 0 || release) {
+        release_console();
+        return rearm::DISARM;
+    }
+    return rearm::REARM;
+}
+
+#endif
+
 void buffered_log_stream::watch_removed() noexcept
 {
     if (fd > STDERR_FILENO) {
@@ -288,6 +773,7 @@ void buffered_log_stream::watch_removed() noexcept
 void init_log(service_set *sset, bool syslog_format)
 {
     services = sset;
+    log_rate.init();
     log_stream[DLOG_CONS].add_watch(event_loop, STDOUT_FILENO, dasynq::OUT_EVENTS, false);
     enable_console_log(true);
 
@@ -301,16 +787,22 @@ void close_log()
 {
     if (log_stream[DLOG_CONS].fd != -1) log_stream[DLOG_CONS].deregister(event_loop);
     if (log_stream[DLOG_MAIN].fd != -1) log_stream[DLOG_MAIN].deregister(event_loop);
+    log_rate.close();
 }
 
-// Set up the main log to output to the given file descriptor.
+// Set up the main log to output to the given file descriptor (a datagram socket, if is_dgram is set).
 // Potentially throws std::bad_alloc or std::system_error
-void setup_main_log(int fd)
+void setup_main_log(int fd, bool is_dgram)
 {
-    log_stream[DLOG_MAIN].init(fd);
+    log_stream[DLOG_MAIN].init(fd, is_dgram);
     log_stream[DLOG_MAIN].add_watch(event_loop, fd, dasynq::OUT_EVENTS);
 }
 
+size_t log_rate_tracked_services() noexcept
+{
+    return log_rate.num_tracked();
+}
+
 bool is_log_flushed() noexcept
 {
     return log_stream[DLOG_CONS].current_index == 0 &&
@@ -346,6 +838,31 @@ void discard_console_log_buffer() noexcept
     }
 }
 
+void set_log_journal_path(const char *path) noexcept
+{
+    log_journal.set_path(path);
+}
+
+void set_log_journal_max_size(unsigned long kib) noexcept
+{
+    log_journal.set_max_size((off_t)kib * 1024);
+}
+
+bool open_log_journal() noexcept
+{
+    return log_journal.open();
+}
+
+void close_log_journal() noexcept
+{
+    log_journal.close();
+}
+
+const char *get_log_journal_path() noexcept
+{
+    return log_journal.get_path();
+}
+
 // Variadic method to calculate the sum of string lengths:
 static int sum_length(const char *arg) noexcept
 {
@@ -448,11 +965,13 @@ template <typename ... T> static void do_log_main(T ... args) noexcept
 void log(loglevel_t lvl, const char *msg) noexcept
 {
     do_log(lvl, true, "dinit: ", msg, "\n");
+    log_journal.record(lvl, nullptr, msg);
 }
 
 void log(loglevel_t lvl, bool to_cons, const char *msg) noexcept
 {
     do_log(lvl, to_cons, "dinit: ", msg, "\n");
+    log_journal.record(lvl, nullptr, msg);
 }
 
 // Log part of a message. A series of calls to do_log_part must be followed by a call to do_log_commit.
@@ -479,8 +998,8 @@ static void do_log_commit(int idx) noexcept
     }
 }
 
-// Log a multi-part message beginning
-void log_msg_begin(loglevel_t lvl, const char *msg) noexcept
+// Begin a multi-part message (in the console and main logs)
+static void do_log_begin(loglevel_t lvl) noexcept
 {
     log_current_line[DLOG_CONS] = lvl >= log_level[DLOG_CONS];
     log_current_line[DLOG_MAIN] = lvl >= log_level[DLOG_MAIN];
@@ -496,15 +1015,82 @@ void log_msg_begin(loglevel_t lvl, const char *msg) noexcept
 
     for (int i = 0; i < 2; i++) {
         do_log_part(i, "dinit: ");
-        do_log_part(i, msg);
     }
 }
 
+// Log a multi-part message beginning
+void log_msg_begin(loglevel_t lvl, const char *msg) noexcept
+{
+    do_log_begin(lvl);
+    log_journal.begin(lvl, nullptr);
+    log_msg_part(msg);
+}
+
+// Log the beginning of a multi-part message concerning a particular service (without rate limiting)
+static void do_svc_msg_begin(loglevel_t lvl, const char *svc_name, bool name_prefix) noexcept
+{
+    do_log_begin(lvl);
+    if (name_prefix) {
+        for (int i = 0; i < 2; i++) {
+            do_log_part(i, svc_name);
+            do_log_part(i, ": ");
+        }
+    }
+    log_journal.begin(lvl, svc_name);
+}
+
+// Log the beginning of a multi-part message concerning a particular service
+void log_svc_msg_begin(loglevel_t lvl, const char *svc_name, bool name_prefix) noexcept
+{
+    // A message which won't be logged to any stream isn't subject to the rate limit (it is not worth
+    // tracking the rate of such messages):
+    bool is_logged = lvl >= log_level[DLOG_CONS] || lvl >= log_level[DLOG_MAIN]
+            || log_journal.is_recorded(lvl);
+    if (is_logged && ! log_rate.check(svc_name, lvl)) {
+        // Suppressed; the remaining parts of the message will be ignored:
+        log_current_line[DLOG_CONS] = false;
+        log_current_line[DLOG_MAIN] = false;
+        return;
+    }
+    do_svc_msg_begin(lvl, svc_name, name_prefix);
+}
+
+dasynq::rearm log_rate_limiter::timer_expiry(eventloop_t &, int expiry_count) noexcept
+{
+    timer_armed = false;
+    uint64_t now = current_ms();
+
+    for (auto i = rates.begin(); i != rates.end(); ) {
+        bool idle = true;
+        for (int lvl = 0; lvl < num_log_levels; lvl++) {
+            bucket &b = i->second.levels[lvl];
+            if (b.suppressed != 0) {
+                do_svc_msg_begin((loglevel_t)lvl, i->first.c_str(), true);
+                log_msg_part((int)std::min(b.suppressed, (unsigned)INT_MAX));
+                log_msg_end(" log message(s) suppressed (rate limit exceeded)");
+                b.suppressed = 0;
+            }
+            accrue(b, now);
+            idle = idle && (b.tokens == log_rate_burst);
+        }
+        // Forget services which haven't logged messages recently:
+        i = idle ? rates.erase(i) : std::next(i);
+    }
+
+    if (! rates.empty()) {
+        arm_timer_rel(event_loop, dasynq::time_val(log_rate_report_secs, 0));
+        timer_armed = true;
+    }
+
+    return dasynq::rearm::NOOP;
+}
+
 // Continue a multi-part log message
 void log_msg_part(const char *msg) noexcept
 {
     do_log_part(DLOG_CONS, msg);
     do_log_part(DLOG_MAIN, msg);
+    log_journal.append(msg);
 }
 
 // Complete a multi-part log message
@@ -515,22 +1101,30 @@ void log_msg_end(const char *msg) noexcept
         do_log_part(i, "\n");
         do_log_commit(i);
     }
+    log_journal.append(msg);
+    log_journal.commit();
 }
 
 void log_service_started(const char *service_name) noexcept
 {
+    if (! log_rate.check(service_name, loglevel_t::INFO)) return;
     do_log_cons("[  OK  ] ", service_name, "\n");
     do_log_main("dinit: service ", service_name, " started.\n");
+    log_journal.record(loglevel_t::INFO, service_name, "started");
 }
 
 void log_service_failed(const char *service_name) noexcept
 {
+    if (! log_rate.check(service_name, loglevel_t::INFO)) return;
     do_log_cons("[FAILED] ", service_name, "\n");
     do_log_main("dinit: service ", service_name, " failed to start.\n");
+    log_journal.record(loglevel_t::INFO, service_name, "failed to start");
 }
 
 void log_service_stopped(const char *service_name) noexcept
 {
+    if (! log_rate.check(service_name, loglevel_t::INFO)) return;
     do_log_cons("[STOPPD] ", service_name, "\n");
     do_log_main("dinit: service ", service_name, " stopped.\n");
+    log_journal.record(loglevel_t::INFO, service_name, "stopped");
 }
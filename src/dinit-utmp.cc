@@ -0,0 +1,93 @@
+#include "dinit-utmp.h"
+
+// Deferred utmp database updates. See dinit-utmp.h.
+
+utmp_queue_t utmp_queue;
+
+#if USE_UTMPX
+
+namespace {
+    // Check whether the database already has an entry for the given id/line that was written by the
+    // process itself (eg. by login, which turns the entry into a LOGIN_PROCESS or USER_PROCESS entry).
+    // A deferred entry for the process must not then replace it.
+    bool process_has_entry(const char *utmp_id, const char *utmp_line, pid_t pid)
+    {
+        struct utmpx record;
+        memset(&record, 0, sizeof(record));
+        record.ut_type = INIT_PROCESS;
+        strncpy(record.ut_id, utmp_id, sizeof(record.ut_id));
+        strncpy(record.ut_line, utmp_line, sizeof(record.ut_line));
+
+        setutxent();
+        struct utmpx *result = (*utmp_id) ? getutxid(&record) : getutxline(&record);
+        bool r = result != nullptr && result->ut_pid == pid && result->ut_type != INIT_PROCESS;
+        endutxent();
+
+        return r;
+    }
+}
+
+void utmp_queue_t::queue(bool create, const char *utmp_id, const char *utmp_line, pid_t pid) noexcept
+{
+    utmp_update update;
+    update.create = create;
+    update.pid = pid;
+    strncpy(update.id, utmp_id, sizeof(update.id));
+    strncpy(update.line, utmp_line, sizeof(update.line));
+
+    if (writable) {
+        perform(update);
+        return;
+    }
+
+    // Remove any pending update for the same entry. If it creates the entry, a clear can record the
+    // process ID directly (the entry won't be present to take it from).
+    for (auto i = pending.begin(); i != pending.end(); ++i) {
+        if (strncmp(i->id, update.id, sizeof(update.id)) == 0
+                && strncmp(i->line, update.line, sizeof(update.line)) == 0) {
+            if (! create && i->create) {
+                update.pid = i->pid;
+            }
+            pending.erase(i);
+            break;
+        }
+    }
+
+    try {
+        pending.push_back(update);
+    }
+    catch (std::bad_alloc &) {
+        // Can't defer; perform the update now instead (we have just removed an entry, if there was
+        // one for the same id/line, so order is maintained).
+        perform(update);
+    }
+}
+
+void utmp_queue_t::perform(const utmp_update &update) noexcept
+{
+    if (update.create) {
+        create_utmp_entry(update.id, update.line, update.pid);
+    }
+    else {
+        clear_utmp_entry(update.id, update.line, update.pid);
+    }
+}
+
+void utmp_queue_t::set_writable() noexcept
+{
+    writable = true;
+    flush();
+}
+
+void utmp_queue_t::flush() noexcept
+{
+    for (const utmp_update &update : pending) {
+        if (update.create && process_has_entry(update.id, update.line, update.pid)) {
+            continue;
+        }
+        perform(update);
+    }
+    pending.clear();
+}
+
+#endif
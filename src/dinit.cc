@@ -10,6 +10,7 @@
 #include <sys/stat.h>
 #include <sys/un.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <pwd.h>
@@ -22,6 +23,9 @@
 #if defined(__FreeBSD__) || defined(__DragonFly__)
 #include <sys/procctl.h>
 #endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include "dinit.h"
 #include "dasynq.h"
@@ -32,6 +36,12 @@
 #include "static-string.h"
 #include "dinit-utmp.h"
 #include "options-processing.h"
+#include "notify-socket.h"
+#include "status-table.h"
+#include "dir-watcher.h"
+#include "boot-history.h"
+#include "log-journal.h"
+#include "readahead.h"
 
 #include "mconfig.h"
 
@@ -60,6 +70,11 @@ static void sigterm_cb(eventloop_t &eloop) noexcept;
 static void open_control_socket(bool report_ro_failure = true) noexcept;
 static void close_control_socket() noexcept;
 static void confirm_restart_boot() noexcept;
+static void write_stop_times() noexcept;
+static void log_previous_stop_times() noexcept;
+static void write_boot_history() noexcept;
+static void lock_memory(size_t pool_size) noexcept;
+static void make_path_absolute(const char *&path, std::string &path_str);
 
 static void control_socket_cb(eventloop_t *loop, int fd);
 
@@ -80,12 +95,33 @@ int active_control_conns = 0;
 // to allocate storage, but control_socket_path is the authoritative value.
 static const char *control_socket_path = SYSCONTROLSOCKET;
 static std::string control_socket_str;
+static bool control_socket_seqpacket = false; // use SOCK_SEQPACKET rather than SOCK_STREAM
 
 static const char *env_file_path = "/etc/dinit/environment";
 
 static const char *log_path = "/dev/log";
 static bool log_is_syslog = true; // if false, log is a file
 
+// File to which service stop times are written at shutdown (and read/logged at next boot)
+static const char *stop_times_path = nullptr;
+static bool did_log_stop_times = false;
+
+// File to which service start times are appended, once boot has completed (and the root filesystem
+// is writable)
+static const char *boot_history_path = nullptr;
+static std::string boot_history_str;
+static bool boot_is_complete = false;
+static bool rootfs_rw = false;
+static bool did_write_boot_history = false;
+
+// Grace period (in milliseconds, as a string) for processes to terminate at final shutdown, passed
+// to the shutdown program via its --term-grace option; null for the shutdown program's default
+static const char *shutdown_term_grace = nullptr;
+
+// Structured log journal file (see log-journal.h):
+static const char *log_journal_path = nullptr;
+static std::string log_journal_str;
+
 // Set to true (when console_input_watcher is active) if console input becomes available
 static bool console_input_ready = false;
 
@@ -189,6 +225,14 @@ int dinit_main(int argc, char **argv)
     bool control_socket_path_set = false;
     bool env_file_set = false;
     bool log_specified = false;
+    long shutdown_timeout = 0;
+    bool watch_services = false;
+    bool lazy_soft_deps = false;
+    unsigned long log_journal_max_kib = log_journal_default_max_kib;
+    const char *readahead_path = nullptr;
+    unsigned readahead_record_time = 30;  // seconds
+    bool do_lock_memory = false;
+    unsigned long lock_pool_kib = 1024;
 
     service_dir_opt service_dir_opts;
 
@@ -244,6 +288,24 @@ int dinit_main(int argc, char **argv)
                         return 1;
                     }
                 }
+                else if (strcmp(argv[i], "--socket-type") == 0) {
+                    if (++i < argc) {
+                        if (strcmp(argv[i], "stream") == 0) {
+                            control_socket_seqpacket = false;
+                        }
+                        else if (strcmp(argv[i], "seqpacket") == 0) {
+                            control_socket_seqpacket = true;
+                        }
+                        else {
+                            cerr << "dinit: '--socket-type' must be 'stream' or 'seqpacket'" << endl;
+                            return 1;
+                        }
+                    }
+                    else {
+                        cerr << "dinit: '--socket-type' requires an argument" << endl;
+                        return 1;
+                    }
+                }
                 else if (strcmp(argv[i], "--log-file") == 0 || strcmp(argv[i], "-l") == 0) {
                     if (++i < argc) {
                         log_path = argv[i];
@@ -255,6 +317,125 @@ int dinit_main(int argc, char **argv)
                         return 1;
                     }
                 }
+                else if (strcmp(argv[i], "--shutdown-timeout") == 0) {
+                    if (++i < argc) {
+                        char *endptr;
+                        long secs = strtol(argv[i], &endptr, 10);
+                        if (*endptr != 0 || endptr == argv[i] || secs < 0 || secs > 86400) {
+                            cerr << "dinit: '--shutdown-timeout' requires a number of seconds (0-86400)"
+                                    << endl;
+                            return 1;
+                        }
+                        shutdown_timeout = secs;
+                    }
+                    else {
+                        cerr << "dinit: '--shutdown-timeout' requires an argument" << endl;
+                        return 1;
+                    }
+                }
+                else if (strcmp(argv[i], "--shutdown-term-grace") == 0) {
+                    if (++i < argc) {
+                        char *endptr;
+                        long ms = strtol(argv[i], &endptr, 10);
+                        if (*endptr != 0 || endptr == argv[i] || ms < 0 || ms > 3600000) {
+                            cerr << "dinit: '--shutdown-term-grace' requires a number of milliseconds "
+                                    "(0-3600000)" << endl;
+                            return 1;
+                        }
+                        shutdown_term_grace = argv[i];
+                    }
+                    else {
+                        cerr << "dinit: '--shutdown-term-grace' requires an argument" << endl;
+                        return 1;
+                    }
+                }
+                else if (strcmp(argv[i], "--stop-times-file") == 0) {
+                    if (++i < argc) {
+                        stop_times_path = argv[i];
+                    }
+                    else {
+                        cerr << "dinit: '--stop-times-file' requires an argument" << endl;
+                        return 1;
+                    }
+                }
+                else if (strcmp(argv[i], "--boot-history-file") == 0) {
+                    if (++i < argc) {
+                        boot_history_path = argv[i];
+                    }
+                    else {
+                        cerr << "dinit: '--boot-history-file' requires an argument" << endl;
+                        return 1;
+                    }
+                }
+                else if (strcmp(argv[i], "--log-journal") == 0) {
+                    if (++i < argc) {
+                        log_journal_path = argv[i];
+                    }
+                    else {
+                        cerr << "dinit: '--log-journal' requires an argument" << endl;
+                        return 1;
+                    }
+                }
+                else if (strcmp(argv[i], "--log-journal-max-size") == 0) {
+                    if (++i < argc) {
+                        char *endp;
+                        log_journal_max_kib = strtoul(argv[i], &endp, 10);
+                        if (*endp != 0 || endp == argv[i] || log_journal_max_kib > 1024 * 1024) {
+                            cerr << "dinit: '--log-journal-max-size' requires a size in KiB (at most 1048576)" << endl;
+                            return 1;
+                        }
+                    }
+                    else {
+                        cerr << "dinit: '--log-journal-max-size' requires an argument" << endl;
+                        return 1;
+                    }
+                }
+                else if (strcmp(argv[i], "--readahead-profile") == 0) {
+                    if (++i < argc) {
+                        readahead_path = argv[i];
+                    }
+                    else {
+                        cerr << "dinit: '--readahead-profile' requires an argument" << endl;
+                        return 1;
+                    }
+                }
+                else if (strcmp(argv[i], "--readahead-record-time") == 0) {
+                    if (++i < argc) {
+                        char *endp;
+                        readahead_record_time = strtoul(argv[i], &endp, 10);
+                        if (*endp != 0 || endp == argv[i]) {
+                            cerr << "dinit: '--readahead-record-time' requires a number of seconds" << endl;
+                            return 1;
+                        }
+                    }
+                    else {
+                        cerr << "dinit: '--readahead-record-time' requires an argument" << endl;
+                        return 1;
+                    }
+                }
+                else if (strcmp(argv[i], "--lock-memory") == 0) {
+                    do_lock_memory = true;
+                }
+                else if (strcmp(argv[i], "--lock-memory-pool") == 0) {
+                    if (++i < argc) {
+                        char *endp;
+                        lock_pool_kib = strtoul(argv[i], &endp, 10);
+                        if (*endp != 0 || endp == argv[i] || lock_pool_kib > 1024 * 1024) {
+                            cerr << "dinit: '--lock-memory-pool' requires a size in KiB (at most 1048576)" << endl;
+                            return 1;
+                        }
+                    }
+                    else {
+                        cerr << "dinit: '--lock-memory-pool' requires an argument" << endl;
+                        return 1;
+                    }
+                }
+                else if (strcmp(argv[i], "--watch-services") == 0) {
+                    watch_services = true;
+                }
+                else if (strcmp(argv[i], "--lazy-soft-deps") == 0) {
+                    lazy_soft_deps = true;
+                }
                 else if (strcmp(argv[i], "--quiet") == 0 || strcmp(argv[i], "-q") == 0) {
                     console_service_status = false;
                     log_level[DLOG_CONS] = loglevel_t::ZERO;
@@ -273,7 +454,31 @@ int dinit_main(int argc, char **argv)
                             " --container, -o              run in container mode (do not manage system)\n"
                             " --socket-path <path>, -p <path>\n"
                             "                              path to control socket\n"
+                            " --socket-type <type>         control socket type: stream (default) or\n"
+                            "                              seqpacket\n"
                             " --log-file <file>, -l <file> log to the specified file\n"
+                            " --shutdown-timeout <secs>    kill service processes if services have not\n"
+                            "                              stopped this long after shutdown begins\n"
+                            " --shutdown-term-grace <ms>   time for remaining processes to exit after\n"
+                            "                              TERM at final shutdown (default 1000)\n"
+                            " --stop-times-file <file>     record service stop times at shutdown (and\n"
+                            "                              log them at next start)\n"
+                            " --boot-history-file <file>   record service start times during boot\n"
+                            " --log-journal <file>         record log messages in a structured journal\n"
+                            " --log-journal-max-size <KiB> size at which to rotate the journal\n"
+                            "                              (default 4096; 0 for no limit)\n"
+                            " --readahead-profile <file>   read files listed in profile into cache at\n"
+                            "                              boot; or, if none, record a new profile\n"
+                            " --readahead-record-time <secs>\n"
+                            "                              time to record readahead profile (default 30)\n"
+                            " --lock-memory                lock dinit's memory, preventing it being paged\n"
+                            "                              out under memory pressure\n"
+                            " --lock-memory-pool <KiB>     size of heap pool prefaulted and locked with\n"
+                            "                              --lock-memory (default 1024)\n"
+                            " --watch-services             watch service directories for changed\n"
+                            "                              service descriptions\n"
+                            " --lazy-soft-deps             load soft dependencies only when the\n"
+                            "                              dependent service starts\n"
                             " --quiet, -q                  disable output to standard output\n"
                             " <service-name> [...]         start service with name <service-name>\n";
                     return 0;
@@ -374,6 +579,13 @@ int dinit_main(int argc, char **argv)
         // (If not PID 1, we instead just let SIGQUIT perform the default action.)
     }
 
+    // The service status table is exported via a file alongside the control socket (once that
+    // can be created):
+    service_status_table.set_path(std::string(control_socket_path) + ".status");
+    if (! service_status_table.init()) {
+        log(loglevel_t::WARN, "Could not allocate service status table");
+    }
+
     // Try to open control socket (may fail due to readonly filesystem)
     open_control_socket(false);
     
@@ -399,18 +611,55 @@ int dinit_main(int argc, char **argv)
 
     service_dir_opts.build_paths(am_system_init);
 
+    // The readiness notification socket lives alongside the control socket:
+    notify_socket.set_path(std::string(control_socket_path) + ".notify");
+
     /* start requested services */
     services = new dirload_service_set(std::move(service_dir_opts.get_paths()));
+    services->set_shutdown_time_limit(time_val(shutdown_timeout, 0));
+    services->set_lazy_soft_deps(lazy_soft_deps);
+    // These paths are reported to clients (dinitctl), so make them absolute:
+    make_path_absolute(boot_history_path, boot_history_str);
+    make_path_absolute(log_journal_path, log_journal_str);
+    services->set_boot_history_path(boot_history_path);
+    set_log_journal_path(log_journal_path);
+    set_log_journal_max_size(log_journal_max_kib);
+
+    if (watch_services) {
+        dir_watcher.start(services);
+    }
 
     init_log(services, log_is_syslog);
     if (am_system_init) {
         log(loglevel_t::INFO, false, "Starting system");
     }
+
+    if (do_lock_memory) {
+        lock_memory(lock_pool_kib * 1024);
+    }
     
     // Only try to set up the external log now if we aren't the system init. (If we are the
     // system init, wait until the log service starts).
     if (! am_system_init && log_specified) setup_external_log();
 
+    // Similarly, if we are the system init, the stop times file may not be accessible until the root
+    // filesystem is writable.
+    if (! am_system_init) {
+        log_previous_stop_times();
+        rootfs_rw = true;
+        readahead_profile.set_rootfs_writable();
+        open_log_journal();
+        utmp_queue.set_writable();
+    }
+
+    if (readahead_path != nullptr) {
+        readahead_profile.start(readahead_path, readahead_record_time);
+    }
+
+    if (boot_history_path != nullptr) {
+        services->begin_recording_start_times();
+    }
+
     if (env_file != nullptr) {
         read_env_file(env_file);
     }
@@ -424,16 +673,33 @@ int dinit_main(int argc, char **argv)
             // exit if user process).
         }
         catch (service_not_found &snf) {
-            log(loglevel_t::ERROR, snf.service_name, ": Could not find service description.");
+            log_service_msg(loglevel_t::ERROR, snf.service_name, "Could not find service description.");
         }
         catch (service_load_exc &sle) {
-            log(loglevel_t::ERROR, sle.service_name, ": ", sle.exc_description);
+            log_service_msg(loglevel_t::ERROR, sle.service_name, sle.exc_description);
         }
         catch (std::bad_alloc &badalloce) {
             log(loglevel_t::ERROR, "Out of memory when trying to start service: ", svc, ".");
             break;
         }
     }
+
+    services->boot_services_started();
+
+    // utmp updates are held until the root filesystem is marked writable (by a service with the
+    // "starts-rwfs" option). If there is no such service, they must not be held indefinitely:
+    if (am_system_init && ! rootfs_rw) {
+        bool have_rw_ready = false;
+        for (auto *sr : services->list_services()) {
+            if (sr->get_flags().rw_ready) {
+                have_rw_ready = true;
+                break;
+            }
+        }
+        if (! have_rw_ready) {
+            utmp_queue.set_writable();
+        }
+    }
     
     run_event_loop:
     
@@ -460,6 +726,10 @@ int dinit_main(int argc, char **argv)
             log_msg_end(" Will power down.");
         }
     }
+
+    if (services->is_shutting_down()) {
+        write_stop_times();
+    }
     
     log_flush_timer.reset();
     log_flush_timer.arm_timer_rel(event_loop, timespec{5,0}); // 5 seconds
@@ -468,6 +738,12 @@ int dinit_main(int argc, char **argv)
     }
     
     close_control_socket();
+    notify_socket.close_socket();
+    dir_watcher.stop();
+    readahead_profile.stop();
+    service_status_table.close_file();
+    close_log_journal();
+    utmp_queue.flush();
     
     if (am_system_mgr) {
         if (shutdown_type == shutdown_type_t::NONE) {
@@ -506,7 +782,13 @@ int dinit_main(int argc, char **argv)
         }
         
         // Fork and execute dinit-reboot.
-        execl(shutdown_exec.c_str(), shutdown_exec.c_str(), "--system", cmd_arg, nullptr);
+        if (shutdown_term_grace != nullptr) {
+            execl(shutdown_exec.c_str(), shutdown_exec.c_str(), "--system", cmd_arg, "--term-grace",
+                    shutdown_term_grace, nullptr);
+        }
+        else {
+            execl(shutdown_exec.c_str(), shutdown_exec.c_str(), "--system", cmd_arg, nullptr);
+        }
         log(loglevel_t::ERROR, error_exec_sd, strerror(errno));
         
         // PID 1 must not actually exit, although we should never reach this point:
@@ -654,6 +936,73 @@ static void confirm_restart_boot() noexcept
     fcntl(STDIN_FILENO, F_SETFL, origFlags);
 }
 
+// Prefault and lock dinit's memory (code, data, heap and stack) so that it is not paged out under
+// memory pressure, when it may be most needed. A heap pool of the given size is prefaulted before
+// locking; with glibc, the allocator is configured to retain freed memory and not to use separate
+// mappings for large allocations, so that later allocations are served from the (locked) pool.
+static void lock_memory(size_t pool_size) noexcept
+{
+    constexpr size_t stack_prefault_size = 128 * 1024;
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0) page_size = 4096;
+
+#ifdef __GLIBC__
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+#endif
+
+    // Prefault the heap pool (via a volatile pointer, so that the writes are not elided):
+    volatile char *pool = (volatile char *) malloc(pool_size);
+    if (pool != nullptr) {
+        for (size_t i = 0; i < pool_size; i += page_size) {
+            pool[i] = 0;
+        }
+        free((void *) pool);
+    }
+    else if (pool_size != 0) {
+        log(loglevel_t::WARN, "Could not allocate memory pool for locking");
+    }
+
+    // Prefault the stack:
+    volatile char stack_area[stack_prefault_size];
+    for (size_t i = 0; i < stack_prefault_size; i += page_size) {
+        stack_area[i] = 0;
+    }
+    (void) stack_area;
+
+    // Lock (and populate) all current mappings. Future mappings are also locked; where supported,
+    // only as they are faulted in, so that eg large new mappings are not populated immediately.
+#ifdef MCL_ONFAULT
+    if (mlockall(MCL_CURRENT) == -1 || mlockall(MCL_FUTURE | MCL_ONFAULT) == -1) {
+#else
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+#endif
+        log(loglevel_t::WARN, "Could not lock memory: ", strerror(errno));
+        return;
+    }
+
+#ifdef __linux__
+    // Report the locked footprint:
+    try {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (starts_with(line, "VmLck:")) {
+                auto i = line.find_first_not_of(" \t", 6);
+                if (i != std::string::npos) {
+                    log(loglevel_t::INFO, "Locked memory: ", line.substr(i));
+                    return;
+                }
+            }
+        }
+    }
+    catch (std::exception &) {
+        // (fall through)
+    }
+#endif
+    log(loglevel_t::INFO, "Locked memory");
+}
+
 // Callback for control socket
 static void control_socket_cb(eventloop_t *loop, int sockfd)
 {
@@ -667,7 +1016,8 @@ static void control_socket_cb(eventloop_t *loop, int sockfd)
 
     if (newfd != -1) {
         try {
-            new control_conn_t(*loop, services, newfd);  // will delete itself when it's finished
+            // will delete itself when it's finished:
+            new control_conn_t(*loop, services, newfd, control_socket_seqpacket);
         }
         catch (std::exception &exc) {
             log(loglevel_t::ERROR, "Accepting control connection: ", exc.what());
@@ -683,6 +1033,183 @@ void rootfs_is_rw() noexcept
     if (! did_log_boot) {
         did_log_boot = log_boot();
     }
+    utmp_queue.set_writable();
+    log_previous_stop_times();
+    rootfs_rw = true;
+    readahead_profile.set_rootfs_writable();
+    open_log_journal();
+    if (boot_is_complete) {
+        write_boot_history();
+    }
+}
+
+// Callback when boot is complete, i.e. when all services started at boot have started (or failed to
+// start). Only called if service start times are being recorded.
+void boot_completed() noexcept
+{
+    boot_is_complete = true;
+    if (rootfs_rw) {
+        write_boot_history();
+    }
+}
+
+// Make a (non-null) path absolute, relative to the current directory, storing the result in the given
+// string. May throw std::bad_alloc.
+static void make_path_absolute(const char *&path, std::string &path_str)
+{
+    if (path == nullptr || path[0] == '/') return;
+
+    std::vector<char> cwd_buf(256);
+    char *cwd;
+    while ((cwd = getcwd(cwd_buf.data(), cwd_buf.size())) == nullptr && errno == ERANGE) {
+        cwd_buf.resize(cwd_buf.size() * 2);
+    }
+    if (cwd != nullptr) {
+        path_str = std::string(cwd) + "/" + path;
+        path = path_str.c_str();
+    }
+}
+
+// Discard the readahead profile, so that a new one is recorded at next boot (via the control
+// protocol). Returns false if no profile is in use or it couldn't be removed.
+bool regenerate_readahead_profile() noexcept
+{
+    return readahead_profile.regenerate();
+}
+
+// Write the stop times of services (recorded during shutdown) to the stop times file, if one was
+// specified. The first line contains the total time taken, in milliseconds; each subsequent line
+// gives the time taken for a service to stop and the time (since shutdown began) at which it
+// stopped, also in milliseconds, followed by the service name. Services are listed from slowest to
+// stop to fastest.
+static void write_stop_times() noexcept
+{
+    using namespace std;
+
+    if (stop_times_path == nullptr) return;
+
+    auto to_ms = [](const time_val &tv) -> long {
+        return tv.seconds() * 1000 + tv.nseconds() / 1000000;
+    };
+
+    try {
+        vector<service_stop_time> stop_times = services->get_stop_times();
+        long total_ms = 0;
+        for (auto &st : stop_times) {
+            total_ms = max(total_ms, to_ms(st.stopped_at));
+        }
+        stable_sort(stop_times.begin(), stop_times.end(),
+                [](const service_stop_time &a, const service_stop_time &b) {
+                    return b.stop_time < a.stop_time;
+                });
+
+        ofstream stop_times_file(stop_times_path, ios::out | ios::trunc);
+        stop_times_file << total_ms << "\n";
+        for (auto &st : stop_times) {
+            stop_times_file << to_ms(st.stop_time) << " " << to_ms(st.stopped_at) << " " << st.name
+                    << "\n";
+        }
+        stop_times_file.close();
+        if (! stop_times_file) {
+            log(loglevel_t::WARN, "Couldn't write service stop times to ", stop_times_path);
+        }
+    }
+    catch (std::exception &) {
+        log(loglevel_t::WARN, "Couldn't write service stop times to ", stop_times_path);
+    }
+}
+
+// Log a summary of the service stop times from the previous shutdown (if they were recorded), and
+// remove the stop times file.
+static void log_previous_stop_times() noexcept
+{
+    using namespace std;
+
+    const int max_logged = 5;
+
+    if (stop_times_path == nullptr || did_log_stop_times) return;
+
+    try {
+        ifstream stop_times_file(stop_times_path);
+        if (! stop_times_file) return;
+        did_log_stop_times = true;
+
+        long total_ms;
+        if (! (stop_times_file >> total_ms)) return;
+
+        log_msg_begin(loglevel_t::INFO, "Services stopped in ");
+        log_msg_part(total_ms);
+        log_msg_part("ms at previous shutdown");
+
+        long stop_ms, stopped_at_ms;
+        string name;
+        int count = 0;
+        while (count < max_logged && stop_times_file >> stop_ms >> stopped_at_ms >> name) {
+            log_msg_part(count == 0 ? "; slowest: " : ", ");
+            log_msg_part(name);
+            log_msg_part(" (");
+            log_msg_part(stop_ms);
+            log_msg_part("ms)");
+            count++;
+        }
+        log_msg_end(".");
+
+        stop_times_file.close();
+        unlink(stop_times_path);
+    }
+    catch (std::exception &) {
+        // Not important enough to report.
+    }
+}
+
+// Append the start times of services recorded during boot to the boot history file (if one was
+// specified), discarding the oldest boots from the history if necessary. See boot-history.h.
+static void write_boot_history() noexcept
+{
+    using namespace std;
+
+    if (boot_history_path == nullptr || did_write_boot_history) return;
+    did_write_boot_history = true;
+
+    auto to_ms = [](const time_val &tv) -> uint32_t {
+        return tv.seconds() * 1000 + tv.nseconds() / 1000000;
+    };
+
+    string tmp_path;
+    try {
+        vector<boot_record> boots;
+        ifstream history_in(boot_history_path, ios::in | ios::binary);
+        if (history_in) {
+            read_boot_history(history_in, boots);
+            history_in.close();
+        }
+
+        boot_record rec;
+        rec.timestamp = time(nullptr);
+        rec.total_ms = to_ms(services->get_boot_duration());
+        for (auto &st : services->get_start_times()) {
+            rec.services.push_back({st.name, to_ms(st.start_time)});
+        }
+        boots.push_back(std::move(rec));
+        if (boots.size() > max_boot_history) {
+            boots.erase(boots.begin(), boots.begin() + (boots.size() - max_boot_history));
+        }
+
+        // Write the new history to a temporary file and replace the original, so that the history
+        // is not lost if interrupted:
+        tmp_path = string(boot_history_path) + ".new";
+        ofstream history_out(tmp_path, ios::out | ios::binary | ios::trunc);
+        write_boot_history(history_out, boots);
+        history_out.close();
+        if (! history_out || rename(tmp_path.c_str(), boot_history_path) == -1) {
+            log(loglevel_t::WARN, "Couldn't write boot history to ", boot_history_path);
+            unlink(tmp_path.c_str());
+        }
+    }
+    catch (std::exception &) {
+        log(loglevel_t::WARN, "Couldn't write boot history to ", boot_history_path);
+        if (! tmp_path.empty()) unlink(tmp_path.c_str());
+    }
 }
 
 // Open/create the control socket, normally /dev/dinitctl, used to allow client programs to connect
@@ -721,7 +1248,8 @@ static void open_control_socket(bool report_ro_failure) noexcept
         name->sun_family = AF_UNIX;
         memcpy(name->sun_path, saddrname, saddrname_len + 1);
 
-        int sockfd = dinit_socket(AF_UNIX, SOCK_STREAM, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        int sock_type = control_socket_seqpacket ? SOCK_SEQPACKET : SOCK_STREAM;
+        int sockfd = dinit_socket(AF_UNIX, sock_type, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (sockfd == -1) {
             log(loglevel_t::ERROR, "Error creating control socket: ", strerror(errno));
             free(name);
@@ -763,6 +1291,10 @@ static void open_control_socket(bool report_ro_failure) noexcept
             close(sockfd);
         }
     }
+
+    if (control_socket_open) {
+        service_status_table.open_file();
+    }
 }
 
 static void close_control_socket() noexcept
@@ -808,7 +1340,7 @@ void setup_external_log() noexcept
                 // the file descriptor so we will be notified when it's ready. In other words we can
                 // basically use it anyway.
                 try {
-                    setup_main_log(sockfd);
+                    setup_main_log(sockfd, true);
                     external_log_open = true;
                 }
                 catch (std::exception &e) {
@@ -857,7 +1389,13 @@ static void sigquit_cb(eventloop_t &eloop) noexcept
 {
     // This performs an immediate shutdown, without service rollback.
     close_control_socket();
-    execl(shutdown_exec.c_str(), shutdown_exec.c_str(), "--system", (char *) 0);
+    if (shutdown_term_grace != nullptr) {
+        execl(shutdown_exec.c_str(), shutdown_exec.c_str(), "--system", "--term-grace",
+                shutdown_term_grace, (char *) 0);
+    }
+    else {
+        execl(shutdown_exec.c_str(), shutdown_exec.c_str(), "--system", (char *) 0);
+    }
     log(loglevel_t::ERROR, error_exec_sd, strerror(errno));
     sync(); // since a hard poweroff might be required at this point...
 }
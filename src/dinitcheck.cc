@@ -6,6 +6,12 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <set>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -24,6 +30,9 @@
 using string = std::string;
 using string_iterator = std::string::iterator;
 
+// Maximum number of threads used to load service descriptions:
+constexpr unsigned max_threads = 8;
+
 // prelim_dep: A preliminary (unresolved) service dependency
 class prelim_dep
 {
@@ -45,20 +54,199 @@ public:
 
     std::string name;
     std::list<prelim_dep> dependencies;
+    std::vector<service_record *> dep_records;  // resolved dependencies (those that loaded)
+
+    // Used for strongly-connected component (cycle) detection:
+    int index = -1;
+    int lowlink = -1;
+    bool on_stack = false;
+    int scc = -1;
+};
+
+// The result of loading a single service description. Descriptions may be loaded by worker threads,
+// so errors are collected here to be output once all services have been loaded.
+class load_result
+{
+public:
+    service_record *record = nullptr;  // the loaded service, or nullptr if loading failed
+    std::string filename;              // path of the service description file
+    std::string messages;              // error messages
+    bool errors = false;
+    std::chrono::steady_clock::duration load_time {};
+};
+
+service_record *load_service(const std::string &name, const service_dir_pathlist &service_dirs,
+        load_result &result);
+
+// Loads service descriptions (and, transitively, the descriptions of their dependencies) using a
+// number of worker threads.
+class service_loader
+{
+    const service_dir_pathlist &service_dirs;
+    std::map<std::string, load_result> &results;
+
+    std::mutex lock;
+    std::condition_variable queue_cv;
+    std::deque<std::string> queue;  // services yet to be loaded
+    int busy = 0;                   // number of workers currently loading a service
+
+    void load(const std::string &name, load_result &result)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+        try {
+            result.record = load_service(name, service_dirs, result);
+        }
+        catch (service_load_exc &exc) {
+            result.messages += "Unable to load service '" + name + "': " + exc.exc_description + "\n";
+            result.errors = true;
+        }
+        catch (std::bad_alloc &exc) {
+            result.messages += "Unable to load service '" + name + "': Out of memory\n";
+            result.errors = true;
+        }
+        result.load_time = std::chrono::steady_clock::now() - start_time;
+    }
+
+public:
+    service_loader(const service_dir_pathlist &service_dirs_p, std::map<std::string, load_result> &results_p)
+            : service_dirs(service_dirs_p), results(results_p) { }
+
+    // Queue a service to be loaded, if it has not already been queued. Must be called with the
+    // lock held, or before any workers have been started.
+    void add(const std::string &name)
+    {
+        if (results.count(name) == 0) {
+            results[name];
+            queue.push_back(name);
+        }
+    }
+
+    // Load services until there are none left to load.
+    void run_worker()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            if (queue.empty()) {
+                if (busy == 0) return;
+                queue_cv.wait(guard);
+                continue;
+            }
+
+            std::string name = std::move(queue.front());
+            queue.pop_front();
+            ++busy;
+            guard.unlock();
 
-    bool visited = false;  // flag used to detect cyclic dependencies
-    bool cycle_free = false;
+            load_result result;
+            load(name, result);
+
+            guard.lock();
+            --busy;
+            if (result.record != nullptr) {
+                for (auto &dep : result.record->dependencies) {
+                    add(dep.name);
+                }
+            }
+            results[name] = std::move(result);
+            queue_cv.notify_all();
+        }
+    }
 };
 
-using service_set_t = std::map<std::string, service_record *>;
+// Find the strongly-connected components of the dependency graph (Tarjan's algorithm), adding
+// each component which forms a cycle to 'cycles'. Runs in time linear in the size of the graph.
+static void find_cycles(service_record *root, int &next_index, std::vector<service_record *> &scc_stack,
+        std::vector<std::vector<service_record *>> &cycles)
+{
+    // (iterative, to avoid deep recursion for long dependency chains)
+    std::vector<std::pair<service_record *, size_t>> call_stack;
+
+    auto visit = [&](service_record *sr) {
+        sr->index = sr->lowlink = next_index++;
+        scc_stack.push_back(sr);
+        sr->on_stack = true;
+        call_stack.emplace_back(sr, 0);
+    };
+
+    visit(root);
+
+    while (! call_stack.empty()) {
+        service_record *sr = call_stack.back().first;
+        size_t &dep_idx = call_stack.back().second;
+
+        if (dep_idx < sr->dep_records.size()) {
+            service_record *dep = sr->dep_records[dep_idx++];
+            if (dep->index == -1) {
+                visit(dep);
+            }
+            else if (dep->on_stack) {
+                sr->lowlink = std::min(sr->lowlink, dep->index);
+            }
+            continue;
+        }
 
-service_record *load_service(service_set_t &services, const std::string &name,
-        const service_dir_pathlist &service_dirs);
+        call_stack.pop_back();
+        if (! call_stack.empty()) {
+            service_record *parent = call_stack.back().first;
+            parent->lowlink = std::min(parent->lowlink, sr->lowlink);
+        }
 
-// Add some missing standard library functionality...
-template <typename T> bool contains(std::vector<T> vec, const T& elem)
+        if (sr->lowlink == sr->index) {
+            // sr is the root of a strongly-connected component, consisting of it and the services
+            // above it on the stack.
+            std::vector<service_record *> component;
+            service_record *member;
+            do {
+                member = scc_stack.back();
+                scc_stack.pop_back();
+                member->on_stack = false;
+                member->scc = sr->index;
+                component.push_back(member);
+            } while (member != sr);
+
+            if (component.size() > 1
+                    || std::find(sr->dep_records.begin(), sr->dep_records.end(), sr) != sr->dep_records.end()) {
+                cycles.emplace_back(std::move(component));
+            }
+        }
+    }
+}
+
+// Find a cycle through the given service, via the other members of its strongly-connected component.
+static std::vector<service_record *> trace_cycle(service_record *start)
+{
+    // Breadth-first search (restricted to the component) for a path back to the start:
+    std::map<service_record *, service_record *> parent;
+    std::deque<service_record *> to_visit { start };
+    service_record *last = nullptr;
+
+    while (last == nullptr && ! to_visit.empty()) {
+        service_record *sr = to_visit.front();
+        to_visit.pop_front();
+        for (service_record *dep : sr->dep_records) {
+            if (dep == start) {
+                last = sr;
+                break;
+            }
+            if (dep->scc == start->scc && parent.count(dep) == 0) {
+                parent[dep] = sr;
+                to_visit.push_back(dep);
+            }
+        }
+    }
+
+    std::vector<service_record *> cycle;
+    for (service_record *sr = last; sr != start; sr = parent[sr]) {
+        cycle.push_back(sr);
+    }
+    cycle.push_back(start);
+    std::reverse(cycle.begin(), cycle.end());
+    return cycle;
+}
+
+static double to_millis(std::chrono::steady_clock::duration d)
 {
-    return std::find(vec.begin(), vec.end(), elem) != vec.end();
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
 }
 
 static bool errors_found = false;
@@ -69,6 +257,7 @@ int main(int argc, char **argv)
 
     service_dir_opt service_dir_opts;
     bool am_system_init = (getuid() == 0);
+    bool show_stats = false;
 
     std::vector<std::string> services_to_check;
 
@@ -86,12 +275,16 @@ int main(int argc, char **argv)
                         return 1;
                     }
                 }
+                else if (strcmp(argv[i], "--stats") == 0) {
+                    show_stats = true;
+                }
                 else if (strcmp(argv[i], "--help") == 0) {
                     cout << "dinitcheck: check dinit service descriptions\n"
                             " --help                       display help\n"
                             " --services-dir <dir>, -d <dir>\n"
                             "                              set base directory for service description\n"
                             "                              files\n"
+                            " --stats                      show load time per service and graph size\n"
                             " <service-name>               check service with name <service-name>\n";
                     return EXIT_SUCCESS;
                 }
@@ -114,97 +307,110 @@ int main(int argc, char **argv)
 
     size_t num_services_to_check = services_to_check.size();
 
-    // Load named service(s)
-    // - load the service, store dependencies as strings
-    // - recurse
+    // Load named service(s) and, transitively, their dependencies. This is done in parallel by a
+    // number of worker threads.
 
-    std::map<std::string, service_record *> service_set;
+    std::map<std::string, load_result> results;
+    service_loader loader(service_dir_opts.get_paths(), results);
+    for (auto &name : services_to_check) {
+        loader.add(name);
+    }
 
-    for (size_t i = 0; i < services_to_check.size(); ++i) {
-        const std::string &name = services_to_check[i];
-        std::cout << "Checking service: " << name << "...\n";
+    auto load_start = std::chrono::steady_clock::now();
+
+    unsigned num_threads = std::min(std::max(std::thread::hardware_concurrency(), 1u), max_threads);
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < num_threads; i++) {
         try {
-            service_record *sr = load_service(service_set, name, service_dir_opts.get_paths());
-            service_set[name] = sr;
-            // add dependencies to services_to_check
-            for (auto &dep : sr->dependencies) {
-                if (service_set.count(dep.name) == 0 && !contains(services_to_check, dep.name)) {
-                    services_to_check.push_back(dep.name);
-                }
-            }
+            workers.emplace_back(&service_loader::run_worker, &loader);
         }
-        catch (service_load_exc &exc) {
-            std::cerr << "Unable to load service '" << name << "': " << exc.exc_description << "\n";
-            errors_found = true;
+        catch (std::system_error &) {
+            break; // make do with the threads we have
         }
     }
+    loader.run_worker();
+    for (auto &worker : workers) {
+        worker.join();
+    }
 
-    // Check for circular dependencies
-    std::vector<std::tuple<service_record *, size_t>> service_chain;
-
-    for (size_t i = 0; i < num_services_to_check; ++i) {
-        service_record *root = service_set[services_to_check[i]];
-        if (! root) continue;
-        if (root->visited) continue;
+    auto load_duration = std::chrono::steady_clock::now() - load_start;
 
-        // invariant: service_chain is empty
-        service_chain.emplace_back(root, 0);
+    // Report results in order (breadth-first from the named services), independent of the order in
+    // which the services were actually loaded:
+    std::set<std::string> seen(services_to_check.begin(), services_to_check.end());
+    size_t num_deps = 0;
+    for (size_t i = 0; i < services_to_check.size(); ++i) {
+        const std::string &name = services_to_check[i];
+        load_result &result = results[name];
+        std::cout << "Checking service: " << name << "...\n";
+        std::cerr << result.messages;
+        errors_found |= result.errors;
+        if (result.record == nullptr) continue;
 
-        // Depth first traversal. If we find a link (dependency) on a service already visited (but not
-        // marked as cycle-free), we know then that we've found a cycle.
-        while (true) {
-            auto n = service_chain.size() - 1;
-            auto &last = service_chain[n];
-            service_record *last_record = std::get<0>(last);
-            size_t &index = std::get<1>(last);
-            if (index >= last_record->dependencies.size()) {
-                // Processed all dependencies, go back up:
-                last_record->cycle_free = true;
-                service_chain.pop_back();
-                if (n == 0) break;
-                size_t &prev_index = std::get<1>(service_chain[n - 1]);
-                ++prev_index;
-                continue;
+        for (auto &dep : result.record->dependencies) {
+            if (seen.insert(dep.name).second) {
+                services_to_check.push_back(dep.name);
             }
-            // Down the tree:
-            auto dep_it = std::next(last_record->dependencies.begin(), index);
-            service_record *next_link = service_set[dep_it->name];
-            if (next_link == nullptr) {
-                ++index;
-                continue;
-            }
-            if (next_link->visited) {
-                if (! next_link->cycle_free) {
-                    // We've found a cycle. Clear entries before the beginning of the cycle, then
-                    // exit the loop.
-                    auto first = std::find_if(service_chain.begin(), service_chain.end(),
-                            [next_link](std::tuple<service_record *, size_t> &a) -> bool {
-                       return std::get<0>(a) == next_link;
-                    });
-                    service_chain.erase(service_chain.begin(), first);
-                    break;
-                }
+            service_record *dep_record = results[dep.name].record;
+            if (dep_record != nullptr) {
+                result.record->dep_records.push_back(dep_record);
+                ++num_deps;
             }
-            next_link->visited = true;
-            service_chain.emplace_back(next_link, 0);
         }
+    }
 
-        // Report only one cycle; otherwise difficult to avoid reporting duplicates or overlapping
-        // cycles.
-        if (!service_chain.empty()) break;
+    // Check for circular dependencies
+    std::vector<std::vector<service_record *>> cycles;
+    std::vector<service_record *> scc_stack;
+    int next_index = 0;
+
+    for (size_t i = 0; i < num_services_to_check; ++i) {
+        service_record *root = results[services_to_check[i]].record;
+        if (root != nullptr && root->index == -1) {
+            find_cycles(root, next_index, scc_stack, cycles);
+        }
     }
 
-    if (!service_chain.empty()) {
+    for (auto &component : cycles) {
+        // Report a cycle starting from the component member that was reached first:
+        service_record *first = *std::min_element(component.begin(), component.end(),
+                [](service_record *a, service_record *b) { return a->index < b->index; });
+        std::vector<service_record *> cycle = trace_cycle(first);
+
         errors_found = true;
         std::cerr << "Found dependency cycle:\n";
-        for (auto chain_link : service_chain) {
-            std::cerr << "    " << std::get<0>(chain_link)->name << " ->\n";
+        for (service_record *sr : cycle) {
+            std::cerr << "    " << sr->name << " ->\n";
+        }
+        std::cerr << "    " << cycle[0]->name << ".\n";
+        if (component.size() > cycle.size()) {
+            std::cerr << "  (the cycle is part of a group of " << component.size()
+                    << " mutually dependent services)\n";
         }
-        std::cerr << "    " << std::get<0>(service_chain[0])->name << ".\n";
     }
 
     // TODO additional: check chain-to, other lint
 
+    if (show_stats) {
+        std::cout << "Statistics:\n";
+        std::streamsize prec = std::cout.precision(3);
+        std::cout << std::fixed;
+        for (auto &name : services_to_check) {
+            load_result &result = results[name];
+            std::cout << "    " << name << ": " << to_millis(result.load_time) << " ms";
+            if (! result.filename.empty()) {
+                std::cout << " (" << result.filename << ")";
+            }
+            std::cout << "\n";
+        }
+        std::cout << "    Services: " << services_to_check.size() << ", dependencies: " << num_deps
+                << ", dependency cycles: " << cycles.size() << "\n";
+        std::cout << "    Total load time: " << to_millis(load_duration) << " ms (" << (workers.size() + 1)
+                << " thread(s))\n";
+        std::cout.precision(prec);
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
     if (! errors_found) {
         std::cout << "No problems found.\n";
     }
@@ -215,28 +421,30 @@ int main(int argc, char **argv)
     return errors_found ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-static void report_service_description_err(const std::string &service_name, const std::string &what)
+static void report_service_description_err(load_result &result, const std::string &service_name,
+        const std::string &what)
 {
-    std::cerr << "Service '" << service_name << "': " << what << "\n";
-    errors_found = true;
+    result.messages += "Service '" + service_name + "': " + what + "\n";
+    result.errors = true;
 }
 
-static void report_service_description_exc(service_description_exc &exc)
+static void report_service_description_exc(load_result &result, service_description_exc &exc)
 {
-    report_service_description_err(exc.service_name, exc.exc_description);
+    report_service_description_err(result, exc.service_name, exc.exc_description);
 }
 
-static void report_error(std::system_error &exc, const std::string &service_name)
+static void report_error(load_result &result, std::system_error &exc, const std::string &service_name)
 {
-    std::cerr << "Service '" << service_name << "', error reading service description: " << exc.what() << "\n";
-    errors_found = true;
+    result.messages += "Service '" + service_name + "', error reading service description: " + exc.what()
+            + "\n";
+    result.errors = true;
 }
 
-static void report_dir_error(const char *service_name, const std::string &dirpath)
+static void report_dir_error(load_result &result, const char *service_name, const std::string &dirpath)
 {
-    std::cerr << "Service '" << service_name << "', error reading dependencies from directory " << dirpath
-            << ": " << strerror(errno) << "\n";
-    errors_found = true;
+    result.messages += std::string("Service '") + service_name + "', error reading dependencies from directory "
+            + dirpath + ": " + strerror(errno) + "\n";
+    result.errors = true;
 }
 
 // Process a dependency directory - filenames contained within correspond to service names which
@@ -244,7 +452,7 @@ static void report_dir_error(const char *service_name, const std::string &dirpat
 // containing symbolic links to other service descriptions, but this isn't required.
 // Failure to read the directory contents, or to find a service listed within, is not considered
 // a fatal error.
-static void process_dep_dir(const char *servicename,
+static void process_dep_dir(load_result &result, const char *servicename,
         const string &service_filename,
         std::list<prelim_dep> &deplist, const std::string &depdirpath,
         dependency_type dep_type)
@@ -253,7 +461,7 @@ static void process_dep_dir(const char *servicename,
 
     DIR *depdir = opendir(depdir_fname.c_str());
     if (depdir == nullptr) {
-        report_dir_error(servicename, depdirpath);
+        report_dir_error(result, servicename, depdirpath);
         return;
     }
 
@@ -268,27 +476,24 @@ static void process_dep_dir(const char *servicename,
     }
 
     if (errno != 0) {
-        report_dir_error(servicename, depdirpath);
+        report_dir_error(result, servicename, depdirpath);
     }
 
     closedir(depdir);
 }
 
-service_record *load_service(service_set_t &services, const std::string &name,
-        const service_dir_pathlist &service_dirs)
+// Lock for user/group database lookups (getpwnam()/getgrnam() are not thread-safe)
+static std::mutex user_db_lock;
+
+service_record *load_service(const std::string &name, const service_dir_pathlist &service_dirs,
+        load_result &result)
 {
     using namespace std;
     using namespace dinit_load;
 
-    auto found = services.find(name);
-    if (found != services.end()) {
-        return found->second;
-    }
-
     string service_filename;
     ifstream service_file;
 
-    // Couldn't find one. Have to load it.
     for (auto &service_dir : service_dirs) {
         service_filename = service_dir.get_dir();
         if (*(service_filename.rbegin()) != '/') {
@@ -300,46 +505,104 @@ service_record *load_service(service_set_t &services, const std::string &name,
         if (service_file) break;
     }
 
+    // If there's no description for the service itself, it may be an instance of a template:
+    string template_name;
+    string instance_arg;
+    bool is_instance = false;
     if (! service_file) {
-        throw service_not_found(string(name));
+        if (split_instance_name(name, template_name, instance_arg)) {
+            for (auto &service_dir : service_dirs) {
+                service_filename = combine_paths(service_dir.get_dir(), template_name.c_str());
+                service_file.open(service_filename.c_str(), ios::in);
+                if (service_file) break;
+            }
+        }
+        if (! service_file) {
+            throw service_not_found(string(name));
+        }
+        is_instance = true;
     }
 
+    result.filename = service_filename;
+
     service_settings_wrapper<prelim_dep> settings;
 
     string line;
     service_file.exceptions(ios::badbit);
 
+    auto process_dep_dir_n = [&](std::list<prelim_dep> &deplist, const std::string &waitsford,
+            dependency_type dep_type) -> void {
+        process_dep_dir(result, name.c_str(), service_filename, deplist, waitsford, dep_type);
+    };
+
+    auto load_service_n = [&](const string &dep_name) -> const string & {
+        return dep_name;
+    };
+
+    // For an instance, the template is processed (and then instantiated):
+    service_template templ;
+
     try {
-        process_service_file(name, service_file,
-                [&](string &line, string &setting, string_iterator &i, string_iterator &end) -> void {
+        auto process_line = [&](string &line, string &setting, string_iterator &i, string_iterator &end) -> void {
 
-            auto process_dep_dir_n = [&](std::list<prelim_dep> &deplist, const std::string &waitsford,
-                    dependency_type dep_type) -> void {
-                process_dep_dir(name.c_str(), service_filename, deplist, waitsford, dep_type);
+            auto process_line_n = [&]() -> void {
+                if (is_instance) {
+                    process_template_line(templ, template_name.c_str(), line, setting, i, end);
+                }
+                else {
+                    process_service_line(settings, name.c_str(), line, setting, i, end, load_service_n,
+                            process_dep_dir_n);
+                }
             };
 
-            auto load_service_n = [&](const string &dep_name) -> const string & {
-                return dep_name;
-            };
+            try {
+                if (setting == "run-as" || setting == "socket-uid" || setting == "socket-gid") {
+                    std::lock_guard<std::mutex> guard(user_db_lock);
+                    process_line_n();
+                }
+                else {
+                    process_line_n();
+                }
+            }
+            catch (service_description_exc &exc) {
+                report_service_description_exc(result, exc);
+            }
+        };
+
+        process_service_file(is_instance ? template_name : name, service_file, process_line);
 
+        if (is_instance) {
             try {
-                process_service_line(settings, name.c_str(), line, setting, i, end, load_service_n, process_dep_dir_n);
+                instantiate_template(templ, name.c_str(), instance_arg, settings, load_service_n,
+                        process_dep_dir_n);
             }
             catch (service_description_exc &exc) {
-                report_service_description_exc(exc);
+                report_service_description_exc(result, exc);
             }
-        });
+        }
     }
     catch (std::system_error &sys_err)
     {
-        report_error(sys_err, name);
+        report_error(result, sys_err, name);
         throw service_description_exc(name, "Error while reading service description.");
     }
 
     settings.finalise();
 
+    try {
+        check_sched_settings(name, settings.sched);
+    }
+    catch (service_description_exc &exc) {
+        report_service_description_exc(result, exc);
+    }
+
     if (settings.service_type != service_type_t::INTERNAL && settings.command.length() == 0) {
-        report_service_description_err(name, "Service command not specified.");
+        report_service_description_err(result, name, "Service command not specified.");
+    }
+
+    if ((settings.watchdog_timeout.tv_sec != 0 || settings.watchdog_timeout.tv_nsec != 0)
+            && ! settings.readiness_socket) {
+        report_service_description_err(result, name, "watchdog-timeout requires ready-notification = socket.");
     }
 
     return new service_record(name, settings.depends);
@@ -7,13 +7,19 @@
 #include <system_error>
 #include <memory>
 #include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <limits>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
 #include <signal.h>
 #include <pwd.h>
 
@@ -23,6 +29,8 @@
 #include "dinit-client.h"
 #include "load-service.h"
 #include "dinit-util.h"
+#include "boot-history.h"
+#include "log-journal.h"
 #include "mconfig.h"
 
 // dinitctl:  utility to control the Dinit daemon, including starting and stopping of services.
@@ -39,9 +47,18 @@ static int issue_load_service(int socknum, const char *service_name, bool find_o
 static int check_load_reply(int socknum, cpbuffer_t &, handle_t *handle_p, service_state_t *state_p);
 static int start_stop_service(int socknum, cpbuffer_t &, const char *service_name, command_t command,
         bool do_pin, bool do_force, bool wait_for_service, bool verbose);
+static int start_stop_services(int socknum, cpbuffer_t &, const std::vector<std::string> &service_names,
+        command_t command, bool do_pin, bool do_force, bool wait_for_service, bool verbose, bool batch);
+static int service_status(int socknum, cpbuffer_t &, const std::vector<std::string> &service_names);
+static int subscribe_events(int socknum, cpbuffer_t &, const char *pattern, unsigned event_mask);
 static int unpin_service(int socknum, cpbuffer_t &, const char *service_name, bool verbose);
 static int unload_service(int socknum, cpbuffer_t &, const char *service_name, bool verbose);
 static int reload_service(int socknum, cpbuffer_t &, const char *service_name, bool verbose);
+static int reload_changed(int socknum, cpbuffer_t &, bool verbose);
+static int boot_history(int socknum, cpbuffer_t &, unsigned threshold);
+static int regen_readahead(int socknum, cpbuffer_t &, bool verbose);
+static int control_stats(int socknum, cpbuffer_t &);
+static int show_log_journal(int socknum, cpbuffer_t &, const char *service_name, time_t since, time_t until);
 static int list_services(int socknum, cpbuffer_t &);
 static int shutdown_dinit(int soclknum, cpbuffer_t &);
 static int add_remove_dependency(int socknum, cpbuffer_t &rbuffer, bool add, const char *service_from,
@@ -70,13 +87,65 @@ enum class command_t {
     UNLOAD_SERVICE,
     RELOAD_SERVICE,
     LIST_SERVICES,
+    SERVICE_STATUS,
     SHUTDOWN,
     ADD_DEPENDENCY,
     RM_DEPENDENCY,
     ENABLE_SERVICE,
-    DISABLE_SERVICE
+    DISABLE_SERVICE,
+    SUBSCRIBE,
+    BOOT_HISTORY,
+    REGEN_READAHEAD,
+    CONTROL_STATS,
+    SHOW_LOG
 };
 
+// Names of service events (as used for subscription), indexed by service_event_t value.
+static const char * const event_names[] = { "started", "stopped", "failed", "start-cancelled",
+        "stop-cancelled" };
+
+// Add a service name to a list, unless it is already present.
+static void add_service_name(std::vector<std::string> &names, std::string &&name)
+{
+    if (std::find(names.begin(), names.end(), name) == names.end()) {
+        names.push_back(std::move(name));
+    }
+}
+
+// Parse a time given as seconds since the epoch, or as a local date and time ("YYYY-MM-DD", optionally
+// followed by " HH:MM" or " HH:MM:SS"). Returns false if the time is not valid.
+static bool parse_log_time(const char *str, time_t &t)
+{
+    char *endp;
+    if (*str >= '0' && *str <= '9') {
+        unsigned long long secs = strtoull(str, &endp, 10);
+        if (*endp == 0) {
+            t = (time_t)secs;
+            return true;
+        }
+    }
+
+    const char * const formats[] = { "%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d" };
+    for (const char *format : formats) {
+        struct tm tm = {};
+        endp = strptime(str, format, &tm);
+        if (endp != nullptr && *endp == 0) {
+            tm.tm_isdst = -1;
+            t = mktime(&tm);
+            return t != (time_t)-1;
+        }
+    }
+    return false;
+}
+
+// Check whether a command accepts multiple service names.
+static bool accepts_multiple(command_t command)
+{
+    return command == command_t::START_SERVICE || command == command_t::WAKE_SERVICE
+            || command == command_t::STOP_SERVICE || command == command_t::RESTART_SERVICE
+            || command == command_t::RELEASE_SERVICE || command == command_t::SERVICE_STATUS;
+}
+
 
 // Entry point.
 int main(int argc, char **argv)
@@ -86,6 +155,7 @@ int main(int argc, char **argv)
     bool show_help = argc < 2;
     const char *service_name = nullptr;
     const char *to_service_name = nullptr;
+    std::vector<std::string> service_names;  // for commands which accept multiple services
     dependency_type dep_type;
     bool dep_type_set = false;
     
@@ -97,11 +167,18 @@ int main(int argc, char **argv)
     bool wait_for_service = true;
     bool do_pin = false;
     bool do_force = false;
+    bool do_batch = false;
+    unsigned event_mask = 0;
+    bool reload_changed_svcs = false;
+    unsigned regression_threshold = 25;  // percent
+    const char *log_service = nullptr;
+    time_t log_since = 0;
+    time_t log_until = std::numeric_limits<time_t>::max();
     
     command_t command = command_t::NONE;
         
     for (int i = 1; i < argc; i++) {
-        if (argv[i][0] == '-') {
+        if (argv[i][0] == '-' && argv[i][1] != 0) {
             if (strcmp(argv[i], "--help") == 0) {
                 show_help = true;
                 break;
@@ -109,6 +186,9 @@ int main(int argc, char **argv)
             else if (strcmp(argv[i], "--no-wait") == 0) {
                 wait_for_service = false;
             }
+            else if (strcmp(argv[i], "--wait") == 0) {
+                wait_for_service = true;
+            }
             else if (strcmp(argv[i], "--quiet") == 0) {
                 verbose = false;
             }
@@ -142,6 +222,56 @@ int main(int argc, char **argv)
                     && (strcmp(argv[i], "--force") == 0 || strcmp(argv[i], "-f") == 0)) {
                 do_force = true;
             }
+            else if (accepts_multiple(command) && command != command_t::SERVICE_STATUS
+                    && strcmp(argv[i], "--batch") == 0) {
+                do_batch = true;
+            }
+            else if (command == command_t::RELOAD_SERVICE && strcmp(argv[i], "--changed") == 0) {
+                reload_changed_svcs = true;
+            }
+            else if (command == command_t::BOOT_HISTORY && strcmp(argv[i], "--threshold") == 0) {
+                ++i;
+                char *endp = nullptr;
+                if (i < argc) {
+                    regression_threshold = strtoul(argv[i], &endp, 10);
+                }
+                if (i == argc || endp == argv[i] || *endp != 0) {
+                    cerr << "dinitctl: --threshold should be followed by a percentage" << std::endl;
+                    return 1;
+                }
+            }
+            else if (command == command_t::SHOW_LOG && strcmp(argv[i], "--service") == 0) {
+                ++i;
+                if (i == argc) {
+                    cerr << "dinitctl: --service should be followed by a service name" << std::endl;
+                    return 1;
+                }
+                log_service = argv[i];
+            }
+            else if (command == command_t::SHOW_LOG && (strcmp(argv[i], "--since") == 0
+                    || strcmp(argv[i], "--until") == 0)) {
+                const char *opt = argv[i];
+                ++i;
+                if (i == argc || ! parse_log_time(argv[i], (opt[2] == 's') ? log_since : log_until)) {
+                    cerr << "dinitctl: " << opt << " should be followed by a time (YYYY-MM-DD "
+                            "[HH:MM[:SS]], or seconds since the epoch)" << std::endl;
+                    return 1;
+                }
+            }
+            else if (command == command_t::SUBSCRIBE && strcmp(argv[i], "--event") == 0) {
+                ++i;
+                unsigned j = 0;
+                while (i < argc && j < sizeof(event_names) / sizeof(event_names[0])
+                        && strcmp(argv[i], event_names[j]) != 0) {
+                    ++j;
+                }
+                if (i == argc || j == sizeof(event_names) / sizeof(event_names[0])) {
+                    cerr << "dinitctl: --event should be followed by an event type (started, stopped, "
+                            "failed, start-cancelled, stop-cancelled)" << std::endl;
+                    return 1;
+                }
+                event_mask |= (1u << j);
+            }
             else {
                 cerr << "dinitctl: unrecognized/invalid option: " << argv[i] << " (use --help for help)\n";
                 return 1;
@@ -175,6 +305,9 @@ int main(int argc, char **argv)
             else if (strcmp(argv[i], "list") == 0) {
                 command = command_t::LIST_SERVICES;
             }
+            else if (strcmp(argv[i], "status") == 0) {
+                command = command_t::SERVICE_STATUS;
+            }
             else if (strcmp(argv[i], "shutdown") == 0) {
                 command = command_t::SHUTDOWN;
             }
@@ -190,6 +323,21 @@ int main(int argc, char **argv)
             else if (strcmp(argv[i], "disable") == 0) {
                 command = command_t::DISABLE_SERVICE;
             }
+            else if (strcmp(argv[i], "subscribe") == 0) {
+                command = command_t::SUBSCRIBE;
+            }
+            else if (strcmp(argv[i], "boot-history") == 0) {
+                command = command_t::BOOT_HISTORY;
+            }
+            else if (strcmp(argv[i], "regen-readahead") == 0) {
+                command = command_t::REGEN_READAHEAD;
+            }
+            else if (strcmp(argv[i], "control-stats") == 0) {
+                command = command_t::CONTROL_STATS;
+            }
+            else if (strcmp(argv[i], "log") == 0) {
+                command = command_t::SHOW_LOG;
+            }
             else {
                 cerr << "dinitctl: unrecognized command: " << argv[i] << " (use --help for help)\n";
                 return 1;
@@ -232,18 +380,36 @@ int main(int argc, char **argv)
                 }
                 to_service_name = argv[i];
             }
+            else if (accepts_multiple(command)) {
+                if (strcmp(argv[i], "-") == 0) {
+                    // Read service names (whitespace-separated) from standard input
+                    std::string name;
+                    while (cin >> name) {
+                        add_service_name(service_names, std::move(name));
+                    }
+                }
+                else {
+                    add_service_name(service_names, argv[i]);
+                }
+            }
             else {
                 if (service_name != nullptr) {
                     show_help = true;
                     break;
                 }
                 service_name = argv[i];
-                // TODO support multiple services
             }
         }
     }
+
+    if (accepts_multiple(command) && ! service_names.empty()) {
+        service_name = service_names.front().c_str();
+    }
     
-    bool no_service_cmd = (command == command_t::LIST_SERVICES || command == command_t::SHUTDOWN);
+    bool no_service_cmd = (command == command_t::LIST_SERVICES || command == command_t::SHUTDOWN
+            || command == command_t::SUBSCRIBE || command == command_t::BOOT_HISTORY
+            || command == command_t::REGEN_READAHEAD || command == command_t::CONTROL_STATS
+            || command == command_t::SHOW_LOG || reload_changed_svcs);
 
     if (command == command_t::ENABLE_SERVICE || command == command_t::DISABLE_SERVICE) {
         show_help |= (to_service_name == nullptr);
@@ -252,7 +418,7 @@ int main(int argc, char **argv)
         show_help = true;
     }
 
-    if (service_name != nullptr && no_service_cmd) {
+    if (service_name != nullptr && no_service_cmd && command != command_t::SUBSCRIBE) {
         show_help = true;
     }
 
@@ -265,22 +431,30 @@ int main(int argc, char **argv)
         cout << "dinitctl:   control Dinit services\n"
           "\n"
           "Usage:\n"
-          "    dinitctl [options] start [options] <service-name>\n"
-          "    dinitctl [options] stop [options] <service-name>\n"
-          "    dinitctl [options] restart [options] <service-name>\n"
-          "    dinitctl [options] wake [options] <service-name>\n"
-          "    dinitctl [options] release [options] <service-name>\n"
+          "    dinitctl [options] start [options] <service-name>...\n"
+          "    dinitctl [options] stop [options] <service-name>...\n"
+          "    dinitctl [options] restart [options] <service-name>...\n"
+          "    dinitctl [options] wake [options] <service-name>...\n"
+          "    dinitctl [options] release [options] <service-name>...\n"
+          "    dinitctl [options] status <service-name>...\n"
           "    dinitctl [options] unpin <service-name>\n"
           "    dinitctl [options] unload <service-name>\n"
           "    dinitctl [options] reload <service-name>\n"
+          "    dinitctl [options] reload --changed\n"
           "    dinitctl [options] list\n"
           "    dinitctl [options] shutdown\n"
           "    dinitctl [options] add-dep <type> <from-service> <to-service>\n"
           "    dinitctl [options] rm-dep <type> <from-service> <to-service>\n"
           "    dinitctl [options] enable [--from <from-service>] <to-service>\n"
           "    dinitctl [options] disable [--from <from-service>] <to-service>\n"
+          "    dinitctl [options] subscribe [--event <event-type>]... [<service-pattern>]\n"
+          "    dinitctl [options] boot-history [--threshold <percent>]\n"
+          "    dinitctl [options] regen-readahead\n"
+          "    dinitctl [options] control-stats\n"
+          "    dinitctl [options] log [--service <service-name>] [--since <time>] [--until <time>]\n"
           "\n"
           "Note: An activated service continues running when its dependents stop.\n"
+          "Where multiple services may be specified, '-' reads service names from standard input.\n"
           "\n"
           "General options:\n"
           "  --help           : show this help\n"
@@ -291,9 +465,21 @@ int main(int argc, char **argv)
           "                   : specify socket for communication with daemon\n"
           "\n"
           "Command options:\n"
+          "  --wait           : wait for service startup/shutdown to complete (default)\n"
           "  --no-wait        : don't wait for service startup/shutdown to complete\n"
           "  --pin            : pin the service in the requested state\n"
-          "  --force          : force stop even if dependents will be affected\n";
+          "  --force          : force stop even if dependents will be affected\n"
+          "  --batch          : perform the operation on all services together, or (if it\n"
+          "                     cannot be performed for any service) not at all\n"
+          "  --changed        : reload all services whose descriptions have changed\n"
+          "  --threshold <percent>\n"
+          "                   : report services whose start time exceeds the baseline by\n"
+          "                     more than this percentage (default 25)\n"
+          "  --service <service-name>\n"
+          "                   : show only log messages concerning the specified service\n"
+          "  --since <time>, --until <time>\n"
+          "                   : show only log messages logged from/until the specified time\n"
+          "                     (YYYY-MM-DD [HH:MM[:SS]], or seconds since the epoch)\n";
         return 1;
     }
     
@@ -327,25 +513,8 @@ int main(int argc, char **argv)
         }
     }
     
-    int socknum = socket(AF_UNIX, SOCK_STREAM, 0);
+    int socknum = connect_to_daemon(control_socket_path);
     if (socknum == -1) {
-        perror("dinitctl: error opening socket");
-        return 1;
-    }
-
-    struct sockaddr_un * name;
-    uint sockaddr_size = offsetof(struct sockaddr_un, sun_path) + strlen(control_socket_path) + 1;
-    name = (struct sockaddr_un *) malloc(sockaddr_size);
-    if (name == nullptr) {
-        cerr << "dinitctl: Out of memory" << endl;
-        return 1;
-    }
-    
-    name->sun_family = AF_UNIX;
-    strcpy(name->sun_path, control_socket_path);
-    
-    int connr = connect(socknum, (struct sockaddr *) name, sockaddr_size);
-    if (connr == -1) {
         perror((std::string("dinitctl: connecting to socket ") + control_socket_path).c_str());
         return 1;
     }
@@ -361,15 +530,36 @@ int main(int argc, char **argv)
         else if (command == command_t::UNLOAD_SERVICE) {
             return unload_service(socknum, rbuffer, service_name, verbose);
         }
+        else if (command == command_t::RELOAD_SERVICE && reload_changed_svcs) {
+            return reload_changed(socknum, rbuffer, verbose);
+        }
         else if (command == command_t::RELOAD_SERVICE) {
             return reload_service(socknum, rbuffer, service_name, verbose);
         }
         else if (command == command_t::LIST_SERVICES) {
             return list_services(socknum, rbuffer);
         }
+        else if (command == command_t::SERVICE_STATUS) {
+            return service_status(socknum, rbuffer, service_names);
+        }
+        else if (command == command_t::SUBSCRIBE) {
+            return subscribe_events(socknum, rbuffer, service_name, event_mask);
+        }
         else if (command == command_t::SHUTDOWN) {
             return shutdown_dinit(socknum, rbuffer);
         }
+        else if (command == command_t::BOOT_HISTORY) {
+            return boot_history(socknum, rbuffer, regression_threshold);
+        }
+        else if (command == command_t::REGEN_READAHEAD) {
+            return regen_readahead(socknum, rbuffer, verbose);
+        }
+        else if (command == command_t::CONTROL_STATS) {
+            return control_stats(socknum, rbuffer);
+        }
+        else if (command == command_t::SHOW_LOG) {
+            return show_log_journal(socknum, rbuffer, log_service, log_since, log_until);
+        }
         else if (command == command_t::ADD_DEPENDENCY || command == command_t::RM_DEPENDENCY) {
             return add_remove_dependency(socknum, rbuffer, command == command_t::ADD_DEPENDENCY,
                     service_name, to_service_name, dep_type);
@@ -382,10 +572,14 @@ int main(int argc, char **argv)
             return enable_disable_service(socknum, rbuffer, service_name, to_service_name,
                     command == command_t::ENABLE_SERVICE);
         }
-        else {
+        else if (service_names.size() == 1) {
             return start_stop_service(socknum, rbuffer, service_name, command, do_pin, do_force,
                     wait_for_service, verbose);
         }
+        else {
+            return start_stop_services(socknum, rbuffer, service_names, command, do_pin, do_force,
+                    wait_for_service, verbose, do_batch);
+        }
     }
     catch (cp_old_client_exception &e) {
         std::cerr << "dinitctl: too old (server reports newer protocol version)" << std::endl;
@@ -421,7 +615,7 @@ static std::string read_string(int socknum, cpbuffer_t &rbuffer, uint32_t length
     uint32_t clen;
     do {
         rbuffer.reset();
-        rbuffer.fill(socknum);
+        cp_fill(rbuffer, socknum);
         char *bptr = rbuffer.get_ptr(0);
         clen = rbuffer.get_length();
         clen = std::min(clen, rlen);
@@ -484,7 +678,7 @@ static std::string get_service_name(int socknum, cpbuffer_t &rbuffer, handle_t h
 
     do {
         if (rbuffer.get_length() == 0) {
-            rbuffer.fill(socknum);
+            cp_fill(rbuffer, socknum);
         }
 
         size_t to_extract = std::min(size_t(rbuffer.get_length()), namesize - name.length());
@@ -573,14 +767,14 @@ static int start_stop_service(int socknum, cpbuffer_t &rbuffer, const char *serv
             }
             // size_t number, N * handle_t handles
             size_t number;
-            rbuffer.fill_to(socknum, sizeof(number));
+            cp_fill_to(rbuffer, socknum, sizeof(number));
             rbuffer.extract(&number, 0, sizeof(number));
             rbuffer.consume(sizeof(number));
             std::vector<handle_t> handles;
             handles.reserve(number);
             for (size_t i = 0; i < number; i++) {
                 handle_t handle;
-                rbuffer.fill_to(socknum, sizeof(handle_t));
+                cp_fill_to(rbuffer, socknum, sizeof(handle_t));
                 rbuffer.extract(&handle, 0, sizeof(handle));
                 handles.push_back(handle);
                 rbuffer.consume(sizeof(handle));
@@ -631,7 +825,7 @@ static int start_stop_service(int socknum, cpbuffer_t &rbuffer, const char *serv
     }
 
     // Wait until service started:
-    int r = rbuffer.fill_to(socknum, 2);
+    int r = cp_fill_to(rbuffer, socknum, 2);
     while (r > 0) {
         if (rbuffer[0] >= 100) {
             int pktlen = (unsigned char) rbuffer[1];
@@ -664,7 +858,7 @@ static int start_stop_service(int socknum, cpbuffer_t &rbuffer, const char *serv
             }
 
             rbuffer.consume(pktlen);
-            r = rbuffer.fill_to(socknum, 2);
+            r = cp_fill_to(rbuffer, socknum, 2);
         }
         else {
             // Not an information packet?
@@ -682,6 +876,518 @@ static int start_stop_service(int socknum, cpbuffer_t &rbuffer, const char *serv
     return 1;
 }
 
+// Maximum number of requests sent (pipelined) before reading replies, when operating on multiple
+// services.
+static constexpr size_t max_pipelined = 64;
+
+// A service being operated on by a multi-service command.
+struct service_op
+{
+    const std::string *name;
+    handle_t handle = 0;
+    service_state_t state = service_state_t::STOPPED;
+    service_state_t target_state = service_state_t::STOPPED;
+    bool loaded = false;      // successfully found/loaded (and not a duplicate)
+    bool waiting = false;     // waiting for a service event to signal completion
+    bool failed = false;
+    std::vector<handle_t> dependents;  // dependents preventing stop, if any
+};
+
+// State for matching service events to multiple service operations.
+struct multi_op_state
+{
+    std::vector<service_op> ops;
+    std::unordered_map<handle_t, size_t> op_for_handle;
+    size_t num_waiting = 0;
+    bool do_stop = false;
+    bool verbose = true;
+};
+
+// Process a service event (DINIT_IP_SERVICEEVENT packet, complete in the buffer) for a multi-service
+// operation.
+static void process_service_event(cpbuffer_t &rbuffer, multi_op_state &mstate)
+{
+    using namespace std;
+
+    handle_t ev_handle;
+    rbuffer.extract((char *) &ev_handle, 2, sizeof(ev_handle));
+    service_event_t event = static_cast<service_event_t>(rbuffer[2 + sizeof(ev_handle)]);
+
+    auto i = mstate.op_for_handle.find(ev_handle);
+    if (i == mstate.op_for_handle.end()) return;
+    service_op &op = mstate.ops[i->second];
+    if (! op.waiting) return;
+
+    bool do_stop = mstate.do_stop;
+    service_event_t completion_event = do_stop ? service_event_t::STOPPED : service_event_t::STARTED;
+    service_event_t cancelled_event = do_stop ? service_event_t::STOPCANCELLED
+            : service_event_t::STARTCANCELLED;
+
+    if (event == completion_event) {
+        if (mstate.verbose) {
+            cout << "Service '" << *op.name << "' " << describeState(do_stop) << "." << endl;
+        }
+    }
+    else if (event == cancelled_event) {
+        if (mstate.verbose) {
+            cout << "Service '" << *op.name << "' " << describeVerb(do_stop) << " cancelled." << endl;
+        }
+        op.failed = true;
+    }
+    else if (! do_stop && event == service_event_t::FAILEDSTART) {
+        if (mstate.verbose) {
+            cout << "Service '" << *op.name << "' failed to start." << endl;
+        }
+        op.failed = true;
+    }
+    else {
+        return;
+    }
+
+    op.waiting = false;
+    mstate.num_waiting--;
+}
+
+// Wait for a reply packet, processing any service event packets received in the meantime.
+static void wait_for_reply(cpbuffer_t &rbuffer, int socknum, multi_op_state &mstate)
+{
+    fill_buffer_to(rbuffer, socknum, 1);
+
+    while (rbuffer[0] >= 100) {
+        fill_buffer_to(rbuffer, socknum, 2);
+        int pktlen = (unsigned char) rbuffer[1];
+        fill_buffer_to(rbuffer, socknum, pktlen);
+        if (rbuffer[0] == DINIT_IP_SERVICEEVENT) {
+            process_service_event(rbuffer, mstate);
+        }
+        rbuffer.consume(pktlen);
+        fill_buffer_to(rbuffer, socknum, 1);
+    }
+}
+
+// Append a find/load request packet to a buffer of pipelined requests.
+static void append_load_request(int socknum, std::vector<char> &buf, const std::string &name,
+        bool find_only)
+{
+    uint16_t sname_len = name.length();
+    prepare_pipelined(socknum, buf, 1 + sizeof(sname_len) + sname_len);
+    buf.push_back(find_only ? DINIT_CP_FINDSERVICE : DINIT_CP_LOADSERVICE);
+    buf.insert(buf.end(), (char *) &sname_len, (char *) &sname_len + sizeof(sname_len));
+    buf.insert(buf.end(), name.begin(), name.end());
+}
+
+// Find or load all services for a multi-service operation. Requests are pipelined. Services which
+// cannot be found/loaded are reported (if report_missing is set) and marked failed.
+static void load_services(int socknum, cpbuffer_t &rbuffer, multi_op_state &mstate, bool find_only,
+        bool report_missing)
+{
+    using namespace std;
+
+    auto &ops = mstate.ops;
+    std::vector<char> buf;
+
+    for (size_t first = 0; first < ops.size(); first += max_pipelined) {
+        size_t last = std::min(ops.size(), first + max_pipelined);
+
+        buf.clear();
+        for (size_t i = first; i < last; i++) {
+            if (ops[i].name->empty() || ops[i].name->length() > 1024 - 3) {
+                cerr << "dinitctl: invalid service name: " << *ops[i].name << endl;
+                ops[i].failed = true;
+                continue;
+            }
+            append_load_request(socknum, buf, *ops[i].name, find_only);
+        }
+        if (buf.empty()) continue;
+        write_all_x(socknum, buf.data(), buf.size());
+
+        for (size_t i = first; i < last; i++) {
+            service_op &op = ops[i];
+            if (op.failed) continue;
+            wait_for_reply(rbuffer, socknum, mstate);
+            if (rbuffer[0] == DINIT_RP_SERVICERECORD) {
+                fill_buffer_to(rbuffer, socknum, 3 + sizeof(handle_t));
+                rbuffer.extract((char *) &op.handle, 2, sizeof(op.handle));
+                op.state = static_cast<service_state_t>(rbuffer[1]);
+                op.target_state = static_cast<service_state_t>(rbuffer[2 + sizeof(handle_t)]);
+                rbuffer.consume(3 + sizeof(handle_t));
+                op.loaded = true;
+                mstate.op_for_handle.emplace(op.handle, i);
+            }
+            else if (rbuffer[0] == DINIT_RP_NOSERVICE) {
+                rbuffer.consume(1);
+                if (report_missing) {
+                    cerr << "dinitctl: failed to find/load service: " << *op.name << endl;
+                }
+                op.failed = true;
+            }
+            else {
+                throw cp_read_exception(0);
+            }
+        }
+    }
+}
+
+// Process the reply (ACK, ALREADYSS or NAK) to a start/stop operation for a single service of a
+// multi-service operation. Returns false if the reply is not recognised.
+static bool process_op_reply(service_op &op, char reply, multi_op_state &mstate, command_t command,
+        bool wait_for_service)
+{
+    using namespace std;
+
+    if (reply == DINIT_RP_ALREADYSS) {
+        if (mstate.verbose) {
+            bool already = (op.state == (mstate.do_stop ? service_state_t::STOPPED
+                    : service_state_t::STARTED));
+            cout << "Service '" << *op.name << "' " << (already ? "(already) " : "")
+                    << describeState(mstate.do_stop) << "." << endl;
+        }
+    }
+    else if (reply == DINIT_RP_NAK) {
+        if (command == command_t::RESTART_SERVICE) {
+            cerr << "dinitctl: cannot restart service '" << *op.name << "'; service not started.\n";
+        }
+        else if (command == command_t::WAKE_SERVICE) {
+            cerr << "dinitctl: service '" << *op.name << "' has no active dependents (or system "
+                    "is shutting down), cannot wake.\n";
+        }
+        else {
+            cerr << "dinitctl: cannot " << describeVerb(mstate.do_stop) << " service '"
+                    << *op.name << "' (during shut down).\n";
+        }
+        op.failed = true;
+    }
+    else if (reply == DINIT_RP_ACK) {
+        if (wait_for_service) {
+            op.waiting = true;
+            mstate.num_waiting++;
+        }
+        else if (mstate.verbose) {
+            cout << "Issued " << describeVerb(mstate.do_stop) << " command for service '"
+                    << *op.name << "' successfully." << endl;
+        }
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Wait until no services of a multi-service operation are waiting for completion. Returns false if
+// an unexpected packet is received.
+static bool wait_for_services(int socknum, cpbuffer_t &rbuffer, multi_op_state &mstate)
+{
+    while (mstate.num_waiting != 0) {
+        fill_buffer_to(rbuffer, socknum, 2);
+        if (rbuffer[0] < 100) {
+            // Not an information packet?
+            return false;
+        }
+        int pktlen = (unsigned char) rbuffer[1];
+        fill_buffer_to(rbuffer, socknum, pktlen);
+        if (rbuffer[0] == DINIT_IP_SERVICEEVENT) {
+            process_service_event(rbuffer, mstate);
+        }
+        rbuffer.consume(pktlen);
+    }
+    return true;
+}
+
+// Maximum number of operations in a single batch request packet:
+static constexpr size_t max_batch_entries = (1024 - 2 - sizeof(uint16_t)) / (2 + sizeof(handle_t));
+
+// Start/stop multiple (already loaded) services as a single batch: the operations are either all
+// performed, together, or (if any cannot be performed) none are.
+static int start_stop_batch(int socknum, cpbuffer_t &rbuffer, multi_op_state &mstate, command_t command,
+        int pcommand, char flags, bool wait_for_service)
+{
+    using namespace std;
+
+    auto &ops = mstate.ops;
+    std::vector<size_t> batch_op_index;  // index into ops for each batch entry
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (ops[i].failed) {
+            // (already reported)
+            cerr << "dinitctl: batch not issued." << endl;
+            return 1;
+        }
+        if (ops[i].loaded) batch_op_index.push_back(i);
+    }
+
+    if (batch_op_index.size() > std::numeric_limits<uint16_t>::max()) {
+        cerr << "dinitctl: too many services for batch." << endl;
+        return 1;
+    }
+
+    // The batch may be split over several packets; all are written before the reply is read.
+    std::vector<char> buf;
+    for (size_t first = 0; first < batch_op_index.size(); first += max_batch_entries) {
+        size_t last = std::min(batch_op_index.size(), first + max_batch_entries);
+        uint16_t count = last - first;
+        char bflags = (last == batch_op_index.size()) ? 0 : 1;
+        auto m = membuf()
+                .append((char) DINIT_CP_STARTSTOPBATCH)
+                .append(bflags)
+                .append(count);
+        prepare_pipelined(socknum, buf, m.size() + count * (2 + sizeof(handle_t)));
+        buf.insert(buf.end(), m.data(), m.data() + m.size());
+        for (size_t i = first; i < last; i++) {
+            auto e = membuf()
+                    .append((char) pcommand)
+                    .append(flags)
+                    .append(ops[batch_op_index[i]].handle);
+            buf.insert(buf.end(), e.data(), e.data() + e.size());
+        }
+    }
+    write_all_x(socknum, buf.data(), buf.size());
+
+    wait_for_reply(rbuffer, socknum, mstate);
+    if (rbuffer[0] == DINIT_RP_BATCHREJECTED) {
+        // 2-byte index, 1-byte reason
+        fill_buffer_to(rbuffer, socknum, 2 + sizeof(uint16_t));
+        uint16_t index;
+        rbuffer.extract(&index, 1, sizeof(index));
+        int reason = rbuffer[1 + sizeof(index)];
+        rbuffer.consume(2 + sizeof(index));
+        if (index >= batch_op_index.size()) {
+            cerr << "dinitctl: protocol error." << endl;
+            return 1;
+        }
+
+        const std::string &name = *ops[batch_op_index[index]].name;
+        cerr << "dinitctl: cannot " << (command == command_t::RESTART_SERVICE ? "restart"
+                : describeVerb(mstate.do_stop)) << " service '" << name << "'";
+        switch (reason) {
+        case DINIT_BATCH_SHUTTING_DOWN:
+            cerr << " (during shut down)";
+            break;
+        case DINIT_BATCH_PINNED:
+            cerr << "; service is pinned " << describeState(! mstate.do_stop);
+            break;
+        case DINIT_BATCH_DEPENDENTS:
+            cerr << " due to dependents";
+            break;
+        case DINIT_BATCH_NOT_STARTED:
+            cerr << "; service not started";
+            break;
+        case DINIT_BATCH_NO_DEPENDENTS:
+            cerr << "; service has no active dependents";
+            break;
+        }
+        cerr << ".\ndinitctl: batch not performed." << endl;
+        return 1;
+    }
+    if (rbuffer[0] != DINIT_RP_BATCHDONE) {
+        cerr << "dinitctl: protocol error." << endl;
+        return 1;
+    }
+
+    // 2-byte count, 1-byte result per entry
+    fill_buffer_to(rbuffer, socknum, 1 + sizeof(uint16_t));
+    uint16_t count;
+    rbuffer.extract(&count, 1, sizeof(count));
+    rbuffer.consume(1 + sizeof(count));
+    if (count != batch_op_index.size()) {
+        cerr << "dinitctl: protocol error." << endl;
+        return 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        fill_buffer_to(rbuffer, socknum, 1);
+        char result = rbuffer[0];
+        rbuffer.consume(1);
+        service_op &op = ops[batch_op_index[i]];
+        if (result == DINIT_RP_NAK && (command == command_t::START_SERVICE
+                || command == command_t::WAKE_SERVICE)) {
+            cerr << "dinitctl: service '" << *op.name << "' failed to start." << endl;
+            op.failed = true;
+        }
+        else if (! process_op_reply(op, result, mstate, command, wait_for_service)) {
+            cerr << "dinitctl: protocol error." << endl;
+            return 1;
+        }
+    }
+
+    if (! wait_for_services(socknum, rbuffer, mstate)) {
+        cerr << "dinitctl: protocol error" << endl;
+        return 1;
+    }
+
+    for (service_op &op : ops) {
+        if (op.failed) return 1;
+    }
+    return 0;
+}
+
+// Start/stop multiple services. The load and start/stop requests are pipelined, and (if requested)
+// completion of all services is waited for concurrently.
+static int start_stop_services(int socknum, cpbuffer_t &rbuffer, const std::vector<std::string> &service_names,
+        command_t command, bool do_pin, bool do_force, bool wait_for_service, bool verbose, bool batch)
+{
+    using namespace std;
+
+    multi_op_state mstate;
+    mstate.do_stop = (command == command_t::STOP_SERVICE || command == command_t::RELEASE_SERVICE);
+    mstate.verbose = verbose;
+
+    auto &ops = mstate.ops;
+    ops.resize(service_names.size());
+    for (size_t i = 0; i < service_names.size(); i++) {
+        ops[i].name = &service_names[i];
+    }
+
+    load_services(socknum, rbuffer, mstate, false, true);
+
+    int pcommand = 0;
+    switch (command) {
+        case command_t::STOP_SERVICE:
+        case command_t::RESTART_SERVICE:  // stop, and then start
+            pcommand = DINIT_CP_STOPSERVICE;
+            break;
+        case command_t::RELEASE_SERVICE:
+            pcommand = DINIT_CP_RELEASESERVICE;
+            break;
+        case command_t::START_SERVICE:
+            pcommand = DINIT_CP_STARTSERVICE;
+            break;
+        case command_t::WAKE_SERVICE:
+            pcommand = DINIT_CP_WAKESERVICE;
+            break;
+        default: ;
+    }
+
+    char flags = (do_pin ? 1 : 0) | ((pcommand == DINIT_CP_STOPSERVICE && !do_force) ? 2 : 0);
+    if (command == command_t::RESTART_SERVICE) {
+        flags |= 4;
+    }
+
+    if (batch) {
+        return start_stop_batch(socknum, rbuffer, mstate, command, pcommand, flags, wait_for_service);
+    }
+
+    std::vector<char> buf;
+    bool any_dependents = false;
+
+    for (size_t first = 0; first < ops.size(); first += max_pipelined) {
+        size_t last = std::min(ops.size(), first + max_pipelined);
+
+        buf.clear();
+        for (size_t i = first; i < last; i++) {
+            if (! ops[i].loaded) continue;
+            auto m = membuf()
+                    .append((char) pcommand)
+                    .append(flags)
+                    .append(ops[i].handle);
+            prepare_pipelined(socknum, buf, m.size());
+            buf.insert(buf.end(), m.data(), m.data() + m.size());
+        }
+        if (buf.empty()) continue;
+        write_all_x(socknum, buf.data(), buf.size());
+
+        for (size_t i = first; i < last; i++) {
+            service_op &op = ops[i];
+            if (! op.loaded) continue;
+
+            wait_for_reply(rbuffer, socknum, mstate);
+            auto reply_pkt_h = rbuffer[0];
+            rbuffer.consume(1); // consume header
+
+            if (reply_pkt_h == DINIT_RP_DEPENDENTS && pcommand == DINIT_CP_STOPSERVICE) {
+                // size_t number, N * handle_t handles
+                size_t number;
+                fill_buffer_to(rbuffer, socknum, sizeof(number));
+                rbuffer.extract(&number, 0, sizeof(number));
+                rbuffer.consume(sizeof(number));
+                op.dependents.reserve(number);
+                for (size_t j = 0; j < number; j++) {
+                    handle_t handle;
+                    fill_buffer_to(rbuffer, socknum, sizeof(handle_t));
+                    rbuffer.extract(&handle, 0, sizeof(handle));
+                    op.dependents.push_back(handle);
+                    rbuffer.consume(sizeof(handle));
+                }
+                op.failed = true;
+                any_dependents = true;
+            }
+            else if (! process_op_reply(op, reply_pkt_h, mstate, command, wait_for_service)) {
+                cerr << "dinitctl: protocol error." << endl;
+                return 1;
+            }
+        }
+    }
+
+    // Wait for all services to reach the requested state:
+    if (! wait_for_services(socknum, rbuffer, mstate)) {
+        cerr << "dinitctl: protocol error" << endl;
+        return 1;
+    }
+
+    // Report any services which couldn't be stopped due to dependents (now that no more service
+    // events are expected, we can query the dependent names):
+    if (any_dependents) {
+        for (service_op &op : ops) {
+            if (op.dependents.empty()) continue;
+            cerr << "dinitctl: cannot stop service '" << *op.name << "' due to the following dependents:\n";
+            cerr << " ";
+            for (handle_t handle : op.dependents) {
+                cerr << " " << get_service_name(socknum, rbuffer, handle);
+            }
+            cerr << "\n";
+        }
+        if (command != command_t::RESTART_SERVICE) {
+            cerr << "(Only direct dependents are listed. Exercise caution before using '--force' !!)\n";
+        }
+    }
+
+    for (service_op &op : ops) {
+        if (op.failed) return 1;
+    }
+    return 0;
+}
+
+static const char *describe_state(service_state_t state)
+{
+    switch (state) {
+        case service_state_t::STOPPED: return "stopped";
+        case service_state_t::STARTING: return "starting";
+        case service_state_t::STARTED: return "started";
+        case service_state_t::STOPPING: return "stopping";
+    }
+    return "unknown";
+}
+
+// Show the status of one or more services (which are not loaded if not already loaded).
+static int service_status(int socknum, cpbuffer_t &rbuffer, const std::vector<std::string> &service_names)
+{
+    using namespace std;
+
+    multi_op_state mstate;
+    auto &ops = mstate.ops;
+    ops.resize(service_names.size());
+    for (size_t i = 0; i < service_names.size(); i++) {
+        ops[i].name = &service_names[i];
+    }
+
+    load_services(socknum, rbuffer, mstate, true, false);
+
+    int r = 0;
+    for (service_op &op : ops) {
+        cout << *op.name << ": ";
+        if (op.failed) {
+            cout << "not loaded" << endl;
+            r = 1;
+            continue;
+        }
+        cout << describe_state(op.state);
+        bool target_started = (op.target_state == service_state_t::STARTED);
+        if ((op.state == service_state_t::STARTING || op.state == service_state_t::STARTED) != target_started) {
+            cout << " (will " << describeVerb(! target_started) << ")";
+        }
+        cout << endl;
+    }
+
+    return r;
+}
+
 // Issue a "load service" command (DINIT_CP_LOADSERVICE), without waiting for
 // a response. Returns 1 on failure (with error logged), 0 on success.
 static int issue_load_service(int socknum, const char *service_name, bool find_only)
@@ -852,6 +1558,68 @@ static int reload_service(int socknum, cpbuffer_t &rbuffer, const char *service_
     return 0;
 }
 
+static int reload_changed(int socknum, cpbuffer_t &rbuffer, bool verbose)
+{
+    using namespace std;
+
+    char cmdbuf[] = { (char)DINIT_CP_RELOADCHANGED };
+    write_all_x(socknum, cmdbuf, 1);
+
+    wait_for_reply(rbuffer, socknum);
+    if (rbuffer[0] == DINIT_RP_NAK) {
+        cerr << "dinitctl: Changes to service descriptions are not being tracked (dinit must be "
+                "started with --watch-services)." << endl;
+        return 1;
+    }
+
+    int reloaded = 0;
+    int not_reloaded = 0;
+    while (rbuffer[0] == DINIT_RP_RELOADRESULT) {
+        constexpr int hdrsize = 3;
+        fill_buffer_to(rbuffer, socknum, hdrsize);
+        int result = rbuffer[1];
+        int name_len = (unsigned char)rbuffer[2];
+
+        fill_buffer_to(rbuffer, socknum, hdrsize + name_len);
+        char *name_ptr = rbuffer.get_ptr(hdrsize);
+        int clength = std::min(rbuffer.get_contiguous_length(name_ptr), name_len);
+        string name = string(name_ptr, clength);
+        name.append(rbuffer.get_buf_base(), name_len - clength);
+
+        if (result == DINIT_RELOAD_OK) {
+            reloaded++;
+            if (verbose) {
+                cout << "Service '" << name << "' reloaded." << endl;
+            }
+        }
+        else {
+            not_reloaded++;
+            if (result == DINIT_RELOAD_IN_USE) {
+                cerr << "dinitctl: Service '" << name << "' not reloaded; it is in use by another "
+                        "connection." << endl;
+            }
+            else {
+                cerr << "dinitctl: Could not reload service '" << name << "'; service in wrong state, "
+                        "incompatible change, or bad service description." << endl;
+            }
+        }
+
+        rbuffer.consume(hdrsize + name_len);
+        wait_for_reply(rbuffer, socknum);
+    }
+
+    if (rbuffer[0] != DINIT_RP_LISTDONE) {
+        cerr << "dinitctl: Protocol error." << endl;
+        return 1;
+    }
+    rbuffer.consume(1);
+
+    if (verbose && reloaded == 0 && not_reloaded == 0) {
+        cout << "No changed services." << endl;
+    }
+    return not_reloaded == 0 ? 0 : 1;
+}
+
 static int list_services(int socknum, cpbuffer_t &rbuffer)
 {
     using namespace std;
@@ -871,6 +1639,8 @@ static int list_services(int socknum, cpbuffer_t &rbuffer)
         bool has_console = (console_flags & 2) != 0;
         bool waiting_console = (console_flags & 1) != 0;
         bool was_skipped = (console_flags & 4) != 0;
+        bool restart_pending = (console_flags & 8) != 0;
+        unsigned restart_delay = (unsigned char)rbuffer[6] | ((unsigned char)rbuffer[7] << 8);
 
         stopped_reason_t stop_reason = static_cast<stopped_reason_t>(rbuffer[5]);
 
@@ -934,6 +1704,10 @@ static int list_services(int socknum, cpbuffer_t &rbuffer)
         if (current != service_state_t::STOPPED && service_pid != -1) {
         	cout << " (pid: " << service_pid << ")";
         }
+
+        if (restart_pending) {
+            cout << " (restart pending; delay: " << (restart_delay / 10) << "." << (restart_delay % 10) << "s)";
+        }
         
         if (current == service_state_t::STOPPED && stop_reason == stopped_reason_t::TERMINATED) {
             if (WIFEXITED(exit_status)) {
@@ -1226,3 +2000,380 @@ static int enable_disable_service(int socknum, cpbuffer_t &rbuffer, const char *
 
     return 0;
 }
+
+// Subscribe to events for all services (matching the pattern, if given), and display them as they
+// are received.
+static int subscribe_events(int socknum, cpbuffer_t &rbuffer, const char *pattern, unsigned event_mask)
+{
+    using namespace std;
+
+    uint16_t pattern_len = (pattern == nullptr) ? 0 : strlen(pattern);
+    if (pattern_len > 1024 - 4) {
+        cerr << "dinitctl: service name pattern too long" << endl;
+        return 1;
+    }
+
+    std::vector<char> buf;
+    buf.push_back(DINIT_CP_SUBSCRIBE);
+    buf.push_back((char) event_mask);
+    buf.insert(buf.end(), (char *) &pattern_len, (char *) &pattern_len + sizeof(pattern_len));
+    buf.insert(buf.end(), pattern, pattern + pattern_len);
+    write_all_x(socknum, buf.data(), buf.size());
+
+    wait_for_reply(rbuffer, socknum);
+    if (rbuffer[0] != DINIT_RP_ACK) {
+        cerr << "dinitctl: protocol error." << endl;
+        return 1;
+    }
+    rbuffer.consume(1);
+
+    constexpr unsigned num_event_names = sizeof(event_names) / sizeof(event_names[0]);
+
+    while (true) {
+        int r = cp_fill_to(rbuffer, socknum, 2);
+        if (r == 0) {
+            // Connection closed (dinit terminated)
+            return 0;
+        }
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            perror("dinitctl: read");
+            return 1;
+        }
+        if (rbuffer[0] < 100) {
+            cerr << "dinitctl: protocol error" << endl;
+            return 1;
+        }
+
+        int pktlen = (unsigned char) rbuffer[1];
+        fill_buffer_to(rbuffer, socknum, pktlen);
+
+        if (rbuffer[0] == DINIT_IP_SERVICEEVENTS) {
+            int pos = 2;
+            while (pos + 6 <= pktlen) {
+                uint32_t seq;
+                rbuffer.extract((char *) &seq, pos, sizeof(seq));
+                unsigned event = (unsigned char) rbuffer[pos + 4];
+                int name_len = (unsigned char) rbuffer[pos + 5];
+                if (pos + 6 + name_len > pktlen) break;
+                std::string name = rbuffer.extract_string(pos + 6, name_len);
+                cout << seq << " " << name << " "
+                        << (event < num_event_names ? event_names[event] : "unknown") << "\n";
+                pos += 6 + name_len;
+            }
+            cout << flush;
+        }
+        else if (rbuffer[0] == DINIT_IP_EVENTSLOST) {
+            uint32_t first_lost, lost_count;
+            rbuffer.extract((char *) &first_lost, 2, sizeof(first_lost));
+            rbuffer.extract((char *) &lost_count, 2 + sizeof(first_lost), sizeof(lost_count));
+            cout << "*** " << lost_count << " event(s) lost, from sequence " << first_lost << endl;
+        }
+
+        rbuffer.consume(pktlen);
+    }
+}
+
+// Get the median of a (non-empty) set of values.
+static uint32_t median(std::vector<uint32_t> &values)
+{
+    size_t mid = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + mid, values.end());
+    uint32_t upper = values[mid];
+    if (values.size() % 2 != 0) return upper;
+    uint32_t lower = *std::max_element(values.begin(), values.begin() + mid);
+    return lower + (upper - lower) / 2;
+}
+
+// Query the path of a file used by dinit (via QUERYBOOTHISTORY or QUERYLOGJOURNAL). Returns 0 on success,
+// 1 if dinit is not using such a file, or -1 (after reporting it) on protocol error.
+static int query_file_path(int socknum, cpbuffer_t &rbuffer, char query, char reply, std::string &path)
+{
+    using namespace std;
+
+    char cmdbuf[] = { query };
+    write_all_x(socknum, cmdbuf, 1);
+
+    wait_for_reply(rbuffer, socknum);
+    if (rbuffer[0] == DINIT_RP_NAK) {
+        rbuffer.consume(1);
+        return 1;
+    }
+    if (rbuffer[0] != reply) {
+        cerr << "dinitctl: Protocol error." << endl;
+        return -1;
+    }
+
+    constexpr int hdrsize = 1 + sizeof(uint16_t);
+    fill_buffer_to(rbuffer, socknum, hdrsize);
+    uint16_t path_len;
+    rbuffer.extract(&path_len, 1, sizeof(path_len));
+    rbuffer.consume(hdrsize);
+    path.reserve(path_len);
+    while (path_len > 0) {
+        fill_buffer_to(rbuffer, socknum, 1);
+        int chunk = std::min((int)path_len, rbuffer.get_contiguous_length(rbuffer.get_ptr(0)));
+        path.append(rbuffer.get_ptr(0), chunk);
+        rbuffer.consume(chunk);
+        path_len -= chunk;
+    }
+    return 0;
+}
+
+// Compare the service start times from the latest boot against a baseline (the median over the
+// previous boots in the history), reporting services whose start time regressed by more than the
+// threshold percentage.
+static int boot_history(int socknum, cpbuffer_t &rbuffer, unsigned threshold)
+{
+    using namespace std;
+
+    // Ignore regressions of less than this (ms), which are likely just noise:
+    constexpr uint32_t min_regression_ms = 100;
+
+    string path;
+    int r = query_file_path(socknum, rbuffer, DINIT_CP_QUERYBOOTHISTORY, DINIT_RP_BOOTHISTORY, path);
+    if (r == 1) {
+        cerr << "dinitctl: Boot history is not being recorded (dinit must be started with "
+                "--boot-history-file)." << endl;
+    }
+    if (r != 0) return 1;
+
+    vector<boot_record> boots;
+    ifstream history_file(path, ios::in | ios::binary);
+    if (! history_file) {
+        cerr << "dinitctl: No boot history available (cannot open " << path << ")." << endl;
+        return 1;
+    }
+    if (! read_boot_history(history_file, boots)) {
+        cerr << "dinitctl: Boot history file " << path << " is invalid or truncated." << endl;
+        if (boots.empty()) return 1;
+    }
+    if (boots.empty()) {
+        cout << "No boots recorded." << endl;
+        return 0;
+    }
+
+    // Start time of each service in the latest boot (for a service that started more than once,
+    // the last start):
+    const boot_record &latest = boots.back();
+    unordered_map<string, uint32_t> latest_times;
+    for (const boot_service_time &st : latest.services) {
+        latest_times[st.name] = st.start_ms;
+    }
+
+    size_t num_previous = boots.size() - 1;
+    cout << "Latest boot: " << latest.total_ms << "ms";
+    if (num_previous == 0) {
+        cout << " (no previous boots for comparison)." << endl;
+        return 0;
+    }
+
+    vector<uint32_t> totals;
+    unordered_map<string, vector<uint32_t>> previous_times;
+    for (size_t i = 0; i < num_previous; i++) {
+        totals.push_back(boots[i].total_ms);
+        unordered_map<string, uint32_t> boot_times;
+        for (const boot_service_time &st : boots[i].services) {
+            boot_times[st.name] = st.start_ms;
+        }
+        for (auto &bt : boot_times) {
+            previous_times[bt.first].push_back(bt.second);
+        }
+    }
+    cout << " (baseline " << median(totals) << "ms, over " << num_previous << " previous boot"
+            << (num_previous == 1 ? "" : "s") << ")." << endl;
+
+    struct regression
+    {
+        const string *name;
+        uint32_t latest_ms;
+        uint32_t baseline_ms;
+    };
+    vector<regression> regressions;
+
+    for (auto &lt : latest_times) {
+        auto i = previous_times.find(lt.first);
+        if (i == previous_times.end()) continue;
+        uint32_t baseline = median(i->second);
+        uint64_t limit = (uint64_t)baseline * (100 + threshold) / 100;
+        if (lt.second > limit && lt.second - baseline >= min_regression_ms) {
+            regressions.push_back({&lt.first, lt.second, baseline});
+        }
+    }
+
+    if (regressions.empty()) {
+        cout << "No services with start time regressions (threshold " << threshold << "%)." << endl;
+        return 0;
+    }
+
+    // Report the largest regressions first:
+    sort(regressions.begin(), regressions.end(), [](const regression &a, const regression &b) {
+        return (a.latest_ms - a.baseline_ms) > (b.latest_ms - b.baseline_ms);
+    });
+
+    cout << "Services with start time regressions (threshold " << threshold << "%):" << endl;
+    for (const regression &r : regressions) {
+        cout << "  " << *r.name << ": " << r.latest_ms << "ms (baseline " << r.baseline_ms << "ms, +"
+                << (r.latest_ms - r.baseline_ms) << "ms)" << endl;
+    }
+    return 0;
+}
+
+// Discard the boot readahead profile, so that a new one is recorded at next boot.
+static int regen_readahead(int socknum, cpbuffer_t &rbuffer, bool verbose)
+{
+    using namespace std;
+
+    char cmdbuf[] = { (char)DINIT_CP_REGENREADAHEAD };
+    write_all_x(socknum, cmdbuf, 1);
+
+    wait_for_reply(rbuffer, socknum);
+    if (rbuffer[0] == DINIT_RP_NAK) {
+        cerr << "dinitctl: Could not discard readahead profile (dinit must be started with "
+                "--readahead-profile)." << endl;
+        return 1;
+    }
+    if (rbuffer[0] != DINIT_RP_ACK) {
+        cerr << "dinitctl: Protocol error." << endl;
+        return 1;
+    }
+    rbuffer.consume(1);
+
+    if (verbose) {
+        cout << "Readahead profile discarded; a new profile will be recorded at next boot." << endl;
+    }
+    return 0;
+}
+
+// Show the matching messages recorded in a single journal file. If 'must_exist' is false, a file
+// which doesn't exist is treated as empty. Returns 0 on success, or 1 on failure.
+static int show_log_journal_file(const std::string &path, bool must_exist, const char *service_name,
+        time_t since, time_t until)
+{
+    using namespace std;
+
+    static const char * const level_names[] = { "debug", "info", "warn", "error" };
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (! must_exist && errno == ENOENT) return 0;
+        cerr << "dinitctl: No log journal available (cannot open " << path << ")." << endl;
+        return 1;
+    }
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) == -1) {
+        perror("dinitctl: fstat");
+        close(fd);
+        return 1;
+    }
+    size_t size = statbuf.st_size;
+    if (size == 0) {
+        // The journal has not been opened by dinit yet (nothing has been written).
+        close(fd);
+        return 0;
+    }
+
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        perror("dinitctl: mmap");
+        return 1;
+    }
+    const char *data = static_cast<const char *>(mapping);
+
+    if (! log_journal_check_header(data, size)) {
+        cerr << "dinitctl: " << path << " is not a log journal." << endl;
+        munmap(mapping, size);
+        return 1;
+    }
+
+    size_t name_len = (service_name != nullptr) ? strlen(service_name) : 0;
+    log_journal_record rec;
+    size_t offset = log_journal_hdr_size;
+    size_t next;
+    while ((next = log_journal_read_record(data, size, offset, rec)) != 0) {
+        const char *rec_name = data + offset + sizeof(rec);
+        const char *rec_msg = rec_name + rec.svc_name_len;
+        offset = next;
+
+        if (service_name != nullptr && (rec.svc_name_len != name_len
+                || memcmp(rec_name, service_name, name_len) != 0)) {
+            continue;
+        }
+        if ((time_t)rec.time_sec < since || (time_t)rec.time_sec > until) {
+            continue;
+        }
+
+        char timebuf[32];
+        time_t rec_time = rec.time_sec;
+        struct tm tm;
+        strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S", localtime_r(&rec_time, &tm));
+        char msbuf[5];
+        snprintf(msbuf, sizeof(msbuf), ".%03u", (unsigned)(rec.time_nsec / 1000000) % 1000);
+
+        cout << timebuf << msbuf << " "
+                << (rec.level < 4 ? level_names[rec.level] : "?") << " ";
+        if (rec.svc_name_len != 0) {
+            cout.write(rec_name, rec.svc_name_len);
+            cout << ": ";
+        }
+        cout.write(rec_msg, rec.msg_len);
+        cout << '\n';
+    }
+
+    munmap(mapping, size);
+    return 0;
+}
+
+// Show the messages recorded in the log journal, optionally only those concerning a particular service
+// and/or logged within a time range. The journal is read (mapped) directly; the older records, from
+// before the journal was last rotated, are shown first.
+static int show_log_journal(int socknum, cpbuffer_t &rbuffer, const char *service_name, time_t since,
+        time_t until)
+{
+    using namespace std;
+
+    string path;
+    int r = query_file_path(socknum, rbuffer, DINIT_CP_QUERYLOGJOURNAL, DINIT_RP_LOGJOURNAL, path);
+    if (r == 1) {
+        cerr << "dinitctl: No log journal is being recorded (dinit must be started with "
+                "--log-journal)." << endl;
+    }
+    if (r != 0) return 1;
+
+    r = show_log_journal_file(path + log_journal_old_suffix, false, service_name, since, until);
+    if (r == 0) {
+        r = show_log_journal_file(path, true, service_name, since, until);
+    }
+    cout << flush;
+    return r;
+}
+
+// Show control connection statistics (output queue accounting).
+static int control_stats(int socknum, cpbuffer_t &rbuffer)
+{
+    using namespace std;
+
+    char cmdbuf[] = { (char)DINIT_CP_QUERYCONNSTATS };
+    write_all_x(socknum, cmdbuf, 1);
+
+    wait_for_reply(rbuffer, socknum);
+    if (rbuffer[0] != DINIT_RP_CONNSTATS) {
+        cerr << "dinitctl: Protocol error." << endl;
+        return 1;
+    }
+
+    uint32_t stats[7];
+    fill_buffer_to(rbuffer, socknum, 1 + sizeof(stats));
+    rbuffer.extract(stats, 1, sizeof(stats));
+    rbuffer.consume(1 + sizeof(stats));
+
+    cout << "Active connections:         " << stats[0] << "\n"
+            "Queued output:              " << stats[1] << " bytes (peak " << stats[2] << " bytes)\n"
+            "Output quota:               " << stats[3] << " bytes per connection, " << stats[4]
+                << " bytes total\n"
+            "Input throttled:            " << stats[5] << " times\n"
+            "Closed for exceeding quota: " << stats[6] << endl;
+    return 0;
+}
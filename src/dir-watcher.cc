@@ -0,0 +1,124 @@
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "dinit.h"
+#include "dinit-log.h"
+#include "dir-watcher.h"
+
+// Implementation of the service directory watcher. See dir-watcher.h.
+
+service_dir_watcher dir_watcher;
+
+#ifdef __linux__
+
+namespace {
+    // Events of interest: any change to (or replacement, addition or removal of) a file.
+    constexpr uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE
+            | IN_DELETE | IN_ONLYDIR;
+
+    // Buffer for reading events (static, as for the notification socket):
+    constexpr size_t event_buf_size = 4096;
+    alignas(inotify_event) char event_buf[event_buf_size];
+
+    // Maximum number of reads per wakeup (to avoid starving other events):
+    constexpr int max_reads = 4;
+}
+
+bool service_dir_watcher::start(dirload_service_set *sset) noexcept
+{
+    if (watching) return true;
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1) {
+        log(loglevel_t::ERROR, "Error creating service directory watch: ", strerror(errno));
+        return false;
+    }
+
+    int dir_count = sset->get_service_dir_count();
+    for (int i = 0; i < dir_count; i++) {
+        const char *dir = sset->get_service_dir(i);
+        if (inotify_add_watch(fd, dir, watch_mask) == -1 && errno != ENOENT) {
+            // (A non-existent directory is not an error; it may not be used on this system).
+            log(loglevel_t::WARN, "Could not watch service directory ", dir, ": ", strerror(errno));
+        }
+    }
+
+    try {
+        add_watch(event_loop, fd, dasynq::IN_EVENTS);
+    }
+    catch (std::exception &e) {
+        log(loglevel_t::ERROR, "Could not set up service directory watch: ", e.what());
+        close(fd);
+        return false;
+    }
+
+    services = sset;
+    services->set_tracking_changes(true);
+    watching = true;
+    return true;
+}
+
+dasynq::rearm service_dir_watcher::fd_event(eventloop_t &loop, int fd, int flags) noexcept
+{
+    for (int reads = 0; reads < max_reads; reads++) {
+        ssize_t r = read(fd, event_buf, event_buf_size);
+        if (r <= 0) {
+            if (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log(loglevel_t::WARN, "Error reading service directory watch: ", strerror(errno));
+            }
+            break;
+        }
+
+        for (char *p = event_buf; p < event_buf + r; ) {
+            inotify_event *ev = reinterpret_cast<inotify_event *>(p);
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // Events were lost; any description may have changed.
+                services->all_descriptions_changed();
+            }
+            else if (ev->len != 0 && (ev->mask & IN_ISDIR) == 0) {
+                try {
+                    services->description_changed(ev->name);
+                }
+                catch (std::bad_alloc &) {
+                    // Can't record the name, so assume the worst:
+                    services->all_descriptions_changed();
+                }
+            }
+            p += sizeof(inotify_event) + ev->len;
+        }
+    }
+
+    return dasynq::rearm::REARM;
+}
+
+#else
+
+bool service_dir_watcher::start(dirload_service_set *sset) noexcept
+{
+    log(loglevel_t::ERROR, "Watching service directories is not supported on this platform");
+    return false;
+}
+
+dasynq::rearm service_dir_watcher::fd_event(eventloop_t &loop, int fd, int flags) noexcept
+{
+    return dasynq::rearm::DISARM;
+}
+
+#endif
+
+void service_dir_watcher::stop() noexcept
+{
+    if (watching) {
+        int fd = get_watched_fd();
+        deregister(event_loop);
+        close(fd);
+        services->set_tracking_changes(false);
+        watching = false;
+    }
+}
@@ -11,6 +11,7 @@
 #include "dasynq.h" // for pipe2
 
 #include <sys/uio.h> // writev
+#include <sys/socket.h> // sendmmsg, recvmsg
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -28,6 +29,10 @@ using ::getpgrp;
 using ::read;
 using ::write;
 using ::writev;
+using ::recvmsg;
+#ifdef __linux__
+using ::sendmmsg;
+#endif
 
 // Wrapper around a POSIX exit status
 class exit_status
@@ -0,0 +1,101 @@
+#ifndef BOOT_HISTORY_H_INCLUDED
+#define BOOT_HISTORY_H_INCLUDED 1
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+
+// Boot timing history: the start times of services, as recorded during each boot (by dinit with
+// the --boot-history-file option), and read by "dinitctl boot-history".
+//
+// The history file is a compact binary file. Values are in native byte order; the file is only
+// expected to be read on the system on which it was written. It consists of:
+//
+//   4-byte magic ("DBH" followed by the format version, 1), then boot records (oldest first), each:
+//     8-byte wall-clock time at which the record was written (seconds since the epoch)
+//     4-byte total boot time (milliseconds)
+//     2-byte number of services, N
+//     N service entries, each: 4-byte start time (milliseconds), 1-byte name length, name
+
+// Maximum number of boots kept in the history file:
+constexpr unsigned max_boot_history = 20;
+
+constexpr char boot_history_magic[4] = { 'D', 'B', 'H', 1 };
+
+struct boot_service_time
+{
+    std::string name;
+    uint32_t start_ms;
+};
+
+struct boot_record
+{
+    uint64_t timestamp;
+    uint32_t total_ms;
+    std::vector<boot_service_time> services;
+};
+
+// Read a boot history file. Returns false if the file is not a valid history file; any complete
+// records before the invalid part are retained. May throw std::bad_alloc.
+inline bool read_boot_history(std::istream &in, std::vector<boot_record> &boots)
+{
+    char magic[sizeof(boot_history_magic)];
+    if (! in.read(magic, sizeof(magic)) || memcmp(magic, boot_history_magic, sizeof(magic)) != 0) {
+        return false;
+    }
+
+    auto read_val = [&](void *val, size_t size) -> bool {
+        return (bool) in.read((char *) val, size);
+    };
+
+    while (in.peek() != std::istream::traits_type::eof()) {
+        boot_record rec;
+        uint16_t count;
+        if (! read_val(&rec.timestamp, sizeof(rec.timestamp)) || ! read_val(&rec.total_ms, sizeof(rec.total_ms))
+                || ! read_val(&count, sizeof(count))) {
+            return false;
+        }
+        rec.services.resize(count);
+        for (boot_service_time &st : rec.services) {
+            unsigned char name_len;
+            if (! read_val(&st.start_ms, sizeof(st.start_ms)) || ! read_val(&name_len, 1)) {
+                return false;
+            }
+            st.name.resize(name_len);
+            if (! in.read(&st.name[0], name_len)) {
+                return false;
+            }
+        }
+        boots.push_back(std::move(rec));
+    }
+
+    return true;
+}
+
+// Write a boot history file. (Services with names longer than 255 characters are omitted).
+inline void write_boot_history(std::ostream &out, const std::vector<boot_record> &boots)
+{
+    out.write(boot_history_magic, sizeof(boot_history_magic));
+    for (const boot_record &rec : boots) {
+        uint16_t count = 0;
+        for (const boot_service_time &st : rec.services) {
+            if (st.name.length() <= 255 && count != UINT16_MAX) ++count;
+        }
+        out.write((const char *) &rec.timestamp, sizeof(rec.timestamp));
+        out.write((const char *) &rec.total_ms, sizeof(rec.total_ms));
+        out.write((const char *) &count, sizeof(count));
+        for (const boot_service_time &st : rec.services) {
+            if (count == 0) break;
+            if (st.name.length() > 255) continue;
+            unsigned char name_len = st.name.length();
+            out.write((const char *) &st.start_ms, sizeof(st.start_ms));
+            out.write((const char *) &name_len, 1);
+            out.write(st.name.data(), name_len);
+            --count;
+        }
+    }
+}
+
+#endif
@@ -45,6 +45,38 @@ constexpr static int DINIT_CP_QUERYSERVICENAME = 15;
 // Reload a service:
 constexpr static int DINIT_CP_RELOADSERVICE = 16;
 
+// Subscribe to events for all services (optionally filtered):
+constexpr static int DINIT_CP_SUBSCRIBE = 17;
+//     followed by 1-byte event mask (bit N = service_event_t N; 0 = all events), 2-byte pattern
+//     length, and the service name pattern (shell wildcard; empty = all services)
+
+// Reload all services whose descriptions have changed (requires dinit to be watching the service
+// directories). Reply is a DINIT_RP_RELOADRESULT for each service, followed by DINIT_RP_LISTDONE;
+// or DINIT_RP_NAK if changes are not being tracked.
+constexpr static int DINIT_CP_RELOADCHANGED = 18;
+
+// Start/stop a batch of services, all together (with the state changes propagated once):
+constexpr static int DINIT_CP_STARTSTOPBATCH = 19;
+//     followed by 1-byte flags (1 = further packets follow in this batch), 2-byte count N, and N
+//     entries, each: 1-byte operation (DINIT_CP_STARTSERVICE, STOPSERVICE, WAKESERVICE or
+//     RELEASESERVICE), 1-byte flags (as for the individual operation), 4-byte service handle.
+//     The batch is checked and applied once its final packet is received (no reply is sent for
+//     preceding packets). Reply is DINIT_RP_BATCHDONE, or DINIT_RP_BATCHREJECTED if any operation
+//     could not be performed (in which case none are).
+
+// Query the path of the boot timing history file (see boot-history.h):
+constexpr static int DINIT_CP_QUERYBOOTHISTORY = 20;
+
+// Discard the boot readahead profile, so that a new profile is recorded at next boot. Reply is ACK,
+// or NAK if no profile is in use (or it could not be removed):
+constexpr static int DINIT_CP_REGENREADAHEAD = 21;
+
+// Query control connection statistics (output queue accounting). Reply is DINIT_RP_CONNSTATS:
+constexpr static int DINIT_CP_QUERYCONNSTATS = 22;
+
+// Query the path of the log journal file (see log-journal.h):
+constexpr static int DINIT_CP_QUERYLOGJOURNAL = 23;
+
 // Replies:
 
 // Reply: ACK/NAK to request
@@ -90,7 +122,52 @@ constexpr static int DINIT_RP_DEPENDENTS = 65;
 // Service name:
 constexpr static int DINIT_RP_SERVICENAME = 66;
 
+// Result of reloading a service (for RELOADCHANGED):
+constexpr static int DINIT_RP_RELOADRESULT = 67;
+//     followed by 1-byte result (see below), 1-byte name length, service name (truncated if necessary)
+constexpr static int DINIT_RELOAD_OK = 0;      // service reloaded
+constexpr static int DINIT_RELOAD_FAILED = 1;  // reload failed (see log); settings remain unchanged
+constexpr static int DINIT_RELOAD_IN_USE = 2;  // not reloaded, as a handle to the service is open
+                                               // (not returned by current versions)
+
+// Batch of operations was rejected; no operations were performed:
+constexpr static int DINIT_RP_BATCHREJECTED = 68;
+//     followed by 2-byte index of the (first) rejected entry, 1-byte reason:
+constexpr static int DINIT_BATCH_SHUTTING_DOWN = 1;  // cannot start/restart while shutting down
+constexpr static int DINIT_BATCH_PINNED = 2;         // service is pinned in the opposite state
+constexpr static int DINIT_BATCH_DEPENDENTS = 3;     // would stop dependents (not stopped by the batch)
+constexpr static int DINIT_BATCH_NOT_STARTED = 4;    // cannot restart; service not started
+constexpr static int DINIT_BATCH_NO_DEPENDENTS = 5;  // cannot wake; service has no active dependents
+
+// Batch of operations was performed:
+constexpr static int DINIT_RP_BATCHDONE = 69;
+//     followed by 2-byte count N, and N 1-byte results (one per entry): DINIT_RP_ACK (operation
+//     issued), DINIT_RP_ALREADYSS (service already in, or has already reached, the requested state),
+//     or DINIT_RP_NAK (service failed to start)
+
+// Path of boot timing history file (reply to QUERYBOOTHISTORY; NAK if there is no history file):
+constexpr static int DINIT_RP_BOOTHISTORY = 70;
+//     followed by 2-byte path length, path
+
+// Control connection statistics (reply to QUERYCONNSTATS):
+constexpr static int DINIT_RP_CONNSTATS = 71;
+//     followed by 4-byte values: number of active connections, total queued output bytes, peak
+//     total queued output bytes, per-connection output quota, total output quota, number of times
+//     a connection's input was throttled, number of connections closed for exceeding the quota
+
+// Path of log journal file (reply to QUERYLOGJOURNAL; NAK if there is no journal):
+constexpr static int DINIT_RP_LOGJOURNAL = 72;
+//     followed by 2-byte path length, path
+
 // Information:
 
 // Service event occurred (4-byte service handle, 1 byte event code)
 constexpr static int DINIT_IP_SERVICEEVENT = 100;
+
+// Service events for a subscription (one or more), each: 4-byte sequence number, 1-byte event
+// code, 1-byte service name length, service name (truncated if necessary)
+constexpr static int DINIT_IP_SERVICEEVENTS = 101;
+
+// Subscription events were lost since the output queue was full (4-byte sequence number of the
+// first lost event, 4-byte count of lost events)
+constexpr static int DINIT_IP_EVENTSLOST = 102;
@@ -3,6 +3,7 @@
 
 #include <list>
 #include <vector>
+#include <string>
 #include <unordered_map>
 #include <map>
 #include <limits>
@@ -29,6 +30,17 @@ extern control_conn_t * rollback_handler_conn;
 
 extern int active_control_conns;
 
+// Accounting of queued output for all control connections:
+struct control_conn_stats_t
+{
+    size_t out_bytes = 0;       // total bytes currently queued for output
+    size_t peak_out_bytes = 0;  // peak value of out_bytes
+    unsigned long throttled = 0;     // number of times input from a connection was throttled
+    unsigned long quota_closed = 0;  // number of connections closed for exceeding output quota
+};
+
+extern control_conn_stats_t control_conn_stats;
+
 // "packet" format:
 // (1 byte) packet type
 // (N bytes) additional data (service name, etc)
@@ -78,7 +90,7 @@ class control_conn_watcher : public eventloop_t::bidi_fd_watcher_impl<control_co
     }
 };
 
-class control_conn_t : private service_listener
+class control_conn_t : private service_listener, private service_set_listener
 {
     friend rearm control_conn_cb(eventloop_t *loop, control_conn_watcher *watcher, int revents);
     friend class control_conn_t_test;
@@ -96,11 +108,16 @@ class control_conn_t : private service_listener
     bool bad_conn_close = false; // close when finished output?
     bool oom_close = false;      // send final 'out of memory' indicator
 
+    // Whether the connection is a SOCK_SEQPACKET connection. Each message received must then
+    // consist of one or more complete packets, and is read contiguously into the (empty) receive
+    // buffer, so that packets are never split across reads and the buffer does not wrap.
+    const bool seqpacket;
+
     // The packet length before we need to re-check if the packet is complete.
     // process_packet() will not be called until the packet reaches this size.
     int chklen;
     
-    // Receive buffer
+    // Receive buffer (also the maximum size of a message for a SOCK_SEQPACKET connection)
     cpbuffer<1024> rbuf;
     
     template <typename T> using list = std::list<T>;
@@ -113,6 +130,41 @@ class control_conn_t : private service_listener
     list<vector<char>> outbuf;
     // Current index within the first outgoing packet (all previous bytes have been sent).
     unsigned outpkt_index = 0;
+
+    // Output quotas. If the output queued for a connection exceeds its quota, or the output queued
+    // for all connections exceeds the total quota (and this connection has output queued), no
+    // further input is read from the connection until its queue drains to half the quota
+    // (backpressure). A connection whose queued output exceeds the hard limit, which can happen
+    // only if it doesn't read its output while service events continue to be queued, is closed.
+    static constexpr size_t out_quota = 64 * 1024;
+    static constexpr size_t out_hard_limit = 4 * out_quota;
+    static constexpr size_t total_out_quota = 1024 * 1024;
+
+    size_t out_bytes = 0;       // bytes queued in outbuf
+    bool in_throttled = false;  // input not being read due to output quota
+    bool quota_close = false;   // output discarded due to hard limit; close connection
+
+    // Subscription to events for all services. Events are batched into DINIT_IP_SERVICEEVENTS
+    // packets as they are queued. If the output queue becomes too long (the client is not keeping
+    // up), events are dropped, and a DINIT_IP_EVENTSLOST packet is queued once the queue drains.
+    static constexpr size_t max_sub_queue = 128;  // maximum queued packets before dropping events
+    bool subscribed = false;
+    unsigned sub_event_mask = 0;   // events of interest (bit per service_event_t); 0 = all
+    std::string sub_pattern;       // pattern for service names; empty = all
+    uint32_t sub_first_lost = 0;   // sequence number of first dropped event
+    uint32_t sub_lost_count = 0;   // number of dropped events
+    vector<char> *sub_batch = nullptr;  // queued (unsent) event batch packet, if any
+
+    // A batch of start/stop operations (DINIT_CP_STARTSTOPBATCH), accumulated until the final
+    // packet of the batch is received:
+    struct batch_op
+    {
+        char op;          // DINIT_CP_STARTSERVICE etc
+        char flags;       // as for the individual operation
+        handle_t handle;
+    };
+    static constexpr size_t max_batch_ops = 65535;
+    vector<batch_op> batch_ops;
     
     // Queue a packet to be sent
     //  Returns:  false if the packet could not be queued and a suitable error packet
@@ -125,6 +177,17 @@ class control_conn_t : private service_listener
     bool queue_packet(vector<char> &&v) noexcept;
     bool queue_packet(const char *pkt, unsigned size) noexcept;
 
+    // Account for output bytes being queued (or, with negative value, sent/discarded). Updates the
+    // throttled state; if the hard limit is exceeded, discards all queued output and marks the
+    // connection to be closed.
+    void account_output(ptrdiff_t bytes) noexcept;
+
+    // Get the watch flag for input (IN_EVENTS, or 0 if input should not be read).
+    int in_flag() noexcept
+    {
+        return (bad_conn_close || in_throttled) ? 0 : dasynq::IN_EVENTS;
+    }
+
     // Process a packet.
     //  Returns:  true (with bad_conn_close == false) if successful
     //            true (with bad_conn_close == true) if an error packet was queued
@@ -136,6 +199,16 @@ class control_conn_t : private service_listener
     
     // Process a STARTSERVICE/STOPSERVICE packet. May throw std::bad_alloc.
     bool process_start_stop(int pktType);
+
+    // Process a STARTSTOPBATCH packet. May throw std::bad_alloc.
+    bool process_start_stop_batch();
+
+    // Check that all operations in the (complete) batch can be performed. Returns -1 if so, or
+    // the index of the first operation which cannot be (with the reason set to a DINIT_BATCH_*
+    // value). The services must already have been resolved from the handles. May throw
+    // std::bad_alloc.
+    int check_batch(const vector<batch_op> &ops, const vector<service_record *> &batch_services,
+            char &reason);
     
     // Process a FINDSERVICE/LOADSERVICE packet. May throw std::bad_alloc.
     bool process_find_load(int pktType);
@@ -149,6 +222,9 @@ class control_conn_t : private service_listener
     // Process a RELOADSERVICE packet. May throw std::bad_alloc.
     bool process_reload_service();
 
+    // Process a RELOADCHANGED packet. May throw std::bad_alloc.
+    bool process_reload_changed();
+
     // Process a QUERYSERVICENAME packet.
     bool process_query_name();
 
@@ -164,9 +240,34 @@ class control_conn_t : private service_listener
     // Query service path / load mechanism.
     bool query_load_mech();
 
+    // Process a QUERYBOOTHISTORY or QUERYLOGJOURNAL packet, replying with the path of the file (or
+    // NAK if it is null). May throw std::bad_alloc.
+    bool process_query_path(char reply_type, const char *path);
+
+    // Process a QUERYCONNSTATS packet.
+    bool process_query_conn_stats();
+
+    // Process a SUBSCRIBE packet. May throw std::bad_alloc.
+    bool process_subscribe();
+
+    // Queue a subscription event, appending it to a queued batch if possible. May throw
+    // std::bad_alloc.
+    void queue_sub_event(const std::string &name, service_event_t event, uint32_t seq);
+
+    // Queue a packet reporting dropped subscription events. May throw std::bad_alloc.
+    void queue_events_lost();
+
     // Notify that data is ready to be read from the socket. Returns true if the connection should
     // be closed.
     bool data_ready() noexcept;
+
+    // Process complete packets in the receive buffer. Returns true if the connection should be
+    // closed.
+    bool process_buffered() noexcept;
+
+    // Handle a SOCK_SEQPACKET message which doesn't consist of complete packets. Returns true if the
+    // connection should be closed immediately.
+    bool incomplete_message() noexcept;
     
     bool send_data() noexcept;
     
@@ -228,9 +329,16 @@ class control_conn_t : private service_listener
         }
     }
     
+    // Process event for any service (for subscription).
+    void service_set_event(service_record * service, service_event_t event, uint32_t seq) noexcept
+            final override;
+
+    // A service record has been replaced (on reload): handles for it now refer to the replacement.
+    void service_replaced(service_record * service, service_record * replacement) noexcept final override;
+
     public:
-    control_conn_t(eventloop_t &loop, service_set * services_p, int fd)
-            : iob(loop), loop(loop), services(services_p), chklen(0)
+    control_conn_t(eventloop_t &loop, service_set * services_p, int fd, bool seqpacket_p = false)
+            : iob(loop), loop(loop), services(services_p), seqpacket(seqpacket_p), chklen(0)
     {
         iob.add_watch(loop, fd, dasynq::IN_EVENTS);
         active_control_conns++;
@@ -262,6 +370,10 @@ inline dasynq::rearm control_conn_cb(eventloop_t * loop, control_conn_watcher *
             delete conn;
             return dasynq::rearm::REMOVED;
         }
+        // The watch is disarmed when the event is delivered; keep watching while output remains:
+        if (! conn->outbuf.empty() || conn->bad_conn_close) {
+            return dasynq::rearm::REARM;
+        }
     }
     
     return dasynq::rearm::NOOP;
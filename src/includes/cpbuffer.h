@@ -84,6 +84,34 @@ template <int SIZE> class cpbuffer
         return r;
     }
 
+    // Fill by receiving a single message from the given (datagram or sequenced-packet) socket. If the
+    // message does not fit in the free space, the remainder of it is lost and 'truncated' is set.
+    // Return is the number of bytes received, 0 on end-of-file or -1 on error.
+    int fill_msg(int fd, bool &truncated) noexcept
+    {
+        int pos = cur_idx + length;
+        if (pos >= SIZE) pos -= SIZE;
+        int first_count = std::min(SIZE - pos, SIZE - length);
+
+        struct iovec iov[2];
+        iov[0].iov_base = buf + pos;
+        iov[0].iov_len = first_count;
+        iov[1].iov_base = buf;
+        iov[1].iov_len = SIZE - length - first_count;
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (iov[1].iov_len == 0) ? 1 : 2;
+
+        ssize_t r = bp_sys::recvmsg(fd, &msg, 0);
+        if (r >= 0) {
+            length += r;
+            truncated = (msg.msg_flags & MSG_TRUNC) != 0;
+        }
+        return r;
+    }
+
     // fill by reading from the given fd, until at least the specified number of bytes are in
     // the buffer. Return 0 if end-of-file reached before fill complete, or -1 on error.
     int fill_to(int fd, int rlength) noexcept
@@ -1,5 +1,15 @@
 #include <cstdint>
 #include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <cerrno>
+#include <vector>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "cpbuffer.h"
 
@@ -9,6 +19,10 @@
 using handle_t = uint32_t;
 using cpbuffer_t = cpbuffer<1024>;
 
+// Maximum size of a message sent to the daemon over a SOCK_SEQPACKET connection (the size of the
+// daemon's receive buffer). Each message must consist of complete packets.
+constexpr size_t cp_max_message = 1024;
+
 class cp_read_exception
 {
     public:
@@ -93,6 +107,108 @@ class membuf
     }
 };
 
+// State of a SOCK_SEQPACKET connection to the daemon (see connect_to_daemon). A message must be
+// received with a single read, but it may not fit in the circular buffer, so it is held here until
+// it has been transferred to the buffer.
+struct cp_seqpacket_state
+{
+    int fd = -1;
+    std::vector<char> msg;
+    size_t msg_len = 0;
+    size_t msg_pos = 0;
+};
+
+inline cp_seqpacket_state &get_cp_seqpacket_state()
+{
+    static cp_seqpacket_state state;
+    return state;
+}
+
+// Check whether a connection to the daemon is a SOCK_SEQPACKET connection.
+inline bool cp_is_seqpacket(int fd)
+{
+    return get_cp_seqpacket_state().fd == fd;
+}
+
+// Connect to the daemon via the control socket at the given path, which may be a SOCK_STREAM or a
+// SOCK_SEQPACKET socket. Returns the connected socket, or -1 on failure (with errno set).
+inline int connect_to_daemon(const char *path)
+{
+    size_t sockaddr_size = offsetof(struct sockaddr_un, sun_path) + strlen(path) + 1;
+    struct sockaddr_un *name = (struct sockaddr_un *) malloc(sockaddr_size);
+    if (name == nullptr) {
+        errno = ENOMEM;
+        return -1;
+    }
+    name->sun_family = AF_UNIX;
+    strcpy(name->sun_path, path);
+
+    int sock_types[] = { SOCK_STREAM, SOCK_SEQPACKET };
+    for (int sock_type : sock_types) {
+        int socknum = socket(AF_UNIX, sock_type, 0);
+        if (socknum == -1) break;
+        if (connect(socknum, (struct sockaddr *) name, sockaddr_size) == 0) {
+            free(name);
+            if (sock_type == SOCK_SEQPACKET) {
+                get_cp_seqpacket_state().fd = socknum;
+            }
+            return socknum;
+        }
+        int connect_errno = errno;
+        close(socknum);
+        errno = connect_errno;
+        // A socket of the wrong type gives EPROTOTYPE (Linux), or ECONNREFUSED (others):
+        if (errno != EPROTOTYPE && errno != ECONNREFUSED) break;
+    }
+
+    free(name);
+    return -1;
+}
+
+// Fill a circular buffer from a connection to the daemon, as for cpbuffer::fill. For a
+// SOCK_SEQPACKET connection, receives a complete message (if the previous one has been entirely
+// transferred) and transfers as much as possible to the buffer.
+inline int cp_fill(cpbuffer_t &buf, int fd)
+{
+    cp_seqpacket_state &sps = get_cp_seqpacket_state();
+    if (fd != sps.fd) {
+        return buf.fill(fd);
+    }
+
+    if (sps.msg_pos == sps.msg_len) {
+        // Determine the message size (peeking with a larger buffer until it is not filled):
+        if (sps.msg.empty()) {
+            sps.msg.resize(cp_max_message);
+        }
+        while (true) {
+            ssize_t r = recv(fd, sps.msg.data(), sps.msg.size(), MSG_PEEK);
+            if (r <= 0) return r;
+            if ((size_t) r < sps.msg.size()) break;
+            sps.msg.resize(sps.msg.size() * 2);
+        }
+        ssize_t r = recv(fd, sps.msg.data(), sps.msg.size(), 0);
+        if (r <= 0) return r;
+        sps.msg_len = r;
+        sps.msg_pos = 0;
+    }
+
+    int count = std::min((size_t) buf.get_free(), sps.msg_len - sps.msg_pos);
+    buf.append(sps.msg.data() + sps.msg_pos, count);
+    sps.msg_pos += count;
+    return count;
+}
+
+// Fill a circular buffer from a connection to the daemon until it contains at least _rlength_
+// bytes, as for cpbuffer::fill_to.
+inline int cp_fill_to(cpbuffer_t &buf, int fd, int rlength)
+{
+    while (buf.get_length() < rlength) {
+        int r = cp_fill(buf, fd);
+        if (r <= 0) return r;
+    }
+    return 1;
+}
+
 // Fill a circular buffer from a file descriptor, until it contains at least _rlength_ bytes.
 // Throws cp_read_exception if the requested number of bytes cannot be read, with:
 //     errcode = 0   if end of stream (remote end closed)
@@ -101,7 +217,7 @@ class membuf
 inline void fill_buffer_to(cpbuffer_t &buf, int fd, int rlength)
 {
     do {
-        int r = buf.fill_to(fd, rlength);
+        int r = cp_fill_to(buf, fd, rlength);
         if (r == -1) {
             if (errno != EINTR) {
                 throw cp_read_exception(errno);
@@ -179,6 +295,19 @@ template <typename Buf> inline void write_all_x(int fd, const Buf &b)
     write_all_x(fd, b.data(), b.size());
 }
 
+// Prepare to append a request packet of the given size to a buffer of pipelined requests (which
+// will be written as a whole). For a SOCK_SEQPACKET connection, each write is received by the
+// daemon as a single message, which must consist of complete packets and be no larger than
+// cp_max_message; if appending the packet would make the buffer too large, the buffer is written
+// (and cleared) first. Throws cp_write_exception on failure.
+inline void prepare_pipelined(int fd, std::vector<char> &buf, size_t pkt_size)
+{
+    if (cp_is_seqpacket(fd) && ! buf.empty() && buf.size() + pkt_size > cp_max_message) {
+        write_all_x(fd, buf.data(), buf.size());
+        buf.clear();
+    }
+}
+
 // Check the protocol version is compatible with the client.
 //   minversion - minimum protocol version that client can speak
 //   version - maximum protocol version that client can speak
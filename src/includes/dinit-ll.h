@@ -73,6 +73,19 @@ class dlist
         return first == nullptr;
     }
 
+    // Get the first element of the list (nullptr if the list is empty).
+    T * front() noexcept
+    {
+        return first;
+    }
+
+    // Get the element following the specified element (nullptr if it is the last element).
+    T * next(T *e) noexcept
+    {
+        T * n = E(e).next;
+        return (n == first) ? nullptr : n;
+    }
+
     T * pop_front() noexcept
     {
         auto r = first;
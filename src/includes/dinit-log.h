@@ -35,10 +35,20 @@ extern bool console_service_status;  // show service status messages to console?
 void enable_console_log(bool do_enable) noexcept;
 void init_log(service_set *sset, bool syslog_format);
 void close_log();
-void setup_main_log(int fd);
+void setup_main_log(int fd, bool is_dgram = false);
 bool is_log_flushed() noexcept;
+size_t log_rate_tracked_services() noexcept;  // (for testing)
 void discard_console_log_buffer() noexcept;
 
+// The log journal (see log-journal.h). Messages are recorded once a path has been set, but are not
+// written to the journal until it is opened. The journal is rotated once it reaches the maximum size
+// (0 for no limit).
+void set_log_journal_path(const char *path) noexcept;
+void set_log_journal_max_size(unsigned long kib) noexcept;
+bool open_log_journal() noexcept;
+void close_log_journal() noexcept;
+const char *get_log_journal_path() noexcept;
+
 // Log a simple string:
 void log(loglevel_t lvl, const char *msg) noexcept;
 // Log a simple string, optionally without logging to console:
@@ -50,6 +60,11 @@ void log_msg_begin(loglevel_t lvl, const char *msg) noexcept;
 void log_msg_part(const char *msg) noexcept;
 void log_msg_end(const char *msg) noexcept;
 
+// Begin a multi-part message concerning a particular service (optionally prefixed with the service
+// name). The service is identified in the log journal. Messages concerning a service are rate-limited
+// (per service and log level); if the message is suppressed, the remaining parts are ignored.
+void log_svc_msg_begin(loglevel_t lvl, const char *svc_name, bool name_prefix = true) noexcept;
+
 // Defined below:
 void log_service_started(const char *service_name) noexcept;
 void log_service_failed(const char *service_name) noexcept;
@@ -138,4 +153,21 @@ template <typename A, typename ...B> static inline void log(loglevel_t lvl, cons
     dinit_log::log_parts(b...);
 }
 
+// Variadic method to log a message concerning a particular service.
+template <typename ...B> static inline void log_service_msg(loglevel_t lvl, const std::string &svc_name,
+        const B & ...b) noexcept
+{
+    log_svc_msg_begin(lvl, svc_name.c_str());
+    dinit_log::log_parts(b...);
+}
+
+// As for log_service_msg, but without the service name prefix (the message itself should identify the
+// service).
+template <typename ...B> static inline void log_about_service(loglevel_t lvl, const std::string &svc_name,
+        const B & ...b) noexcept
+{
+    log_svc_msg_begin(lvl, svc_name.c_str(), false);
+    dinit_log::log_parts(b...);
+}
+
 #endif
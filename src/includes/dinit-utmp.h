@@ -1,4 +1,7 @@
 // Wrappers for utmp/wtmp & equivalent database access.
+//
+// Entries for service processes are not written directly, but via utmp_queue (see below), which defers
+// them until the filesystem holding the database is expected to be writable.
 
 #ifndef DINIT_UTMP_H_INCLUDED
 #define DINIT_UTMP_H_INCLUDED
@@ -53,11 +56,17 @@
 #endif
 #endif
 
+#include <cstddef>
+
+#include <sys/types.h>
+
 #if USE_UTMPX
 
 #include <cstring>
+#include <vector>
 
 #include <sys/time.h>
+#include <unistd.h>
 
 // Set the time for a utmpx record to the current time.
 inline void set_current_time(struct utmpx *record)
@@ -120,8 +129,9 @@ inline bool create_utmp_entry(const char *utmp_id, const char *utmp_line, pid_t
     return success;
 }
 
-// Clear the utmp entry for the given id/line/process.
-inline void clear_utmp_entry(const char *utmp_id, const char *utmp_line)
+// Clear the utmp entry for the given id/line/process. If the process ID is not given (0), it is taken
+// from the existing entry, if any.
+inline void clear_utmp_entry(const char *utmp_id, const char *utmp_line, pid_t pid = 0)
 {
     struct utmpx record;
     memset(&record, 0, sizeof(record));
@@ -135,22 +145,76 @@ inline void clear_utmp_entry(const char *utmp_id, const char *utmp_line)
 
     setutxent();
 
-    // Try to find an existing entry by id/line and copy the process ID:
-    if (*utmp_id) {
-        result = getutxid(&record);
+    if (pid != 0) {
+        record.ut_pid = pid;
     }
     else {
-        result = getutxline(&record);
-    }
-
-    if (result) {
-        record.ut_pid = result->ut_pid;
+        // Try to find an existing entry by id/line and copy the process ID:
+        if (*utmp_id) {
+            result = getutxid(&record);
+        }
+        else {
+            result = getutxline(&record);
+        }
+
+        if (result) {
+            record.ut_pid = result->ut_pid;
+        }
     }
 
     pututxline(&record);
     endutxent();
 }
 
+// A queue of utmp entry updates for service processes. Updates are held until the database is marked
+// writable (for the system manager, once the root filesystem is read-write and the boot entry has been
+// written), so that starting services early in boot never waits on (possibly slow) database access,
+// and so that entries are not lost when the database is cleared as the boot entry is written. Once
+// the database is writable, updates are performed immediately.
+//
+// Updates are performed in the order in which they were queued. A queued update supersedes any
+// earlier pending update for the same id/line, so there is at most one pending update for each.
+class utmp_queue_t
+{
+    struct utmp_update
+    {
+        bool create;  // true to create an entry, false to clear it
+        pid_t pid;    // process ID (for a clear, 0 if unknown)
+        char id[sizeof(utmpx().ut_id)];
+        char line[sizeof(utmpx().ut_line)];
+    };
+
+    std::vector<utmp_update> pending;
+    bool writable = false;
+
+    void queue(bool create, const char *utmp_id, const char *utmp_line, pid_t pid) noexcept;
+    void perform(const utmp_update &update) noexcept;
+
+    public:
+    // Create an entry for the specified process, with the given id and tty line.
+    void create_entry(const char *utmp_id, const char *utmp_line, pid_t pid) noexcept
+    {
+        queue(true, utmp_id, utmp_line, pid);
+    }
+
+    // Clear the entry for the given id/line.
+    void clear_entry(const char *utmp_id, const char *utmp_line) noexcept
+    {
+        queue(false, utmp_id, utmp_line, 0);
+    }
+
+    // Mark the database as writable: perform pending updates, and perform further updates immediately.
+    void set_writable() noexcept;
+
+    // Perform any pending updates (at shutdown), whether or not the database was marked writable.
+    void flush() noexcept;
+
+    size_t num_pending() const noexcept
+    {
+        return pending.size();
+    }
+};
+
 #else // Don't update databases:
 
 static inline bool log_boot()
@@ -168,6 +232,18 @@ inline void clear_utmp_entry(const char *utmp_id, const char *utmp_line)
     return;
 }
 
+class utmp_queue_t
+{
+    public:
+    void create_entry(const char *utmp_id, const char *utmp_line, pid_t pid) noexcept { }
+    void clear_entry(const char *utmp_id, const char *utmp_line) noexcept { }
+    void set_writable() noexcept { }
+    void flush() noexcept { }
+    size_t num_pending() const noexcept { return 0; }
+};
+
 #endif
 
+extern utmp_queue_t utmp_queue;
+
 #endif
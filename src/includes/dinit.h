@@ -14,6 +14,8 @@ using rearm = dasynq::rearm;
 using time_val = dasynq::time_val;
 
 void rootfs_is_rw() noexcept;
+void boot_completed() noexcept;
+bool regenerate_readahead_profile() noexcept;
 void setup_external_log() noexcept;
 void read_env_file(const char *);
 
@@ -0,0 +1,34 @@
+#ifndef DIR_WATCHER_H_INCLUDED
+#define DIR_WATCHER_H_INCLUDED 1
+
+#include "dinit.h"
+#include "service.h"
+
+// The service directory watcher: watches the service description directories (using inotify) for
+// changes to service description files, and marks the corresponding loaded services as changed
+// (see service_set::description_changed()). Services so marked can then be reloaded together via
+// the control protocol ("dinitctl reload --changed").
+//
+// Only files directly within the service directories are watched; changes within dependency
+// directories (such as "waits-for.d") are not detected, nor are changes in a service directory
+// which did not exist when watching began.
+
+class service_dir_watcher : public eventloop_t::fd_watcher_impl<service_dir_watcher>
+{
+    dirload_service_set *services = nullptr;
+    bool watching = false;
+
+    public:
+    // Begin watching the service directories of the given service set. Returns false (and logs
+    // an error) on failure.
+    bool start(dirload_service_set *sset) noexcept;
+
+    // Stop watching, if watching.
+    void stop() noexcept;
+
+    dasynq::rearm fd_event(eventloop_t &loop, int fd, int flags) noexcept;
+};
+
+extern service_dir_watcher dir_watcher;
+
+#endif
@@ -1,14 +1,17 @@
 #include <iostream>
 #include <list>
+#include <memory>
 #include <limits>
 #include <csignal>
 #include <cstring>
+#include <cstdint>
 #include <utility>
 #include <vector>
 
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sched.h>
 #include <grp.h>
 #include <pwd.h>
 
@@ -50,6 +53,47 @@ struct service_rlimits
     service_rlimits(int id) : resource_id(id), soft_set(0), hard_set(0), limits({0,0}) { }
 };
 
+// NUMA memory policy for a service process (Linux only)
+enum class numa_policy_t
+{
+    NONE,       // not set (inherit)
+    DEFAULT,    // system default policy
+    LOCAL,      // allocate on the node of the CPU which triggers allocation
+    BIND,       // allocate only from the specified nodes
+    PREFERRED,  // prefer allocation from the specified node
+    INTERLEAVE  // interleave allocation across the specified nodes
+};
+
+// Scheduling and placement settings for a service process. These are applied (in the child
+// process) before executing the service command.
+struct service_sched_settings
+{
+    std::vector<unsigned long> cpu_mask;  // CPU affinity (bit per CPU); empty if not set
+    int sched_policy = -1;                // scheduling policy (SCHED_xxx), or -1 if not set
+    bool sched_priority_set = false;
+    int sched_priority = 0;               // static scheduling priority (for SCHED_FIFO/SCHED_RR)
+    bool nice_set = false;
+    int nice = 0;                         // nice value (if nice_set)
+    int ioprio = -1;                      // I/O priority (class << 13 | level), or -1 if not set
+    numa_policy_t numa_policy = numa_policy_t::NONE;
+    std::vector<unsigned long> numa_nodes;  // NUMA nodes for policy (bit per node)
+};
+
+// Settings for running a service process, which do not change once the service is loaded. Process-based
+// services refer to these via a shared pointer, so that instances of a service template can share a
+// single copy.
+struct process_exec_settings
+{
+    std::string working_dir;               // working directory (or empty)
+    std::string env_file;                  // file with environment settings (or empty)
+    std::vector<service_rlimits> rlimits;  // resource limits
+    service_sched_settings sched;          // CPU affinity, scheduling policy etc
+};
+
+// Maximum CPU number, and NUMA node number, that can be specified in settings:
+constexpr unsigned max_cpu_number = 4095;
+constexpr unsigned max_numa_node = 1023;
+
 // Exception while loading a service
 class service_load_exc
 {
@@ -113,18 +157,43 @@ class setting_exception
 };
 
 
+// Character classes for lexing service description files. Service descriptions are interpreted as
+// ASCII (the classic locale); bytes outside the ASCII range belong to no class.
+constexpr unsigned char LEX_SPACE = 1;     // white space (as per isspace() in the classic locale)
+constexpr unsigned char LEX_NAME = 2;      // may appear in a setting name
+constexpr unsigned char LEX_SPECIAL = 4;   // has special meaning in a setting value
+
+constexpr unsigned char lex_class_of(unsigned c)
+{
+    return (c == ' ' || (c >= '\t' && c <= '\r')) ? (LEX_SPACE | LEX_SPECIAL)
+            : ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '.') ? LEX_NAME
+            : (c == '"' || c == '\\' || c == '#') ? LEX_SPECIAL : 0;
+}
+
+#define DINIT_LEX_ROW(n) lex_class_of(n), lex_class_of(n+1), lex_class_of(n+2), lex_class_of(n+3), \
+        lex_class_of(n+4), lex_class_of(n+5), lex_class_of(n+6), lex_class_of(n+7), lex_class_of(n+8), \
+        lex_class_of(n+9), lex_class_of(n+10), lex_class_of(n+11), lex_class_of(n+12), lex_class_of(n+13), \
+        lex_class_of(n+14), lex_class_of(n+15)
+
+// Check whether a character belongs to a class (or any of a set of classes).
+inline bool lex_is(char c, unsigned char lex_class) noexcept
+{
+    static constexpr unsigned char lex_classes[256] = {
+        DINIT_LEX_ROW(0), DINIT_LEX_ROW(16), DINIT_LEX_ROW(32), DINIT_LEX_ROW(48),
+        DINIT_LEX_ROW(64), DINIT_LEX_ROW(80), DINIT_LEX_ROW(96), DINIT_LEX_ROW(112)
+        // (remainder: zero)
+    };
+    return (lex_classes[(unsigned char)c] & lex_class) != 0;
+}
+
+#undef DINIT_LEX_ROW
+
 // Utility function to skip white space. Returns an iterator at the
 // first non-white-space position (or at end).
 inline string_iterator skipws(string_iterator i, string_iterator end)
 {
-    using std::locale;
-    using std::isspace;
-
-    while (i != end) {
-      if (! isspace(*i, locale::classic())) {
-        break;
-      }
-      ++i;
+    while (i != end && lex_is(*i, LEX_SPACE)) {
+        ++i;
     }
     return i;
 }
@@ -144,19 +213,12 @@ inline int signal_name_to_number(std::string &signame)
 // Read a setting name.
 inline string read_setting_name(string_iterator & i, string_iterator end)
 {
-    using std::locale;
-    using std::ctype;
-    using std::use_facet;
-
-    const ctype<char> & facet = use_facet<ctype<char> >(locale::classic());
-
-    string rval;
-    // Allow alphabetical characters, and dash (-) in setting name
-    while (i != end && (*i == '-' || *i == '.' || facet.is(ctype<char>::alpha, *i))) {
-        rval += *i;
+    // Allow alphabetical characters, dash (-) and dot (.) in setting name
+    string_iterator start = i;
+    while (i != end && lex_is(*i, LEX_NAME)) {
         ++i;
     }
-    return rval;
+    return string(start, i);
 }
 
 // Read a setting value.
@@ -185,9 +247,6 @@ inline string read_setting_name(string_iterator & i, string_iterator end)
 inline string read_setting_value(string_iterator & i, string_iterator end,
         std::list<std::pair<unsigned,unsigned>> * part_positions = nullptr)
 {
-    using std::locale;
-    using std::isspace;
-
     i = skipws(i, end);
 
     string rval;
@@ -241,7 +300,7 @@ inline string read_setting_value(string_iterator & i, string_iterator end,
                 throw setting_exception("Backslash escape (`\\') not followed by character");
             }
         }
-        else if (isspace(c, locale::classic())) {
+        else if (lex_is(c, LEX_SPACE)) {
             if (! new_part && part_positions != nullptr) {
                 part_positions->emplace_back(part_start, rval.length());
                 new_part = true;
@@ -262,7 +321,13 @@ inline string read_setting_value(string_iterator & i, string_iterator end,
                 part_start = rval.length();
                 new_part = false;
             }
-            rval += c;
+            // Copy a run of ordinary characters in one go:
+            string_iterator run_start = i;
+            do {
+                ++i;
+            } while (i != end && ! lex_is(*i, LEX_SPECIAL));
+            rval.append(run_start, i);
+            continue;
         }
         ++i;
     }
@@ -523,6 +588,223 @@ inline void parse_rlimit(const std::string &line, const std::string &service_nam
     }
 }
 
+// Parse a list of CPU (or NUMA node) numbers and ranges, separated by commas and/or white space,
+// eg "0-3,6 8", into a bit mask. The list must not be empty.
+inline void parse_cpu_list(const std::string &value, const std::string &service_name, const char *param_name,
+        unsigned max_num, std::vector<unsigned long> &mask)
+{
+    constexpr unsigned bits_per_long = std::numeric_limits<unsigned long>::digits;
+
+    auto bad_value = [&]() {
+        return service_description_exc(service_name, std::string(param_name) + ": Bad CPU/node list.");
+    };
+
+    // Read a number at the given position, advance the position past it:
+    auto read_num = [&](std::string::size_type &pos) -> unsigned {
+        if (pos == value.length() || value[pos] < '0' || value[pos] > '9') throw bad_value();
+        unsigned num = 0;
+        while (pos < value.length() && value[pos] >= '0' && value[pos] <= '9') {
+            num = num * 10 + (value[pos++] - '0');
+            if (num > max_num) {
+                throw service_description_exc(service_name, std::string(param_name)
+                        + ": CPU/node number is too large.");
+            }
+        }
+        return num;
+    };
+
+    mask.clear();
+    std::string::size_type pos = 0;
+    while (true) {
+        while (pos < value.length() && (value[pos] == ',' || lex_is(value[pos], LEX_SPACE))) ++pos;
+        if (pos == value.length()) break;
+
+        unsigned first = read_num(pos);
+        unsigned last = first;
+        if (pos < value.length() && value[pos] == '-') {
+            ++pos;
+            last = read_num(pos);
+            if (last < first) throw bad_value();
+        }
+        if (pos < value.length() && value[pos] != ',' && ! lex_is(value[pos], LEX_SPACE)) {
+            throw bad_value();
+        }
+
+        if (mask.size() <= last / bits_per_long) {
+            mask.resize(last / bits_per_long + 1);
+        }
+        for (unsigned n = first; n <= last; ++n) {
+            mask[n / bits_per_long] |= 1ul << (n % bits_per_long);
+        }
+    }
+
+    if (mask.empty()) throw bad_value();
+}
+
+// Parse a scheduling policy name, returning the SCHED_xxx value.
+inline int parse_sched_policy(const std::string &value, const std::string &service_name)
+{
+    if (value == "other") return SCHED_OTHER;
+    if (value == "fifo") return SCHED_FIFO;
+    if (value == "rr") return SCHED_RR;
+    #ifdef SCHED_BATCH
+    if (value == "batch") return SCHED_BATCH;
+    #endif
+    #ifdef SCHED_IDLE
+    if (value == "idle") return SCHED_IDLE;
+    #endif
+    throw service_description_exc(service_name, "sched-policy: Unknown/unsupported scheduling policy: "
+            + value);
+}
+
+// Parse a nice value (-20 to 19).
+inline int parse_nice(const std::string &value, const std::string &service_name)
+{
+    std::size_t ind = 0;
+    try {
+        int v = std::stoi(value, &ind, 10);
+        if (ind == value.length() && v >= -20 && v <= 19) {
+            return v;
+        }
+    }
+    catch (std::logic_error &exc) {
+        // (fall through)
+    }
+    throw service_description_exc(service_name, "nice: Value must be a number between -20 and 19.");
+}
+
+// Parse an I/O priority setting: "realtime:<level>", "best-effort:<level>" (where level is 0-7), or "idle".
+// Returns the value to be passed to ioprio_set (class << 13 | level).
+inline int parse_ioprio(const std::string &value, const std::string &service_name)
+{
+    // I/O scheduling classes (as for the Linux IOPRIO_CLASS_xxx constants):
+    constexpr int ioprio_class_rt = 1;
+    constexpr int ioprio_class_be = 2;
+    constexpr int ioprio_class_idle = 3;
+    constexpr int ioprio_class_shift = 13;
+
+    if (value == "idle") {
+        return ioprio_class_idle << ioprio_class_shift;
+    }
+
+    int ioclass;
+    std::string level_str;
+    if (starts_with(value, "realtime:")) {
+        ioclass = ioprio_class_rt;
+        level_str = value.substr(9 /* len 'realtime:' */);
+    }
+    else if (starts_with(value, "best-effort:")) {
+        ioclass = ioprio_class_be;
+        level_str = value.substr(12 /* len 'best-effort:' */);
+    }
+    else {
+        throw service_description_exc(service_name, "ioprio: Value must be one of \"realtime:<level>\", "
+                "\"best-effort:<level>\" or \"idle\".");
+    }
+
+    if (level_str.length() != 1 || level_str[0] < '0' || level_str[0] > '7') {
+        throw service_description_exc(service_name, "ioprio: Level must be between 0 and 7.");
+    }
+    return (ioclass << ioprio_class_shift) | (level_str[0] - '0');
+}
+
+// Parse a NUMA policy setting: "default", "local", or one of "bind", "preferred" or "interleave"
+// followed by a list of nodes (for "preferred", a single node).
+inline void parse_numa_policy(const std::string &value, const std::list<std::pair<unsigned,unsigned>> &indices,
+        const std::string &service_name, service_sched_settings &sched)
+{
+    if (indices.empty()) {
+        throw service_description_exc(service_name, "numa-policy: Bad value.");
+    }
+
+    auto first_part = indices.front();
+    std::string policy_str = value.substr(first_part.first, first_part.second - first_part.first);
+    std::string nodes_str = value.substr(first_part.second);
+
+    sched.numa_nodes.clear();
+    if (policy_str == "default" || policy_str == "local") {
+        if (indices.size() != 1) {
+            throw service_description_exc(service_name, "numa-policy: Policy \"" + policy_str
+                    + "\" does not take a node list.");
+        }
+        sched.numa_policy = (policy_str == "default") ? numa_policy_t::DEFAULT : numa_policy_t::LOCAL;
+        return;
+    }
+
+    if (policy_str == "bind") {
+        sched.numa_policy = numa_policy_t::BIND;
+    }
+    else if (policy_str == "preferred") {
+        sched.numa_policy = numa_policy_t::PREFERRED;
+    }
+    else if (policy_str == "interleave") {
+        sched.numa_policy = numa_policy_t::INTERLEAVE;
+    }
+    else {
+        throw service_description_exc(service_name, "numa-policy: Unknown policy: " + policy_str);
+    }
+
+    parse_cpu_list(nodes_str, service_name, "numa-policy", max_numa_node, sched.numa_nodes);
+
+    if (sched.numa_policy == numa_policy_t::PREFERRED) {
+        unsigned count = 0;
+        for (unsigned long bits : sched.numa_nodes) {
+            for ( ; bits != 0; bits &= bits - 1) ++count;
+        }
+        if (count != 1) {
+            throw service_description_exc(service_name, "numa-policy: Policy \"preferred\" requires a "
+                    "single node.");
+        }
+    }
+}
+
+// Check that the scheduling policy and priority settings are consistent (this can only be done once
+// all settings have been read). A real-time policy requires a non-zero priority, other policies
+// require a zero priority, and a priority is meaningless without a policy.
+inline void check_sched_settings(const std::string &service_name, const service_sched_settings &sched)
+{
+    if (sched.sched_policy == -1) {
+        if (sched.sched_priority_set) {
+            throw service_description_exc(service_name, "sched-priority: Requires sched-policy to be "
+                    "specified.");
+        }
+        return;
+    }
+
+    bool realtime = (sched.sched_policy == SCHED_FIFO || sched.sched_policy == SCHED_RR);
+    if (realtime && sched.sched_priority == 0) {
+        throw service_description_exc(service_name, "sched-policy: Real-time policy requires a "
+                "non-zero sched-priority.");
+    }
+    if (! realtime && sched.sched_priority != 0) {
+        throw service_description_exc(service_name, "sched-priority: Must be 0 for a non-real-time "
+                "scheduling policy.");
+    }
+}
+
+// Process a single line of a service description, calling the given function if it contains a setting.
+template <typename T>
+void process_service_file_line(const string &name, string &line, T func)
+{
+    string::iterator i = line.begin();
+    string::iterator end = line.end();
+
+    i = skipws(i, end);
+    if (i != end) {
+        if (*i == '#') {
+            return;  // comment line
+        }
+        string setting = read_setting_name(i, end);
+        i = skipws(i, end);
+        if (i == end || (*i != '=' && *i != ':')) {
+            throw service_description_exc(name, "Badly formed line.");
+        }
+        i = skipws(++i, end);
+
+        func(line, setting, i, end);
+    }
+}
+
 // Process an opened service file, line by line.
 //    name - the service name
 //    service_file - the service file input stream
@@ -541,29 +823,12 @@ void process_service_file(string name, std::istream &service_file, T func)
     string line;
 
     while (getline(service_file, line)) {
-        string::iterator i = line.begin();
-        string::iterator end = line.end();
-
-        i = skipws(i, end);
-        if (i != end) {
-            if (*i == '#') {
-                continue;  // comment line
-            }
-            string setting = read_setting_name(i, end);
-            i = skipws(i, end);
-            if (i == end || (*i != '=' && *i != ':')) {
-                throw service_description_exc(name, "Badly formed line.");
-            }
-            i = skipws(++i, end);
-
-            func(line, setting, i, end);
-        }
+        process_service_file_line(name, line, func);
     }
 }
 
-// A wrapper type for service parameters. It is parameterised by dependency type.
-template <class dep_type>
-class service_settings_wrapper
+// Service parameters, other than dependencies (see service_settings_wrapper).
+class service_settings
 {
     template <typename A, typename B> using pair = std::pair<A,B>;
     template <typename A> using list = std::list<A>;
@@ -581,7 +846,10 @@ class service_settings_wrapper
     bool do_sub_vars = false;
 
     service_type_t service_type = service_type_t::PROCESS;
-    std::list<dep_type> depends;
+    // If lazy_soft_deps is set, soft (waits-for and milestone) dependencies are not loaded, but are
+    // instead recorded by name in lazy_depends (the loader must handle waits-for.d itself):
+    bool lazy_soft_deps = false;
+    std::list<pair<string, dependency_type>> lazy_depends;
     string logfile;
     service_flags_t onstart_flags;
     int term_signal = -1;  // additional termination signal
@@ -598,12 +866,18 @@ class service_settings_wrapper
     timespec restart_interval = { .tv_sec = 10, .tv_nsec = 0 };
     int max_restarts = 3;
     timespec restart_delay = { .tv_sec = 0, .tv_nsec = 200000000 };
+    timespec restart_delay_max = { .tv_sec = 0, .tv_nsec = 0 };  // restart backoff; 0 = disabled
+    int restart_delay_jitter = 0;  // percent
+    timespec restart_delay_reset = { .tv_sec = 10, .tv_nsec = 0 };
     timespec stop_timeout = { .tv_sec = 10, .tv_nsec = 0 };
     timespec start_timeout = { .tv_sec = 60, .tv_nsec = 0 };
     std::vector<service_rlimits> rlimits;
+    service_sched_settings sched;
 
     int readiness_fd = -1;      // readiness fd in service process
     std::string readiness_var;  // environment var to hold readiness fd
+    bool readiness_socket = false;  // readiness notification via shared notification socket
+    timespec watchdog_timeout = { .tv_sec = 0, .tv_nsec = 0 };
 
     uid_t run_as_uid = -1;
     gid_t run_as_uid_gid = -1; // primary group of "run as" uid if known
@@ -627,6 +901,146 @@ class service_settings_wrapper
     }
 };
 
+// A wrapper type for service parameters. It is parameterised by dependency type.
+template <class dep_type>
+class service_settings_wrapper : public service_settings
+{
+    public:
+    std::list<dep_type> depends;
+};
+
+// Identifiers for service settings.
+enum class setting_id
+{
+    COMMAND, WORKING_DIR, ENV_FILE, SOCKET_LISTEN, SOCKET_PERMISSIONS, SOCKET_UID, SOCKET_GID,
+    STOP_COMMAND, PID_FILE, DEPENDS_ON, DEPENDS_MS, WAITS_FOR, WAITS_FOR_D, LOGFILE, RESTART,
+    SMOOTH_RECOVERY, TYPE, OPTIONS, LOAD_OPTIONS, TERM_SIGNAL, RESTART_LIMIT_INTERVAL, RESTART_DELAY,
+    RESTART_DELAY_MAX, RESTART_DELAY_JITTER, RESTART_DELAY_RESET, RESTART_LIMIT_COUNT, STOP_TIMEOUT,
+    START_TIMEOUT, WATCHDOG_TIMEOUT, RUN_AS, CHAIN_TO, READY_NOTIFICATION, INITTAB_ID, INITTAB_LINE,
+    RLIMIT_NOFILE, RLIMIT_CORE, RLIMIT_DATA, RLIMIT_ADDRSPACE, CPU_AFFINITY, SCHED_POLICY,
+    SCHED_PRIORITY, NICE, IOPRIO, NUMA_POLICY, UNKNOWN
+};
+
+// Hash a setting name (FNV-1a). This is used to dispatch on setting names via a switch statement; since
+// the case labels are computed at compile time, the compiler verifies that the hash is collision-free
+// (perfect) over the set of recognised names.
+constexpr uint32_t setting_name_hash(const char *name, uint32_t hash = 2166136261u)
+{
+    return *name == 0 ? hash : setting_name_hash(name + 1, (hash ^ (unsigned char)*name) * 16777619u);
+}
+
+inline uint32_t setting_name_hash(const string &name) noexcept
+{
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash = (hash ^ (unsigned char)c) * 16777619u;
+    }
+    return hash;
+}
+
+// Find the identifier for a setting name, or setting_id::UNKNOWN if not recognised.
+inline setting_id lookup_setting(const string &setting) noexcept
+{
+    // (An unrecognised name may have the same hash as a recognised one, so we must check the name).
+    auto check = [&](const char *name, setting_id id) -> setting_id {
+        return setting == name ? id : setting_id::UNKNOWN;
+    };
+
+    switch (setting_name_hash(setting)) {
+    case setting_name_hash("command"):
+        return check("command", setting_id::COMMAND);
+    case setting_name_hash("working-dir"):
+        return check("working-dir", setting_id::WORKING_DIR);
+    case setting_name_hash("env-file"):
+        return check("env-file", setting_id::ENV_FILE);
+    case setting_name_hash("socket-listen"):
+        return check("socket-listen", setting_id::SOCKET_LISTEN);
+    case setting_name_hash("socket-permissions"):
+        return check("socket-permissions", setting_id::SOCKET_PERMISSIONS);
+    case setting_name_hash("socket-uid"):
+        return check("socket-uid", setting_id::SOCKET_UID);
+    case setting_name_hash("socket-gid"):
+        return check("socket-gid", setting_id::SOCKET_GID);
+    case setting_name_hash("stop-command"):
+        return check("stop-command", setting_id::STOP_COMMAND);
+    case setting_name_hash("pid-file"):
+        return check("pid-file", setting_id::PID_FILE);
+    case setting_name_hash("depends-on"):
+        return check("depends-on", setting_id::DEPENDS_ON);
+    case setting_name_hash("depends-ms"):
+        return check("depends-ms", setting_id::DEPENDS_MS);
+    case setting_name_hash("waits-for"):
+        return check("waits-for", setting_id::WAITS_FOR);
+    case setting_name_hash("waits-for.d"):
+        return check("waits-for.d", setting_id::WAITS_FOR_D);
+    case setting_name_hash("logfile"):
+        return check("logfile", setting_id::LOGFILE);
+    case setting_name_hash("restart"):
+        return check("restart", setting_id::RESTART);
+    case setting_name_hash("smooth-recovery"):
+        return check("smooth-recovery", setting_id::SMOOTH_RECOVERY);
+    case setting_name_hash("type"):
+        return check("type", setting_id::TYPE);
+    case setting_name_hash("options"):
+        return check("options", setting_id::OPTIONS);
+    case setting_name_hash("load-options"):
+        return check("load-options", setting_id::LOAD_OPTIONS);
+    case setting_name_hash("term-signal"):
+        return check("term-signal", setting_id::TERM_SIGNAL);
+    case setting_name_hash("termsignal"):
+        return check("termsignal", setting_id::TERM_SIGNAL);
+    case setting_name_hash("restart-limit-interval"):
+        return check("restart-limit-interval", setting_id::RESTART_LIMIT_INTERVAL);
+    case setting_name_hash("restart-delay"):
+        return check("restart-delay", setting_id::RESTART_DELAY);
+    case setting_name_hash("restart-delay-max"):
+        return check("restart-delay-max", setting_id::RESTART_DELAY_MAX);
+    case setting_name_hash("restart-delay-jitter"):
+        return check("restart-delay-jitter", setting_id::RESTART_DELAY_JITTER);
+    case setting_name_hash("restart-delay-reset"):
+        return check("restart-delay-reset", setting_id::RESTART_DELAY_RESET);
+    case setting_name_hash("restart-limit-count"):
+        return check("restart-limit-count", setting_id::RESTART_LIMIT_COUNT);
+    case setting_name_hash("stop-timeout"):
+        return check("stop-timeout", setting_id::STOP_TIMEOUT);
+    case setting_name_hash("start-timeout"):
+        return check("start-timeout", setting_id::START_TIMEOUT);
+    case setting_name_hash("watchdog-timeout"):
+        return check("watchdog-timeout", setting_id::WATCHDOG_TIMEOUT);
+    case setting_name_hash("run-as"):
+        return check("run-as", setting_id::RUN_AS);
+    case setting_name_hash("chain-to"):
+        return check("chain-to", setting_id::CHAIN_TO);
+    case setting_name_hash("ready-notification"):
+        return check("ready-notification", setting_id::READY_NOTIFICATION);
+    case setting_name_hash("inittab-id"):
+        return check("inittab-id", setting_id::INITTAB_ID);
+    case setting_name_hash("inittab-line"):
+        return check("inittab-line", setting_id::INITTAB_LINE);
+    case setting_name_hash("rlimit-nofile"):
+        return check("rlimit-nofile", setting_id::RLIMIT_NOFILE);
+    case setting_name_hash("rlimit-core"):
+        return check("rlimit-core", setting_id::RLIMIT_CORE);
+    case setting_name_hash("rlimit-data"):
+        return check("rlimit-data", setting_id::RLIMIT_DATA);
+    case setting_name_hash("rlimit-addrspace"):
+        return check("rlimit-addrspace", setting_id::RLIMIT_ADDRSPACE);
+    case setting_name_hash("cpu-affinity"):
+        return check("cpu-affinity", setting_id::CPU_AFFINITY);
+    case setting_name_hash("sched-policy"):
+        return check("sched-policy", setting_id::SCHED_POLICY);
+    case setting_name_hash("sched-priority"):
+        return check("sched-priority", setting_id::SCHED_PRIORITY);
+    case setting_name_hash("nice"):
+        return check("nice", setting_id::NICE);
+    case setting_name_hash("ioprio"):
+        return check("ioprio", setting_id::IOPRIO);
+    case setting_name_hash("numa-policy"):
+        return check("numa-policy", setting_id::NUMA_POLICY);
+    default: return setting_id::UNKNOWN;
+    }
+}
+
 // Process a service description line. In general, parse the setting value and record the parsed value
 // in a service settings wrapper object. Errors will be reported via service_description_exc exception.
 //
@@ -657,19 +1071,21 @@ void process_service_line(settings_wrapper &settings, const char *name, string &
         string::iterator &i, string::iterator &end, load_service_t load_service,
         process_dep_dir_t process_dep_dir)
 {
-    if (setting == "command") {
+    switch (lookup_setting(setting)) {
+    case setting_id::COMMAND:
         settings.command = read_setting_value(i, end, &settings.command_offsets);
-    }
-    else if (setting == "working-dir") {
+        break;
+    case setting_id::WORKING_DIR:
         settings.working_dir = read_setting_value(i, end, nullptr);
-    }
-    else if (setting == "env-file") {
+        break;
+    case setting_id::ENV_FILE:
         settings.env_file = read_setting_value(i, end, nullptr);
-    }
-    else if (setting == "socket-listen") {
+        break;
+    case setting_id::SOCKET_LISTEN:
         settings.socket_path = read_setting_value(i, end, nullptr);
-    }
-    else if (setting == "socket-permissions") {
+        break;
+    case setting_id::SOCKET_PERMISSIONS:
+    {
         string sock_perm_str = read_setting_value(i, end, nullptr);
         std::size_t ind = 0;
         try {
@@ -682,49 +1098,77 @@ void process_service_line(settings_wrapper &settings, const char *name, string &
             throw service_description_exc(name, "socket-permissions: Badly-formed or "
                     "out-of-range numeric value");
         }
+        break;
     }
-    else if (setting == "socket-uid") {
+    case setting_id::SOCKET_UID:
+    {
         string sock_uid_s = read_setting_value(i, end, nullptr);
         settings.socket_uid = parse_uid_param(sock_uid_s, name, "socket-uid", &settings.socket_uid_gid);
+        break;
     }
-    else if (setting == "socket-gid") {
+    case setting_id::SOCKET_GID:
+    {
         string sock_gid_s = read_setting_value(i, end, nullptr);
         settings.socket_gid = parse_gid_param(sock_gid_s, "socket-gid", name);
+        break;
     }
-    else if (setting == "stop-command") {
+    case setting_id::STOP_COMMAND:
         settings.stop_command = read_setting_value(i, end, &settings.stop_command_offsets);
-    }
-    else if (setting == "pid-file") {
+        break;
+    case setting_id::PID_FILE:
         settings.pid_file = read_setting_value(i, end);
-    }
-    else if (setting == "depends-on") {
+        break;
+    case setting_id::DEPENDS_ON:
+    {
         string dependency_name = read_setting_value(i, end);
         settings.depends.emplace_back(load_service(dependency_name.c_str()), dependency_type::REGULAR);
+        break;
     }
-    else if (setting == "depends-ms") {
+    case setting_id::DEPENDS_MS:
+    {
         string dependency_name = read_setting_value(i, end);
-        settings.depends.emplace_back(load_service(dependency_name.c_str()), dependency_type::MILESTONE);
+        if (settings.lazy_soft_deps) {
+            settings.lazy_depends.emplace_back(std::move(dependency_name), dependency_type::MILESTONE);
+        }
+        else {
+            settings.depends.emplace_back(load_service(dependency_name.c_str()), dependency_type::MILESTONE);
+        }
+        break;
     }
-    else if (setting == "waits-for") {
+    case setting_id::WAITS_FOR:
+    {
         string dependency_name = read_setting_value(i, end);
-        settings.depends.emplace_back(load_service(dependency_name.c_str()), dependency_type::WAITS_FOR);
+        if (settings.lazy_soft_deps) {
+            settings.lazy_depends.emplace_back(std::move(dependency_name), dependency_type::WAITS_FOR);
+        }
+        else {
+            settings.depends.emplace_back(load_service(dependency_name.c_str()), dependency_type::WAITS_FOR);
+        }
+        break;
     }
-    else if (setting == "waits-for.d") {
+    case setting_id::WAITS_FOR_D:
+    {
         string waitsford = read_setting_value(i, end);
         process_dep_dir(settings.depends, waitsford, dependency_type::WAITS_FOR);
+        break;
     }
-    else if (setting == "logfile") {
+    case setting_id::LOGFILE:
         settings.logfile = read_setting_value(i, end);
-    }
-    else if (setting == "restart") {
+        break;
+    case setting_id::RESTART:
+    {
         string restart = read_setting_value(i, end);
         settings.auto_restart = (restart == "yes" || restart == "true");
+        break;
     }
-    else if (setting == "smooth-recovery") {
+    case setting_id::SMOOTH_RECOVERY:
+    {
         string recovery = read_setting_value(i, end);
         settings.smooth_recovery = (recovery == "yes" || recovery == "true");
+        break;
     }
-    else if (setting == "type") {
+    case setting_id::TYPE:
+    {
         string type_str = read_setting_value(i, end);
         if (type_str == "scripted") {
             settings.service_type = service_type_t::SCRIPTED;
@@ -742,8 +1186,10 @@ void process_service_line(settings_wrapper &settings, const char *name, string &
             throw service_description_exc(name, "Service type must be one of: \"scripted\","
                 " \"process\", \"bgprocess\" or \"internal\"");
         }
+        break;
     }
-    else if (setting == "options") {
+    case setting_id::OPTIONS:
+    {
         std::list<std::pair<unsigned,unsigned>> indices;
         string onstart_cmds = read_setting_value(i, end, &indices);
         for (auto indexpair : indices) {
@@ -789,8 +1235,10 @@ void process_service_line(settings_wrapper &settings, const char *name, string &
                 throw service_description_exc(name, "Unknown option: " + option_txt);
             }
         }
+        break;
     }
-    else if (setting == "load-options") {
+    case setting_id::LOAD_OPTIONS:
+    {
         std::list<std::pair<unsigned,unsigned>> indices;
         string load_opts = read_setting_value(i, end, &indices);
         for (auto indexpair : indices) {
@@ -807,8 +1255,10 @@ void process_service_line(settings_wrapper &settings, const char *name, string &
                 throw service_description_exc(name, "Unknown load option: " + option_txt);
             }
         }
+        break;
     }
-    else if (setting == "term-signal" || setting == "termsignal") {
+    case setting_id::TERM_SIGNAL:
+    {
         // Note: "termsignal" supported for legacy reasons.
         string signame = read_setting_value(i, end, nullptr);
         int signo = signal_name_to_number(signame);
@@ -819,35 +1269,73 @@ void process_service_line(settings_wrapper &settings, const char *name, string &
         else {
             settings.term_signal = signo;
         }
+        break;
     }
-    else if (setting == "restart-limit-interval") {
+    case setting_id::RESTART_LIMIT_INTERVAL:
+    {
         string interval_str = read_setting_value(i, end, nullptr);
         parse_timespec(interval_str, name, "restart-limit-interval", settings.restart_interval);
+        break;
     }
-    else if (setting == "restart-delay") {
+    case setting_id::RESTART_DELAY:
+    {
         string rsdelay_str = read_setting_value(i, end, nullptr);
         parse_timespec(rsdelay_str, name, "restart-delay", settings.restart_delay);
+        break;
     }
-    else if (setting == "restart-limit-count") {
+    case setting_id::RESTART_DELAY_MAX:
+    {
+        string rsdelay_str = read_setting_value(i, end, nullptr);
+        parse_timespec(rsdelay_str, name, "restart-delay-max", settings.restart_delay_max);
+        break;
+    }
+    case setting_id::RESTART_DELAY_JITTER:
+    {
+        string jitter_str = read_setting_value(i, end, nullptr);
+        settings.restart_delay_jitter = parse_unum_param(jitter_str, name, 100);
+        break;
+    }
+    case setting_id::RESTART_DELAY_RESET:
+    {
+        string reset_str = read_setting_value(i, end, nullptr);
+        parse_timespec(reset_str, name, "restart-delay-reset", settings.restart_delay_reset);
+        break;
+    }
+    case setting_id::RESTART_LIMIT_COUNT:
+    {
         string limit_str = read_setting_value(i, end, nullptr);
         settings.max_restarts = parse_unum_param(limit_str, name, std::numeric_limits<int>::max());
+        break;
     }
-    else if (setting == "stop-timeout") {
+    case setting_id::STOP_TIMEOUT:
+    {
         string stoptimeout_str = read_setting_value(i, end, nullptr);
         parse_timespec(stoptimeout_str, name, "stop-timeout", settings.stop_timeout);
+        break;
     }
-    else if (setting == "start-timeout") {
+    case setting_id::START_TIMEOUT:
+    {
         string starttimeout_str = read_setting_value(i, end, nullptr);
         parse_timespec(starttimeout_str, name, "start-timeout", settings.start_timeout);
+        break;
     }
-    else if (setting == "run-as") {
+    case setting_id::WATCHDOG_TIMEOUT:
+    {
+        string watchdog_str = read_setting_value(i, end, nullptr);
+        parse_timespec(watchdog_str, name, "watchdog-timeout", settings.watchdog_timeout);
+        break;
+    }
+    case setting_id::RUN_AS:
+    {
         string run_as_str = read_setting_value(i, end, nullptr);
         settings.run_as_uid = parse_uid_param(run_as_str, name, "run-as", &settings.run_as_uid_gid);
+        break;
     }
-    else if (setting == "chain-to") {
+    case setting_id::CHAIN_TO:
         settings.chain_to_name = read_setting_value(i, end, nullptr);
-    }
-    else if (setting == "ready-notification") {
+        break;
+    case setting_id::READY_NOTIFICATION:
+    {
         string notify_setting = read_setting_value(i, end, nullptr);
         if (starts_with(notify_setting, "pipefd:")) {
             settings.readiness_fd = parse_unum_param(notify_setting.substr(7 /* len 'pipefd:' */),
@@ -860,12 +1348,17 @@ void process_service_line(settings_wrapper &settings, const char *name, string &
                         "in ready-notification");
             }
         }
+        else if (notify_setting == "socket") {
+            settings.readiness_socket = true;
+        }
         else {
             throw service_description_exc(name, "Unknown ready-notification setting: "
                     + notify_setting);
         }
+        break;
     }
-    else if (setting == "inittab-id") {
+    case setting_id::INITTAB_ID:
+    {
         string inittab_setting = read_setting_value(i, end, nullptr);
         #if USE_UTMPX
         if (inittab_setting.length() > sizeof(settings.inittab_id)) {
@@ -873,8 +1366,10 @@ void process_service_line(settings_wrapper &settings, const char *name, string &
         }
         strncpy(settings.inittab_id, inittab_setting.c_str(), sizeof(settings.inittab_id));
         #endif
+        break;
     }
-    else if (setting == "inittab-line") {
+    case setting_id::INITTAB_LINE:
+    {
         string inittab_setting = read_setting_value(i, end, nullptr);
         #if USE_UTMPX
         if (inittab_setting.length() > sizeof(settings.inittab_line)) {
@@ -882,34 +1377,281 @@ void process_service_line(settings_wrapper &settings, const char *name, string &
         }
         strncpy(settings.inittab_line, inittab_setting.c_str(), sizeof(settings.inittab_line));
         #endif
+        break;
     }
-    else if (setting == "rlimit-nofile") {
+    case setting_id::RLIMIT_NOFILE:
+    {
         string nofile_setting = read_setting_value(i, end, nullptr);
         service_rlimits &nofile_limits = find_rlimits(settings.rlimits, RLIMIT_NOFILE);
         parse_rlimit(line, name, "rlimit-nofile", nofile_limits);
+        break;
     }
-    else if (setting == "rlimit-core") {
+    case setting_id::RLIMIT_CORE:
+    {
         string nofile_setting = read_setting_value(i, end, nullptr);
         service_rlimits &nofile_limits = find_rlimits(settings.rlimits, RLIMIT_CORE);
         parse_rlimit(line, name, "rlimit-core", nofile_limits);
+        break;
     }
-    else if (setting == "rlimit-data") {
+    case setting_id::RLIMIT_DATA:
+    {
         string nofile_setting = read_setting_value(i, end, nullptr);
         service_rlimits &nofile_limits = find_rlimits(settings.rlimits, RLIMIT_DATA);
         parse_rlimit(line, name, "rlimit-data", nofile_limits);
+        break;
     }
-    else if (setting == "rlimit-addrspace") {
+    case setting_id::RLIMIT_ADDRSPACE:
+    {
         #if defined(RLIMIT_AS)
             string nofile_setting = read_setting_value(i, end, nullptr);
             service_rlimits &nofile_limits = find_rlimits(settings.rlimits, RLIMIT_AS);
             parse_rlimit(line, name, "rlimit-addrspace", nofile_limits);
         #endif
+        break;
     }
-    else {
+    case setting_id::CPU_AFFINITY:
+    {
+        string cpus_str = read_setting_value(i, end, nullptr);
+        #ifdef __linux__
+        parse_cpu_list(cpus_str, name, "cpu-affinity", max_cpu_number, settings.sched.cpu_mask);
+        #else
+        throw service_description_exc(name, "cpu-affinity: Not supported on this platform.");
+        #endif
+        break;
+    }
+    case setting_id::SCHED_POLICY:
+    {
+        string policy_str = read_setting_value(i, end, nullptr);
+        settings.sched.sched_policy = parse_sched_policy(policy_str, name);
+        break;
+    }
+    case setting_id::SCHED_PRIORITY:
+    {
+        string priority_str = read_setting_value(i, end, nullptr);
+        settings.sched.sched_priority = parse_unum_param(priority_str, name, 99);
+        settings.sched.sched_priority_set = true;
+        break;
+    }
+    case setting_id::NICE:
+    {
+        string nice_str = read_setting_value(i, end, nullptr);
+        settings.sched.nice = parse_nice(nice_str, name);
+        settings.sched.nice_set = true;
+        break;
+    }
+    case setting_id::IOPRIO:
+    {
+        string ioprio_str = read_setting_value(i, end, nullptr);
+        #ifdef __linux__
+        settings.sched.ioprio = parse_ioprio(ioprio_str, name);
+        #else
+        throw service_description_exc(name, "ioprio: Not supported on this platform.");
+        #endif
+        break;
+    }
+    case setting_id::NUMA_POLICY:
+    {
+        std::list<std::pair<unsigned,unsigned>> indices;
+        string numa_str = read_setting_value(i, end, &indices);
+        #ifdef __linux__
+        parse_numa_policy(numa_str, indices, name, settings.sched);
+        #else
+        throw service_description_exc(name, "numa-policy: Not supported on this platform.");
+        #endif
+        break;
+    }
+    default:
         throw service_description_exc(name, "Unknown setting: '" + setting + "'.");
     }
 }
 
+// Service templates: a service with a name of the form "base@argument", for which there is no
+// service description, is instead loaded as an instance of the template "base@". The template
+// description is parsed once, into a service_template which is shared by all instances. Within the
+// template, "$1" stands for the instance argument. It may be used only in settings which take a
+// string value, such as the command and dependencies (see template_arg_allowed()), and is
+// substituted in those settings when an instance is created (see instantiate_template()).
+
+// Split a service name into template name (including the trailing '@') and instance argument.
+// Returns false if the name is not of the correct form.
+inline bool split_instance_name(const string &name, string &template_name, string &instance_arg)
+{
+    auto at_pos = name.find('@');
+    if (at_pos == string::npos || at_pos == 0 || at_pos + 1 == name.length()) {
+        return false;
+    }
+    template_name = name.substr(0, at_pos + 1);
+    instance_arg = name.substr(at_pos + 1);
+    return true;
+}
+
+// A dependency in a service template, by name (which may contain "$1"). If is_dir is set, the name
+// is that of a dependency directory (as for waits-for.d) rather than of a service.
+class template_dep
+{
+    public:
+    string name;
+    dependency_type dep_type;
+    bool is_dir = false;
+
+    template_dep(const string &name_p, dependency_type dep_type_p)
+        : name(name_p), dep_type(dep_type_p) { }
+};
+
+// A parsed service template description.
+class service_template
+{
+    public:
+    string filename;  // path of the template description file
+    service_settings_wrapper<template_dep> settings;  // settings, with "$1" unsubstituted
+
+    // Process settings for all instances, if these do not contain "$1" (otherwise, nullptr). Set by
+    // the service loader.
+    std::shared_ptr<const process_exec_settings> exec_settings;
+};
+
+// Check whether "$1" (the instance argument) may be used in a setting in a service template.
+inline bool template_arg_allowed(setting_id id) noexcept
+{
+    switch (id) {
+    case setting_id::COMMAND:
+    case setting_id::STOP_COMMAND:
+    case setting_id::WORKING_DIR:
+    case setting_id::ENV_FILE:
+    case setting_id::SOCKET_LISTEN:
+    case setting_id::PID_FILE:
+    case setting_id::DEPENDS_ON:
+    case setting_id::DEPENDS_MS:
+    case setting_id::WAITS_FOR:
+    case setting_id::WAITS_FOR_D:
+    case setting_id::LOGFILE:
+    case setting_id::CHAIN_TO:
+    case setting_id::READY_NOTIFICATION:
+    case setting_id::INITTAB_ID:
+    case setting_id::INITTAB_LINE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Process a line of a service template description (see process_service_line()). Dependencies are
+// recorded by name. Throws service_description_exc if "$1" is used in a setting which does not
+// allow it.
+inline void process_template_line(service_template &templ, const char *name, string &line,
+        string &setting, string::iterator &i, string::iterator &end)
+{
+    if (! template_arg_allowed(lookup_setting(setting))) {
+        string::iterator value_i = i;
+        if (read_setting_value(value_i, end, nullptr).find("$1") != string::npos) {
+            throw service_description_exc(name, "Instance argument ($1) cannot be used in setting: '"
+                    + setting + "'.");
+        }
+    }
+
+    auto load_dep = [](const string &dep_name) -> const string & {
+        return dep_name;
+    };
+
+    auto process_dep_dir = [](std::list<template_dep> &deplist, const string &waitsford,
+            dependency_type dep_type) -> void {
+        deplist.emplace_back(waitsford, dep_type);
+        deplist.back().is_dir = true;
+    };
+
+    process_service_line(templ.settings, name, line, setting, i, end, load_dep, process_dep_dir);
+}
+
+// Substitute the instance argument for each "$1" in a setting value.
+inline void substitute_instance_arg(string &value, const string &instance_arg)
+{
+    auto pos = value.find("$1");
+    while (pos != string::npos) {
+        value.replace(pos, 2, instance_arg);
+        pos = value.find("$1", pos + instance_arg.length());
+    }
+}
+
+// Substitute the instance argument for each "$1" in a command, given the offsets of each of its
+// parts (which are updated accordingly).
+inline void substitute_instance_arg(string &command, std::list<std::pair<unsigned,unsigned>> &offsets,
+        const string &instance_arg)
+{
+    if (command.find("$1") == string::npos) return;
+
+    string r_command;
+    for (auto &offset_pair : offsets) {
+        string part = command.substr(offset_pair.first, offset_pair.second - offset_pair.first);
+        substitute_instance_arg(part, instance_arg);
+        if (&offset_pair != &offsets.front()) {
+            r_command += ' ';
+        }
+        offset_pair.first = r_command.length();
+        r_command += part;
+        offset_pair.second = r_command.length();
+    }
+    command = std::move(r_command);
+}
+
+#if USE_UTMPX
+// Substitute the instance argument for each "$1" in an inittab-id or inittab-line setting.
+template <size_t N>
+void substitute_instance_arg(char (&field)[N], const char *name, const char *setting_name,
+        const string &instance_arg)
+{
+    string value(field, strnlen(field, N));
+    if (value.find("$1") == string::npos) return;
+    substitute_instance_arg(value, instance_arg);
+    if (value.length() > N) {
+        throw service_description_exc(name, string(setting_name) + " setting is too long");
+    }
+    strncpy(field, value.c_str(), N);
+}
+#endif
+
+// Create the settings for an instance of a service template, substituting the instance argument for
+// "$1" in those settings which contain it. Dependencies are loaded (or, for soft dependencies when
+// settings.lazy_soft_deps is set, recorded by name), and dependency directories processed, via the
+// load_service and process_dep_dir functions, as for process_service_line().
+template <typename dep_type, typename load_service_t, typename process_dep_dir_t>
+void instantiate_template(const service_template &templ, const char *name, const string &instance_arg,
+        service_settings_wrapper<dep_type> &settings, load_service_t load_service,
+        process_dep_dir_t process_dep_dir)
+{
+    bool lazy_soft_deps = settings.lazy_soft_deps;
+    static_cast<service_settings &>(settings) = templ.settings;
+    settings.lazy_soft_deps = lazy_soft_deps;
+
+    substitute_instance_arg(settings.command, settings.command_offsets, instance_arg);
+    substitute_instance_arg(settings.stop_command, settings.stop_command_offsets, instance_arg);
+    substitute_instance_arg(settings.working_dir, instance_arg);
+    substitute_instance_arg(settings.env_file, instance_arg);
+    substitute_instance_arg(settings.socket_path, instance_arg);
+    substitute_instance_arg(settings.pid_file, instance_arg);
+    substitute_instance_arg(settings.logfile, instance_arg);
+    substitute_instance_arg(settings.chain_to_name, instance_arg);
+    substitute_instance_arg(settings.readiness_var, instance_arg);
+    #if USE_UTMPX
+    substitute_instance_arg(settings.inittab_id, name, "inittab-id", instance_arg);
+    substitute_instance_arg(settings.inittab_line, name, "inittab-line", instance_arg);
+    #endif
+
+    for (const template_dep &dep : templ.settings.depends) {
+        string dep_name = dep.name;
+        substitute_instance_arg(dep_name, instance_arg);
+        if (dep.is_dir) {
+            process_dep_dir(settings.depends, dep_name, dep.dep_type);
+        }
+        else if (settings.lazy_soft_deps && (dep.dep_type == dependency_type::WAITS_FOR
+                || dep.dep_type == dependency_type::MILESTONE)) {
+            settings.lazy_depends.emplace_back(std::move(dep_name), dep.dep_type);
+        }
+        else {
+            settings.depends.emplace_back(load_service(dep_name.c_str()), dep.dep_type);
+        }
+    }
+}
+
 } // namespace dinit_load
 
 using dinit_load::process_service_file;
@@ -0,0 +1,77 @@
+#ifndef LOG_JOURNAL_H_INCLUDED
+#define LOG_JOURNAL_H_INCLUDED 1
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// The log journal: a structured record of dinit's own log messages, as written by dinit (with the
+// --log-journal option) and read by "dinitctl log". Unlike the text log, records can be selected by
+// service and time without parsing message text.
+//
+// The journal is an append-only binary file, laid out so that it can be read via mmap. Values are
+// in native byte order; the file is only expected to be read on the system on which it was written.
+// It consists of:
+//
+//   8-byte file header: 4-byte magic ("DLJ" followed by the format version, 1), 4 bytes reserved
+//   records (oldest first), each: a log_journal_record header, the service name (if any), and the
+//     message text (neither nul-terminated), padded with zero bytes to a multiple of 8 bytes
+//
+// Each record is written with a single write, so that records are never interleaved. A partial
+// record at the end of the journal (after a crash) is discarded when dinit next opens the journal.
+//
+// When the journal reaches its maximum size, it is renamed (with log_journal_old_suffix appended,
+// replacing any previous such file) and a new journal is begun; the older records are in the renamed
+// file.
+
+constexpr const char *log_journal_old_suffix = ".old";
+
+// Default maximum journal size, in KiB:
+constexpr unsigned long log_journal_default_max_kib = 4096;
+
+constexpr char log_journal_magic[4] = { 'D', 'L', 'J', 1 };
+constexpr size_t log_journal_hdr_size = 8;
+constexpr size_t log_journal_align = 8;
+
+struct log_journal_record
+{
+    uint32_t length;        // total record length, including this header and padding
+    uint8_t level;          // log level (loglevel_t: 0 = debug, 1 = info, 2 = warn, 3 = error)
+    uint8_t reserved;
+    uint16_t svc_name_len;  // length of the service name (0 if not about a particular service)
+    uint32_t msg_len;       // length of the message text
+    uint32_t time_nsec;     // time at which the message was logged (wall clock)
+    uint64_t time_sec;      //   (seconds since the epoch)
+};
+
+static_assert(sizeof(log_journal_record) == 24, "log_journal_record has unexpected size");
+
+// Get the total (padded) length of a record with the given service name and message lengths.
+inline uint64_t log_journal_record_length(uint16_t svc_name_len, uint32_t msg_len) noexcept
+{
+    uint64_t len = sizeof(log_journal_record) + svc_name_len + (uint64_t)msg_len;
+    return (len + log_journal_align - 1) & ~(uint64_t)(log_journal_align - 1);
+}
+
+// Check whether (mapped) data begins with a valid journal header.
+inline bool log_journal_check_header(const char *data, size_t size) noexcept
+{
+    return size >= log_journal_hdr_size && memcmp(data, log_journal_magic, sizeof(log_journal_magic)) == 0;
+}
+
+// Read the header of the record at the given offset of (mapped) journal data, if there is a complete
+// and consistent record there. Returns the offset of the following record, or 0 if there is no valid
+// record at the offset. The service name and message follow the header in the data.
+inline size_t log_journal_read_record(const char *data, size_t size, size_t offset,
+        log_journal_record &rec) noexcept
+{
+    if (size - offset < sizeof(log_journal_record)) return 0;
+    memcpy(&rec, data + offset, sizeof(rec));
+    if (rec.length != log_journal_record_length(rec.svc_name_len, rec.msg_len)
+            || rec.length > size - offset) {
+        return 0;
+    }
+    return offset + rec.length;
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef MOUNT_TREE_H_INCLUDED
+#define MOUNT_TREE_H_INCLUDED 1
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <cstdlib>
+
+// Mount table parsing and unmount ordering, used by the shutdown utility.
+//
+// The mount table (in Linux /proc/self/mountinfo format) is read into a tree, where each mount
+// is a child of the mount on which it was mounted. A mount is ready to be unmounted once all
+// of its children have been dealt with; mounts which are ready are independent of each other and
+// can be unmounted in parallel.
+
+// Decode the octal escapes (\040 etc) used in mount table / swap table path fields.
+inline std::string decode_mount_path(const std::string &field)
+{
+    std::string r;
+    r.reserve(field.length());
+    for (size_t i = 0; i < field.length(); i++) {
+        char c = field[i];
+        if (c == '\\' && i + 3 < field.length()) {
+            char oct[4] = { field[i+1], field[i+2], field[i+3], 0 };
+            if (oct[0] >= '0' && oct[0] <= '3' && oct[1] >= '0' && oct[1] <= '7'
+                    && oct[2] >= '0' && oct[2] <= '7') {
+                r += (char) strtol(oct, nullptr, 8);
+                i += 3;
+                continue;
+            }
+        }
+        r += c;
+    }
+    return r;
+}
+
+class mount_tree
+{
+    public:
+    struct mount_entry
+    {
+        int mount_id;
+        int parent_id;
+        std::string mount_point;
+        std::string fs_type;
+
+        int parent_idx = -1;      // index of parent mount, or -1 if none (root of tree)
+        int pending_children = 0; // number of children not yet dealt with
+        bool skip = false;        // should not be unmounted (virtual filesystem etc)
+        bool done = false;        // has been dealt with (unmounted or otherwise)
+    };
+
+    private:
+    std::vector<mount_entry> mounts;
+
+    // Filesystem types that are not unmounted (or remounted) at shutdown.
+    static bool is_skipped_type(const std::string &fs_type)
+    {
+        static const char * const skip_types[] = { "proc", "sysfs", "devtmpfs", "devpts", "securityfs",
+                "cgroup", "cgroup2", "debugfs", "tracefs", "rpc_pipefs", "nfsd", "binfmt_misc",
+                "autofs" };
+        for (const char *st : skip_types) {
+            if (fs_type == st) return true;
+        }
+        return false;
+    }
+
+    public:
+    // Read the mount table, in mountinfo format. Each line has the form:
+    //   mount-id parent-id major:minor root mount-point options [optional-fields...]
+    //       - fstype source super-options
+    // Returns false if the table could not be parsed. May throw std::bad_alloc.
+    bool read_mountinfo(std::istream &in)
+    {
+        mounts.clear();
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty()) continue;
+
+            std::vector<std::string> fields;
+            size_t pos = 0;
+            while (pos < line.length()) {
+                size_t end = line.find(' ', pos);
+                if (end == std::string::npos) end = line.length();
+                if (end != pos) fields.emplace_back(line, pos, end - pos);
+                pos = end + 1;
+            }
+
+            // find the separator field:
+            size_t sep = 6;
+            while (sep < fields.size() && fields[sep] != "-") sep++;
+            if (sep + 1 >= fields.size()) return false;
+
+            mount_entry ent;
+            char *endptr;
+            ent.mount_id = strtol(fields[0].c_str(), &endptr, 10);
+            if (*endptr != 0) return false;
+            ent.parent_id = strtol(fields[1].c_str(), &endptr, 10);
+            if (*endptr != 0) return false;
+            ent.mount_point = decode_mount_path(fields[4]);
+            ent.fs_type = fields[sep + 1];
+            ent.skip = is_skipped_type(ent.fs_type);
+            mounts.push_back(std::move(ent));
+        }
+
+        // Link each mount to its parent:
+        for (auto &ent : mounts) {
+            if (ent.parent_id == ent.mount_id) continue;
+            for (size_t i = 0; i < mounts.size(); i++) {
+                if (mounts[i].mount_id == ent.parent_id) {
+                    ent.parent_idx = i;
+                    mounts[i].pending_children++;
+                    break;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    size_t size() const noexcept
+    {
+        return mounts.size();
+    }
+
+    mount_entry &operator[](size_t idx) noexcept
+    {
+        return mounts[idx];
+    }
+
+    // Check whether a mount should be remounted read-only rather than unmounted. This is the case
+    // for the root filesystem, which cannot be unmounted.
+    bool is_root(size_t idx) const noexcept
+    {
+        return mounts[idx].mount_point == "/";
+    }
+
+    // Get all mounts that are ready to be dealt with (have no outstanding children), in order.
+    void get_ready(std::vector<int> &ready)
+    {
+        for (size_t i = 0; i < mounts.size(); i++) {
+            if (! mounts[i].done && mounts[i].pending_children == 0) {
+                ready.push_back(i);
+            }
+        }
+    }
+
+    // Mark a mount as having been dealt with. Returns the index of its parent if the parent is now
+    // ready to be dealt with, or -1 otherwise.
+    int mark_done(int idx) noexcept
+    {
+        mounts[idx].done = true;
+        int pidx = mounts[idx].parent_idx;
+        if (pidx != -1) {
+            if (--mounts[pidx].pending_children == 0 && ! mounts[pidx].done) {
+                return pidx;
+            }
+        }
+        return -1;
+    }
+};
+
+// Read the list of active swap devices/files, in the format of Linux /proc/swaps:
+//   Filename  Type  Size  Used  Priority
+// (with a header line). May throw std::bad_alloc.
+inline void read_swaps(std::istream &in, std::vector<std::string> &swaps)
+{
+    std::string line;
+    if (! std::getline(in, line)) return;  // header
+    while (std::getline(in, line)) {
+        size_t end = line.find_first_of(" \t");
+        if (end == 0) continue;
+        swaps.push_back(decode_mount_path(line.substr(0, end)));
+    }
+}
+
+#endif
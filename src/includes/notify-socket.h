@@ -0,0 +1,73 @@
+#ifndef NOTIFY_SOCKET_H_INCLUDED
+#define NOTIFY_SOCKET_H_INCLUDED 1
+
+#include <string>
+#include <unordered_map>
+
+#include "dinit.h"
+#include "proc-service.h"
+
+// The readiness notification socket: a single datagram socket shared by all services which use
+// "ready-notification = socket". This is compatible with the Systemd "sd_notify" protocol: the
+// socket path is passed to the service process via the NOTIFY_SOCKET environment variable, and
+// each message consists of newline-separated variable assignments, of which we recognise:
+//
+//   READY=1      - the service has started and is ready
+//   STATUS=...   - free-form status description
+//   WATCHDOG=1   - watchdog keep-alive
+//
+// Messages are attributed to services according to the sender's process ID, as supplied (and
+// verified) by the kernel via SO_PASSCRED. Only messages from the main process of a service are
+// accepted.
+//
+// The socket is only opened once a service requiring it is started.
+
+class notify_socket_watcher : public eventloop_t::fd_watcher_impl<notify_socket_watcher>
+{
+    std::string socket_path;
+    bool socket_open = false;
+
+    // Services with a running process which may send notifications, by process ID:
+    std::unordered_map<pid_t, base_process_service *> notify_services;
+
+    public:
+    // Set the path of the socket (should be done before it is opened).
+    void set_path(std::string &&path) noexcept
+    {
+        socket_path = std::move(path);
+    }
+
+    const char *get_path() noexcept
+    {
+        return socket_path.c_str();
+    }
+
+    // Open the socket, if it is not already open. Returns false (and logs an error) on failure.
+    bool open_socket() noexcept;
+
+    // Close (and unlink) the socket, if it is open.
+    void close_socket() noexcept;
+
+    // Register a service, whose process (with pid as returned by get_pid()) may send
+    // notifications. If the service is already registered under a different process ID, the
+    // registration is updated. Returns false (and logs an error) if out of memory.
+    bool add_service(base_process_service *sr) noexcept;
+
+    // Unregister a service; has no effect if the service isn't registered.
+    void remove_service(base_process_service *sr) noexcept
+    {
+        if (sr->notify_pid != -1) {
+            notify_services.erase(sr->notify_pid);
+            sr->notify_pid = -1;
+        }
+    }
+
+    // Process a notification message from the given process.
+    void process_message(pid_t pid, const char *msg, size_t len) noexcept;
+
+    dasynq::rearm fd_event(eventloop_t &loop, int fd, int flags) noexcept;
+};
+
+extern notify_socket_watcher notify_socket;
+
+#endif
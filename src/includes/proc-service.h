@@ -1,6 +1,10 @@
+#ifndef PROC_SERVICE_H_INCLUDED
+#define PROC_SERVICE_H_INCLUDED 1
+
 #include <vector>
 #include <string>
 #include <list>
+#include <memory>
 
 #include <sys/types.h>
 #include <sys/resource.h>
@@ -34,21 +38,26 @@ struct run_proc_params
     int notify_fd;            // pipe for readiness notification message (or -1); may be moved
     int force_notify_fd;      // if not -1, notification fd must be moved to this fd
     const char *notify_var;   // environment variable name where notification fd will be stored, or nullptr
+    const char *notify_socket; // path of shared notification socket (for NOTIFY_SOCKET), or nullptr
+    long long watchdog_usec;  // watchdog timeout in microseconds (for WATCHDOG_USEC), or 0
     uid_t uid;
     gid_t gid;
     const std::vector<service_rlimits> &rlimits;
+    const service_sched_settings *sched; // scheduling settings (or nullptr)
 
     run_proc_params(const char * const *args, const char *working_dir, const char *logfile, int wpipefd,
             uid_t uid, gid_t gid, const std::vector<service_rlimits> &rlimits)
             : args(args), working_dir(working_dir), logfile(logfile), env_file(nullptr), on_console(false),
               in_foreground(false), wpipefd(wpipefd), csfd(-1), socket_fd(-1), notify_fd(-1),
-              force_notify_fd(-1), notify_var(nullptr), uid(uid), gid(gid), rlimits(rlimits)
+              force_notify_fd(-1), notify_var(nullptr), notify_socket(nullptr), watchdog_usec(0),
+              uid(uid), gid(gid), rlimits(rlimits), sched(nullptr)
     { }
 };
 
 enum class exec_stage {
     ARRANGE_FDS, READ_ENV_FILE, SET_NOTIFYFD_VAR, SETUP_ACTIVATION_SOCKET, SETUP_CONTROL_SOCKET,
-    CHDIR, SETUP_STDINOUTERR, SET_RLIMITS, SET_UIDGID, /* must be last: */ DO_EXEC
+    CHDIR, SETUP_STDINOUTERR, SET_RLIMITS, SET_CPU_AFFINITY, SET_NUMA_POLICY, SET_IOPRIO, SET_SCHED_POLICY,
+    SET_NICE, SET_UIDGID, /* must be last: */ DO_EXEC
 };
 
 extern const char * const exec_stage_descriptions[static_cast<int>(exec_stage::DO_EXEC) + 1];
@@ -77,6 +86,21 @@ class process_restart_timer : public eventloop_t::timer_impl<process_restart_tim
     dasynq::rearm timer_expiry(eventloop_t &, int expiry_count);
 };
 
+// A timer for the service watchdog: the service process must send watchdog keep-alive messages
+// (via the notification socket) more frequently than the timeout period, or it will be killed.
+class process_watchdog_timer : public eventloop_t::timer_impl<process_watchdog_timer>
+{
+    public:
+    base_process_service * service;
+
+    explicit process_watchdog_timer(base_process_service *service_p)
+        : service(service_p)
+    {
+    }
+
+    dasynq::rearm timer_expiry(eventloop_t &, int expiry_count);
+};
+
 // Watcher for the pipe used to receive exec() failure status errno
 class exec_status_pipe_watcher : public eventloop_t::fd_watcher_impl<exec_status_pipe_watcher>
 {
@@ -123,6 +147,7 @@ class base_process_service : public service_record
     friend class exec_status_pipe_watcher;
     friend class base_process_service_test;
     friend class ready_notify_watcher;
+    friend class process_watchdog_timer;
 
     private:
     // Re-launch process
@@ -137,10 +162,9 @@ class base_process_service : public service_record
     // pointer to each argument/part of the stop_command, and nullptr:
     std::vector<const char *> stop_arg_parts;
 
-    string working_dir;       // working directory (or empty)
-    string env_file;          // file with environment settings for this service
-
-    std::vector<service_rlimits> rlimits; // resource limits
+    // working directory, environment file, resource limits and scheduling settings (may be shared
+    // with other services; nullptr if not set):
+    std::shared_ptr<const process_exec_settings> exec_settings;
 
     service_child_watcher child_listener;
     exec_status_pipe_watcher child_status_listener;
@@ -156,6 +180,15 @@ class base_process_service : public service_record
     int max_restart_interval_count;  // number of restarts allowed over maximum interval
     time_val restart_delay;          // delay between restarts
 
+    // Restart backoff: each automatic restart doubles the restart delay (up to restart_delay_max),
+    // with a random variation of up to +/- restart_delay_jitter percent. Once the process has run
+    // for at least restart_delay_reset, the delay returns to restart_delay.
+    time_val restart_delay_max = {0, 0};     // maximum delay; 0 (or <= restart_delay) to disable
+    int restart_delay_jitter = 0;            // jitter, in percent of the delay
+    time_val restart_delay_reset = {10, 0};  // run time after which backoff is reset
+    time_val current_restart_delay;          // base delay to be used for the next restart
+    time_val pending_restart_delay;          // delay applied to the currently pending restart
+
     // Time allowed for service stop, after which SIGKILL is sent. 0 to disable.
     time_val stop_timeout = {10, 0}; // default of 10 seconds
 
@@ -167,6 +200,15 @@ class base_process_service : public service_record
     gid_t run_as_gid = -1;
     int force_notification_fd = -1;  // if set, notification fd for service process is set to this fd
     string notification_var; // if set, name of an environment variable for notification fd
+    bool notification_socket = false; // whether readiness notification is via the shared socket
+    bool notified_ready = false;  // readiness notified (via socket) before exec status was received
+    string status_text;       // last status reported via the notification socket
+
+    // Watchdog timeout (0 to disable); watchdog keep-alives are received via the notification socket
+    time_val watchdog_timeout = {0, 0};
+    process_watchdog_timer watchdog_timer;
+    bool watchdog_timer_added = false;
+    bool watchdog_timer_armed = false;
 
     pid_t pid = -1;  // PID of the process. If state is STARTING or STOPPING,
                      //   this is PID of the service script; otherwise it is the
@@ -227,7 +269,25 @@ class base_process_service : public service_record
     void becoming_inactive() noexcept override;
 
     // Kill with SIGKILL
-    void kill_with_fire() noexcept;
+    void kill_with_fire() noexcept override;
+
+    // Start (or restart) the watchdog timer, if a watchdog timeout is set.
+    void arm_watchdog() noexcept;
+
+    // Stop the watchdog timer (if it is armed).
+    void stop_watchdog() noexcept
+    {
+        if (watchdog_timer_armed) {
+            watchdog_timer.stop_timer(event_loop);
+            watchdog_timer_armed = false;
+        }
+    }
+
+    // The watchdog timer expired.
+    void watchdog_expired() noexcept;
+
+    // The process has terminated or failed to execute; stop tracking notifications.
+    void end_notifications() noexcept;
 
     // Signal the process group of the service process
     void kill_pg(int signo) noexcept;
@@ -242,19 +302,17 @@ class base_process_service : public service_record
     }
 
     public:
+    // Process ID under which the service is registered with the notification socket (-1 if not
+    // registered)
+    pid_t notify_pid = -1;
+
     // Constructor for a base_process_service. Note that the various parameters not specified here must in
     // general be set separately (using the appropriate set_xxx function for each).
     base_process_service(service_set *sset, string name, service_type_t record_type_p, string &&command,
             const std::list<std::pair<unsigned,unsigned>> &command_offsets,
             const std::list<prelim_dep> &deplist_p);
 
-    ~base_process_service() noexcept
-    {
-        if (reserved_child_watch) {
-            child_listener.unreserve(event_loop);
-        }
-        restart_timer.deregister(event_loop);
-    }
+    ~base_process_service() noexcept;
 
     // Set the command to run this service (executable and arguments, nul separated). The command_parts_p
     // vector must contain pointers to each part.
@@ -288,19 +346,15 @@ class base_process_service : public service_record
         stop_arg_parts = std::move(command_parts);
     }
 
-    void set_env_file(const std::string &env_file_p)
+    // Set the working directory, environment file, resource limits and scheduling settings
+    void set_exec_settings(std::shared_ptr<const process_exec_settings> &&exec_settings_p) noexcept
     {
-        env_file = env_file_p;
+        exec_settings = std::move(exec_settings_p);
     }
 
-    void set_env_file(std::string &&env_file_p) noexcept
+    const process_exec_settings *get_exec_settings() noexcept
     {
-        env_file = std::move(env_file_p);
-    }
-
-    void set_rlimits(std::vector<service_rlimits> &&rlimits_p)
-    {
-        rlimits = std::move(rlimits_p);
+        return exec_settings.get();
     }
 
     void set_restart_interval(timespec interval, int max_restarts) noexcept
@@ -312,6 +366,23 @@ class base_process_service : public service_record
     void set_restart_delay(timespec delay) noexcept
     {
         restart_delay = delay;
+        current_restart_delay = delay;
+    }
+
+    void set_restart_backoff(timespec max_delay, int jitter, timespec reset_time) noexcept
+    {
+        restart_delay_max = max_delay;
+        restart_delay_jitter = jitter;
+        restart_delay_reset = reset_time;
+    }
+
+    // Get the delay before the pending restart (if waiting to restart), as determined by the
+    // restart backoff; returns false if no restart is pending.
+    bool get_restart_delay(time_val &delay) noexcept override
+    {
+        if (! waiting_restart_timer) return false;
+        delay = pending_restart_delay;
+        return true;
     }
 
     void set_stop_timeout(timespec timeout) noexcept
@@ -337,17 +408,6 @@ class base_process_service : public service_record
         run_as_gid = gid;
     }
 
-    // Set the working directory
-    void set_working_dir(const string &working_dir_p)
-    {
-        working_dir = working_dir_p;
-    }
-
-    void set_working_dir(string &&working_dir_p) noexcept
-    {
-        working_dir = std::move(working_dir_p);
-    }
-
     // Set the notification fd number that the service process will use
     void set_notification_fd(int fd)
     {
@@ -361,6 +421,38 @@ class base_process_service : public service_record
         notification_var = std::move(varname);
     }
 
+    // Set whether readiness notification is via the shared notification socket
+    void set_notification_socket(bool use_socket) noexcept
+    {
+        notification_socket = use_socket;
+    }
+
+    // Set the watchdog timeout (0 to disable)
+    void set_watchdog_timeout(timespec timeout) noexcept
+    {
+        watchdog_timeout = timeout;
+    }
+
+    // Readiness was notified via the notification socket.
+    virtual void notify_ready() noexcept { }
+
+    // A watchdog keep-alive was received via the notification socket.
+    void notify_watchdog() noexcept
+    {
+        if (watchdog_timer_armed) {
+            watchdog_timer.arm_timer_rel(event_loop, watchdog_timeout);
+        }
+    }
+
+    // Status was reported via the notification socket.
+    void notify_status(const char *status, size_t len) noexcept;
+
+    // Get the status most recently reported via the notification socket.
+    const std::string &get_notify_status() noexcept
+    {
+        return status_text;
+    }
+
     // The restart/stop timer expired.
     void timer_expired() noexcept;
 
@@ -400,7 +492,7 @@ class process_service : public base_process_service
     void after_fork(pid_t child_pid) noexcept override
     {
         if (*inittab_id || *inittab_line) {
-            create_utmp_entry(inittab_id, inittab_line, child_pid);
+            utmp_queue.create_entry(inittab_id, inittab_line, child_pid);
         }
     }
 
@@ -421,6 +513,8 @@ class process_service : public base_process_service
     {
     }
 
+    void notify_ready() noexcept override;
+
 #if USE_UTMPX
 
     // Set the id of the process in utmp (the "inittab" id)
@@ -530,3 +624,5 @@ class scripted_service : public base_process_service
     {
     }
 };
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef READAHEAD_PROFILE_H_INCLUDED
+#define READAHEAD_PROFILE_H_INCLUDED 1
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Readahead profile format: a text file, listing the files to be read into the page cache at boot
+// (in the order they should be read), with one absolute path per line. Blank lines, and lines which
+// do not begin with '/', are ignored when reading a profile. A path containing a newline cannot be
+// represented, and is omitted when writing a profile.
+
+// Read a readahead profile, appending the paths it lists to the given vector. May throw
+// std::bad_alloc.
+inline void read_readahead_profile(std::istream &in, std::vector<std::string> &files)
+{
+    std::string file;
+    while (std::getline(in, file)) {
+        if (! file.empty() && file[0] == '/') {
+            files.push_back(std::move(file));
+        }
+    }
+}
+
+// Write a readahead profile listing the given files.
+inline void write_readahead_profile(std::ostream &out, const std::vector<std::string> &files)
+{
+    for (const std::string &file : files) {
+        if (file.empty() || file[0] != '/' || file.find('\n') != std::string::npos) continue;
+        out << file << '\n';
+    }
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef READAHEAD_H_INCLUDED
+#define READAHEAD_H_INCLUDED 1
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+#include "dinit.h"
+
+// Boot-time readahead. If the readahead profile (a list of files, one path per line; see
+// readahead-profile.h) exists at boot, the files it lists are read into the page cache by a helper
+// process, in the background, while services start. Otherwise, the files opened (on the root
+// filesystem) during the first part of boot are recorded using fanotify (Linux only) and written to
+// the profile, for use at the next boot. The profile is written once the recording period ends and
+// the root filesystem is writable.
+//
+// The path of each opened file is found via /proc/self/fd, which is often not mounted when dinit
+// starts. Until it is, fanotify events are left queued by the kernel (each holding the opened file)
+// and the fanotify descriptor is not watched; /proc is checked for once per second during the
+// recording period.
+//
+// The profile can be discarded via the control protocol (DINIT_CP_REGENREADAHEAD), so that a new
+// profile is recorded at the next boot.
+
+class boot_readahead : public eventloop_t::fd_watcher_impl<boot_readahead>
+{
+    // Timer (once per second) for the recording period:
+    class record_timer : public eventloop_t::timer_impl<record_timer>
+    {
+        public:
+        boot_readahead *owner;
+
+        explicit record_timer(boot_readahead *owner_p) noexcept : owner(owner_p) { }
+
+        dasynq::rearm timer_expiry(eventloop_t &, int expiry_count) noexcept;
+    };
+
+    // Maximum number of files recorded in a profile:
+    static constexpr size_t max_files = 20000;
+
+    const char *profile_path = nullptr;
+    bool recording = false;
+    bool watching = false;    // fanotify descriptor is watched (/proc is available)
+    int fanotify_fd = -1;
+    unsigned record_remaining = 0;  // seconds remaining in recording period
+    bool rootfs_rw = false;
+    bool profile_pending = false;  // recording finished, profile not yet written
+
+    std::vector<std::string> files;  // files recorded, in order of first access
+    std::unordered_set<std::string> seen_files;
+
+    record_timer timer {this};
+
+    // Handle the passing of (one or more) seconds in the recording period.
+    void record_tick(int seconds) noexcept;
+
+    // Finish recording, writing the profile if the root filesystem is writable.
+    void stop_recording() noexcept;
+
+    // Write the recorded profile.
+    void write_profile() noexcept;
+
+    public:
+    // Begin boot readahead, using the given profile: replay it if it exists, otherwise record a new
+    // profile for the given time (in seconds).
+    void start(const char *path, unsigned record_secs) noexcept;
+
+    // Note that the root filesystem is now writable (a pending profile will be written).
+    void set_rootfs_writable() noexcept;
+
+    // Discard the profile (and any recording in progress), so that a new one is recorded at the
+    // next boot. Returns false if no profile is in use.
+    bool regenerate() noexcept;
+
+    // Stop recording (without writing the profile), if recording.
+    void stop() noexcept;
+
+    dasynq::rearm fd_event(eventloop_t &loop, int fd, int flags) noexcept;
+};
+
+extern boot_readahead readahead_profile;
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef SERVICE_LISTENER_H
 #define SERVICE_LISTENER_H
 
+#include <cstdint>
+
 #include "service-constants.h"
 
 class service_record;
@@ -13,6 +15,24 @@ class service_listener
     // An event occurred on the service being observed.
     // Listeners must not be added or removed during event notification.
     virtual void service_event(service_record * service, service_event_t event) noexcept = 0;
+
+    // The service record has been replaced by another for the same service (as the result of a reload),
+    // and the listener has been transferred to the replacement. The listener may remove itself from the
+    // replacement during this notification, but must not otherwise add or remove listeners.
+    virtual void service_replaced(service_record * service, service_record * replacement) noexcept
+    {
+    }
+};
+
+// Interface for listening to all services in a service set
+class service_set_listener
+{
+    public:
+
+    // An event occurred on a service in the set. Events are numbered sequentially (per service
+    // set), with seq giving the number of this event.
+    // Listeners must not be added or removed during event notification.
+    virtual void service_set_event(service_record * service, service_event_t event, uint32_t seq) noexcept = 0;
 };
 
 #endif
@@ -3,9 +3,11 @@
 
 #include <string>
 #include <list>
+#include <memory>
 #include <vector>
 #include <csignal>
 #include <unordered_set>
+#include <unordered_map>
 #include <algorithm>
 
 #include "dasynq.h"
@@ -173,6 +175,10 @@ class prelim_dep
     }
 };
 
+// Dependencies which are not loaded until the dependent starts (see
+// dirload_service_set::set_lazy_soft_deps()): the name, and type, of each dependency.
+using lazy_dep_list = std::list<std::pair<std::string, dependency_type>>;
+
 // service_record: base class for service record containing static information
 // and current state of each service.
 //
@@ -251,8 +257,16 @@ class service_record
 
     stopped_reason_t stop_reason = stopped_reason_t::NORMAL;  // reason why stopped
 
+    unsigned restart_count = 0;  // number of automatic restarts (of the service process)
+    int status_slot = -1;        // slot in the status table, or -1 if none
+    bool desc_changed = false;   // description has changed since the service was loaded
+    lazy_dep_list lazy_deps;     // dependencies to be loaded when the service starts
+
     string start_on_completion;  // service to start when this one completes
 
+    time_val stop_begin_time;  // time at which bring_down() was called (only set during shutdown)
+    time_val start_begin_time; // time at which bring_up() was called (only set while recording start times)
+
     // Data for use by service_set
     public:
     
@@ -285,6 +299,19 @@ class service_record
     
     void all_deps_started() noexcept;
 
+    // Load any dependencies which were not loaded with the service, and add them as dependencies.
+    // Dependencies which cannot be loaded remain in the lazy dependency list.
+    void load_lazy_deps() noexcept;
+
+    // Check whether a milestone dependency remains unresolved (could not be loaded).
+    bool has_unresolved_milestone() noexcept
+    {
+        for (auto &dep : lazy_deps) {
+            if (dep.second == dependency_type::MILESTONE) return true;
+        }
+        return false;
+    }
+
     // Start all dependencies, return true if all have started
     bool start_check_dependencies() noexcept;
 
@@ -318,12 +345,8 @@ class service_record
             || (service_state == service_state_t::STARTING && waiting_for_deps);
     }
     
-    void notify_listeners(service_event_t event) noexcept
-    {
-        for (auto l : listeners) {
-            l->service_event(this, event);
-        }
-    }
+    // Notify listeners (including those listening to all services in the set) of an event.
+    void notify_listeners(service_event_t event) noexcept;
     
     // Queue to run on the console. 'acquired_console()' will be called when the console is available.
     // Has no effect if the service has already queued for console.
@@ -345,10 +368,7 @@ class service_record
     void do_stop(bool with_restart = false) noexcept;
 
     // Set the service state
-    void set_state(service_state_t new_state) noexcept
-    {
-        service_state = new_state;
-    }
+    void set_state(service_state_t new_state) noexcept;
 
     // Virtual functions, to be implemented by service implementations:
 
@@ -428,9 +448,7 @@ class service_record
     service_record(const service_record &) = delete;
     void operator=(const service_record &) = delete;
 
-    virtual ~service_record() noexcept
-    {
-    }
+    virtual ~service_record() noexcept;
     
     // Get the type of this service record
     service_type_t get_type() noexcept
@@ -527,6 +545,16 @@ class service_record
         pinned_stopped = true;
     }
     
+    bool is_start_pinned() noexcept
+    {
+        return pinned_started;
+    }
+
+    bool is_stop_pinned() noexcept
+    {
+        return pinned_stopped;
+    }
+
     // Remove both "started" and "stopped" pins. If the service is currently pinned
     // in either state but would naturally be in the opposite state, it will immediately
     // commence starting/stopping.
@@ -559,6 +587,18 @@ class service_record
     {
         listeners.erase(listener);
     }
+
+    // Transfer all listeners to a replacement record (which must have none), and notify them.
+    void transfer_listeners(service_record *replacement) noexcept
+    {
+        replacement->listeners = std::move(listeners);
+        listeners.clear();
+        for (auto i = replacement->listeners.begin(); i != replacement->listeners.end(); ) {
+            service_listener *listener = *i;
+            ++i; // (listener may remove itself)
+            listener->service_replaced(this, replacement);
+        }
+    }
     
     // Assuming there is one reference (from a control link), return true if this is the only reference,
     // or false if there are others (including dependents).
@@ -586,6 +626,52 @@ class service_record
         return stop_reason;
     }
 
+    // Get the number of times the service process has been automatically restarted.
+    unsigned get_restart_count() noexcept
+    {
+        return restart_count;
+    }
+
+    // Set the dependencies to be loaded when the service starts.
+    void set_lazy_deps(lazy_dep_list &&deps) noexcept
+    {
+        lazy_deps = std::move(deps);
+    }
+
+    const lazy_dep_list &get_lazy_deps() noexcept
+    {
+        return lazy_deps;
+    }
+
+    // Resolve the lazy dependencies of this service and of all services which it depends on
+    // (directly or indirectly) and which are stopped, loading them as necessary. This is done when a
+    // service is explicitly started, before the start is queued, so that service descriptions are not
+    // loaded in the middle of state transitions.
+    void resolve_lazy_deps() noexcept;
+
+    // Mark the service description as having changed (or not) since the service was loaded.
+    void set_description_changed(bool changed = true) noexcept
+    {
+        desc_changed = changed;
+    }
+
+    bool is_description_changed() noexcept
+    {
+        return desc_changed;
+    }
+
+    // Update the entry for this service in the status table, if it has one. If 'transition' is
+    // true, the state has changed, and the transition time is also updated.
+    void update_status(bool transition = false) noexcept;
+
+    // Allocate an entry for this service in the status table, if it doesn't have one, and write
+    // the current status to it (done when the service is added to the service set).
+    void alloc_status_slot() noexcept;
+
+    // Give this service's status table entry to a record which replaces it, so that the entry
+    // for the service remains at the same position in the table.
+    void transfer_status_slot(service_record *replacement) noexcept;
+
     bool is_waiting_for_console()
     {
         return waiting_for_console;
@@ -606,6 +692,27 @@ class service_record
         return 0;
     }
 
+    // If the service is waiting to restart its process, get the delay (as measured from the last
+    // process start) before the restart, and return true.
+    virtual bool get_restart_delay(time_val &delay) noexcept
+    {
+        return false;
+    }
+
+    // Is the service actively starting or stopping (as opposed to waiting for its dependencies
+    // to start, or its dependents to stop)?
+    bool is_transitioning() noexcept
+    {
+        return (service_state == service_state_t::STARTING || service_state == service_state_t::STOPPING)
+                && ! waiting_for_deps;
+    }
+
+    // Forcefully terminate the service process (if any), because the service has taken too long
+    // to stop.
+    virtual void kill_with_fire() noexcept
+    {
+    }
+
     dep_list & get_dependencies()
     {
         return depends_on;
@@ -638,7 +745,7 @@ class service_record
             to->dependents.push_back(&(*pre_i));
         }
         catch (...) {
-            depends_on.erase(i);
+            depends_on.erase(pre_i);
             throw;
         }
 
@@ -708,6 +815,52 @@ inline auto extract_console_queue(service_record *sr) -> decltype(sr->console_qu
     return sr->console_queue_node;
 }
 
+// Timer for tracking shutdown progress: periodically reports which services are preventing
+// shutdown, and enforces the overall shutdown time limit.
+class shutdown_progress_timer : public eventloop_t::timer_impl<shutdown_progress_timer>
+{
+    public:
+    service_set * services;
+
+    explicit shutdown_progress_timer(service_set *services_p) : services(services_p)
+    {
+    }
+
+    dasynq::rearm timer_expiry(eventloop_t &, int expiry_count);
+};
+
+// Maximum time (in seconds) for which service start times are recorded during boot. If some
+// service is still starting after this time, boot is considered complete anyway.
+constexpr unsigned max_boot_record_secs = 600;
+
+// Timer limiting the time for which start times are recorded (see max_boot_record_secs).
+class boot_record_timer : public eventloop_t::timer_impl<boot_record_timer>
+{
+    public:
+    service_set * services;
+
+    explicit boot_record_timer(service_set *services_p) : services(services_p)
+    {
+    }
+
+    dasynq::rearm timer_expiry(eventloop_t &, int expiry_count);
+};
+
+// The time taken by a service to stop during shutdown.
+struct service_stop_time
+{
+    std::string name;
+    time_val stopped_at;  // time (since shutdown began) at which the service stopped
+    time_val stop_time;   // time between beginning to stop and reaching STOPPED
+};
+
+// The time taken by a service to start during boot.
+struct service_start_time
+{
+    std::string name;
+    time_val start_time;  // time between beginning to start (once dependencies started) and reaching STARTED
+};
+
 /*
  * A service_set, as the name suggests, manages a set of services.
  *
@@ -741,7 +894,50 @@ class service_set
     // Propagation and start/stop "queues" - list of services waiting for processing
     slist<service_record, extract_prop_queue> prop_queue;
     slist<service_record, extract_stop_queue> stop_queue;
-    
+
+    // Shutdown progress tracking:
+    time_val shutdown_start_time;
+    time_val shutdown_time_limit = {0, 0};  // time allowed for services to stop (0 = unlimited)
+    bool shutdown_limit_reached = false;
+    bool shutdown_timer_added = false;
+    shutdown_progress_timer shutdown_timer {this};
+    std::vector<service_stop_time> stop_times;  // stop times of services stopped during shutdown
+
+    // Boot timing (start times of services started during boot):
+    bool recording_start_times = false;
+    bool awaiting_boot_complete = false;  // boot services have been started; waiting for all to start
+    int starting_services = 0;  // number of services in the STARTING state
+    bool boot_timer_added = false;
+    boot_record_timer boot_timer {this};
+    const char *boot_history_path = nullptr;  // file to which start times are written (if any)
+    time_val boot_start_time;
+    time_val boot_duration;
+    std::vector<service_start_time> start_times;
+
+    // Listeners for events on any service in the set, and the sequence number of the next event:
+    std::unordered_set<service_set_listener *> set_listeners;
+    uint32_t next_event_seq = 0;
+
+    bool tracking_changes = false;  // whether description changes are tracked (see description_changed())
+
+    // Names of services which could not be loaded as lazy dependencies. Loading is not retried (and
+    // the failure is not logged again) until the description changes or the dependent is reloaded.
+    std::unordered_set<std::string> lazy_load_failures;
+
+    friend class shutdown_progress_timer;
+    friend class boot_record_timer;
+
+    // End recording of start times; boot is complete.
+    void end_recording_start_times() noexcept;
+
+    // Log the services which are currently preventing shutdown, and kill their processes if the
+    // shutdown time limit has been exceeded. Returns the time until this should next be called.
+    time_val check_shutdown_progress() noexcept;
+
+    // Get the time until shutdown progress should next be checked, given the time elapsed since
+    // shutdown began.
+    time_val next_shutdown_check(time_val elapsed) noexcept;
+
     public:
     service_set()
     {
@@ -751,6 +947,14 @@ class service_set
     
     virtual ~service_set()
     {
+        if (shutdown_timer_added) {
+            shutdown_timer.stop_timer(event_loop);
+            shutdown_timer.deregister(event_loop);
+        }
+        if (boot_timer_added) {
+            boot_timer.stop_timer(event_loop);
+            boot_timer.deregister(event_loop);
+        }
         for (auto * s : records) {
             delete s;
         }
@@ -773,6 +977,27 @@ class service_set
     // Locate an existing service record.
     service_record *find_service(const std::string &name) noexcept;
 
+    // Add a listener for events on all services. May throw std::bad_alloc.
+    void add_set_listener(service_set_listener *listener)
+    {
+        set_listeners.insert(listener);
+    }
+
+    // Remove a listener for events on all services.
+    void remove_set_listener(service_set_listener *listener) noexcept
+    {
+        set_listeners.erase(listener);
+    }
+
+    // Notify listeners for events on all services of an event.
+    void notify_set_listeners(service_record *service, service_event_t event) noexcept
+    {
+        uint32_t seq = next_event_seq++;
+        for (auto l : set_listeners) {
+            l->service_set_event(service, event, seq);
+        }
+    }
+
     // Load a service description, and dependencies, if there is no existing
     // record for the given name.
     // Throws:
@@ -813,6 +1038,7 @@ class service_set
     void add_service(service_record *svc)
     {
         records.push_back(svc);
+        svc->alloc_status_slot();
     }
     
     void remove_service(service_record *svc)
@@ -820,10 +1046,60 @@ class service_set
         records.erase(std::find(records.begin(), records.end(), svc));
     }
 
+    // Replace a service record with another for the same service (after a reload). Listeners,
+    // including control connections holding handles to the service, are transferred to the
+    // replacement.
     void replace_service(service_record *orig, service_record *replacement)
     {
         auto i = std::find(records.begin(), records.end(), orig);
         *i = replacement;
+        orig->transfer_listeners(replacement);
+        orig->transfer_status_slot(replacement);
+    }
+
+    // Set whether changes to service descriptions are being tracked, i.e. whether
+    // description_changed() will be called when a description changes.
+    void set_tracking_changes(bool tracking) noexcept
+    {
+        tracking_changes = tracking;
+    }
+
+    bool is_tracking_changes() noexcept
+    {
+        return tracking_changes;
+    }
+
+    // Record that the service description with the given name has changed. A loaded service with
+    // that name is marked as changed; if the name is that of a template ("base@"), so are all
+    // loaded instances of the template.
+    virtual void description_changed(const std::string &name) noexcept;
+
+    // Record that any or all service descriptions may have changed, marking all loaded services.
+    virtual void all_descriptions_changed() noexcept;
+
+    // Check whether a service previously failed to load as a lazy dependency.
+    bool lazy_load_failed(const std::string &name) noexcept
+    {
+        return lazy_load_failures.find(name) != lazy_load_failures.end();
+    }
+
+    // Record that a service failed to load as a lazy dependency.
+    void set_lazy_load_failed(const std::string &name) noexcept
+    {
+        try {
+            lazy_load_failures.insert(name);
+        }
+        catch (std::bad_alloc &) {
+            // (loading will be retried)
+        }
+    }
+
+    // Forget previous load failures of the given lazy dependencies (when the dependent is reloaded).
+    void clear_lazy_load_failures(const lazy_dep_list &deps) noexcept
+    {
+        for (auto &dep : deps) {
+            lazy_load_failures.erase(dep.first);
+        }
     }
 
     // Get the list of all loaded services.
@@ -863,6 +1139,9 @@ class service_set
                 next->execute_transition();
             }
         }
+        if (awaiting_boot_complete) {
+            check_boot_complete();
+        }
     }
     
     // Set the console queue tail (returns previous tail)
@@ -918,6 +1197,17 @@ class service_set
     // Notification from service that it is inactive (STOPPED)
     // Only to be called on the transition from active to inactive.
     void service_inactive(service_record *) noexcept;
+
+    // Notification from service that it has entered, or left, the STARTING state.
+    void service_starting() noexcept
+    {
+        ++starting_services;
+    }
+
+    void service_not_starting() noexcept
+    {
+        --starting_services;
+    }
     
     // Find out how many services are active (starting, running or stopping,
     // but not stopped).
@@ -926,22 +1216,81 @@ class service_set
         return active_services;
     }
     
-    void stop_all_services(shutdown_type_t type = shutdown_type_t::HALT) noexcept
-    {
-        restart_enabled = false;
-        shutdown_type = type;
-        for (std::list<service_record *>::iterator i = records.begin(); i != records.end(); ++i) {
-            (*i)->stop(false);
-            (*i)->unpin();
-        }
-        process_queues();
-    }
+    // Stop all services, as part of shutdown.
+    void stop_all_services(shutdown_type_t type = shutdown_type_t::HALT) noexcept;
     
     bool is_shutting_down() noexcept
     {
         return !restart_enabled;
     }
 
+    // Set the time allowed for all services to stop at shutdown, after which any remaining service
+    // processes are killed (a zero time value specifies no limit).
+    void set_shutdown_time_limit(time_val limit) noexcept
+    {
+        shutdown_time_limit = limit;
+    }
+
+    // Record that a service has stopped during shutdown, having begun stopping at the given time.
+    void record_stop_time(service_record *sr, time_val stop_begin) noexcept;
+
+    // Get the stop times of services stopped during shutdown (in the order they stopped).
+    const std::vector<service_stop_time> &get_stop_times() noexcept
+    {
+        return stop_times;
+    }
+
+    // Begin recording the start times of services (as started during boot), for at most
+    // max_boot_record_secs.
+    void begin_recording_start_times() noexcept;
+
+    // Note that all boot services have been issued start. Once no service is starting, boot is
+    // complete: recording of start times ends (with the total time since recording began being
+    // the boot duration) and boot_completed() is called.
+    void boot_services_started() noexcept
+    {
+        if (recording_start_times) {
+            awaiting_boot_complete = true;
+            check_boot_complete();
+        }
+    }
+
+    // Check whether boot is complete (see boot_services_started()).
+    void check_boot_complete() noexcept;
+
+    bool is_recording_start_times() noexcept
+    {
+        return recording_start_times;
+    }
+
+    // Record that a service has started, having begun starting at the given time (only while
+    // recording start times).
+    void record_start_time(service_record *sr, time_val start_begin) noexcept;
+
+    // Get the start times of services started during boot (in the order they started).
+    const std::vector<service_start_time> &get_start_times() noexcept
+    {
+        return start_times;
+    }
+
+    // Set/get the path of the boot history file, to which the start times are written (see
+    // boot-history.h). The path is not copied and must remain valid.
+    void set_boot_history_path(const char *path) noexcept
+    {
+        boot_history_path = path;
+    }
+
+    const char *get_boot_history_path() noexcept
+    {
+        return boot_history_path;
+    }
+
+    // Get the boot duration (valid once recording of start times has ended).
+    time_val get_boot_duration() noexcept
+    {
+        return boot_duration;
+    }
+
     shutdown_type_t get_shutdown_type() noexcept
     {
         return shutdown_type;
@@ -960,6 +1309,17 @@ class dirload_service_set : public service_set
 {
     service_dir_pathlist service_dirs;
 
+    // Templates which have been read and parsed (see load-service.h), by template name ("base@")
+    std::unordered_map<std::string, std::shared_ptr<const dinit_load::service_template>> templates;
+
+    bool lazy_soft_deps = false;  // load soft dependencies only when the dependent starts
+
+    // Find a service template, reading and parsing it from file if it hasn't yet been read (or if
+    // 'reread' is true). Returns nullptr if the template doesn't exist; throws service_description_exc
+    // on I/O error or if the template description is invalid, or std::bad_alloc.
+    std::shared_ptr<const dinit_load::service_template> find_template(const std::string &template_name,
+            bool reread);
+
     // Implementation of service load/reload.
     // Find a service record, or load it from file. If the service has dependencies, load those also.
     //
@@ -1002,6 +1362,15 @@ class dirload_service_set : public service_set
         return service_dirs[n].get_dir();
     }
 
+    // Set whether soft dependencies (waits-for, including those in a waits-for.d directory, and
+    // milestone dependencies) of subsequently loaded services are loaded only when the dependent
+    // service starts, rather than when it is loaded. A dependency which cannot then be loaded is
+    // ignored, unless it is a milestone dependency, in which case the dependent fails to start.
+    void set_lazy_soft_deps(bool lazy) noexcept
+    {
+        lazy_soft_deps = lazy;
+    }
+
     service_record *load_service(const char *name) override
     {
         return load_service(name, nullptr);
@@ -1011,6 +1380,10 @@ class dirload_service_set : public service_set
 
     service_record *reload_service(service_record *service) override;
 
+    void description_changed(const std::string &name) noexcept override;
+
+    void all_descriptions_changed() noexcept override;
+
     int get_set_type_id() override
     {
         return SSET_TYPE_DIRLOAD;
@@ -0,0 +1,143 @@
+#ifndef STATUS_TABLE_H_INCLUDED
+#define STATUS_TABLE_H_INCLUDED 1
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// The service status table: the status of each loaded service, kept in shared memory so that it
+// can be mapped (read-only) by monitoring tools, which can then poll the status of services
+// without communicating with dinit.
+//
+// The table is held in anonymous memory until it can be exported via a file (alongside the
+// control socket, with ".status" appended to the path), at which point it is moved into the
+// file. The file consists of a header followed by an array of entries; each entry is either
+// unused or holds the status of a single service. The table can grow (but never shrinks) as
+// services are loaded; readers should check the capacity in the header and re-map the file if
+// it has increased.
+//
+// Each entry is protected by a sequence lock: the sequence number is odd while the entry is
+// being updated, and is incremented again once the update is complete. A reader must read the
+// sequence number, copy the entry, and then check that the sequence number is even and has not
+// changed (retrying otherwise); read_status_entry() does this.
+
+constexpr uint32_t status_table_magic = 0x54534e44;  // "DNST" (little-endian)
+constexpr uint16_t status_table_version = 1;
+constexpr size_t status_name_max = 91;  // maximum name length (longer names are truncated)
+
+struct status_table_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;      // size of each entry (sizeof(status_table_entry))
+    uint32_t capacity;        // number of entries following the header
+    uint32_t reserved[5];
+};
+
+struct status_table_entry
+{
+    uint32_t seq;             // sequence lock (odd while being updated)
+    uint8_t in_use;           // 1 if the entry holds the status of a (loaded) service
+    uint8_t state;            // current state (service_state_t)
+    uint8_t target_state;     // target state (service_state_t)
+    uint8_t stop_reason;      // reason for last stop (stopped_reason_t)
+    int32_t pid;              // process ID, or -1 if none
+    int32_t exit_status;      // exit status of the process (as returned by wait()), if it has exited
+    uint32_t restart_count;   // number of automatic restarts of the process
+    uint32_t reserved;
+    int64_t transition_sec;   // time of the last state transition (monotonic clock)
+    int32_t transition_nsec;
+    uint8_t name_len;         // length of the name (which may be truncated)
+    char name[status_name_max];
+};
+
+static_assert(sizeof(status_table_header) == 32, "status_table_header has unexpected size");
+static_assert(sizeof(status_table_entry) == 128, "status_table_entry has unexpected size");
+
+// Read an entry of a (mapped) status table into 'out', retrying while the entry is being updated.
+inline void read_status_entry(const status_table_entry *ent, status_table_entry &out) noexcept
+{
+    uint32_t seq1, seq2;
+    do {
+        seq1 = __atomic_load_n(&ent->seq, __ATOMIC_ACQUIRE);
+        memcpy(&out, ent, sizeof(out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seq2 = __atomic_load_n(&ent->seq, __ATOMIC_RELAXED);
+    } while ((seq1 & 1) != 0 || seq1 != seq2);
+}
+
+class service_record;
+
+// The status table, as maintained by dinit.
+class status_table
+{
+    char *table = nullptr;    // header followed by entries
+    uint32_t capacity = 0;    // number of entries
+    uint32_t used = 0;        // number of entries allocated (in use or on the free list)
+    std::vector<uint32_t> free_slots;
+
+    std::string file_path;
+    int fd = -1;              // file descriptor of the backing file, or -1 (anonymous memory)
+
+    size_t table_size(uint32_t entries) noexcept
+    {
+        return sizeof(status_table_header) + (size_t)entries * sizeof(status_table_entry);
+    }
+
+    status_table_entry *get_entry(int slot) noexcept
+    {
+        return reinterpret_cast<status_table_entry *>(table + sizeof(status_table_header)) + slot;
+    }
+
+    // Map (or re-map) the table with the given capacity. Returns false on failure (the existing
+    // mapping then remains valid).
+    bool map_table(uint32_t new_capacity) noexcept;
+
+    public:
+    ~status_table() noexcept;
+
+    // Set the path of the backing file (should be done before the file is opened).
+    void set_path(std::string &&path) noexcept
+    {
+        file_path = std::move(path);
+    }
+
+    // Allocate the table (in anonymous memory). Until this is done, updates have no effect.
+    // Returns false on failure.
+    bool init() noexcept;
+
+    bool is_active() noexcept
+    {
+        return table != nullptr;
+    }
+
+    // Move the table to the backing file, if not already done. Returns false on failure (in
+    // which case the table remains in anonymous memory).
+    bool open_file() noexcept;
+
+    // Unlink and close the backing file, if open (the table remains mapped).
+    void close_file() noexcept;
+
+    // Allocate an entry, returning its slot number, or -1 if the table is inactive or can't be
+    // grown.
+    int alloc_slot() noexcept;
+
+    // Mark an entry as unused, and return it to the free list.
+    void release_slot(int slot) noexcept;
+
+    // Update an entry with the current status of a service. If 'transition' is true, the
+    // transition time is set to the current time.
+    void update(int slot, service_record *sr, bool transition) noexcept;
+
+    // Read an entry (for testing).
+    void read_entry(int slot, status_table_entry &out) noexcept
+    {
+        read_status_entry(get_entry(slot), out);
+    }
+};
+
+extern status_table service_status_table;
+
+#endif
@@ -70,11 +70,12 @@ static void do_env_subst(std::string &line, std::list<std::pair<unsigned,unsigne
 // are loaded and added as a dependency of the given type. Expected use is with a directory
 // containing symbolic links to other service descriptions, but this isn't required.
 // Failure to read the directory contents, or to find a service listed within, is not considered
-// a fatal error.
+// a fatal error. If lazy_deplist is not null, the services are not loaded, but are instead added
+// (by name) to lazy_deplist.
 static void process_dep_dir(dirload_service_set &sset,
         const char *servicename,
         const string &service_filename,
-        std::list<prelim_dep> &deplist, const std::string &depdirpath,
+        std::list<prelim_dep> &deplist, lazy_dep_list *lazy_deplist, const std::string &depdirpath,
         dependency_type dep_type,
         const service_record *avoid_circular)
 {
@@ -92,14 +93,19 @@ static void process_dep_dir(dirload_service_set &sset,
     while (dent != nullptr) {
         char * name =  dent->d_name;
         if (name[0] != '.') {
-            try {
-                service_record * sr = sset.load_service(name);
-                deplist.emplace_back(sr, dep_type);
+            if (lazy_deplist != nullptr) {
+                lazy_deplist->emplace_back(name, dep_type);
             }
-            catch (service_not_found &) {
-                log(loglevel_t::WARN, "Ignoring unresolved dependency '", name,
-                        "' in dependency directory '", depdirpath,
-                        "' for ", servicename, " service.");
+            else {
+                try {
+                    service_record * sr = sset.load_service(name);
+                    deplist.emplace_back(sr, dep_type);
+                }
+                catch (service_not_found &) {
+                    log(loglevel_t::WARN, "Ignoring unresolved dependency '", name,
+                            "' in dependency directory '", depdirpath,
+                            "' for ", servicename, " service.");
+                }
             }
         }
         dent = readdir(depdir);
@@ -123,6 +129,19 @@ service_record * dirload_service_set::reload_service(service_record * service)
     return load_reload_service(service->get_name().c_str(), service, service);
 }
 
+void dirload_service_set::description_changed(const std::string &name) noexcept
+{
+    // A changed template must be re-read before any further instances are loaded:
+    templates.erase(name);
+    service_set::description_changed(name);
+}
+
+void dirload_service_set::all_descriptions_changed() noexcept
+{
+    templates.clear();
+    service_set::all_descriptions_changed();
+}
+
 // Update the dependencies of the specified service atomically. May fail with bad_alloc.
 static void update_depenencies(service_record *service,
         dinit_load::service_settings_wrapper<prelim_dep> &settings)
@@ -185,6 +204,77 @@ static void update_command_and_dependencies(base_process_service *service,
     }
 }
 
+// Create the process settings for a service, from its settings (which are moved from).
+static std::shared_ptr<const process_exec_settings> make_exec_settings(dinit_load::service_settings &settings)
+{
+    auto exec_settings = std::make_shared<process_exec_settings>();
+    exec_settings->working_dir = std::move(settings.working_dir);
+    exec_settings->env_file = std::move(settings.env_file);
+    exec_settings->rlimits = std::move(settings.rlimits);
+    exec_settings->sched = std::move(settings.sched);
+    return exec_settings;
+}
+
+std::shared_ptr<const dinit_load::service_template>
+dirload_service_set::find_template(const std::string &template_name, bool reread)
+{
+    using std::ifstream;
+    using std::ios;
+    using namespace dinit_load;
+
+    if (! reread) {
+        auto found = templates.find(template_name);
+        if (found != templates.end()) {
+            return found->second;
+        }
+    }
+
+    ifstream template_file;
+    string template_filename;
+    for (auto &service_dir : service_dirs) {
+        template_filename = service_dir.get_dir();
+        if (*(template_filename.rbegin()) != '/') {
+            template_filename += '/';
+        }
+        template_filename += template_name;
+
+        template_file.open(template_filename.c_str(), ios::in);
+        if (template_file) break;
+    }
+
+    if (! template_file) {
+        templates.erase(template_name);
+        return nullptr;
+    }
+
+    auto templ = std::make_shared<service_template>();
+    templ->filename = std::move(template_filename);
+    template_file.exceptions(ios::badbit);
+    try {
+        process_service_file(template_name, template_file,
+                [&](string &line, string &setting, string_iterator &i, string_iterator &end) -> void {
+            process_template_line(*templ, template_name.c_str(), line, setting, i, end);
+        });
+    }
+    catch (setting_exception &setting_exc) {
+        throw service_description_exc(template_name, std::move(setting_exc.get_info()));
+    }
+    catch (std::system_error &sys_err) {
+        throw service_description_exc(template_name, sys_err.what());
+    }
+
+    // Unless they depend on the instance argument, the process settings are shared by all instances:
+    if (templ->settings.working_dir.find("$1") == string::npos
+            && templ->settings.env_file.find("$1") == string::npos) {
+        service_settings exec_src = templ->settings;
+        templ->exec_settings = make_exec_settings(exec_src);
+    }
+
+    auto &entry = templates[template_name];
+    entry = std::move(templ);
+    return entry;
+}
+
 service_record * dirload_service_set::load_reload_service(const char *name, service_record *reload_svc,
         const service_record *avoid_circular)
 {
@@ -265,12 +355,31 @@ service_record * dirload_service_set::load_reload_service(const char *name, serv
         if (service_file) break;
     }
 
+    // If there's no description for the service itself, it may be an instance of a template:
+    std::shared_ptr<const service_template> templ;
+    string instance_arg;
     if (! service_file) {
-        throw service_not_found(string(name));
+        string template_name;
+        if (split_instance_name(name, template_name, instance_arg)) {
+            templ = find_template(template_name, reload_svc != nullptr);
+        }
+        if (templ == nullptr) {
+            throw service_not_found(string(name));
+        }
+        service_filename = templ->filename;
+    }
+    else if (name[strlen(name) - 1] == '@') {
+        throw service_description_exc(name, "A service template cannot be loaded directly (an instance "
+                "argument must be specified).");
     }
 
     service_settings_wrapper<prelim_dep> settings;
 
+    // Soft dependencies can be loaded lazily, unless we are reloading a service which is not stopped
+    // (in which case any new dependencies must be added now):
+    settings.lazy_soft_deps = lazy_soft_deps
+            && (reload_svc == nullptr || reload_svc->get_state() == service_state_t::STOPPED);
+
     string line;
     // getline can set failbit if it reaches end-of-file, we don't want an exception in that case. There's
     // no good way to handle an I/O error however, so we'll have exceptions thrown on badbit:
@@ -286,24 +395,31 @@ service_record * dirload_service_set::load_reload_service(const char *name, serv
             add_service(dummy);
         }
 
-        process_service_file(name, service_file,
-                [&](string &line, string &setting, string_iterator &i, string_iterator &end) -> void {
-
-            auto process_dep_dir_n = [&](std::list<prelim_dep> &deplist, const std::string &waitsford,
-                    dependency_type dep_type) -> void {
-                process_dep_dir(*this, name, service_filename, deplist, waitsford, dep_type, reload_svc);
-            };
+        auto process_dep_dir_n = [&](std::list<prelim_dep> &deplist, const std::string &waitsford,
+                dependency_type dep_type) -> void {
+            process_dep_dir(*this, name, service_filename, deplist,
+                    settings.lazy_soft_deps ? &settings.lazy_depends : nullptr, waitsford, dep_type,
+                    reload_svc);
+        };
 
-            auto load_service_n = [&](const string &dep_name) -> service_record * {
-                return load_service(dep_name.c_str(), reload_svc);
-            };
-
-            process_service_line(settings, name, line, setting, i, end, load_service_n, process_dep_dir_n);
-        });
+        auto load_service_n = [&](const string &dep_name) -> service_record * {
+            return load_service(dep_name.c_str(), reload_svc);
+        };
 
-        service_file.close();
+        if (templ != nullptr) {
+            instantiate_template(*templ, name, instance_arg, settings, load_service_n, process_dep_dir_n);
+        }
+        else {
+            process_service_file(name, service_file,
+                    [&](string &line, string &setting, string_iterator &i, string_iterator &end) -> void {
+                process_service_line(settings, name, line, setting, i, end, load_service_n,
+                        process_dep_dir_n);
+            });
+            service_file.close();
+        }
 
         settings.finalise();
+        check_sched_settings(name, settings.sched);
         auto service_type = settings.service_type;
 
         if (service_type == service_type_t::PROCESS || service_type == service_type_t::BGPROCESS
@@ -374,6 +490,18 @@ service_record * dirload_service_set::load_reload_service(const char *name, serv
             }
         }
 
+        // Process settings are shared with other instances of the same template, where possible:
+        std::shared_ptr<const process_exec_settings> exec_settings;
+        if (service_type == service_type_t::PROCESS || service_type == service_type_t::BGPROCESS
+                || service_type == service_type_t::SCRIPTED) {
+            if (templ != nullptr && templ->exec_settings != nullptr) {
+                exec_settings = templ->exec_settings;
+            }
+            else {
+                exec_settings = make_exec_settings(settings);
+            }
+        }
+
         // Note, we need to be very careful to handle exceptions properly and roll back any changes that
         // we've made before the exception occurred.
 
@@ -390,17 +518,19 @@ service_record * dirload_service_set::load_reload_service(const char *name, serv
             }
             rval = rvalps;
             // All of the following should be noexcept or must perform rollback on exception
-            rvalps->set_working_dir(std::move(settings.working_dir));
-            rvalps->set_env_file(std::move(settings.env_file));
-            rvalps->set_rlimits(std::move(settings.rlimits));
+            rvalps->set_exec_settings(std::move(exec_settings));
             rvalps->set_restart_interval(settings.restart_interval, settings.max_restarts);
             rvalps->set_restart_delay(settings.restart_delay);
+            rvalps->set_restart_backoff(settings.restart_delay_max, settings.restart_delay_jitter,
+                    settings.restart_delay_reset);
             rvalps->set_stop_timeout(settings.stop_timeout);
             rvalps->set_start_timeout(settings.start_timeout);
             rvalps->set_extra_termination_signal(settings.term_signal);
             rvalps->set_run_as_uid_gid(settings.run_as_uid, settings.run_as_gid);
             rvalps->set_notification_fd(settings.readiness_fd);
             rvalps->set_notification_var(std::move(settings.readiness_var));
+            rvalps->set_notification_socket(settings.readiness_socket);
+            rvalps->set_watchdog_timeout(settings.watchdog_timeout);
             #if USE_UTMPX
             rvalps->set_utmp_id(settings.inittab_id);
             rvalps->set_utmp_line(settings.inittab_line);
@@ -419,12 +549,12 @@ service_record * dirload_service_set::load_reload_service(const char *name, serv
             }
             rval = rvalps;
             // All of the following should be noexcept or must perform rollback on exception
-            rvalps->set_working_dir(std::move(settings.working_dir));
-            rvalps->set_env_file(std::move(settings.env_file));
-            rvalps->set_rlimits(std::move(settings.rlimits));
+            rvalps->set_exec_settings(std::move(exec_settings));
             rvalps->set_pid_file(std::move(settings.pid_file));
             rvalps->set_restart_interval(settings.restart_interval, settings.max_restarts);
             rvalps->set_restart_delay(settings.restart_delay);
+            rvalps->set_restart_backoff(settings.restart_delay_max, settings.restart_delay_jitter,
+                    settings.restart_delay_reset);
             rvalps->set_stop_timeout(settings.stop_timeout);
             rvalps->set_start_timeout(settings.start_timeout);
             rvalps->set_extra_termination_signal(settings.term_signal);
@@ -446,9 +576,7 @@ service_record * dirload_service_set::load_reload_service(const char *name, serv
             rval = rvalps;
             // All of the following should be noexcept or must perform rollback on exception
             rvalps->set_stop_command(std::move(settings.stop_command), std::move(stop_arg_parts));
-            rvalps->set_working_dir(std::move(settings.working_dir));
-            rvalps->set_env_file(std::move(settings.env_file));
-            rvalps->set_rlimits(std::move(settings.rlimits));
+            rvalps->set_exec_settings(std::move(exec_settings));
             rvalps->set_stop_timeout(settings.stop_timeout);
             rvalps->set_start_timeout(settings.start_timeout);
             rvalps->set_extra_termination_signal(settings.term_signal);
@@ -471,6 +599,8 @@ service_record * dirload_service_set::load_reload_service(const char *name, serv
         rval->set_socket_details(std::move(settings.socket_path), settings.socket_perms,
                 settings.socket_uid, settings.socket_gid);
         rval->set_chain_to(std::move(settings.chain_to_name));
+        rval->set_lazy_deps(std::move(settings.lazy_depends));
+        clear_lazy_load_failures(rval->get_lazy_deps());
 
         if (create_new_record && reload_svc != nullptr) {
             // switch dependencies to old record so that they refer to the new record
@@ -503,8 +633,7 @@ service_record * dirload_service_set::load_reload_service(const char *name, serv
         }
 
         if (dummy != nullptr) {
-            auto iter = std::find(records.begin(), records.end(), dummy);
-            *iter = rval;
+            replace_service(dummy, rval);
             delete dummy;
         }
 
@@ -0,0 +1,224 @@
+#include <cstring>
+#include <cstddef>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "dinit.h"
+#include "dinit-log.h"
+#include "dinit-socket.h"
+#include "notify-socket.h"
+
+// Implementation of the shared readiness notification socket. See notify-socket.h.
+
+notify_socket_watcher notify_socket;
+
+#ifdef __linux__
+
+namespace {
+    // Number of messages received per recvmmsg call, and the maximum message size (longer
+    // messages are truncated). The buffers are static to avoid using stack (or heap) space.
+    constexpr int msg_batch_size = 16;
+    constexpr size_t max_msg_size = 1024;
+
+    // Maximum number of batches to process per wakeup (to avoid starving other events):
+    constexpr int max_batches = 4;
+
+    char msg_bufs[msg_batch_size][max_msg_size];
+    union {
+        cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(ucred))];
+    } msg_cmsgs[msg_batch_size];
+    iovec msg_iovs[msg_batch_size];
+    mmsghdr msg_hdrs[msg_batch_size];
+
+    // Find the sender pid of a received message, or return -1 if unknown.
+    pid_t get_sender_pid(msghdr &hdr) noexcept
+    {
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS
+                    && cmsg->cmsg_len >= CMSG_LEN(sizeof(ucred))) {
+                ucred cred;
+                memcpy(&cred, CMSG_DATA(cmsg), sizeof(cred));
+                return cred.pid;
+            }
+        }
+        return -1;
+    }
+}
+
+bool notify_socket_watcher::open_socket() noexcept
+{
+    if (socket_open) return true;
+
+    const char *saddrname = socket_path.c_str();
+    size_t saddrname_len = socket_path.length();
+    if (saddrname_len == 0 || saddrname_len >= sizeof(sockaddr_un::sun_path)) {
+        log(loglevel_t::ERROR, "Invalid notification socket path: ", saddrname);
+        return false;
+    }
+
+    sockaddr_un name;
+    name.sun_family = AF_UNIX;
+    memcpy(name.sun_path, saddrname, saddrname_len + 1);
+    socklen_t sockaddr_size = offsetof(struct sockaddr_un, sun_path) + saddrname_len + 1;
+
+    int sockfd = dinit_socket(AF_UNIX, SOCK_DGRAM, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (sockfd == -1) {
+        log(loglevel_t::ERROR, "Error creating notification socket: ", strerror(errno));
+        return false;
+    }
+
+    int enable = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_PASSCRED, &enable, sizeof(enable)) == -1) {
+        log(loglevel_t::ERROR, "Error setting notification socket options: ", strerror(errno));
+        close(sockfd);
+        return false;
+    }
+
+    // Remove any stale socket (the path is specific to this dinit instance):
+    unlink(saddrname);
+
+    if (bind(sockfd, (struct sockaddr *) &name, sockaddr_size) == -1) {
+        log(loglevel_t::ERROR, "Error binding notification socket: ", strerror(errno));
+        close(sockfd);
+        return false;
+    }
+
+    // Service processes may run as any user. Messages are only accepted from the main process of a
+    // service, so it is safe to allow anyone to send:
+    if (chmod(saddrname, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH) == -1) {
+        log(loglevel_t::ERROR, "Error setting notification socket permissions: ", strerror(errno));
+        close(sockfd);
+        unlink(saddrname);
+        return false;
+    }
+
+    try {
+        add_watch(event_loop, sockfd, dasynq::IN_EVENTS);
+        socket_open = true;
+    }
+    catch (std::exception &e) {
+        log(loglevel_t::ERROR, "Could not set up I/O on notification socket: ", e.what());
+        close(sockfd);
+        unlink(saddrname);
+        return false;
+    }
+
+    return true;
+}
+
+dasynq::rearm notify_socket_watcher::fd_event(eventloop_t &loop, int fd, int flags) noexcept
+{
+    for (int batch = 0; batch < max_batches; batch++) {
+        for (int i = 0; i < msg_batch_size; i++) {
+            msg_iovs[i].iov_base = msg_bufs[i];
+            msg_iovs[i].iov_len = max_msg_size;
+            msghdr &hdr = msg_hdrs[i].msg_hdr;
+            hdr.msg_name = nullptr;
+            hdr.msg_namelen = 0;
+            hdr.msg_iov = &msg_iovs[i];
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = msg_cmsgs[i].buf;
+            hdr.msg_controllen = sizeof(msg_cmsgs[i].buf);
+            hdr.msg_flags = 0;
+        }
+
+        int r = recvmmsg(fd, msg_hdrs, msg_batch_size, MSG_DONTWAIT, nullptr);
+        if (r <= 0) {
+            if (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log(loglevel_t::WARN, "Error reading notification socket: ", strerror(errno));
+            }
+            break;
+        }
+
+        for (int i = 0; i < r; i++) {
+            pid_t sender = get_sender_pid(msg_hdrs[i].msg_hdr);
+            if (sender > 0) {
+                process_message(sender, msg_bufs[i], msg_hdrs[i].msg_len);
+            }
+        }
+
+        if (r < msg_batch_size) break;
+    }
+
+    return dasynq::rearm::REARM;
+}
+
+#else
+
+bool notify_socket_watcher::open_socket() noexcept
+{
+    log(loglevel_t::ERROR, "Readiness notification socket is not supported on this platform");
+    return false;
+}
+
+dasynq::rearm notify_socket_watcher::fd_event(eventloop_t &loop, int fd, int flags) noexcept
+{
+    return dasynq::rearm::DISARM;
+}
+
+#endif
+
+void notify_socket_watcher::close_socket() noexcept
+{
+    if (socket_open) {
+        int fd = get_watched_fd();
+        deregister(event_loop);
+        close(fd);
+        unlink(socket_path.c_str());
+        socket_open = false;
+    }
+}
+
+bool notify_socket_watcher::add_service(base_process_service *sr) noexcept
+{
+    pid_t pid = sr->get_pid();
+    if (sr->notify_pid == pid) return true;
+    remove_service(sr);
+
+    try {
+        notify_services[pid] = sr;
+    }
+    catch (std::bad_alloc &) {
+        log_service_msg(loglevel_t::ERROR, sr->get_name(), "out of memory registering for readiness "
+                "notification");
+        return false;
+    }
+
+    sr->notify_pid = pid;
+    return true;
+}
+
+void notify_socket_watcher::process_message(pid_t pid, const char *msg, size_t len) noexcept
+{
+    auto found = notify_services.find(pid);
+    if (found == notify_services.end()) {
+        // Not from the main process of any service; ignore.
+        return;
+    }
+    base_process_service *sr = found->second;
+
+    const char *end = msg + len;
+    while (msg < end) {
+        const char *eol = static_cast<const char *>(memchr(msg, '\n', end - msg));
+        if (eol == nullptr) eol = end;
+        size_t line_len = eol - msg;
+
+        if (line_len == 7 && strncmp(msg, "READY=1", 7) == 0) {
+            sr->notify_ready();
+        }
+        else if (line_len == 10 && strncmp(msg, "WATCHDOG=1", 10) == 0) {
+            sr->notify_watchdog();
+        }
+        else if (line_len >= 7 && strncmp(msg, "STATUS=", 7) == 0) {
+            sr->notify_status(msg + 7, line_len - 7);
+        }
+
+        msg = eol + 1;
+    }
+}
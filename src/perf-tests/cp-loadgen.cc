@@ -0,0 +1,766 @@
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <limits>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <csignal>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include "control-cmds.h"
+
+// Control protocol load generator.
+//
+// Starts a user-mode dinit instance with a generated service directory, opens many concurrent
+// control connections, and has each issue a series of requests (one at a time): loading services,
+// starting and stopping them, and listing all services. Starting and stopping services generates
+// service events, which are sent to every connection holding a handle to the service, and to a
+// number of subscriber connections (DINIT_CP_SUBSCRIBE). Reports throughput and the latency
+// distribution of requests (per request type), and the CPU time used by dinit.
+
+namespace {
+
+using handle_t = uint32_t;
+using clock_type = std::chrono::steady_clock;
+
+enum class op_t { LOAD, START, STOP, LIST, SUBSCRIBE, NONE };
+constexpr int num_timed_ops = 4;  // LOAD to LIST
+const char * const op_names[num_timed_ops] = { "load", "start", "stop", "list" };
+
+// Size of the header of a DINIT_RP_SVCINFO packet (as sent by dinit):
+constexpr size_t svcinfo_hdr_size = 8 + (sizeof(int) > sizeof(pid_t) ? sizeof(int) : sizeof(pid_t));
+
+struct options
+{
+    unsigned connections = 1000;
+    unsigned subscribers = 10;
+    unsigned requests = 50;     // per connection
+    unsigned services = 200;
+    unsigned seed = 1;
+    bool seqpacket = false;
+    const char *dinit_path = "../dinit";
+};
+
+struct connection
+{
+    int fd = -1;
+    bool subscriber = false;
+    op_t pending = op_t::NONE;
+    unsigned pending_svc = 0;   // service index, for LOAD
+    clock_type::time_point sent_time;
+    unsigned requests_done = 0;
+    std::vector<char> inbuf;
+    std::vector<char> outbuf;   // request data not yet written
+    std::unordered_map<unsigned, handle_t> handles;  // service index -> handle
+    std::vector<unsigned> loaded;  // service indexes for which we have a handle
+    bool have_seq = false;      // (subscriber) whether next_seq is valid
+    uint32_t next_seq = 0;      // (subscriber) expected sequence number of next event
+};
+
+struct load_stats
+{
+    std::vector<uint32_t> latencies[num_timed_ops];  // microseconds
+    unsigned long events = 0;       // service events received (by request connections)
+    unsigned long sub_events = 0;   // service events received by subscribers
+    unsigned long events_lost = 0;  // events lost by subscribers (queue full)
+    unsigned long events_missed = 0;  // events missed by subscribers without being reported lost
+    unsigned long naks = 0;         // requests not performed (NAK etc)
+};
+
+// Readiness notification for the connections, via epoll where available (with thousands of
+// connections the cost of poll() would otherwise dominate), or poll(). Readiness is reported using
+// the poll() flags.
+class conn_poller
+{
+    std::vector<bool> want_out;
+#ifdef __linux__
+    int epfd = -1;
+    std::vector<int> fds;
+    std::vector<struct epoll_event> events;
+#else
+    std::vector<struct pollfd> pollfds;
+#endif
+
+    public:
+    // Initialise for the given connection fds. Returns false on failure.
+    bool init(const std::vector<int> &conn_fds)
+    {
+        want_out.resize(conn_fds.size());
+#ifdef __linux__
+        fds = conn_fds;
+        events.resize(conn_fds.size());
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd == -1) return false;
+        for (unsigned i = 0; i < conn_fds.size(); i++) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u32 = i;
+            if (epoll_ctl(epfd, EPOLL_CTL_ADD, conn_fds[i], &ev) == -1) return false;
+        }
+#else
+        pollfds.resize(conn_fds.size());
+        for (unsigned i = 0; i < conn_fds.size(); i++) {
+            pollfds[i].fd = conn_fds[i];
+        }
+#endif
+        return true;
+    }
+
+    // Set whether to watch for a connection being writable.
+    void watch_output(unsigned idx, bool want)
+    {
+        if (want_out[idx] == want) return;
+        want_out[idx] = want;
+#ifdef __linux__
+        struct epoll_event ev;
+        ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+        ev.data.u32 = idx;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fds[idx], &ev);
+#endif
+    }
+
+    // Wait for readiness; returns the number of ready connections (0 on timeout) or -1 on error.
+    int wait(int timeout_ms, std::vector<std::pair<unsigned, int>> &ready)
+    {
+        ready.clear();
+#ifdef __linux__
+        int r = epoll_wait(epfd, events.data(), events.size(), timeout_ms);
+        for (int i = 0; i < r; i++) {
+            uint32_t evs = events[i].events;
+            int flags = ((evs & EPOLLIN) ? POLLIN : 0) | ((evs & EPOLLOUT) ? POLLOUT : 0)
+                    | ((evs & EPOLLHUP) ? POLLHUP : 0) | ((evs & EPOLLERR) ? POLLERR : 0);
+            unsigned idx = events[i].data.u32;
+            ready.emplace_back(idx, flags);
+        }
+#else
+        for (unsigned i = 0; i < pollfds.size(); i++) {
+            pollfds[i].events = POLLIN | (want_out[i] ? POLLOUT : 0);
+            pollfds[i].revents = 0;
+        }
+        int r = poll(pollfds.data(), pollfds.size(), timeout_ms);
+        for (unsigned i = 0; r > 0 && i < pollfds.size(); i++) {
+            if (pollfds[i].revents != 0) {
+                ready.emplace_back(i, pollfds[i].revents);
+            }
+        }
+#endif
+        return r;
+    }
+
+    ~conn_poller()
+    {
+#ifdef __linux__
+        if (epfd != -1) close(epfd);
+#endif
+    }
+};
+
+std::string service_name(unsigned i)
+{
+    return "svc-" + std::to_string(i);
+}
+
+// Create the service directory: a "boot" service (which keeps dinit running) and the services
+// used by the workload. Every fourth service is independent; the others wait for the previous one.
+bool create_services(const std::string &sd, unsigned count)
+{
+    if (mkdir(sd.c_str(), 0700) == -1) {
+        std::cerr << "cp-loadgen: mkdir " << sd << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::ofstream boot(sd + "/boot");
+    boot << "type = internal\n";
+    for (unsigned i = 0; i < count; i++) {
+        std::ofstream svc(sd + "/" + service_name(i));
+        svc << "type = internal\n";
+        if (i % 4 != 0) {
+            svc << "waits-for = " << service_name(i - 1) << "\n";
+        }
+        if (! svc) {
+            std::cerr << "cp-loadgen: couldn't write service description" << std::endl;
+            return false;
+        }
+    }
+    return (bool) boot;
+}
+
+// Remove a directory and its contents (including one level of subdirectories).
+void remove_dir(const std::string &path, bool is_subdir = false)
+{
+    DIR *dir = opendir(path.c_str());
+    if (dir != nullptr) {
+        while (dirent *ent = readdir(dir)) {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+            std::string ent_path = path + "/" + ent->d_name;
+            if (unlink(ent_path.c_str()) == -1 && ! is_subdir) {
+                remove_dir(ent_path, true);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(path.c_str());
+}
+
+pid_t start_dinit(const options &opts, const std::string &sd, const std::string &sock_path)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        int nullfd = open("/dev/null", O_RDWR);
+        if (nullfd != -1) {
+            dup2(nullfd, STDIN_FILENO);
+            dup2(nullfd, STDOUT_FILENO);
+            dup2(nullfd, STDERR_FILENO);
+        }
+        const char *sock_type = opts.seqpacket ? "seqpacket" : "stream";
+        execl(opts.dinit_path, opts.dinit_path, "--user", "--quiet", "-d", sd.c_str(), "-p",
+                sock_path.c_str(), "--socket-type", sock_type, "boot", (char *) nullptr);
+        _exit(127);
+    }
+    if (pid == -1) {
+        std::cerr << "cp-loadgen: fork: " << strerror(errno) << std::endl;
+    }
+    return pid;
+}
+
+int connect_to(const std::string &sock_path, bool seqpacket)
+{
+    int fd = socket(AF_UNIX, seqpacket ? SOCK_SEQPACKET : SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+
+    struct sockaddr_un name;
+    if (sock_path.length() >= sizeof(name.sun_path)) {
+        errno = ENAMETOOLONG;
+        close(fd);
+        return -1;
+    }
+    name.sun_family = AF_UNIX;
+    strcpy(name.sun_path, sock_path.c_str());
+    if (connect(fd, (struct sockaddr *) &name, sizeof(name)) == -1) {
+        int connect_errno = errno;
+        close(fd);
+        errno = connect_errno;
+        return -1;
+    }
+    return fd;
+}
+
+// Write as much pending request data as possible. Returns false on error.
+bool flush_output(connection &conn)
+{
+    while (! conn.outbuf.empty()) {
+        ssize_t r = write(conn.fd, conn.outbuf.data(), conn.outbuf.size());
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn.outbuf.erase(conn.outbuf.begin(), conn.outbuf.begin() + r);
+    }
+    return true;
+}
+
+template <typename T> void append_val(std::vector<char> &buf, const T &val)
+{
+    const char *val_p = reinterpret_cast<const char *>(&val);
+    buf.insert(buf.end(), val_p, val_p + sizeof(val));
+}
+
+// Issue the next request for a (non-subscriber) connection.
+bool issue_request(connection &conn, std::minstd_rand &rng, unsigned num_services)
+{
+    unsigned pick = rng() % 100;
+    std::vector<char> &buf = conn.outbuf;
+
+    if (pick < 10) {
+        conn.pending = op_t::LIST;
+        buf.push_back(DINIT_CP_LISTSERVICES);
+    }
+    else if (pick < 30 || conn.loaded.empty()) {
+        conn.pending = op_t::LOAD;
+        conn.pending_svc = rng() % num_services;
+        std::string name = service_name(conn.pending_svc);
+        uint16_t name_len = name.length();
+        buf.push_back(DINIT_CP_LOADSERVICE);
+        append_val(buf, name_len);
+        buf.insert(buf.end(), name.begin(), name.end());
+    }
+    else {
+        bool start = pick < 65;
+        conn.pending = start ? op_t::START : op_t::STOP;
+        unsigned svc = conn.loaded[rng() % conn.loaded.size()];
+        buf.push_back(start ? DINIT_CP_STARTSERVICE : DINIT_CP_STOPSERVICE);
+        buf.push_back(0);  // flags
+        append_val(buf, conn.handles[svc]);
+    }
+
+    conn.sent_time = clock_type::now();
+    return flush_output(conn);
+}
+
+// Count the events in an information packet.
+void count_events(connection &conn, const unsigned char *pkt, size_t len, load_stats &stats)
+{
+    // Subscribers check the event sequence numbers, to verify that no events are missed:
+    auto check_seq = [&](uint32_t seq, uint32_t count) {
+        if (conn.have_seq && seq != conn.next_seq) {
+            stats.events_missed += seq - conn.next_seq;
+        }
+        conn.have_seq = true;
+        conn.next_seq = seq + count;
+    };
+
+    if (pkt[0] == DINIT_IP_SERVICEEVENTS) {
+        // entries: 4-byte sequence number, 1-byte event, 1-byte name length, name
+        size_t pos = 2;
+        while (pos + 6 <= len) {
+            uint32_t seq;
+            memcpy(&seq, pkt + pos, sizeof(seq));
+            check_seq(seq, 1);
+            stats.sub_events++;
+            pos += 6 + pkt[pos + 5];
+        }
+    }
+    else if (pkt[0] == DINIT_IP_EVENTSLOST && len >= 10) {
+        uint32_t first, lost;
+        memcpy(&first, pkt + 2, sizeof(first));
+        memcpy(&lost, pkt + 6, sizeof(lost));
+        check_seq(first, lost);
+        stats.events_lost += lost;
+    }
+    else if (pkt[0] == DINIT_IP_SERVICEEVENT) {
+        stats.events++;
+    }
+}
+
+// Process complete packets received on a connection. Returns false on protocol error. Sets
+// 'completed' if the pending request completed.
+bool process_input(connection &conn, load_stats &stats, bool &completed)
+{
+    completed = false;
+    size_t pos = 0;
+    std::vector<char> &buf = conn.inbuf;
+
+    while (pos < buf.size()) {
+        const unsigned char *pkt = reinterpret_cast<const unsigned char *>(buf.data() + pos);
+        size_t avail = buf.size() - pos;
+
+        if (pkt[0] >= 100) {
+            // Information packet (length in second byte)
+            if (avail < 2) break;
+            size_t len = pkt[1];
+            if (len < 2) return false;
+            if (avail < len) break;
+            count_events(conn, pkt, len, stats);
+            pos += len;
+            continue;
+        }
+
+        size_t len = 1;
+        bool done = true;
+        bool performed = true;
+        switch (pkt[0]) {
+        case DINIT_RP_SERVICERECORD:
+            // state, handle, target state
+            len = 3 + sizeof(handle_t);
+            if (avail < len) break;
+            if (conn.pending != op_t::LOAD) return false;
+            if (conn.handles.find(conn.pending_svc) == conn.handles.end()) {
+                conn.loaded.push_back(conn.pending_svc);
+            }
+            memcpy(&conn.handles[conn.pending_svc], pkt + 2, sizeof(handle_t));
+            break;
+        case DINIT_RP_SVCINFO:
+            if (avail < 2) {
+                len = 2;
+                break;
+            }
+            len = svcinfo_hdr_size + pkt[1];
+            done = false;
+            break;
+        case DINIT_RP_DEPENDENTS: {
+            // size_t count, handles
+            len = 1 + sizeof(size_t);
+            if (avail < len) break;
+            size_t count;
+            memcpy(&count, pkt + 1, sizeof(count));
+            len += count * sizeof(handle_t);
+            performed = false;
+            break;
+        }
+        case DINIT_RP_ACK:
+        case DINIT_RP_ALREADYSS:
+        case DINIT_RP_LISTDONE:
+            break;
+        case DINIT_RP_NAK:
+        case DINIT_RP_NOSERVICE:
+        case DINIT_RP_SERVICELOADERR:
+            performed = false;
+            break;
+        default:
+            return false;
+        }
+
+        if (avail < len) break;
+        pos += len;
+        if (done) {
+            if (conn.pending == op_t::NONE) return false;
+            if (! performed) stats.naks++;
+            if (conn.pending != op_t::SUBSCRIBE) {
+                auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                        clock_type::now() - conn.sent_time).count();
+                stats.latencies[(int) conn.pending].push_back(elapsed);
+                conn.requests_done++;
+            }
+            conn.pending = op_t::NONE;
+            completed = true;
+            // (further replies can only be information packets)
+        }
+    }
+
+    buf.erase(buf.begin(), buf.begin() + pos);
+    return true;
+}
+
+uint32_t percentile(const std::vector<uint32_t> &sorted, unsigned pct)
+{
+    if (sorted.empty()) return 0;
+    size_t idx = (sorted.size() * pct + 99) / 100;
+    return sorted[idx == 0 ? 0 : idx - 1];
+}
+
+void print_latencies(const char *name, std::vector<uint32_t> &lats)
+{
+    std::sort(lats.begin(), lats.end());
+    std::cout << std::left << std::setw(10) << name << std::right
+            << std::setw(10) << lats.size()
+            << std::setw(12) << percentile(lats, 50)
+            << std::setw(12) << percentile(lats, 99)
+            << std::setw(12) << (lats.empty() ? 0 : lats.back()) << "\n";
+}
+
+bool parse_uint(const char *arg, unsigned &val, unsigned min_val)
+{
+    char *endptr;
+    unsigned long v = strtoul(arg, &endptr, 10);
+    if (*arg == 0 || *endptr != 0 || v < min_val || v > 1000000) {
+        return false;
+    }
+    val = v;
+    return true;
+}
+
+void usage()
+{
+    std::cout << "cp-loadgen: control protocol load generator for dinit\n"
+            "Usage: cp-loadgen [options]\n"
+            "  --connections <n>    number of concurrent request connections (default 1000)\n"
+            "  --subscribers <n>    number of connections subscribed to all events (default 10)\n"
+            "  --requests <n>       number of requests issued by each connection (default 50)\n"
+            "  --services <n>       number of services in generated service directory (default 200)\n"
+            "  --seed <n>           random number seed (default 1)\n"
+            "  --socket-type <type> control socket type: stream (default) or seqpacket\n"
+            "  --dinit <path>       path to dinit executable (default ../dinit)\n";
+}
+
+} // anon namespace
+
+int main(int argc, char **argv)
+{
+    options opts;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        bool ok = val != nullptr;
+        if (strcmp(arg, "--connections") == 0) {
+            ok = ok && parse_uint(val, opts.connections, 1);
+        }
+        else if (strcmp(arg, "--subscribers") == 0) {
+            ok = ok && parse_uint(val, opts.subscribers, 0);
+        }
+        else if (strcmp(arg, "--requests") == 0) {
+            ok = ok && parse_uint(val, opts.requests, 1);
+        }
+        else if (strcmp(arg, "--services") == 0) {
+            ok = ok && parse_uint(val, opts.services, 1);
+        }
+        else if (strcmp(arg, "--seed") == 0) {
+            ok = ok && parse_uint(val, opts.seed, 0);
+        }
+        else if (strcmp(arg, "--socket-type") == 0) {
+            ok = ok && (strcmp(val, "stream") == 0 || strcmp(val, "seqpacket") == 0);
+            opts.seqpacket = ok && strcmp(val, "seqpacket") == 0;
+        }
+        else if (strcmp(arg, "--dinit") == 0) {
+            opts.dinit_path = val;
+        }
+        else if (strcmp(arg, "--help") == 0) {
+            usage();
+            return 0;
+        }
+        else {
+            ok = false;
+        }
+        if (! ok) {
+            std::cerr << "cp-loadgen: invalid or incomplete option: " << arg << " (use --help for help)"
+                    << std::endl;
+            return 1;
+        }
+        ++i;
+    }
+
+    // Raise the file descriptor limit as needed (dinit inherits the limit):
+    unsigned num_conns = opts.connections + opts.subscribers;
+    struct rlimit nofile;
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == 0) {
+        rlim_t needed = num_conns + 64;
+        if (nofile.rlim_cur != RLIM_INFINITY && nofile.rlim_cur < needed) {
+            if (nofile.rlim_max != RLIM_INFINITY && nofile.rlim_max < needed) {
+                std::cerr << "cp-loadgen: file descriptor limit too low for " << num_conns
+                        << " connections" << std::endl;
+                return 1;
+            }
+            nofile.rlim_cur = needed;
+            setrlimit(RLIMIT_NOFILE, &nofile);
+        }
+    }
+
+    char dir_template[] = "/tmp/cp-loadgen.XXXXXX";
+    if (mkdtemp(dir_template) == nullptr) {
+        std::cerr << "cp-loadgen: mkdtemp: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    std::string work_dir = dir_template;
+    std::string sock_path = work_dir + "/socket";
+
+    if (! create_services(work_dir + "/sd", opts.services)) {
+        remove_dir(work_dir);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    pid_t dinit_pid = start_dinit(opts, work_dir + "/sd", sock_path);
+    if (dinit_pid == -1) {
+        remove_dir(work_dir);
+        return 1;
+    }
+
+    std::vector<connection> conns(num_conns);
+    conn_poller poller;
+    std::minstd_rand rng(opts.seed);
+    load_stats stats;
+    bool failed = false;
+
+    // Wait for dinit to open its control socket (up to 5 seconds):
+    int first_fd = -1;
+    for (int tries = 0; tries < 100 && first_fd == -1; tries++) {
+        first_fd = connect_to(sock_path, opts.seqpacket);
+        if (first_fd == -1) usleep(50000);
+    }
+    if (first_fd == -1) {
+        std::cerr << "cp-loadgen: couldn't connect to dinit: " << strerror(errno) << std::endl;
+        failed = true;
+    }
+    else {
+        conns[0].fd = first_fd;
+    }
+
+    for (unsigned i = 1; i < num_conns && ! failed; i++) {
+        conns[i].fd = connect_to(sock_path, opts.seqpacket);
+        if (conns[i].fd == -1) {
+            std::cerr << "cp-loadgen: connect: " << strerror(errno) << std::endl;
+            failed = true;
+        }
+    }
+
+    auto start_time = clock_type::now();
+    unsigned active = opts.connections;
+
+    if (! failed) {
+        for (unsigned i = 0; i < num_conns; i++) {
+            connection &conn = conns[i];
+            fcntl(conn.fd, F_SETFL, fcntl(conn.fd, F_GETFL) | O_NONBLOCK);
+            if (i >= opts.connections) {
+                // Subscribe to all events for all services:
+                conn.subscriber = true;
+                conn.pending = op_t::SUBSCRIBE;
+                conn.outbuf = { DINIT_CP_SUBSCRIBE, 0, 0, 0 };
+                failed = ! flush_output(conn);
+            }
+            else {
+                failed = ! issue_request(conn, rng, opts.services);
+            }
+            if (failed) {
+                std::cerr << "cp-loadgen: write: " << strerror(errno) << std::endl;
+                break;
+            }
+        }
+    }
+
+    if (! failed) {
+        std::vector<int> conn_fds;
+        for (connection &conn : conns) {
+            conn_fds.push_back(conn.fd);
+        }
+        if (! poller.init(conn_fds)) {
+            std::cerr << "cp-loadgen: couldn't set up polling: " << strerror(errno) << std::endl;
+            failed = true;
+        }
+        for (unsigned i = 0; i < num_conns; i++) {
+            poller.watch_output(i, ! conns[i].outbuf.empty());
+        }
+    }
+
+    char read_buf[65536];
+    std::vector<std::pair<unsigned, int>> ready;
+    double elapsed = 0.0;
+
+    // Once all requests are complete, continue reading until no further events are received for
+    // a short time (so that subscribers receive any report of lost events):
+    bool draining = false;
+
+    while (! failed) {
+        if (active == 0 && ! draining) {
+            elapsed = std::chrono::duration<double>(clock_type::now() - start_time).count();
+            draining = true;
+        }
+
+        int r = poller.wait(draining ? 200 : 10000, ready);
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            std::cerr << "cp-loadgen: poll: " << strerror(errno) << std::endl;
+            failed = true;
+            break;
+        }
+        if (r == 0) {
+            if (draining) break;
+            std::cerr << "cp-loadgen: no progress for 10 seconds; aborting" << std::endl;
+            failed = true;
+            break;
+        }
+
+        for (auto &ready_conn : ready) {
+            if (failed) break;
+            unsigned i = ready_conn.first;
+            int revents = ready_conn.second;
+            connection &conn = conns[i];
+
+            if ((revents & POLLOUT) && ! flush_output(conn)) {
+                std::cerr << "cp-loadgen: write: " << strerror(errno) << std::endl;
+                failed = true;
+                break;
+            }
+            poller.watch_output(i, ! conn.outbuf.empty());
+            if ((revents & (POLLIN | POLLHUP | POLLERR)) == 0) continue;
+
+            ssize_t rlen = read(conn.fd, read_buf, sizeof(read_buf));
+            if (rlen == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) continue;
+                std::cerr << "cp-loadgen: read: " << strerror(errno) << std::endl;
+                failed = true;
+                break;
+            }
+            if (rlen == 0) {
+                std::cerr << "cp-loadgen: connection closed by dinit" << std::endl;
+                failed = true;
+                break;
+            }
+
+            conn.inbuf.insert(conn.inbuf.end(), read_buf, read_buf + rlen);
+            bool completed;
+            if (! process_input(conn, stats, completed)) {
+                std::cerr << "cp-loadgen: protocol error" << std::endl;
+                failed = true;
+                break;
+            }
+            if (completed && ! conn.subscriber) {
+                if (conn.requests_done == opts.requests) {
+                    --active;
+                }
+                else if (! issue_request(conn, rng, opts.services)) {
+                    std::cerr << "cp-loadgen: write: " << strerror(errno) << std::endl;
+                    failed = true;
+                }
+            }
+
+            poller.watch_output(i, ! conn.outbuf.empty());
+        }
+    }
+
+    for (connection &conn : conns) {
+        if (conn.fd != -1) close(conn.fd);
+    }
+
+    // Stop dinit, and collect its resource usage:
+    kill(dinit_pid, SIGTERM);
+    int wstatus;
+    struct rusage usage;
+    bool have_usage = wait4(dinit_pid, &wstatus, 0, &usage) == dinit_pid;
+    remove_dir(work_dir);
+
+    if (failed) {
+        return 1;
+    }
+
+    unsigned long total_requests = 0;
+    std::vector<uint32_t> all_lats;
+    for (auto &lats : stats.latencies) {
+        total_requests += lats.size();
+        all_lats.insert(all_lats.end(), lats.begin(), lats.end());
+    }
+
+    std::cout << "Connections: " << opts.connections << " (+" << opts.subscribers << " subscribers), "
+            << "services: " << opts.services << ", socket type: "
+            << (opts.seqpacket ? "seqpacket" : "stream") << "\n";
+    std::cout << std::fixed << std::setprecision(2) << "Requests: " << total_requests << " in "
+            << elapsed << " s (" << std::setprecision(0) << (total_requests / elapsed) << " requests/s); "
+            << stats.naks << " not performed\n";
+    std::cout << "Service events received: " << stats.events << " (requesting connections), "
+            << stats.sub_events << " (subscribers, " << stats.events_lost << " lost";
+    if (stats.events_missed != 0) {
+        std::cout << ", " << stats.events_missed << " MISSED";
+    }
+    std::cout << ")\n\n";
+
+    std::cout << std::left << std::setw(10) << "Request" << std::right << std::setw(10) << "count"
+            << std::setw(12) << "p50 (us)" << std::setw(12) << "p99 (us)" << std::setw(12) << "max (us)"
+            << "\n";
+    for (int i = 0; i < num_timed_ops; i++) {
+        print_latencies(op_names[i], stats.latencies[i]);
+    }
+    print_latencies("all", all_lats);
+
+    if (have_usage) {
+        std::cout << std::setprecision(2) << "\ndinit CPU time: "
+                << (usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6) << " s user, "
+                << (usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6) << " s system\n";
+    }
+    std::cout << std::flush;
+
+    return 0;
+}
@@ -9,6 +9,7 @@
 #include "dinit-util.h"
 #include "dinit-log.h"
 #include "proc-service.h"
+#include "notify-socket.h"
 
 /*
  * Most of the implementation for process-based services (process, scripted, bgprocess) is here.
@@ -26,6 +27,11 @@ const char * const exec_stage_descriptions[static_cast<int>(exec_stage::DO_EXEC)
         "changing directory",           // CHDIR
         "setting up standard input/output descriptors", // SETUP_STDINOUTERR
         "setting resource limits",      // SET_RLIMITS
+        "setting CPU affinity",         // SET_CPU_AFFINITY
+        "setting NUMA memory policy",   // SET_NUMA_POLICY
+        "setting I/O priority",         // SET_IOPRIO
+        "setting scheduling policy",    // SET_SCHED_POLICY
+        "setting nice value",           // SET_NICE
         "setting user/group ID",        // SET_UIDGID
         "executing command"             // DO_EXEC
 };
@@ -62,7 +68,14 @@ void process_service::exec_succeeded() noexcept
     // might be stopped (and killed via a signal) during smooth recovery.  We don't to
     // process startup again in either case, so we check for state STARTING:
     if (get_state() == service_state_t::STARTING) {
-        if (force_notification_fd != -1 || !notification_var.empty()) {
+        if (notification_socket) {
+            // Wait for readiness notification, unless it already arrived:
+            if (notified_ready) {
+                started();
+                arm_watchdog();
+            }
+        }
+        else if (force_notification_fd != -1 || !notification_var.empty()) {
             // Wait for readiness notification:
             readiness_watcher.set_enabled(event_loop, true);
         }
@@ -70,6 +83,12 @@ void process_service::exec_succeeded() noexcept
             started();
         }
     }
+    else if (get_state() == service_state_t::STARTED) {
+        // Smooth recovery: the new process is subject to the watchdog.
+        if (notification_socket) {
+            arm_watchdog();
+        }
+    }
     else if (get_state() == service_state_t::STOPPING) {
         // stopping, but smooth recovery was in process. That's now over so we can
         // commence normal stop. Note that if pid == -1 the process already stopped(!),
@@ -123,6 +142,21 @@ rearm exec_status_pipe_watcher::fd_event(eventloop_t &loop, int fd, int flags) n
     return rearm::REMOVED;
 }
 
+void process_service::notify_ready() noexcept
+{
+    if (get_state() == service_state_t::STARTING) {
+        if (waiting_for_execstat) {
+            // We can't consider the service started until we know that exec() succeeded:
+            notified_ready = true;
+        }
+        else {
+            started();
+            arm_watchdog();
+            services->process_queues();
+        }
+    }
+}
+
 rearm ready_notify_watcher::fd_event(eventloop_t &, int fd, int flags) noexcept
 {
     char buf[128];
@@ -159,6 +193,7 @@ dasynq::rearm service_child_watcher::status_change(eventloop_t &loop, pid_t chil
 
     sr->pid = -1;
     sr->exit_status = bp_sys::exit_status(status);
+    sr->update_status();
 
     // Ok, for a process service, any process death which we didn't rig ourselves is a bit... unexpected.
     // Probably, the child died because we asked it to (sr->service_state == STOPPING). But even if we
@@ -194,21 +229,22 @@ void process_service::handle_exit_status(bp_sys::exit_status exit_status) noexce
         bp_sys::close(notification_fd);
         notification_fd = -1;
     }
+    end_notifications();
 
     if (!exit_status.did_exit_clean() && service_state != service_state_t::STOPPING) {
         if (did_exit) {
-            log(loglevel_t::ERROR, "Service ", get_name(), " process terminated with exit code ",
-                    exit_status.get_exit_status());
+            log_about_service(loglevel_t::ERROR, get_name(), "Service ", get_name(),
+                    " process terminated with exit code ", exit_status.get_exit_status());
         }
         else if (was_signalled) {
-            log(loglevel_t::ERROR, "Service ", get_name(), " terminated due to signal ",
-                    exit_status.get_term_sig());
+            log_about_service(loglevel_t::ERROR, get_name(), "Service ", get_name(),
+                    " terminated due to signal ", exit_status.get_term_sig());
         }
     }
 
 #if USE_UTMPX
     if (*inittab_id || *inittab_line) {
-        clear_utmp_entry(inittab_id, inittab_line);
+        utmp_queue.clear_entry(inittab_id, inittab_line);
     }
 #endif
 
@@ -240,7 +276,7 @@ void process_service::handle_exit_status(bp_sys::exit_status exit_status) noexce
 
 void process_service::exec_failed(run_proc_err errcode) noexcept
 {
-    log(loglevel_t::ERROR, get_name(), ": execution failed - ",
+    log_service_msg(loglevel_t::ERROR, get_name(), "execution failed - ",
             exec_stage_descriptions[static_cast<int>(errcode.stage)], ": ", strerror(errcode.st_errno));
 
     if (notification_fd != -1) {
@@ -248,6 +284,7 @@ void process_service::exec_failed(run_proc_err errcode) noexcept
         bp_sys::close(notification_fd);
         notification_fd = -1;
     }
+    end_notifications();
 
     if (get_state() == service_state_t::STARTING) {
         stop_reason = stopped_reason_t::EXECFAILED;
@@ -276,12 +313,12 @@ void bgproc_service::handle_exit_status(bp_sys::exit_status exit_status) noexcep
 
     if (!exit_status.did_exit_clean() && service_state != service_state_t::STOPPING) {
         if (did_exit) {
-            log(loglevel_t::ERROR, "Service ", get_name(), " process terminated with exit code ",
-                    exit_status.get_exit_status());
+            log_about_service(loglevel_t::ERROR, get_name(), "Service ", get_name(),
+                    " process terminated with exit code ", exit_status.get_exit_status());
         }
         else if (was_signalled) {
-            log(loglevel_t::ERROR, "Service ", get_name(), " terminated due to signal ",
-                    exit_status.get_term_sig());
+            log_about_service(loglevel_t::ERROR, get_name(), "Service ", get_name(),
+                    " terminated due to signal ", exit_status.get_term_sig());
         }
     }
 
@@ -367,7 +404,7 @@ void bgproc_service::handle_exit_status(bp_sys::exit_status exit_status) noexcep
 
 void bgproc_service::exec_failed(run_proc_err errcode) noexcept
 {
-    log(loglevel_t::ERROR, get_name(), ": execution failed - ",
+    log_service_msg(loglevel_t::ERROR, get_name(), "execution failed - ",
             exec_stage_descriptions[static_cast<int>(errcode.stage)], ": ", strerror(errcode.st_errno));
 
     // Only time we execute is for startup:
@@ -396,15 +433,15 @@ void scripted_service::handle_exit_status(bp_sys::exit_status exit_status) noexc
             }
             // We issued a start interrupt, so we expected this failure:
             if (did_exit && exit_status.get_exit_status() != 0) {
-                log(loglevel_t::INFO, "Service ", get_name(), " start cancelled; exit code ",
-                        exit_status.get_exit_status());
+                log_about_service(loglevel_t::INFO, get_name(), "Service ", get_name(),
+                        " start cancelled; exit code ", exit_status.get_exit_status());
                 // Assume that a command terminating normally (with failure status) requires no cleanup:
                 stopped();
             }
             else {
                 if (was_signalled) {
-                    log(loglevel_t::INFO, "Service ", get_name(), " start cancelled from signal ",
-                            exit_status.get_term_sig());
+                    log_about_service(loglevel_t::INFO, get_name(), "Service ", get_name(),
+                            " start cancelled from signal ", exit_status.get_term_sig());
                 }
                 // If the start script completed successfully, or was interrupted via our signal,
                 // we want to run the stop script to clean up:
@@ -419,12 +456,12 @@ void scripted_service::handle_exit_status(bp_sys::exit_status exit_status) noexc
         else {
             // ??? failed to stop! Let's log it as warning:
             if (did_exit) {
-                log(loglevel_t::WARN, "Service ", get_name(), " stop command failed with exit code ",
-                        exit_status.get_exit_status());
+                log_about_service(loglevel_t::WARN, get_name(), "Service ", get_name(),
+                        " stop command failed with exit code ", exit_status.get_exit_status());
             }
             else if (was_signalled) {
-                log(loglevel_t::WARN, "Service ", get_name(), " stop command terminated due to signal ",
-                        exit_status.get_term_sig());
+                log_about_service(loglevel_t::WARN, get_name(), "Service ", get_name(),
+                        " stop command terminated due to signal ", exit_status.get_term_sig());
             }
             // Even if the stop script failed, assume that service is now stopped, so that any dependencies
             // can be stopped. There's not really any other useful course of action here.
@@ -445,12 +482,12 @@ void scripted_service::handle_exit_status(bp_sys::exit_status exit_status) noexc
         else {
             // failed to start
             if (did_exit) {
-                log(loglevel_t::ERROR, "Service ", get_name(), " command failed with exit code ",
-                        exit_status.get_exit_status());
+                log_about_service(loglevel_t::ERROR, get_name(), "Service ", get_name(),
+                        " command failed with exit code ", exit_status.get_exit_status());
             }
             else if (was_signalled) {
-                log(loglevel_t::ERROR, "Service ", get_name(), " command terminated due to signal ",
-                        exit_status.get_term_sig());
+                log_about_service(loglevel_t::ERROR, get_name(), "Service ", get_name(),
+                        " command terminated due to signal ", exit_status.get_term_sig());
             }
             stop_reason = stopped_reason_t::FAILED;
             failed_to_start();
@@ -461,7 +498,7 @@ void scripted_service::handle_exit_status(bp_sys::exit_status exit_status) noexc
 
 void scripted_service::exec_failed(run_proc_err errcode) noexcept
 {
-    log(loglevel_t::ERROR, get_name(), ": execution failed - ",
+    log_service_msg(loglevel_t::ERROR, get_name(), "execution failed - ",
             exec_stage_descriptions[static_cast<int>(errcode.stage)], ": ", strerror(errcode.st_errno));
     auto service_state = get_state();
     if (service_state == service_state_t::STARTING) {
@@ -487,7 +524,7 @@ bgproc_service::read_pid_file(bp_sys::exit_status *exit_status) noexcept
     const char *pid_file_c = pid_file.c_str();
     int fd = bp_sys::open(pid_file_c, O_CLOEXEC);
     if (fd == -1) {
-        log(loglevel_t::ERROR, get_name(), ": read pid file: ", strerror(errno));
+        log_service_msg(loglevel_t::ERROR, get_name(), "read pid file: ", strerror(errno));
         return pid_result_t::FAILED;
     }
 
@@ -495,7 +532,7 @@ bgproc_service::read_pid_file(bp_sys::exit_status *exit_status) noexcept
     int r = complete_read(fd, pidbuf, 20);
     if (r < 0) {
         // Could not read from PID file
-        log(loglevel_t::ERROR, get_name(), ": could not read from pidfile; ", strerror(errno));
+        log_service_msg(loglevel_t::ERROR, get_name(), "could not read from pidfile; ", strerror(errno));
         bp_sys::close(fd);
         return pid_result_t::FAILED;
     }
@@ -527,7 +564,8 @@ bgproc_service::read_pid_file(bp_sys::exit_status *exit_status) noexcept
                 return pid_result_t::OK;
             }
             else {
-                log(loglevel_t::ERROR, get_name(), ": pid read from pidfile (", pid, ") is not valid");
+                log_service_msg(loglevel_t::ERROR, get_name(), "pid read from pidfile (", pid,
+                        ") is not valid");
                 pid = -1;
                 return pid_result_t::FAILED;
             }
@@ -545,7 +583,7 @@ bgproc_service::read_pid_file(bp_sys::exit_status *exit_status) noexcept
         }
     }
 
-    log(loglevel_t::ERROR, get_name(), ": pid read from pidfile (", pid, ") is not valid");
+    log_service_msg(loglevel_t::ERROR, get_name(), "pid read from pidfile (", pid, ") is not valid");
     pid = -1;
     return pid_result_t::FAILED;
 }
@@ -559,6 +597,8 @@ void process_service::bring_down() noexcept
         return;
     }
     else if (pid != -1) {
+        stop_watchdog();
+
         // The process is still kicking on - must actually kill it. We signal the process
         // group (-pid) rather than just the process as there's less risk then of creating
         // an orphaned process group:
@@ -578,7 +618,11 @@ void process_service::bring_down() noexcept
         // The rest is done in handle_exit_status.
     }
     else {
-        // The process is already dead.
+        // The process is already dead (but a restart may be pending, which we must cancel).
+        if (waiting_restart_timer) {
+            restart_timer.stop_timer(event_loop);
+            waiting_restart_timer = false;
+        }
         stopped();
     }
 }
@@ -608,7 +652,11 @@ void bgproc_service::bring_down() noexcept
         }
     }
     else {
-        // The process is already dead.
+        // The process is already dead (but a restart may be pending, which we must cancel).
+        if (waiting_restart_timer) {
+            restart_timer.stop_timer(event_loop);
+            waiting_restart_timer = false;
+        }
         stopped();
     }
 }
@@ -643,3 +691,9 @@ dasynq::rearm process_restart_timer::timer_expiry(eventloop_t &, int expiry_coun
     // Leave the timer disabled, or, if it has been reset by any processing above, leave it armed:
     return dasynq::rearm::NOOP;
 }
+
+dasynq::rearm process_watchdog_timer::timer_expiry(eventloop_t &, int expiry_count)
+{
+    service->watchdog_expired();
+    return dasynq::rearm::NOOP;
+}
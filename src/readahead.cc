@@ -0,0 +1,283 @@
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/fanotify.h>
+#endif
+
+#include "dinit.h"
+#include "dinit-log.h"
+#include "readahead.h"
+#include "readahead-profile.h"
+
+// Implementation of boot-time readahead. See readahead.h.
+
+boot_readahead readahead_profile;
+
+namespace {
+    // Read the files listed in a profile into the page cache (run in the helper process).
+    void replay_profile(const char *path) noexcept
+    {
+        try {
+            std::vector<std::string> files;
+            std::ifstream profile(path);
+            read_readahead_profile(profile, files);
+            profile.close();
+
+            for (const std::string &file : files) {
+                int fd = open(file.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+                if (fd == -1) continue;
+                struct stat statbuf;
+                if (fstat(fd, &statbuf) == 0 && S_ISREG(statbuf.st_mode)) {
+#ifdef __linux__
+                    readahead(fd, 0, statbuf.st_size);
+#else
+                    posix_fadvise(fd, 0, statbuf.st_size, POSIX_FADV_WILLNEED);
+#endif
+                }
+                close(fd);
+            }
+        }
+        catch (std::exception &) {
+            // (Nothing to be done).
+        }
+    }
+
+#ifdef __linux__
+    // Buffer for reading events (static, as for the directory watcher):
+    constexpr size_t event_buf_size = 4096;
+    alignas(fanotify_event_metadata) char event_buf[event_buf_size];
+
+    // Maximum number of reads per wakeup (to avoid starving other events):
+    constexpr int max_reads = 4;
+#endif
+}
+
+void boot_readahead::start(const char *path, unsigned record_secs) noexcept
+{
+    profile_path = path;
+
+    if (access(path, R_OK) == 0) {
+        // Replay the profile in the background, via a helper process (which will be reaped by the
+        // event loop along with any other unwatched child).
+        pid_t pid = fork();
+        if (pid == 0) {
+            // Unmask the signals that dinit blocks (so that, in particular, SIGTERM from the
+            // shutdown program terminates the helper):
+            sigset_t sigempty_set;
+            sigemptyset(&sigempty_set);
+            sigprocmask(SIG_SETMASK, &sigempty_set, nullptr);
+            replay_profile(path);
+            _exit(0);
+        }
+        if (pid == -1) {
+            log(loglevel_t::WARN, "Could not start readahead: ", strerror(errno));
+        }
+        return;
+    }
+
+#ifdef __linux__
+    int fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE
+            | O_CLOEXEC);
+    if (fd == -1) {
+        log(loglevel_t::WARN, "Could not record readahead profile: fanotify_init: ", strerror(errno));
+        return;
+    }
+    if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_MOUNT, FAN_OPEN, AT_FDCWD, "/") == -1) {
+        log(loglevel_t::WARN, "Could not record readahead profile: fanotify_mark: ", strerror(errno));
+        close(fd);
+        return;
+    }
+
+    try {
+        timer.add_timer(event_loop);
+    }
+    catch (std::exception &e) {
+        log(loglevel_t::WARN, "Could not record readahead profile: ", e.what());
+        close(fd);
+        return;
+    }
+
+    fanotify_fd = fd;
+    record_remaining = record_secs;
+    recording = true;
+    timer.arm_timer_rel(event_loop, time_val(1, 0), time_val(1, 0));
+    record_tick(0);
+#else
+    log(loglevel_t::WARN, "Recording a readahead profile is not supported on this platform");
+#endif
+}
+
+#ifdef __linux__
+
+dasynq::rearm boot_readahead::fd_event(eventloop_t &loop, int fd, int flags) noexcept
+{
+    pid_t our_pid = getpid();
+    char fd_path[32];
+    char file_path[PATH_MAX];
+
+    for (int reads = 0; reads < max_reads; reads++) {
+        ssize_t r = read(fd, event_buf, event_buf_size);
+        if (r <= 0) {
+            if (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log(loglevel_t::WARN, "Error reading readahead events: ", strerror(errno));
+            }
+            break;
+        }
+
+        auto *md = reinterpret_cast<fanotify_event_metadata *>(event_buf);
+        for ( ; FAN_EVENT_OK(md, r); md = FAN_EVENT_NEXT(md, r)) {
+            if (md->fd < 0) continue;  // (queue overflow)
+
+            // Ignore files opened by dinit itself:
+            if (md->pid != our_pid && files.size() < max_files) {
+                snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", md->fd);
+                ssize_t len = readlink(fd_path, file_path, sizeof(file_path) - 1);
+                if (len > 0 && file_path[0] == '/' && memchr(file_path, '\n', len) == nullptr) {
+                    try {
+                        std::string file(file_path, len);
+                        if (seen_files.insert(file).second) {
+                            files.push_back(std::move(file));
+                        }
+                    }
+                    catch (std::bad_alloc &) {
+                        // The profile is an optimisation only; just omit the file.
+                    }
+                }
+            }
+            close(md->fd);
+        }
+    }
+
+    return dasynq::rearm::REARM;
+}
+
+#else
+
+dasynq::rearm boot_readahead::fd_event(eventloop_t &loop, int fd, int flags) noexcept
+{
+    return dasynq::rearm::DISARM;
+}
+
+#endif
+
+dasynq::rearm boot_readahead::record_timer::timer_expiry(eventloop_t &, int expiry_count) noexcept
+{
+    owner->record_tick(expiry_count);
+    return dasynq::rearm::NOOP;
+}
+
+void boot_readahead::record_tick(int seconds) noexcept
+{
+    if (! watching && access("/proc/self/fd", X_OK) == 0) {
+        // /proc is now available; begin processing events (including any queued until now):
+        try {
+            add_watch(event_loop, fanotify_fd, dasynq::IN_EVENTS);
+            watching = true;
+        }
+        catch (std::exception &e) {
+            log(loglevel_t::WARN, "Could not record readahead profile: ", e.what());
+            stop();
+            return;
+        }
+    }
+
+    if ((unsigned)seconds < record_remaining) {
+        record_remaining -= seconds;
+        return;
+    }
+
+    if (! watching) {
+        log(loglevel_t::WARN, "Readahead profile not recorded: /proc is not mounted");
+        stop();
+        return;
+    }
+
+    stop_recording();
+}
+
+void boot_readahead::stop() noexcept
+{
+    if (recording) {
+        if (watching) {
+            deregister(event_loop);
+            watching = false;
+        }
+        close(fanotify_fd);
+        fanotify_fd = -1;
+        timer.stop_timer(event_loop);
+        recording = false;
+    }
+}
+
+void boot_readahead::stop_recording() noexcept
+{
+    if (! recording) return;
+    stop();
+    profile_pending = true;
+    if (rootfs_rw) {
+        write_profile();
+    }
+}
+
+void boot_readahead::set_rootfs_writable() noexcept
+{
+    rootfs_rw = true;
+    if (profile_pending) {
+        write_profile();
+    }
+}
+
+void boot_readahead::write_profile() noexcept
+{
+    profile_pending = false;
+
+    // Write the profile to a temporary file and replace the original, so that a partially written
+    // profile is never replayed:
+    std::string tmp_path;
+    try {
+        tmp_path = std::string(profile_path) + ".new";
+        std::ofstream profile(tmp_path, std::ios::out | std::ios::trunc);
+        write_readahead_profile(profile, files);
+        profile.close();
+        if (! profile || rename(tmp_path.c_str(), profile_path) == -1) {
+            log(loglevel_t::WARN, "Couldn't write readahead profile to ", profile_path);
+            unlink(tmp_path.c_str());
+        }
+        else {
+            log(loglevel_t::INFO, "Recorded readahead profile (", (int)files.size(), " files)");
+        }
+    }
+    catch (std::exception &) {
+        log(loglevel_t::WARN, "Couldn't write readahead profile to ", profile_path);
+        if (! tmp_path.empty()) unlink(tmp_path.c_str());
+    }
+
+    files.clear();
+    files.shrink_to_fit();
+    seen_files.clear();
+}
+
+bool boot_readahead::regenerate() noexcept
+{
+    if (profile_path == nullptr) return false;
+
+    // Discard any recording in progress (it would otherwise overwrite the profile):
+    stop();
+    profile_pending = false;
+    files.clear();
+    seen_files.clear();
+
+    if (unlink(profile_path) == -1 && errno != ENOENT) {
+        log(loglevel_t::WARN, "Couldn't remove readahead profile ", profile_path, ": ", strerror(errno));
+        return false;
+    }
+    return true;
+}
@@ -6,10 +6,17 @@
 #include <sys/ioctl.h>
 #include <sys/un.h>
 #include <sys/socket.h>
+#include <sys/resource.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <unistd.h>
 #include <termios.h>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
 #include "service.h"
 #include "proc-service.h"
 
@@ -52,6 +59,7 @@ void base_process_service::run_child_proc(run_proc_params params) noexcept
     int notify_fd = params.notify_fd;
     int force_notify_fd = params.force_notify_fd;
     const char *notify_var = params.notify_var;
+    const char *notify_socket = params.notify_socket;
     uid_t uid = params.uid;
     gid_t gid = params.gid;
     const std::vector<service_rlimits> &rlimits = params.rlimits;
@@ -82,6 +90,10 @@ void base_process_service::run_child_proc(run_proc_params params) noexcept
     constexpr int csenvbufsz = 12 + ((CHAR_BIT * sizeof(int) - 1 + 2) / 3) + 1;
     char csenvbuf[csenvbufsz];
 
+    // "WATCHDOG_USEC=" - 14 bytes, followed by a long long in decimal.
+    constexpr int wdenvbufsz = 14 + ((CHAR_BIT * sizeof(long long) - 1 + 2) / 3) + 1;
+    char wdenvbuf[wdenvbufsz];
+
     run_proc_err err;
     err.stage = exec_stage::ARRANGE_FDS;
 
@@ -160,6 +172,21 @@ void base_process_service::run_child_proc(run_proc_params params) noexcept
         if (putenv(var_str)) goto failure_out;
     }
 
+    // Set up notification socket variables:
+    if (notify_socket != nullptr) {
+        err.stage = exec_stage::SET_NOTIFYFD_VAR;
+        int req_sz = 14 /* "NOTIFY_SOCKET=" */ + strlen(notify_socket) + 1;
+        char * var_str = (char *) malloc(req_sz);
+        if (var_str == nullptr) goto failure_out;
+        snprintf(var_str, req_sz, "NOTIFY_SOCKET=%s", notify_socket);
+        if (putenv(var_str)) goto failure_out;
+
+        if (params.watchdog_usec != 0) {
+            snprintf(wdenvbuf, wdenvbufsz, "WATCHDOG_USEC=%lld", params.watchdog_usec);
+            if (putenv(wdenvbuf)) goto failure_out;
+        }
+    }
+
     // Set up Systemd-style socket activation:
     if (socket_fd != -1) {
         err.stage = exec_stage::SETUP_ACTIVATION_SOCKET;
@@ -256,6 +283,60 @@ void base_process_service::run_child_proc(run_proc_params params) noexcept
         if (setrlimit(limit.resource_id, &setlimits) != 0) goto failure_out;
     }
 
+    // CPU affinity, NUMA policy, and scheduling/priority settings. These are applied before
+    // dropping privileges, since raising priority (or using a realtime policy) typically requires
+    // privileges.
+    if (params.sched != nullptr) {
+        const service_sched_settings &sched = *params.sched;
+
+#ifdef __linux__
+        if (! sched.cpu_mask.empty()) {
+            err.stage = exec_stage::SET_CPU_AFFINITY;
+            if (sched_setaffinity(0, sched.cpu_mask.size() * sizeof(unsigned long),
+                    reinterpret_cast<const cpu_set_t *>(sched.cpu_mask.data())) != 0) {
+                goto failure_out;
+            }
+        }
+
+        if (sched.numa_policy != numa_policy_t::NONE) {
+            err.stage = exec_stage::SET_NUMA_POLICY;
+            int mode = MPOL_DEFAULT;
+            switch (sched.numa_policy) {
+            case numa_policy_t::LOCAL: mode = MPOL_LOCAL; break;
+            case numa_policy_t::BIND: mode = MPOL_BIND; break;
+            case numa_policy_t::PREFERRED: mode = MPOL_PREFERRED; break;
+            case numa_policy_t::INTERLEAVE: mode = MPOL_INTERLEAVE; break;
+            default: ;
+            }
+            // (The kernel takes the maximum node number plus one, hence "+ 1").
+            unsigned long maxnode = sched.numa_nodes.size() * CHAR_BIT * sizeof(unsigned long);
+            if (maxnode != 0) maxnode++;
+            if (syscall(SYS_set_mempolicy, mode, sched.numa_nodes.empty() ? nullptr : sched.numa_nodes.data(),
+                    maxnode) != 0) {
+                goto failure_out;
+            }
+        }
+
+        if (sched.ioprio != -1) {
+            err.stage = exec_stage::SET_IOPRIO;
+            // 1 = IOPRIO_WHO_PROCESS (and 0 = the calling process):
+            if (syscall(SYS_ioprio_set, 1, 0, sched.ioprio) != 0) goto failure_out;
+        }
+#endif
+
+        if (sched.sched_policy != -1) {
+            err.stage = exec_stage::SET_SCHED_POLICY;
+            sched_param param;
+            param.sched_priority = sched.sched_priority;
+            if (sched_setscheduler(0, sched.sched_policy, &param) != 0) goto failure_out;
+        }
+
+        if (sched.nice_set) {
+            err.stage = exec_stage::SET_NICE;
+            if (setpriority(PRIO_PROCESS, 0, sched.nice) != 0) goto failure_out;
+        }
+    }
+
     if (uid != uid_t(-1)) {
         err.stage = exec_stage::SET_UIDGID;
         // We must set group first (i.e. before we drop privileges)
@@ -14,6 +14,7 @@
 #include "dinit-socket.h"
 #include "dinit-util.h"
 #include "baseproc-sys.h"
+#include "status-table.h"
 
 /*
  * service.cc - Service management.
@@ -39,6 +40,82 @@ service_record * service_set::find_service(const std::string &name) noexcept
     return ::find_service(records, name.c_str());
 }
 
+void service_set::description_changed(const std::string &name) noexcept
+{
+    bool is_template = name.length() > 1 && name.back() == '@';
+    for (auto *sr : records) {
+        const std::string &sr_name = sr->get_name();
+        if (sr_name == name || (is_template && sr_name.length() > name.length()
+                && sr_name.compare(0, name.length(), name) == 0)) {
+            sr->set_description_changed();
+        }
+    }
+
+    // A service which failed to load as a lazy dependency may now load:
+    for (auto i = lazy_load_failures.begin(); i != lazy_load_failures.end(); ) {
+        if (*i == name || (is_template && i->length() > name.length()
+                && i->compare(0, name.length(), name) == 0)) {
+            i = lazy_load_failures.erase(i);
+        }
+        else {
+            ++i;
+        }
+    }
+}
+
+void service_set::all_descriptions_changed() noexcept
+{
+    for (auto *sr : records) {
+        sr->set_description_changed();
+    }
+    lazy_load_failures.clear();
+}
+
+service_record::~service_record() noexcept
+{
+    if (status_slot != -1) {
+        service_status_table.release_slot(status_slot);
+    }
+}
+
+void service_record::update_status(bool transition) noexcept
+{
+    if (status_slot != -1) {
+        service_status_table.update(status_slot, this, transition);
+    }
+}
+
+void service_record::alloc_status_slot() noexcept
+{
+    if (status_slot == -1) {
+        status_slot = service_status_table.alloc_slot();
+    }
+    update_status(true);
+}
+
+void service_record::transfer_status_slot(service_record *replacement) noexcept
+{
+    std::swap(status_slot, replacement->status_slot);
+    replacement->alloc_status_slot();
+}
+
+void service_record::set_state(service_state_t new_state) noexcept
+{
+    if (service_state == service_state_t::STARTING) services->service_not_starting();
+    if (new_state == service_state_t::STARTING) services->service_starting();
+    service_state = new_state;
+    update_status(true);
+}
+
+void service_record::notify_listeners(service_event_t event) noexcept
+{
+    update_status();
+    for (auto l : listeners) {
+        l->service_event(this, event);
+    }
+    services->notify_set_listeners(this, event);
+}
+
 // Called when a service has actually stopped; dependents have stopped already, unless this stop
 // is due to an unexpected process termination.
 void service_record::stopped() noexcept
@@ -79,7 +156,11 @@ void service_record::stopped() noexcept
         dependency.get_to()->dependent_stopped();
     }
 
-    service_state = service_state_t::STOPPED;
+    set_state(service_state_t::STOPPED);
+
+    if (services->is_shutting_down()) {
+        services->record_stop_time(this, stop_begin_time);
+    }
 
     if (will_restart) {
         // Desired state is "started".
@@ -155,6 +236,7 @@ void service_record::release(bool issue_stop) noexcept
             }
         }
         desired_state = service_state_t::STOPPED;
+        update_status();
 
         if (pinned_started) return;
 
@@ -199,6 +281,10 @@ void service_record::start() noexcept
         start_explicit = true;
     }
 
+    if (service_state == service_state_t::STOPPED) {
+        resolve_lazy_deps();
+    }
+
     do_start();
 }
 
@@ -206,8 +292,8 @@ void service_record::initiate_start() noexcept
 {
     start_failed = false;
     start_skipped = false;
-    service_state = service_state_t::STARTING;
     waiting_for_deps = true;
+    set_state(service_state_t::STARTING);
 
     if (start_check_dependencies()) {
         services->add_transition_queue(this);
@@ -259,6 +345,9 @@ void service_record::execute_transition() noexcept
     else if (service_state == service_state_t::STOPPING) {
         if (stop_check_dependents()) {
             waiting_for_deps = false;
+            if (services->is_shutting_down()) {
+                event_loop.get_time(stop_begin_time, clock_type::MONOTONIC);
+            }
             bring_down();
         }
     }
@@ -269,6 +358,7 @@ void service_record::do_start() noexcept
     bool was_active = service_state != service_state_t::STOPPED;
 
     desired_state = service_state_t::STARTED;
+    update_status();
 
     if (pinned_stopped) {
         if (!was_active) {
@@ -295,6 +385,12 @@ void service_record::do_start() noexcept
         notify_listeners(service_event_t::STOPCANCELLED);
     }
     else { // !was_active
+        if (has_unresolved_milestone()) {
+            stop_reason = stopped_reason_t::DEPFAILED;
+            failed_to_start(true, false);
+            return;
+        }
+
         services->service_active(this);
         prop_require = !prop_release;
         prop_release = false;
@@ -316,6 +412,79 @@ void service_record::dependency_started() noexcept
     }
 }
 
+// Check whether a service depends, directly or indirectly, on another. May throw std::bad_alloc.
+static bool depends_on_service(service_record *sr, service_record *target)
+{
+    std::vector<service_record *> to_visit { sr };
+    std::unordered_set<service_record *> visited { sr };
+    while (! to_visit.empty()) {
+        service_record *next = to_visit.back();
+        to_visit.pop_back();
+        if (next == target) return true;
+        for (auto &dep : next->get_dependencies()) {
+            if (visited.insert(dep.get_to()).second) {
+                to_visit.push_back(dep.get_to());
+            }
+        }
+    }
+    return false;
+}
+
+void service_record::load_lazy_deps() noexcept
+{
+    // Dependencies which can't be loaded are kept. Loading is retried on a later start only if the
+    // dependency's description changes or this service is reloaded (see service_set::lazy_load_failed()).
+    for (auto i = lazy_deps.begin(); i != lazy_deps.end(); ) {
+        if (services->lazy_load_failed(i->first)) {
+            ++i;
+            continue;
+        }
+        try {
+            service_record *to = services->load_service(i->first.c_str());
+            if (depends_on_service(to, this)) {
+                throw service_cyclic_dependency(i->first);
+            }
+            add_dep(to, i->second);
+            i = lazy_deps.erase(i);
+        }
+        catch (service_load_exc &exc) {
+            log(loglevel_t::ERROR, "Could not load dependency ", i->first, " of service ", service_name, ": ",
+                    exc.exc_description);
+            services->set_lazy_load_failed(i->first);
+            ++i;
+        }
+        catch (std::bad_alloc &) {
+            log(loglevel_t::ERROR, "Could not load dependency ", i->first, " of service ", service_name,
+                    ": Out of memory");
+            return;
+        }
+    }
+}
+
+void service_record::resolve_lazy_deps() noexcept
+{
+    try {
+        std::vector<service_record *> to_visit { this };
+        std::unordered_set<service_record *> visited { this };
+        while (! to_visit.empty()) {
+            service_record *next = to_visit.back();
+            to_visit.pop_back();
+            if (! next->lazy_deps.empty()) {
+                next->load_lazy_deps();
+            }
+            for (auto &dep : next->depends_on) {
+                service_record *to = dep.get_to();
+                if (to->service_state == service_state_t::STOPPED && visited.insert(to).second) {
+                    to_visit.push_back(to);
+                }
+            }
+        }
+    }
+    catch (std::bad_alloc &) {
+        log(loglevel_t::ERROR, "Could not load dependencies of service ", service_name, ": Out of memory");
+    }
+}
+
 bool service_record::start_check_dependencies() noexcept
 {
     bool all_deps_started = true;
@@ -360,6 +529,10 @@ void service_record::all_deps_started() noexcept
         return;
     }
 
+    if (services->is_recording_start_times()) {
+        event_loop.get_time(start_begin_time, clock_type::MONOTONIC);
+    }
+
     bool start_success = bring_up();
     restarting = false;
     if (start_success) {
@@ -407,7 +580,10 @@ void service_record::started() noexcept
     }
 
     log_service_started(get_name());
-    service_state = service_state_t::STARTED;
+    set_state(service_state_t::STARTED);
+    if (services->is_recording_start_times()) {
+        services->record_start_time(this, start_begin_time);
+    }
     notify_listeners(service_event_t::STARTED);
 
     if (onstart_flags.rw_ready) {
@@ -483,6 +659,7 @@ void service_record::failed_to_start(bool depfailed, bool immediate_stop) noexce
 void service_record::unrecoverable_stop() noexcept
 {
     desired_state = service_state_t::STOPPED;
+    update_status();
     forced_stop();
 }
 
@@ -525,6 +702,7 @@ void service_record::stop(bool bring_down) noexcept
         // Set desired state to STOPPED, this will inhibit automatic restart (and will be
         // propagated to dependents)
         desired_state = service_state_t::STOPPED;
+        update_status();
     }
 
     if (pinned_started) {
@@ -619,8 +797,8 @@ void service_record::do_stop(bool with_restart) noexcept
         }
     }
 
-    service_state = service_state_t::STOPPING;
     waiting_for_deps = true;
+    set_state(service_state_t::STOPPING);
     if (all_deps_stopped) {
         services->add_transition_queue(this);
     }
@@ -673,6 +851,7 @@ bool service_record::stop_dependents(bool for_restart) noexcept
                 if (desired_state == service_state_t::STOPPED) {
                     // if we don't want to restart, don't restart dependent
                     dep_from->desired_state = service_state_t::STOPPED;
+                    dep_from->update_status();
                     if (dep_from->start_explicit) {
                         dep_from->start_explicit = false;
                         dep_from->release(true);
@@ -766,7 +945,180 @@ void service_set::service_active(service_record *sr) noexcept
     active_services++;
 }
 
+// Interval (seconds) between reports of services that are preventing shutdown
+static const int shutdown_report_interval = 5;
+
 void service_set::service_inactive(service_record *sr) noexcept
 {
     active_services--;
+    if (active_services == 0 && shutdown_timer_added) {
+        shutdown_timer.stop_timer(event_loop);
+    }
+}
+
+void service_set::stop_all_services(shutdown_type_t type) noexcept
+{
+    if (restart_enabled) {
+        event_loop.get_time(shutdown_start_time, clock_type::MONOTONIC);
+    }
+
+    restart_enabled = false;
+    shutdown_type = type;
+    for (std::list<service_record *>::iterator i = records.begin(); i != records.end(); ++i) {
+        (*i)->stop(false);
+        (*i)->unpin();
+    }
+    process_queues();
+
+    // Track progress until all services have stopped:
+    if (active_services != 0 && ! shutdown_timer_added) {
+        try {
+            shutdown_timer.add_timer(event_loop);
+            shutdown_timer_added = true;
+            shutdown_timer.arm_timer_rel(event_loop, next_shutdown_check(time_val(0, 0)));
+        }
+        catch (std::exception &exc) {
+            log(loglevel_t::WARN, "Unable to track shutdown progress: ", exc.what());
+        }
+    }
+}
+
+void service_set::record_stop_time(service_record *sr, time_val stop_begin) noexcept
+{
+    time_val now;
+    event_loop.get_time(now, clock_type::MONOTONIC);
+    if (stop_begin < shutdown_start_time) {
+        // The service didn't need to be brought down (or began stopping before shutdown)
+        stop_begin = shutdown_start_time;
+    }
+
+    try {
+        stop_times.push_back({sr->get_name(), now - shutdown_start_time, now - stop_begin});
+    }
+    catch (std::bad_alloc &) {
+        // Just don't record it; the stop times are informational only.
+    }
+}
+
+void service_set::record_start_time(service_record *sr, time_val start_begin) noexcept
+{
+    time_val now;
+    event_loop.get_time(now, clock_type::MONOTONIC);
+
+    try {
+        start_times.push_back({sr->get_name(), now - start_begin});
+    }
+    catch (std::bad_alloc &) {
+        // As for stop times, the start times are informational only.
+    }
+}
+
+void service_set::begin_recording_start_times() noexcept
+{
+    event_loop.get_time(boot_start_time, clock_type::MONOTONIC);
+    recording_start_times = true;
+
+    try {
+        boot_timer.add_timer(event_loop);
+        boot_timer_added = true;
+        boot_timer.arm_timer_rel(event_loop, time_val(max_boot_record_secs, 0));
+    }
+    catch (std::exception &exc) {
+        log(loglevel_t::WARN, "Unable to limit boot timing: ", exc.what());
+    }
+}
+
+void service_set::check_boot_complete() noexcept
+{
+    if (starting_services == 0) {
+        end_recording_start_times();
+    }
+}
+
+void service_set::end_recording_start_times() noexcept
+{
+    event_loop.get_time(boot_duration, clock_type::MONOTONIC);
+    boot_duration -= boot_start_time;
+    recording_start_times = false;
+    awaiting_boot_complete = false;
+    if (boot_timer_added) {
+        boot_timer.stop_timer(event_loop);
+    }
+    boot_completed();
+}
+
+time_val service_set::next_shutdown_check(time_val elapsed) noexcept
+{
+    // Check after the report interval, or when the time limit expires (if sooner):
+    time_val next = elapsed + time_val(shutdown_report_interval, 0);
+    if (shutdown_time_limit != time_val(0, 0) && ! shutdown_limit_reached
+            && shutdown_time_limit < next) {
+        next = shutdown_time_limit;
+    }
+    return next - elapsed;
+}
+
+time_val service_set::check_shutdown_progress() noexcept
+{
+    const int max_reported = 10;
+
+    time_val elapsed;
+    event_loop.get_time(elapsed, clock_type::MONOTONIC);
+    elapsed -= shutdown_start_time;
+
+    if (shutdown_time_limit != time_val(0, 0) && ! shutdown_limit_reached
+            && elapsed >= shutdown_time_limit) {
+        shutdown_limit_reached = true;
+        log(loglevel_t::WARN, "Services did not stop within the shutdown time limit; killing "
+                "remaining processes.");
+        for (auto *sr : records) {
+            if (sr->get_state() != service_state_t::STOPPED) {
+                sr->kill_with_fire();
+            }
+        }
+    }
+    else {
+        // Report the services that shutdown is waiting for (i.e. those actually stopping, or
+        // still starting, rather than waiting for other services).
+        int count = 0;
+        for (auto *sr : records) {
+            if (sr->is_transitioning()) {
+                if (count == 0) {
+                    log_msg_begin(loglevel_t::INFO, "Waiting for services to stop (");
+                    log_msg_part((int)elapsed.seconds());
+                    log_msg_part("s elapsed): ");
+                }
+                else if (count == max_reported) {
+                    log_msg_part(", ...");
+                    break;
+                }
+                else {
+                    log_msg_part(", ");
+                }
+                log_msg_part(sr->get_name().c_str());
+                count++;
+            }
+        }
+        if (count != 0) {
+            log_msg_end("");
+        }
+    }
+
+    return next_shutdown_check(elapsed);
+}
+
+rearm shutdown_progress_timer::timer_expiry(eventloop_t &, int expiry_count)
+{
+    arm_timer_rel(event_loop, services->check_shutdown_progress());
+    return rearm::NOOP;
+}
+
+rearm boot_record_timer::timer_expiry(eventloop_t &, int expiry_count)
+{
+    if (services->recording_start_times) {
+        log(loglevel_t::WARN, "Boot not complete after ", (int)max_boot_record_secs,
+                " seconds; no longer recording service start times.");
+        services->end_recording_start_times();
+    }
+    return rearm::NOOP;
 }
@@ -3,7 +3,9 @@
 #include <csignal>
 #include <cstring>
 #include <string>
+#include <vector>
 #include <iostream>
+#include <fstream>
 #include <exception>
 
 #include <sys/reboot.h>
@@ -14,12 +16,18 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <dirent.h>
+#ifdef __linux__
+#include <sys/mount.h>
+#include <sys/swap.h>
+#endif
 
 #include "cpbuffer.h"
 #include "control-cmds.h"
 #include "service-constants.h"
 #include "dinit-client.h"
 #include "dinit-util.h"
+#include "mount-tree.h"
 #include "mconfig.h"
 
 #include "dasynq.h"
@@ -35,12 +43,25 @@ using rearm = dasynq::rearm;
 using clock_type = dasynq::clock_type;
 class subproc_buffer;
 
-void do_system_shutdown(shutdown_type_t shutdown_type);
+void do_system_shutdown(shutdown_type_t shutdown_type, int term_grace_ms);
 static void unmount_disks(loop_t &loop, subproc_buffer &sub_buf);
 static void swap_off(loop_t &loop, subproc_buffer &sub_buf);
 
 constexpr static int subproc_bufsize = 4096;
 
+// Default maximum time (milliseconds) to wait for processes to exit after SIGTERM, before sending
+// SIGKILL. We stop waiting as soon as no processes remain.
+constexpr static int default_term_grace_ms = 1000;
+
+// Interval (milliseconds) between checks for remaining processes during the grace period
+constexpr static int term_check_interval_ms = 50;
+
+// Maximum number of still-running processes to report by pid when the grace period expires
+constexpr static int max_report_pids = 16;
+
+// Maximum number of unmount (or swapoff) operations to run concurrently
+constexpr static int max_parallel_ops = 8;
+
 constexpr static char output_lost_msg[] = "[Some output has not been shown due to buffer overflow]\n";
 
 // A buffer which maintains a series of overflow markers, used for capturing and echoing
@@ -247,6 +268,7 @@ int main(int argc, char **argv)
     bool show_help = false;
     bool sys_shutdown = false;
     bool use_passed_cfd = false;
+    int term_grace_ms = default_term_grace_ms;
     
     auto shutdown_type = shutdown_type_t::POWEROFF;
 
@@ -277,6 +299,19 @@ int main(int argc, char **argv)
             else if (strcmp(argv[i], "--use-passed-cfd") == 0) {
                 use_passed_cfd = true;
             }
+            else if (strcmp(argv[i], "--term-grace") == 0) {
+                if (++i == argc) {
+                    cerr << "--term-grace: argument required" << endl;
+                    return 1;
+                }
+                char * endptr;
+                long grace = strtol(argv[i], &endptr, 10);
+                if (*argv[i] == 0 || *endptr != 0 || grace < 0 || grace > 3600000) {
+                    cerr << "--term-grace: invalid argument: " << argv[i] << endl;
+                    return 1;
+                }
+                term_grace_ms = (int) grace;
+            }
             else {
                 cerr << "Unrecognized command-line parameter: " << argv[i] << endl;
                 return 1;
@@ -298,12 +333,14 @@ int main(int argc, char **argv)
                 "                     environment variable to communicate with the init daemon.\n"
                 "  --system         : perform shutdown immediately, instead of issuing shutdown\n"
                 "                     command to the init program. Not recommended for use\n"
-                "                     by users.\n";
+                "                     by users.\n"
+                "  --term-grace <ms>: with --system, maximum time to wait for processes to exit\n"
+                "                     after TERM before sending KILL (default 1000).\n";
         return 1;
     }
     
     if (sys_shutdown) {
-        do_system_shutdown(shutdown_type);
+        do_system_shutdown(shutdown_type, term_grace_ms);
         return 0;
     }
 
@@ -332,21 +369,8 @@ int main(int argc, char **argv)
     }
     
     if (! use_passed_cfd) {
-        socknum = socket(AF_UNIX, SOCK_STREAM, 0);
+        socknum = connect_to_daemon(SYSCONTROLSOCKET);
         if (socknum == -1) {
-            perror("socket");
-            return 1;
-        }
-        
-        const char *naddr = SYSCONTROLSOCKET;
-        
-        struct sockaddr_un name;
-        name.sun_family = AF_UNIX;
-        strcpy(name.sun_path, naddr);
-        int sunlen = offsetof(struct sockaddr_un, sun_path) + strlen(naddr) + 1; // family, (string), nul
-        
-        int connr = connect(socknum, (struct sockaddr *) &name, sunlen);
-        if (connr == -1) {
             perror("connect");
             return 1;
         }
@@ -401,8 +425,62 @@ int main(int argc, char **argv)
     return 0;
 }
 
+// Check for processes that remain after signalling all processes; any terminated children
+// (which, if we are PID 1, includes orphaned processes) are reaped first. Kernel threads, zombies,
+// the init process and ourself are not counted. Up to max_report pids of remaining processes are
+// stored in report_pids.
+// Returns the number of remaining processes, or -1 if they could not be determined (no /proc).
+static int check_remaining_procs(pid_t *report_pids, int max_report) noexcept
+{
+    while (waitpid(-1, nullptr, WNOHANG) > 0) { }
+
+    DIR *proc_dir = opendir("/proc");
+    if (proc_dir == nullptr) {
+        return -1;
+    }
+
+    pid_t our_pid = getpid();
+    int count = 0;
+    char path_buf[32];
+    char stat_buf[512];
+
+    while (dirent *ent = readdir(proc_dir)) {
+        char *endptr;
+        long pid = strtol(ent->d_name, &endptr, 10);
+        if (*ent->d_name == 0 || *endptr != 0 || pid <= 1 || pid == our_pid) continue;
+
+        snprintf(path_buf, sizeof(path_buf), "/proc/%ld/stat", pid);
+        int stat_fd = open(path_buf, O_RDONLY | O_CLOEXEC);
+        if (stat_fd == -1) continue; // most likely, process has since exited
+        ssize_t r = read(stat_fd, stat_buf, sizeof(stat_buf) - 1);
+        close(stat_fd);
+        if (r <= 0) continue;
+        stat_buf[r] = 0;
+
+        // Format is: pid (comm) state ppid pgrp session tty_nr tpgid flags ...
+        // The command name may itself contain ')', so find the last one:
+        char *comm_end = strrchr(stat_buf, ')');
+        if (comm_end == nullptr || comm_end[1] != ' ') continue;
+        char state = comm_end[2];
+        if (state == 'Z' || state == 'X') continue;
+
+        unsigned long flags = 0;
+        if (sscanf(comm_end + 3, "%*d %*d %*d %*d %*d %lu", &flags) != 1) continue;
+        constexpr unsigned long PF_KTHREAD = 0x00200000;
+        if (flags & PF_KTHREAD) continue;
+
+        if (count < max_report) {
+            report_pids[count] = (pid_t) pid;
+        }
+        count++;
+    }
+
+    closedir(proc_dir);
+    return count;
+}
+
 // Actually shut down the system.
-void do_system_shutdown(shutdown_type_t shutdown_type)
+void do_system_shutdown(shutdown_type_t shutdown_type, int term_grace_ms)
 {
     using namespace std;
     
@@ -436,21 +514,53 @@ void do_system_shutdown(shutdown_type_t shutdown_type)
     // Send TERM/KILL to all (remaining) processes
     kill(-1, SIGTERM);
 
-    // 1 second delay (while outputting from sub_buf):
-    bool timeout_reached = false;
-    dasynq::time_val timeout {1, 0};
-    dasynq::time_val interval {0,0};
-    loop_t::timer::add_timer(loop, clock_type::MONOTONIC, true /* relative */,
-            timeout.get_timespec(), interval.get_timespec(),
-            [&](loop_t &eloop, int expiry_count) -> rearm {
+    // Wait until all processes have terminated, or the grace period expires (while outputting
+    // from sub_buf). If we can't check for remaining processes, we wait for the full period.
+    bool wait_complete = false;
+    pid_t remaining_pids[max_report_pids];
+    int remaining = 0;
+    int checks_left = (term_grace_ms + term_check_interval_ms - 1) / term_check_interval_ms;
+
+    auto check_procs = [&]() {
+        if (remaining == -1) return;
+        remaining = check_remaining_procs(remaining_pids, max_report_pids);
+        if (remaining == 0) wait_complete = true;
+    };
 
-        timeout_reached = true;
-        return rearm::REMOVE;
-    });
+    check_procs();
+    if (checks_left == 0) wait_complete = true;
 
-    do {
-      loop.run();
-    } while (! timeout_reached);
+    if (! wait_complete) {
+        dasynq::time_val interval {0, term_check_interval_ms * 1000000L};
+        loop_t::timer::add_timer(loop, clock_type::MONOTONIC, true /* relative */,
+                interval.get_timespec(), interval.get_timespec(),
+                [&](loop_t &eloop, int expiry_count) -> rearm {
+
+            checks_left -= std::min(checks_left, expiry_count);
+            check_procs();
+            if (checks_left == 0) wait_complete = true;
+            return wait_complete ? rearm::REMOVE : rearm::REARM;
+        });
+
+        do {
+            loop.run();
+        } while (! wait_complete);
+    }
+
+    if (remaining > 0) {
+        // Report (some of) the processes which are still running:
+        char pid_buf[16];
+        sub_buf.append("Processes still running after TERM:");
+        for (int i = 0; i < std::min(remaining, max_report_pids); i++) {
+            snprintf(pid_buf, sizeof(pid_buf), " %d", (int) remaining_pids[i]);
+            sub_buf.append(pid_buf);
+        }
+        if (remaining > max_report_pids) {
+            snprintf(pid_buf, sizeof(pid_buf), " (+%d)", remaining - max_report_pids);
+            sub_buf.append(pid_buf);
+        }
+        sub_buf.append("\n");
+    }
 
     kill(-1, SIGKILL);
     
@@ -592,8 +702,218 @@ static void run_process(const char * prog_args[], loop_t &loop, subproc_buffer &
     }
 }
 
+// Run a series of operations, each in its own child process, with up to max_parallel_ops running
+// concurrently:
+//   get_next() - returns the identifier (>= 0) of the next operation ready to run, or -1 if
+//                there is none (currently).
+//   run_op(id) - performs an operation; this is called in the child process, and the result is
+//                used as the child's exit status.
+//   op_done(id, result) - called (in this process) when an operation completes, with the result
+//                from run_op. The result is -1 if the child process terminated abnormally.
+// Returns when no operations are running and get_next() returns -1. If a child process cannot be
+// created, the operation is run directly in this process instead.
+template <typename N, typename R, typename D>
+static void run_parallel(loop_t &loop, N get_next, R run_op, D op_done)
+{
+    class op_watcher_t : public loop_t::child_proc_watcher_impl<op_watcher_t>
+    {
+        public:
+        int op_id = -1;  // -1 if not running
+        bool terminated = false;
+        int status = 0;
+
+        rearm status_change(loop_t &, pid_t child, int status_p)
+        {
+            terminated = true;
+            status = status_p;
+            return rearm::REMOVE;
+        }
+    };
+
+    op_watcher_t watchers[max_parallel_ops];
+    int active = 0;
+
+    while (true) {
+        for (op_watcher_t &watcher : watchers) {
+            if (watcher.op_id != -1) continue;
+            int next_id = get_next();
+            if (next_id == -1) break;
+
+            try {
+                pid_t ch_pid = watcher.fork(loop);
+                if (ch_pid == 0) {
+                    _exit(run_op(next_id));
+                }
+                watcher.op_id = next_id;
+                watcher.terminated = false;
+                active++;
+            }
+            catch (std::exception &e) {
+                op_done(next_id, run_op(next_id));
+            }
+        }
+
+        if (active == 0) break;
+
+        loop.run();
+
+        for (op_watcher_t &watcher : watchers) {
+            if (watcher.op_id == -1 || ! watcher.terminated) continue;
+            int id = watcher.op_id;
+            watcher.op_id = -1;
+            active--;
+            int status = watcher.status;
+            op_done(id, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        }
+    }
+}
+
+#ifdef __linux__
+
+// Results of unmounting a filesystem (exit status of the child process doing the unmount):
+enum unmount_result : int
+{
+    UNMOUNTED = 0,
+    REMOUNTED_RO = 1,           // (not unmounted, but remounted read-only)
+    REMOUNTED_RO_DETACHED = 2,  // (remounted read-only, then lazily detached)
+    DETACHED = 3,               // (could not remount, but lazily detached)
+    UNMOUNT_FAILED = 4
+};
+
+// Unmount a single filesystem, falling back to remounting read-only and lazy detach if it is busy.
+static int unmount_one(const mount_tree::mount_entry &ent, bool is_root) noexcept
+{
+    const char *mount_point = ent.mount_point.c_str();
+    if (! is_root && umount2(mount_point, 0) == 0) {
+        return UNMOUNTED;
+    }
+
+    bool is_ro = mount(nullptr, mount_point, nullptr, MS_REMOUNT | MS_RDONLY, nullptr) == 0;
+    if (is_root) {
+        return is_ro ? REMOUNTED_RO : UNMOUNT_FAILED;
+    }
+
+    bool is_detached = umount2(mount_point, MNT_DETACH) == 0;
+    if (is_ro) {
+        return is_detached ? REMOUNTED_RO_DETACHED : REMOUNTED_RO;
+    }
+    return is_detached ? DETACHED : UNMOUNT_FAILED;
+}
+
+// Unmount all filesystems natively, processing the mount tree from the leaves up and unmounting
+// independent filesystems in parallel. Returns false if the mount table could not be read (in
+// which case nothing has been unmounted).
+static bool unmount_native(loop_t &loop, subproc_buffer &sub_buf)
+{
+    mount_tree mounts;
+    std::vector<int> ready;
+
+    {
+        std::ifstream mountinfo("/proc/self/mountinfo");
+        if (! mountinfo || ! mounts.read_mountinfo(mountinfo) || mounts.size() == 0) {
+            return false;
+        }
+    }
+
+    mounts.get_ready(ready);
+    size_t ready_pos = 0;
+
+    auto get_next = [&]() -> int {
+        while (ready_pos < ready.size()) {
+            int idx = ready[ready_pos++];
+            if (! mounts[idx].skip) return idx;
+            int pidx = mounts.mark_done(idx);
+            if (pidx != -1) ready.push_back(pidx);
+        }
+        return -1;
+    };
+
+    auto run_op = [&](int idx) -> int {
+        return unmount_one(mounts[idx], mounts.is_root(idx));
+    };
+
+    auto op_done = [&](int idx, int result) {
+        const char *msg = nullptr;
+        switch (result) {
+        case UNMOUNTED:
+            break;
+        case REMOUNTED_RO:
+            if (! mounts.is_root(idx)) msg = ": busy; remounted read-only\n";
+            break;
+        case REMOUNTED_RO_DETACHED:
+            msg = ": busy; remounted read-only and detached\n";
+            break;
+        case DETACHED:
+            msg = ": busy; could not remount read-only, detached\n";
+            break;
+        default:
+            msg = ": could not unmount or remount read-only\n";
+        }
+        if (msg != nullptr) {
+            sub_buf.append(mounts[idx].mount_point.c_str());
+            sub_buf.append(msg);
+        }
+        int pidx = mounts.mark_done(idx);
+        if (pidx != -1) ready.push_back(pidx);
+    };
+
+    run_parallel(loop, get_next, run_op, op_done);
+    return true;
+}
+
+// Turn off all swap devices/files natively, in parallel. Returns false if the list of active swap
+// devices could not be read.
+static bool swap_off_native(loop_t &loop, subproc_buffer &sub_buf)
+{
+    std::vector<std::string> swaps;
+
+    {
+        std::ifstream swaps_file("/proc/swaps");
+        if (! swaps_file) {
+            return false;
+        }
+        read_swaps(swaps_file, swaps);
+    }
+
+    size_t next_swap = 0;
+
+    auto get_next = [&]() -> int {
+        return next_swap < swaps.size() ? next_swap++ : -1;
+    };
+
+    auto run_op = [&](int idx) -> int {
+        return swapoff(swaps[idx].c_str()) == 0 ? 0 : errno;
+    };
+
+    auto op_done = [&](int idx, int result) {
+        if (result != 0) {
+            sub_buf.append("swapoff: ");
+            sub_buf.append(swaps[idx].c_str());
+            sub_buf.append(": ");
+            sub_buf.append(result == -1 ? "failed" : strerror(result));
+            sub_buf.append("\n");
+        }
+    };
+
+    run_parallel(loop, get_next, run_op, op_done);
+    return true;
+}
+
+#endif
+
 static void unmount_disks(loop_t &loop, subproc_buffer &sub_buf)
 {
+#ifdef __linux__
+    try {
+        if (unmount_native(loop, sub_buf)) return;
+    }
+    catch (std::exception &e) {
+        sub_buf.append("Couldn't unmount natively: ");
+        sub_buf.append(e.what());
+        sub_buf.append("\n");
+    }
+#endif
+
     try {
         const char * unmount_args[] = { "/bin/umount", "-a", "-r", nullptr };
         run_process(unmount_args, loop, sub_buf);
@@ -607,6 +927,17 @@ static void unmount_disks(loop_t &loop, subproc_buffer &sub_buf)
 
 static void swap_off(loop_t &loop, subproc_buffer &sub_buf)
 {
+#ifdef __linux__
+    try {
+        if (swap_off_native(loop, sub_buf)) return;
+    }
+    catch (std::exception &e) {
+        sub_buf.append("Couldn't turn off swap natively: ");
+        sub_buf.append(e.what());
+        sub_buf.append("\n");
+    }
+#endif
+
     try {
         const char * swapoff_args[] = { "/sbin/swapoff", "-a", nullptr };
         run_process(swapoff_args, loop, sub_buf);
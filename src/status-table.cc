@@ -0,0 +1,185 @@
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dinit.h"
+#include "dinit-log.h"
+#include "service.h"
+#include "status-table.h"
+
+// Implementation of the service status table. See status-table.h.
+
+status_table service_status_table;
+
+namespace {
+    // Initial number of entries in the table (the capacity is doubled as required):
+    constexpr uint32_t initial_capacity = 64;
+}
+
+status_table::~status_table() noexcept
+{
+    if (table != nullptr) {
+        munmap(table, table_size(capacity));
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+bool status_table::map_table(uint32_t new_capacity) noexcept
+{
+    size_t new_size = table_size(new_capacity);
+    void *new_table;
+
+    if (fd == -1) {
+        new_table = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (new_table == MAP_FAILED) return false;
+        if (table != nullptr) {
+            memcpy(new_table, table, table_size(capacity));
+        }
+    }
+    else {
+        // The existing contents are in the file; extend it and map the new size:
+        if (ftruncate(fd, new_size) == -1) return false;
+        new_table = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (new_table == MAP_FAILED) return false;
+    }
+
+    if (table != nullptr) {
+        munmap(table, table_size(capacity));
+    }
+    table = static_cast<char *>(new_table);
+    capacity = new_capacity;
+
+    status_table_header *header = reinterpret_cast<status_table_header *>(table);
+    header->magic = status_table_magic;
+    header->version = status_table_version;
+    header->entry_size = sizeof(status_table_entry);
+    __atomic_store_n(&header->capacity, new_capacity, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool status_table::init() noexcept
+{
+    if (table != nullptr) return true;
+    return map_table(initial_capacity);
+}
+
+bool status_table::open_file() noexcept
+{
+    if (fd != -1) return true;
+    if (table == nullptr || file_path.empty()) return false;
+
+    const char *path = file_path.c_str();
+    int new_fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0644);
+    if (new_fd == -1) {
+        log(loglevel_t::ERROR, "Error creating status table file: ", path, ": ", strerror(errno));
+        return false;
+    }
+
+    // The table is readable by all (it contains no information that isn't otherwise available
+    // via /proc), but writable only by us:
+    size_t size = table_size(capacity);
+    void *new_table;
+    if (fchmod(new_fd, 0644) == -1 || ftruncate(new_fd, size) == -1
+            || (new_table = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, new_fd, 0)) == MAP_FAILED) {
+        log(loglevel_t::ERROR, "Error setting up status table file: ", path, ": ", strerror(errno));
+        close(new_fd);
+        unlink(path);
+        return false;
+    }
+
+    memcpy(new_table, table, size);
+    munmap(table, size);
+    table = static_cast<char *>(new_table);
+    fd = new_fd;
+    return true;
+}
+
+void status_table::close_file() noexcept
+{
+    if (fd != -1) {
+        unlink(file_path.c_str());
+        close(fd);
+        fd = -1;
+    }
+}
+
+int status_table::alloc_slot() noexcept
+{
+    if (table == nullptr) return -1;
+
+    if (! free_slots.empty()) {
+        uint32_t slot = free_slots.back();
+        free_slots.pop_back();
+        return slot;
+    }
+
+    if (used == capacity) {
+        if (! map_table(capacity * 2)) {
+            log(loglevel_t::WARN, "Could not grow service status table");
+            return -1;
+        }
+    }
+
+    return used++;
+}
+
+void status_table::release_slot(int slot) noexcept
+{
+    status_table_entry *entry = get_entry(slot);
+    uint32_t seq = entry->seq;
+    __atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    entry->in_use = 0;
+    entry->name_len = 0;
+    __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+
+    try {
+        free_slots.push_back(slot);
+    }
+    catch (std::bad_alloc &) {
+        // The slot is lost; it will not be re-used.
+    }
+}
+
+void status_table::update(int slot, service_record *sr, bool transition) noexcept
+{
+    time_val transition_time;
+    if (transition) {
+        event_loop.get_time(transition_time, clock_type::MONOTONIC);
+    }
+
+    status_table_entry *entry = get_entry(slot);
+    uint32_t seq = entry->seq;
+    __atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    entry->in_use = 1;
+    entry->state = static_cast<uint8_t>(sr->get_state());
+    entry->target_state = static_cast<uint8_t>(sr->get_target_state());
+    entry->stop_reason = static_cast<uint8_t>(sr->get_stop_reason());
+    entry->pid = sr->get_pid();
+    entry->exit_status = sr->get_exit_status();
+    entry->restart_count = sr->get_restart_count();
+    if (transition) {
+        entry->transition_sec = transition_time.seconds();
+        entry->transition_nsec = transition_time.nseconds();
+    }
+
+    const std::string &name = sr->get_name();
+    size_t name_len = std::min(name.length(), status_name_max);
+    if (entry->name_len != name_len || memcmp(entry->name, name.data(), name_len) != 0) {
+        memcpy(entry->name, name.data(), name_len);
+        memset(entry->name + name_len, 0, status_name_max - name_len);
+        entry->name_len = name_len;
+    }
+
+    __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -20,6 +20,54 @@ class control_conn_t_test
     {
         return cc->find_service_for_key(handle);
     }
+
+    static size_t queued_packets(control_conn_t *cc)
+    {
+        return cc->outbuf.size();
+    }
+
+    static size_t queued_bytes(control_conn_t *cc)
+    {
+        return cc->out_bytes;
+    }
+
+    static bool input_throttled(control_conn_t *cc)
+    {
+        return cc->in_throttled;
+    }
+
+    static size_t out_quota()
+    {
+        return control_conn_t::out_quota;
+    }
+};
+
+// A write handler which can be made to fail writes with EAGAIN (as if the socket buffer is full):
+class blockable_write_handler : public bp_sys::default_write_handler
+{
+    public:
+    bool blocked = true;
+
+    ssize_t write(int fd, const void *buf, size_t count) override
+    {
+        if (blocked) {
+            errno = EAGAIN;
+            return -1;
+        }
+        return default_write_handler::write(fd, buf, count);
+    }
+};
+
+// A write handler which accepts only a limited amount of data per write (once unblocked)
+class partial_write_handler : public blockable_write_handler
+{
+    public:
+    size_t max_write = 100;
+
+    ssize_t write(int fd, const void *buf, size_t count) override
+    {
+        return blockable_write_handler::write(fd, buf, std::min(count, max_write));
+    }
 };
 
 void cptest_queryver()
@@ -73,7 +121,7 @@ void cptest_listservices()
 	// (1 byte)   target state
 	// (1 byte)   flags: has console, waiting for console, start skipped
 	// (1 byte)   stop reason
-    // (2 bytes)  reserved
+    // (2 bytes)  restart delay
 	// (? bytes)  exit status (int) / process id (pid_t)
 	// (N bytes)  service name
 
@@ -1103,6 +1151,593 @@ void cptest_wake()
 }
 
 
+// Multiple (pipelined) requests received together
+void cptest_pipelined()
+{
+    service_set sset;
+
+    service_record *s1 = new service_record(&sset, "test-service-1", service_type_t::INTERNAL, {});
+    sset.add_service(s1);
+    service_record *s2 = new service_record(&sset, "test-service-2", service_type_t::INTERNAL, {});
+    sset.add_service(s2);
+
+    int fd = bp_sys::allocfd();
+    auto *cc = new control_conn_t(event_loop, &sset, fd);
+
+    std::vector<char> cmd;
+    for (const char *service_name : { "test-service-1", "test-service-2", "test-service-3" }) {
+        cmd.push_back(DINIT_CP_FINDSERVICE);
+        uint16_t name_len = strlen(service_name);
+        char *name_len_cptr = reinterpret_cast<char *>(&name_len);
+        cmd.insert(cmd.end(), name_len_cptr, name_len_cptr + sizeof(name_len));
+        cmd.insert(cmd.end(), service_name, service_name + name_len);
+    }
+    cmd.push_back(DINIT_CP_QUERYVERSION);
+
+    bp_sys::supply_read_data(fd, std::move(cmd));
+
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    // We expect a reply to each request, in order:
+    std::vector<char> wdata;
+    bp_sys::extract_written_data(fd, wdata);
+
+    constexpr size_t svcrec_size = 3 + sizeof(control_conn_t::handle_t);
+    assert(wdata.size() == svcrec_size * 2 + 1 + 5);
+    assert(wdata[0] == DINIT_RP_SERVICERECORD);
+    assert(wdata[svcrec_size] == DINIT_RP_SERVICERECORD);
+    assert(wdata[svcrec_size * 2] == DINIT_RP_NOSERVICE);
+    assert(wdata[svcrec_size * 2 + 1] == DINIT_RP_CPVERSION);
+
+    control_conn_t::handle_t h1, h2;
+    memcpy(&h1, wdata.data() + 2, sizeof(h1));
+    memcpy(&h2, wdata.data() + svcrec_size + 2, sizeof(h2));
+    assert(control_conn_t_test::service_from_handle(cc, h1) == s1);
+    assert(control_conn_t_test::service_from_handle(cc, h2) == s2);
+
+    delete cc;
+}
+
+// Subscription to events for all services
+void cptest_subscribe()
+{
+    service_set sset;
+
+    service_record *s1 = new service_record(&sset, "test-service-1", service_type_t::INTERNAL, {});
+    sset.add_service(s1);
+    service_record *s2 = new service_record(&sset, "test-service-2", service_type_t::INTERNAL,
+            {{s1, dependency_type::REGULAR}});
+    sset.add_service(s2);
+    service_record *s3 = new service_record(&sset, "other-service", service_type_t::INTERNAL, {});
+    sset.add_service(s3);
+
+    int fd = bp_sys::allocfd();
+    auto *cc = new control_conn_t(event_loop, &sset, fd);
+
+    const char *pattern = "test-service-*";
+    std::vector<char> cmd = { DINIT_CP_SUBSCRIBE, 0 };
+    uint16_t pattern_len = strlen(pattern);
+    char *pattern_len_cptr = reinterpret_cast<char *>(&pattern_len);
+    cmd.insert(cmd.end(), pattern_len_cptr, pattern_len_cptr + sizeof(pattern_len));
+    cmd.insert(cmd.end(), pattern, pattern + pattern_len);
+
+    bp_sys::supply_read_data(fd, std::move(cmd));
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    std::vector<char> wdata;
+    bp_sys::extract_written_data(fd, wdata);
+    assert(wdata.size() == 1);
+    assert(wdata[0] == DINIT_RP_ACK);
+
+    sset.start_service(s3);
+    sset.start_service(s2);
+
+    // Events are not written until the connection is writable, and are then sent as a single
+    // batch (events for other-service are filtered out):
+    wdata.clear();
+    bp_sys::extract_written_data(fd, wdata);
+    assert(wdata.empty());
+
+    event_loop.regd_bidi_watchers[fd]->write_ready(event_loop, fd);
+    bp_sys::extract_written_data(fd, wdata);
+
+    constexpr size_t entry_size = 6 + 14;
+    assert(wdata.size() == 2 + entry_size * 2);
+    assert(wdata[0] == DINIT_IP_SERVICEEVENTS);
+    assert((unsigned char)wdata[1] == wdata.size());
+
+    uint32_t seq1, seq2;
+    memcpy(&seq1, wdata.data() + 2, sizeof(seq1));
+    memcpy(&seq2, wdata.data() + 2 + entry_size, sizeof(seq2));
+    assert(seq2 == seq1 + 1);
+    assert(wdata[6] == (char)service_event_t::STARTED);
+    assert(wdata[7] == 14);
+    assert(std::string(wdata.data() + 8, 14) == "test-service-1");
+    assert(std::string(wdata.data() + 8 + entry_size, 14) == "test-service-2");
+
+    // Generate many events without the connection being writable; some events should be dropped:
+    constexpr int num_cycles = 2000;
+    for (int i = 0; i < num_cycles; i++) {
+        sset.stop_service(s1);
+        sset.start_service(s2);
+    }
+
+    assert(control_conn_t_test::queued_packets(cc) != 0);
+    while (control_conn_t_test::queued_packets(cc) != 0) {
+        event_loop.regd_bidi_watchers[fd]->write_ready(event_loop, fd);
+    }
+
+    wdata.clear();
+    bp_sys::extract_written_data(fd, wdata);
+
+    // We should receive consecutive events, followed by a "lost" marker for the rest:
+    uint32_t next_seq = seq2 + 1;
+    size_t pos = 0;
+    while (pos < wdata.size() && wdata[pos] == DINIT_IP_SERVICEEVENTS) {
+        size_t pkt_end = pos + (unsigned char)wdata[pos + 1];
+        for (pos += 2; pos < pkt_end; pos += entry_size) {
+            uint32_t seq;
+            memcpy(&seq, wdata.data() + pos, sizeof(seq));
+            assert(seq == next_seq++);
+        }
+    }
+
+    assert(pos + 10 == wdata.size());
+    assert(wdata[pos] == DINIT_IP_EVENTSLOST);
+    uint32_t first_lost, lost_count;
+    memcpy(&first_lost, wdata.data() + pos + 2, sizeof(first_lost));
+    memcpy(&lost_count, wdata.data() + pos + 6, sizeof(lost_count));
+    assert(first_lost == next_seq);
+    assert(lost_count != 0);
+    // 4 events per cycle: test-service-1, -2 stopped; test-service-1, -2 started
+    assert(first_lost + lost_count == seq2 + 1 + num_cycles * 4);
+
+    delete cc;
+}
+
+void cptest_reloadchanged()
+{
+    service_set sset;
+
+    service_record *s1 = new service_record(&sset, "getty@tty1", service_type_t::INTERNAL, {});
+    sset.add_service(s1);
+    service_record *s2 = new service_record(&sset, "getty@tty2", service_type_t::INTERNAL, {});
+    sset.add_service(s2);
+    service_record *s3 = new service_record(&sset, "other", service_type_t::INTERNAL, {});
+    sset.add_service(s3);
+    service_record *s4 = new service_record(&sset, "in-use", service_type_t::INTERNAL, {});
+    sset.add_service(s4);
+
+    int fd = bp_sys::allocfd();
+    auto *cc = new control_conn_t(event_loop, &sset, fd);
+
+    // Changes are not being tracked:
+    bp_sys::supply_read_data(fd, { DINIT_CP_RELOADCHANGED });
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    std::vector<char> wdata;
+    bp_sys::extract_written_data(fd, wdata);
+    assert(wdata.size() == 1);
+    assert(wdata[0] == DINIT_RP_NAK);
+
+    // Change the template (and so both instances), a service with a handle open via another
+    // connection, and an unloaded service:
+    sset.set_tracking_changes(true);
+    sset.description_changed("getty@");
+    sset.description_changed("in-use");
+    sset.description_changed("not-loaded");
+    assert(s1->is_description_changed() && s2->is_description_changed());
+    assert(! s3->is_description_changed());
+    assert(s4->is_description_changed());
+
+    int fd2 = bp_sys::allocfd();
+    auto *cc2 = new control_conn_t(event_loop, &sset, fd2);
+
+    const char *in_use_name = "in-use";
+    std::vector<char> cmd = { DINIT_CP_FINDSERVICE };
+    uint16_t name_len = strlen(in_use_name);
+    char *name_len_cptr = reinterpret_cast<char *>(&name_len);
+    cmd.insert(cmd.end(), name_len_cptr, name_len_cptr + sizeof(name_len));
+    cmd.insert(cmd.end(), in_use_name, in_use_name + name_len);
+    bp_sys::supply_read_data(fd2, std::move(cmd));
+    event_loop.regd_bidi_watchers[fd2]->read_ready(event_loop, fd2);
+    bp_sys::extract_written_data(fd2, wdata);
+    assert(wdata[0] == DINIT_RP_SERVICERECORD);
+
+    bp_sys::supply_read_data(fd, { DINIT_CP_RELOADCHANGED });
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    // We expect a result for each changed service, in order:
+    // (1 byte) DINIT_RP_RELOADRESULT, (1 byte) result, (1 byte) name length, name
+    // followed by DINIT_RP_LISTDONE.
+    wdata.clear();
+    bp_sys::extract_written_data(fd, wdata);
+    std::vector<std::pair<int, std::string>> results;
+    size_t pos = 0;
+    while (pos < wdata.size() && wdata[pos] == DINIT_RP_RELOADRESULT) {
+        int result = wdata[pos + 1];
+        size_t len = (unsigned char)wdata[pos + 2];
+        results.emplace_back(result, std::string(wdata.data() + pos + 3, len));
+        pos += 3 + len;
+    }
+    assert(pos + 1 == wdata.size());
+    assert(wdata[pos] == DINIT_RP_LISTDONE);
+
+    assert(results.size() == 3);
+    assert(results[0].first == DINIT_RELOAD_OK && results[0].second == "getty@tty1");
+    assert(results[1].first == DINIT_RELOAD_OK && results[1].second == "getty@tty2");
+    assert(results[2].first == DINIT_RELOAD_OK && results[2].second == "in-use");
+
+    // The reloaded services are no longer marked as changed:
+    assert(! s1->is_description_changed() && ! s2->is_description_changed());
+    assert(! s4->is_description_changed());
+
+    delete cc2;
+    delete cc;
+}
+
+// A service set in which reloading a service always produces a new service record.
+class replacing_service_set : public service_set
+{
+    public:
+    service_record *reload_service(service_record *service) override
+    {
+        return new service_record(this, service->get_name(), service_type_t::INTERNAL, {});
+    }
+};
+
+// When a reload (via RELOADCHANGED) replaces a service record, handles held by other connections
+// refer to the new record.
+void cptest_reloadreplaced()
+{
+    replacing_service_set sset;
+    sset.set_tracking_changes(true);
+
+    const char *svc_name = "test-service-1";
+    service_record *s1 = new service_record(&sset, svc_name, service_type_t::INTERNAL, {});
+    sset.add_service(s1);
+
+    int fd = bp_sys::allocfd();
+    auto *cc = new control_conn_t(event_loop, &sset, fd);
+    int fd2 = bp_sys::allocfd();
+    auto *cc2 = new control_conn_t(event_loop, &sset, fd2);
+
+    std::vector<char> cmd = { DINIT_CP_FINDSERVICE };
+    uint16_t name_len = strlen(svc_name);
+    char *name_len_cptr = reinterpret_cast<char *>(&name_len);
+    cmd.insert(cmd.end(), name_len_cptr, name_len_cptr + sizeof(name_len));
+    cmd.insert(cmd.end(), svc_name, svc_name + name_len);
+    bp_sys::supply_read_data(fd2, std::move(cmd));
+    event_loop.regd_bidi_watchers[fd2]->read_ready(event_loop, fd2);
+
+    std::vector<char> wdata;
+    bp_sys::extract_written_data(fd2, wdata);
+    assert(wdata[0] == DINIT_RP_SERVICERECORD);
+    control_conn_t::handle_t h;
+    memcpy(&h, wdata.data() + 2, sizeof(h));
+
+    sset.description_changed(svc_name);
+    bp_sys::supply_read_data(fd, { DINIT_CP_RELOADCHANGED });
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    wdata.clear();
+    bp_sys::extract_written_data(fd, wdata);
+    assert(wdata.size() == 3 + strlen(svc_name) + 1);
+    assert(wdata[0] == DINIT_RP_RELOADRESULT);
+    assert(wdata[1] == DINIT_RELOAD_OK);
+
+    service_record *s1_new = sset.find_service(svc_name);
+    assert(s1_new != nullptr && s1_new != s1);
+
+    // Events for the new record are reported via the existing handle:
+    sset.start_service(s1_new);
+    assert(s1_new->get_state() == service_state_t::STARTED);
+
+    wdata.clear();
+    bp_sys::extract_written_data(fd2, wdata);
+    assert(wdata.size() == 3 + sizeof(h));
+    assert(wdata[0] == DINIT_IP_SERVICEEVENT);
+    control_conn_t::handle_t ev_h;
+    memcpy(&ev_h, wdata.data() + 2, sizeof(ev_h));
+    assert(ev_h == h);
+    assert(wdata[2 + sizeof(h)] == static_cast<int>(service_event_t::STARTED));
+
+    delete cc2;
+    delete cc;
+}
+
+// Batched start/stop: all operations are checked first, and are performed together.
+void cptest_startstopbatch()
+{
+    service_set sset;
+
+    service_record *s1 = new service_record(&sset, "test-service-1", service_type_t::INTERNAL, {});
+    sset.add_service(s1);
+    service_record *s2 = new service_record(&sset, "test-service-2", service_type_t::INTERNAL,
+            {{s1, dependency_type::REGULAR}});
+    sset.add_service(s2);
+
+    int fd = bp_sys::allocfd();
+    auto *cc = new control_conn_t(event_loop, &sset, fd);
+
+    std::vector<char> cmd;
+    for (const char *service_name : { "test-service-1", "test-service-2" }) {
+        cmd.push_back(DINIT_CP_FINDSERVICE);
+        uint16_t name_len = strlen(service_name);
+        char *name_len_cptr = reinterpret_cast<char *>(&name_len);
+        cmd.insert(cmd.end(), name_len_cptr, name_len_cptr + sizeof(name_len));
+        cmd.insert(cmd.end(), service_name, service_name + name_len);
+    }
+    bp_sys::supply_read_data(fd, std::move(cmd));
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    std::vector<char> wdata;
+    bp_sys::extract_written_data(fd, wdata);
+    constexpr size_t svcrec_size = 3 + sizeof(control_conn_t::handle_t);
+    assert(wdata.size() == svcrec_size * 2);
+    control_conn_t::handle_t h1, h2;
+    memcpy(&h1, wdata.data() + 2, sizeof(h1));
+    memcpy(&h2, wdata.data() + svcrec_size + 2, sizeof(h2));
+
+    // Build a batch packet: flags, count, entries (op, op flags, handle)
+    auto batch_pkt = [](char flags, std::vector<std::pair<char, control_conn_t::handle_t>> entries,
+            char op_flags) {
+        std::vector<char> pkt = { DINIT_CP_STARTSTOPBATCH, flags };
+        uint16_t count = entries.size();
+        pkt.insert(pkt.end(), (char *) &count, (char *) &count + sizeof(count));
+        for (auto &entry : entries) {
+            pkt.push_back(entry.first);
+            pkt.push_back(op_flags);
+            pkt.insert(pkt.end(), (char *) &entry.second, (char *) &entry.second + sizeof(entry.second));
+        }
+        return pkt;
+    };
+
+    // Skip service event (information) packets, returning the position of the reply:
+    auto skip_info = [](const std::vector<char> &data) {
+        size_t pos = 0;
+        while (pos < data.size() && data[pos] >= 100) {
+            pos += (unsigned char) data[pos + 1];
+        }
+        return pos;
+    };
+
+    // Start both services:
+    bp_sys::supply_read_data(fd, batch_pkt(0, {{DINIT_CP_STARTSERVICE, h1}, {DINIT_CP_STARTSERVICE, h2}}, 0));
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    wdata.clear();
+    bp_sys::extract_written_data(fd, wdata);
+    size_t pos = skip_info(wdata);
+    assert(wdata.size() == pos + 5);
+    assert(wdata[pos] == DINIT_RP_BATCHDONE);
+    uint16_t count;
+    memcpy(&count, wdata.data() + pos + 1, sizeof(count));
+    assert(count == 2);
+    assert(wdata[pos + 3] == DINIT_RP_ALREADYSS);
+    assert(wdata[pos + 4] == DINIT_RP_ALREADYSS);
+    assert(s1->get_state() == service_state_t::STARTED);
+    assert(s2->get_state() == service_state_t::STARTED);
+
+    // Gently stopping only s1 is rejected due to s2 depending on it; nothing is done:
+    cmd = batch_pkt(0, {{DINIT_CP_STOPSERVICE, h1}}, 2 /* gentle */);
+    bp_sys::supply_read_data(fd, std::move(cmd));
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    wdata.clear();
+    bp_sys::extract_written_data(fd, wdata);
+    assert(wdata.size() == 4);
+    assert(wdata[0] == DINIT_RP_BATCHREJECTED);
+    uint16_t index;
+    memcpy(&index, wdata.data() + 1, sizeof(index));
+    assert(index == 0);
+    assert(wdata[3] == DINIT_BATCH_DEPENDENTS);
+    assert(s1->get_state() == service_state_t::STARTED);
+
+    // Gently stopping both (the batch split over two packets) is allowed:
+    cmd = batch_pkt(1 /* more */, {{DINIT_CP_STOPSERVICE, h1}}, 2);
+    bp_sys::supply_read_data(fd, std::move(cmd));
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+    wdata.clear();
+    bp_sys::extract_written_data(fd, wdata);
+    assert(wdata.empty());
+    assert(s1->get_state() == service_state_t::STARTED);
+
+    cmd = batch_pkt(0, {{DINIT_CP_STOPSERVICE, h2}}, 2);
+    bp_sys::supply_read_data(fd, std::move(cmd));
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+    wdata.clear();
+    bp_sys::extract_written_data(fd, wdata);
+    pos = skip_info(wdata);
+    assert(wdata.size() == pos + 5);
+    assert(wdata[pos] == DINIT_RP_BATCHDONE);
+    assert(wdata[pos + 3] == DINIT_RP_ALREADYSS);
+    assert(wdata[pos + 4] == DINIT_RP_ALREADYSS);
+    assert(s1->get_state() == service_state_t::STOPPED);
+    assert(s2->get_state() == service_state_t::STOPPED);
+
+    // Restart of a service which isn't started is rejected:
+    cmd = batch_pkt(0, {{DINIT_CP_STARTSERVICE, h1}, {DINIT_CP_STOPSERVICE, h2}}, 4 /* restart */);
+    bp_sys::supply_read_data(fd, std::move(cmd));
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+    wdata.clear();
+    bp_sys::extract_written_data(fd, wdata);
+    assert(wdata.size() == 4);
+    assert(wdata[0] == DINIT_RP_BATCHREJECTED);
+    memcpy(&index, wdata.data() + 1, sizeof(index));
+    assert(index == 1);
+    assert(wdata[3] == DINIT_BATCH_NOT_STARTED);
+    assert(s1->get_state() == service_state_t::STOPPED);
+
+    delete cc;
+}
+
+void cptest_outquota()
+{
+    service_set sset;
+
+    constexpr int num_services = 40;
+    constexpr int name_len = 200;
+    for (int i = 0; i < num_services; i++) {
+        std::string name = std::to_string(i) + "-" + std::string(name_len - 1 - std::to_string(i).length(), 'x');
+        service_record *s = new service_record(&sset, name, service_type_t::INTERNAL, {});
+        sset.add_service(s);
+    }
+
+    auto *whandler = new blockable_write_handler();
+    int fd = bp_sys::allocfd(whandler);
+    auto *cc = new control_conn_t(event_loop, &sset, fd);
+
+    // Pipeline many list requests, while the client isn't reading replies:
+    constexpr int num_requests = 20;
+    bp_sys::supply_read_data(fd, std::vector<char>(num_requests, DINIT_CP_LISTSERVICES));
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    // Input should be throttled once the output quota is exceeded, with later requests not yet
+    // processed:
+    const size_t list_reply_size = num_services * (8 + std::max(sizeof(int), sizeof(pid_t)) + name_len) + 1;
+    assert(control_conn_t_test::input_throttled(cc));
+    assert(control_conn_t_test::queued_bytes(cc) > control_conn_t_test::out_quota());
+    assert(control_conn_t_test::queued_bytes(cc) < control_conn_t_test::out_quota() + list_reply_size);
+    assert(control_conn_stats.out_bytes == control_conn_t_test::queued_bytes(cc));
+
+    // Once the client reads, the remaining requests are processed:
+    whandler->blocked = false;
+    while (control_conn_t_test::queued_packets(cc) != 0) {
+        event_loop.regd_bidi_watchers[fd]->write_ready(event_loop, fd);
+    }
+
+    assert(! control_conn_t_test::input_throttled(cc));
+    assert(control_conn_stats.out_bytes == 0);
+
+    std::vector<char> wdata;
+    bp_sys::extract_written_data(fd, wdata);
+    assert(wdata.size() == list_reply_size * num_requests);
+    assert(wdata.back() == DINIT_RP_LISTDONE);
+
+    // A client which never reads output, while service events are generated, is disconnected:
+    whandler->blocked = true;
+    const char *svc_name = "0-";
+    std::string svc_name_full = svc_name + std::string(name_len - 2, 'x');
+    std::vector<char> cmd = { DINIT_CP_FINDSERVICE };
+    uint16_t svc_name_len = svc_name_full.length();
+    char *svc_name_len_cptr = reinterpret_cast<char *>(&svc_name_len);
+    cmd.insert(cmd.end(), svc_name_len_cptr, svc_name_len_cptr + sizeof(svc_name_len));
+    cmd.insert(cmd.end(), svc_name_full.begin(), svc_name_full.end());
+    bp_sys::supply_read_data(fd, std::move(cmd));
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    service_record *s0 = sset.find_service(svc_name_full);
+    assert(s0 != nullptr);
+    unsigned long prev_closed = control_conn_stats.quota_closed;
+    for (int i = 0; i < 30000 && control_conn_stats.quota_closed == prev_closed; i++) {
+        sset.start_service(s0);
+        sset.stop_service(s0);
+    }
+    assert(control_conn_stats.quota_closed == prev_closed + 1);
+    assert(control_conn_stats.out_bytes == 0);
+
+    event_loop.regd_bidi_watchers[fd]->write_ready(event_loop, fd);
+    assert(event_loop.regd_bidi_watchers.find(fd) == event_loop.regd_bidi_watchers.end());
+}
+
+void cptest_seqpacket()
+{
+    service_set sset;
+    int fd = bp_sys::allocfd();
+    new control_conn_t(event_loop, &sset, fd, true /* seqpacket */);
+
+    // Each message (read) may contain several complete packets:
+    bp_sys::supply_read_data(fd, { DINIT_CP_QUERYVERSION, DINIT_CP_QUERYVERSION });
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    std::vector<char> wdata;
+    bp_sys::extract_written_data(fd, wdata);
+    assert(wdata.size() == 10);
+    assert(wdata[0] == DINIT_RP_CPVERSION);
+    assert(wdata[5] == DINIT_RP_CPVERSION);
+
+    // A packet can't continue in the next message; a message with an incomplete packet is an error:
+    bp_sys::supply_read_data(fd, { DINIT_CP_FINDSERVICE, 5, 0, 't', 'e' });
+    bp_sys::supply_read_data(fd, { 's', 't', '1' });
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    wdata.clear();
+    bp_sys::extract_written_data(fd, wdata);
+    assert(wdata.size() == 1);
+    assert(wdata[0] == DINIT_RP_BADREQ);
+
+    event_loop.regd_bidi_watchers[fd]->write_ready(event_loop, fd);
+    assert(event_loop.regd_bidi_watchers.find(fd) == event_loop.regd_bidi_watchers.end());
+
+    // A message which is too large for the buffer is truncated; even if the truncated part consists
+    // of complete packets, it is rejected (rather than silently dropping the remainder):
+    fd = bp_sys::allocfd();
+    new control_conn_t(event_loop, &sset, fd, true /* seqpacket */);
+    bp_sys::supply_read_data(fd, std::vector<char>(1100, DINIT_CP_QUERYVERSION));
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+
+    wdata.clear();
+    bp_sys::extract_written_data(fd, wdata);
+    assert(wdata.size() == 1);
+    assert(wdata[0] == DINIT_RP_BADREQ);
+
+    event_loop.regd_bidi_watchers[fd]->write_ready(event_loop, fd);
+    assert(event_loop.regd_bidi_watchers.find(fd) == event_loop.regd_bidi_watchers.end());
+}
+
+// After a partial write, the connection must remain armed for output until all output is sent (the
+// watch is disarmed when an output event is delivered).
+void cptest_partialwrite()
+{
+    service_set sset;
+
+    constexpr int num_services = 10;
+    for (int i = 0; i < num_services; i++) {
+        std::string name = "test-service-" + std::to_string(i);
+        service_record *s = new service_record(&sset, name, service_type_t::INTERNAL, {});
+        sset.add_service(s);
+    }
+
+    auto *whandler = new partial_write_handler();
+    int fd = bp_sys::allocfd(whandler);
+    auto *cc = new control_conn_t(event_loop, &sset, fd);
+
+    // The reply can't be written while the client isn't reading, so it is queued:
+    bp_sys::supply_read_data(fd, { DINIT_CP_LISTSERVICES });
+    event_loop.regd_bidi_watchers[fd]->read_ready(event_loop, fd);
+    assert(control_conn_t_test::queued_packets(cc) != 0);
+
+    // Each output event writes only part of the output; the watch must be re-armed until it has
+    // all been written:
+    whandler->blocked = false;
+    int events = 0;
+    while (true) {
+        auto r = event_loop.regd_bidi_watchers[fd]->write_ready(event_loop, fd);
+        ++events;
+        if (control_conn_t_test::queued_packets(cc) != 0) {
+            assert(r == dasynq::rearm::REARM);
+        }
+        else {
+            assert(r == dasynq::rearm::NOOP);
+            break;
+        }
+    }
+    assert(events > 1);
+
+    std::vector<char> wdata;
+    bp_sys::extract_written_data(fd, wdata);
+    size_t list_reply_size = 1;
+    for (int i = 0; i < num_services; i++) {
+        list_reply_size += 8 + std::max(sizeof(int), sizeof(pid_t))
+                + ("test-service-" + std::to_string(i)).length();
+    }
+    assert(wdata.size() == list_reply_size);
+    assert(wdata.back() == DINIT_RP_LISTDONE);
+
+    delete cc;
+}
+
 #define RUN_TEST(name, spacing) \
     std::cout << #name "..." spacing << std::flush; \
     name(); \
@@ -1124,5 +1759,13 @@ int main(int argc, char **argv)
     RUN_TEST(cptest_enableservice, "      ");
     RUN_TEST(cptest_restart, "            ");
     RUN_TEST(cptest_wake, "               ");
+    RUN_TEST(cptest_pipelined, "          ");
+    RUN_TEST(cptest_subscribe, "          ");
+    RUN_TEST(cptest_reloadchanged, "      ");
+    RUN_TEST(cptest_reloadreplaced, "     ");
+    RUN_TEST(cptest_startstopbatch, "     ");
+    RUN_TEST(cptest_outquota, "           ");
+    RUN_TEST(cptest_partialwrite, "       ");
+    RUN_TEST(cptest_seqpacket, "          ");
     return 0;
 }
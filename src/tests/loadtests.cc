@@ -3,6 +3,7 @@
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
+#include <sstream>
 
 #include "service.h"
 #include "proc-service.h"
@@ -48,6 +49,242 @@ void test_nonexistent()
     assert(got_service_not_found);
 }
 
+void test_template()
+{
+    dirload_service_set sset(test_service_dir.c_str());
+    auto t3 = static_cast<base_process_service *>(sset.load_service("t3@one"));
+    assert(t3->get_name() == "t3@one");
+    auto exec_parts = t3->get_exec_arg_parts();
+    assert(exec_parts.size() == 4 && exec_parts[3] == nullptr);
+    assert(strcmp("echo", exec_parts[0]) == 0);
+    assert(strcmp("one", exec_parts[1]) == 0);
+    assert(strcmp("[one]", exec_parts[2]) == 0);
+    assert(t3->get_dependencies().size() == 1);
+    assert(t3->get_dependencies().front().get_to()->get_name() == "t4@one");
+
+    // Special characters in the instance argument are not interpreted:
+    auto t3b = static_cast<base_process_service *>(sset.load_service("t3@a \"b\" #c"));
+    exec_parts = t3b->get_exec_arg_parts();
+    assert(exec_parts.size() == 4 && exec_parts[3] == nullptr);
+    assert(strcmp("a \"b\" #c", exec_parts[1]) == 0);
+    assert(strcmp("[a \"b\" #c]", exec_parts[2]) == 0);
+    assert(t3b->get_dependencies().front().get_to()->get_name() == "t4@a \"b\" #c");
+
+    // Process settings are per-instance if they contain "$1", and otherwise shared:
+    assert(t3->get_exec_settings()->working_dir == "/tmp/one");
+    assert(t3b->get_exec_settings()->working_dir == "/tmp/a \"b\" #c");
+    auto t14a = static_cast<base_process_service *>(sset.load_service("t14@a"));
+    auto t14b = static_cast<base_process_service *>(sset.load_service("t14@b"));
+    assert(strcmp("b", t14b->get_exec_arg_parts()[1]) == 0);
+    assert(t14a->get_exec_settings() == t14b->get_exec_settings());
+    assert(t14a->get_exec_settings()->working_dir == "/tmp");
+    assert(t14a->get_exec_settings()->sched.nice_set && t14a->get_exec_settings()->sched.nice == 5);
+
+    // Templates can't be loaded directly, and instances need a template:
+    bool got_exc = false;
+    try {
+        sset.load_service("t3@");
+    }
+    catch (service_description_exc &) {
+        got_exc = true;
+    }
+    assert(got_exc);
+
+    got_exc = false;
+    try {
+        sset.load_service("t5@one");
+    }
+    catch (service_not_found &) {
+        got_exc = true;
+    }
+    assert(got_exc);
+
+    // "$1" can only be used in settings with a string value:
+    got_exc = false;
+    try {
+        sset.load_service("t15@1");
+    }
+    catch (service_description_exc &) {
+        got_exc = true;
+    }
+    assert(got_exc);
+}
+
+void test_lazy_deps()
+{
+    dirload_service_set sset(test_service_dir.c_str());
+    sset.set_lazy_soft_deps(true);
+
+    // Soft dependencies are not loaded with the service (a missing waits-for dependency is not yet
+    // detected):
+    service_record *t5 = sset.load_service("t5");
+    assert(t5->get_dependencies().empty());
+    assert(t5->get_lazy_deps().size() == 3);
+    assert(sset.find_service("t6") == nullptr);
+    assert(sset.find_service("t7") == nullptr);
+
+    // ... but are loaded when the service starts (the missing dependency is ignored):
+    sset.start_service(t5);
+    assert(t5->get_state() == service_state_t::STARTED);
+    service_record *t6 = sset.find_service("t6");
+    service_record *t7 = sset.find_service("t7");
+    assert(t6 != nullptr && t6->get_state() == service_state_t::STARTED);
+    assert(t7 != nullptr && t7->get_state() == service_state_t::STARTED);
+    assert(t5->get_dependencies().size() == 2);
+    assert(t5->get_lazy_deps().size() == 1);
+
+    // A missing milestone dependency causes the dependent to fail to start:
+    service_record *t8 = sset.load_service("t8");
+    sset.start_service(t8);
+    assert(t8->get_state() == service_state_t::STOPPED);
+    assert(t8->get_stop_reason() == stopped_reason_t::DEPFAILED);
+
+    // The failure is remembered; loading is not retried (nor the failure logged again) until the
+    // description changes:
+    assert(sset.lazy_load_failed("t-missing"));
+    sset.start_service(t8);
+    assert(t8->get_state() == service_state_t::STOPPED);
+    assert(t8->get_stop_reason() == stopped_reason_t::DEPFAILED);
+    sset.description_changed("t-missing");
+    assert(! sset.lazy_load_failed("t-missing"));
+
+    // A dependency which would form a cycle is not added:
+    service_record *t9 = sset.load_service("t9");
+    sset.start_service(t9);
+    assert(t9->get_state() == service_state_t::STARTED);
+    assert(t9->get_dependencies().empty());
+    service_record *t10 = sset.find_service("t10");
+    assert(t10 != nullptr && t10->get_dependencies().front().get_to() == t9);
+
+    // Lazy dependencies of a service's dependencies are resolved when the service is started:
+    service_record *t11 = sset.load_service("t11");
+    service_record *t12 = sset.find_service("t12");
+    assert(t12 != nullptr && t12->get_lazy_deps().size() == 1);
+    sset.start_service(t11);
+    assert(t11->get_state() == service_state_t::STARTED);
+    assert(t12->get_lazy_deps().empty());
+    service_record *t13 = sset.find_service("t13");
+    assert(t13 != nullptr && t13->get_state() == service_state_t::STARTED);
+}
+
+// Parse a service description from a string.
+static void parse_settings(const char *description, dinit_load::service_settings_wrapper<prelim_dep> &settings)
+{
+    using namespace dinit_load;
+    std::istringstream service_file(description);
+    process_service_file("test-service", service_file,
+            [&](string &line, string &setting, string_iterator &i, string_iterator &end) -> void {
+        auto process_dep_dir_n = [&](std::list<prelim_dep> &deplist, const std::string &waitsford,
+                dependency_type dep_type) -> void { };
+        auto load_service_n = [&](const string &dep_name) -> service_record * {
+            return nullptr;
+        };
+        process_service_line(settings, "test-service", line, setting, i, end, load_service_n,
+                process_dep_dir_n);
+    });
+}
+
+void test_settings()
+{
+    dinit_load::service_settings_wrapper<prelim_dep> settings;
+    parse_settings("  # comment\n"
+            "type=scripted\n"
+            "command = /bin/echo \"one  two\"\tthree\\ four\n"
+            "stop-command\t:\t/bin/true   # comment\n"
+            "termsignal = USR1\n"
+            "waits-for.d = some-dir\n"
+            "depends-on = other\n", settings);
+
+    assert(settings.service_type == service_type_t::SCRIPTED);
+    assert(settings.command == "/bin/echo one  two three four");
+    assert(settings.command_offsets.size() == 3);
+    assert(settings.stop_command == "/bin/true");
+    assert(settings.term_signal == SIGUSR1);
+    assert(settings.depends.size() == 1);
+    assert(settings.depends.front().dep_type == dependency_type::REGULAR);
+
+    // Unknown settings (including ones that differ from a known setting only in case):
+    for (const char *bad_line : { "bogus = 1\n", "Command = /bin/true\n", "restart-delay-maximum = 1\n" }) {
+        bool got_exc = false;
+        try {
+            dinit_load::service_settings_wrapper<prelim_dep> settings2;
+            parse_settings(bad_line, settings2);
+        }
+        catch (service_description_exc &exc) {
+            got_exc = true;
+            std::string setting_name(bad_line, strchr(bad_line, ' ') - bad_line);
+            assert(exc.exc_description == "Unknown setting: '" + setting_name + "'.");
+        }
+        assert(got_exc);
+    }
+}
+
+void test_sched_settings()
+{
+    dinit_load::service_settings_wrapper<prelim_dep> settings;
+    parse_settings("sched-policy = fifo\n"
+            "sched-priority = 10\n"
+            "nice = -5\n", settings);
+
+    assert(settings.sched.sched_policy == SCHED_FIFO);
+    assert(settings.sched.sched_priority == 10);
+    assert(settings.sched.nice_set && settings.sched.nice == -5);
+    assert(settings.sched.cpu_mask.empty());
+    assert(settings.sched.ioprio == -1);
+    assert(settings.sched.numa_policy == numa_policy_t::NONE);
+
+    #ifdef __linux__
+    parse_settings("cpu-affinity = 0-2,4 65\n"
+            "ioprio = best-effort:3\n"
+            "numa-policy = interleave 0,1\n", settings);
+
+    assert(settings.sched.cpu_mask.size() == 128 / std::numeric_limits<unsigned long>::digits);
+    assert(settings.sched.cpu_mask[0] == 0x17);
+    assert(settings.sched.cpu_mask.back() == (1ul << (65 % std::numeric_limits<unsigned long>::digits)));
+    assert(settings.sched.ioprio == ((2 << 13) | 3));
+    assert(settings.sched.numa_policy == numa_policy_t::INTERLEAVE);
+    assert(settings.sched.numa_nodes.size() == 1 && settings.sched.numa_nodes[0] == 0x3);
+    #endif
+
+    for (const char *bad_line : { "nice = 20\n", "sched-policy = fast\n", "sched-priority = 100\n",
+            "cpu-affinity = 3-1\n", "cpu-affinity = ,\n", "ioprio = realtime:8\n",
+            "numa-policy = preferred 0-1\n", "numa-policy = local 0\n" }) {
+        bool got_exc = false;
+        try {
+            dinit_load::service_settings_wrapper<prelim_dep> settings2;
+            parse_settings(bad_line, settings2);
+        }
+        catch (service_description_exc &exc) {
+            got_exc = true;
+        }
+        assert(got_exc);
+    }
+
+    // Valid policy/priority combinations:
+    dinit_load::check_sched_settings("test-service", settings.sched);
+    for (const char *good_lines : { "sched-policy = rr\nsched-priority = 1\n", "sched-policy = other\n",
+            "sched-policy = other\nsched-priority = 0\n", "nice = 5\n" }) {
+        dinit_load::service_settings_wrapper<prelim_dep> settings2;
+        parse_settings(good_lines, settings2);
+        dinit_load::check_sched_settings("test-service", settings2.sched);
+    }
+
+    // Invalid combinations, which are only detected once all settings have been read:
+    for (const char *bad_lines : { "sched-policy = fifo\n", "sched-policy = rr\nsched-priority = 0\n",
+            "sched-policy = other\nsched-priority = 5\n", "sched-priority = 10\n" }) {
+        dinit_load::service_settings_wrapper<prelim_dep> settings2;
+        parse_settings(bad_lines, settings2);
+        bool got_exc = false;
+        try {
+            dinit_load::check_sched_settings("test-service", settings2.sched);
+        }
+        catch (service_description_exc &exc) {
+            got_exc = true;
+        }
+        assert(got_exc);
+    }
+}
+
 #define RUN_TEST(name, spacing) \
     std::cout << #name "..." spacing << std::flush; \
     name(); \
@@ -59,5 +296,9 @@ int main(int argc, char **argv)
     RUN_TEST(test_basic, "                ");
     RUN_TEST(test_env_subst, "            ");
     RUN_TEST(test_nonexistent, "          ");
+    RUN_TEST(test_settings, "             ");
+    RUN_TEST(test_sched_settings, "       ");
+    RUN_TEST(test_template, "             ");
+    RUN_TEST(test_lazy_deps, "            ");
     return 0;
 }
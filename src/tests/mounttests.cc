@@ -0,0 +1,150 @@
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cassert>
+
+#include "mount-tree.h"
+
+// Tests for mount table parsing and unmount ordering (as used by the shutdown utility).
+
+static int find_mount(mount_tree &mounts, const char *mount_point)
+{
+    int found = -1;
+    for (size_t i = 0; i < mounts.size(); i++) {
+        if (mounts[i].mount_point == mount_point) {
+            found = i; // (for an over-mounted mount point, find the last)
+        }
+    }
+    return found;
+}
+
+static void read_test_mountinfo(mount_tree &mounts)
+{
+    std::ifstream mountinfo("./test-mountinfo");
+    assert(mountinfo);
+    assert(mounts.read_mountinfo(mountinfo));
+}
+
+void test_mountinfo_parse()
+{
+    mount_tree mounts;
+    read_test_mountinfo(mounts);
+
+    assert(mounts.size() == 15);
+
+    int root = find_mount(mounts, "/");
+    assert(root == 0);
+    assert(mounts.is_root(root));
+    assert(mounts[root].parent_idx == -1);
+    assert(mounts[root].fs_type == "ext4");
+
+    int myfiles = find_mount(mounts, "/home/user/my files");
+    assert(myfiles != -1);
+    assert(mounts[myfiles].fs_type == "fuse.sshfs");
+    assert(mounts[myfiles].parent_idx == find_mount(mounts, "/home/user"));
+
+    assert(mounts[find_mount(mounts, "/proc")].skip);
+    assert(mounts[find_mount(mounts, "/dev")].skip);
+    assert(! mounts[find_mount(mounts, "/dev/shm")].skip);
+    assert(! mounts[find_mount(mounts, "/home")].skip);
+}
+
+void test_mountinfo_bad()
+{
+    mount_tree mounts;
+    std::istringstream bad_mountinfo("22 1 8:1 / / rw,relatime shared:1 ext4 /dev/sda1 rw\n");
+    assert(! mounts.read_mountinfo(bad_mountinfo));
+}
+
+// Process the mount tree in the same way as the shutdown utility, checking that a mount is never
+// ready before all mounts on top of it have been dealt with.
+void test_unmount_order()
+{
+    mount_tree mounts;
+    read_test_mountinfo(mounts);
+
+    std::vector<int> ready;
+    mounts.get_ready(ready);
+
+    // The leaves are ready initially (and only the leaves):
+    assert(ready.size() == 7);
+    for (int idx : ready) {
+        assert(mounts[idx].pending_children == 0);
+    }
+
+    std::vector<int> order;
+    size_t ready_pos = 0;
+    while (ready_pos < ready.size()) {
+        // Deal with all currently-ready mounts as one "parallel" batch:
+        size_t batch_begin = ready_pos;
+        size_t batch_end = ready.size();
+        for ( ; ready_pos < batch_end; ready_pos++) {
+            int idx = ready[ready_pos];
+            for (size_t i = 0; i < mounts.size(); i++) {
+                if (mounts[i].parent_idx == idx) {
+                    assert(mounts[i].done);
+                }
+            }
+            order.push_back(idx);
+        }
+        for (size_t i = batch_begin; i < batch_end; i++) {
+            int pidx = mounts.mark_done(ready[i]);
+            if (pidx != -1) ready.push_back(pidx);
+        }
+    }
+
+    // Every mount is dealt with exactly once, and the root filesystem is last:
+    assert(order.size() == mounts.size());
+    assert(order.back() == find_mount(mounts, "/"));
+
+    auto pos_of = [&](const char *mount_point) -> size_t {
+        int idx = find_mount(mounts, mount_point);
+        for (size_t i = 0; i < order.size(); i++) {
+            if (order[i] == idx) return i;
+        }
+        return order.size();
+    };
+
+    assert(pos_of("/home/user/my files") < pos_of("/home/user"));
+    assert(pos_of("/home/user") < pos_of("/home"));
+    assert(pos_of("/run/user/1000") < pos_of("/run"));
+
+    // Over-mounted mount point: the top mount must be unmounted first
+    int top_data = find_mount(mounts, "/var/lib/data");
+    int lower_data = mounts[top_data].parent_idx;
+    assert(mounts[lower_data].mount_point == "/var/lib/data");
+    size_t top_pos = 0, lower_pos = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (order[i] == top_data) top_pos = i;
+        if (order[i] == lower_data) lower_pos = i;
+    }
+    assert(top_pos < lower_pos);
+    assert(lower_pos < pos_of("/var"));
+}
+
+void test_read_swaps()
+{
+    std::ifstream swaps_file("./test-swaps");
+    assert(swaps_file);
+    std::vector<std::string> swaps;
+    read_swaps(swaps_file, swaps);
+    assert(swaps.size() == 2);
+    assert(swaps[0] == "/dev/sda7");
+    assert(swaps[1] == "/var/swap file");
+}
+
+#define RUN_TEST(name, spacing) \
+    std::cout << #name "..." spacing << std::flush; \
+    name(); \
+    std::cout << "PASSED" << std::endl;
+
+int main(int argc, char **argv)
+{
+    RUN_TEST(test_mountinfo_parse, "      ");
+    RUN_TEST(test_mountinfo_bad, "        ");
+    RUN_TEST(test_unmount_order, "        ");
+    RUN_TEST(test_read_swaps, "           ");
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <string>
+#include <vector>
+#include <list>
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+
+#include "load-service.h"
+
+// Benchmark for service description parsing: parses a large number of (generated) service
+// descriptions, from memory, and reports the time taken. Run via "make bench".
+
+using string = std::string;
+using string_iterator = std::string::iterator;
+
+namespace {
+
+constexpr int num_descriptions = 10000;
+constexpr int default_rounds = 5;
+
+class bench_dep
+{
+    public:
+    std::string name;
+    dependency_type dep_type;
+
+    bench_dep(const std::string &name_p, dependency_type dep_type_p)
+        : name(name_p), dep_type(dep_type_p) { }
+};
+
+// Generate a service description, with a mix of settings typical of real descriptions.
+std::string generate_description(int n)
+{
+    std::ostringstream desc;
+    desc << "# Service description " << n << "\n";
+    switch (n % 3) {
+    case 0:
+        desc << "type = process\n"
+                "command = /usr/sbin/daemon-" << n << " --foreground --config \"/etc/daemon " << n
+                << ".conf\" -v\n"
+                "restart = yes\n"
+                "smooth-recovery = true\n"
+                "restart-delay = 0.5\n"
+                "restart-limit-count = 5\n"
+                "stop-timeout = 10\n"
+                "ready-notification = pipefd:3\n";
+        break;
+    case 1:
+        desc << "type = scripted\n"
+                "command = /etc/init.d/script-" << n << " start\n"
+                "stop-command = /etc/init.d/script-" << n << " stop\n"
+                "start-timeout = 30   # allow time for slow hardware\n"
+                "options = starts-rwfs start-interruptible\n"
+                "logfile = /var/log/script-" << n << ".log\n";
+        break;
+    default:
+        desc << "type = internal\n"
+                "\n"
+                "options = skippable\n";
+        break;
+    }
+    desc << "depends-on = svc-" << (n / 2) << "\n"
+            "waits-for = svc-" << (n / 3) << "\n"
+            "term-signal = HUP\n";
+    return desc.str();
+}
+
+// Parse a description (from memory), returning the number of dependencies found.
+size_t parse_description(const std::string &name, const std::string &description)
+{
+    using namespace dinit_load;
+
+    std::istringstream service_file(description);
+    service_settings_wrapper<bench_dep> settings;
+
+    process_service_file(name, service_file,
+            [&](string &line, string &setting, string_iterator &i, string_iterator &end) -> void {
+        auto process_dep_dir_n = [&](std::list<bench_dep> &deplist, const std::string &waitsford,
+                dependency_type dep_type) -> void { };
+        auto load_service_n = [&](const string &dep_name) -> const string & {
+            return dep_name;
+        };
+        process_service_line(settings, name.c_str(), line, setting, i, end, load_service_n,
+                process_dep_dir_n);
+    });
+
+    settings.finalise();
+    return settings.depends.size();
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv)
+{
+    int rounds = default_rounds;
+    if (argc > 1) {
+        rounds = std::max(1, atoi(argv[1]));
+    }
+
+    std::vector<std::string> names;
+    std::vector<std::string> descriptions;
+    size_t total_bytes = 0;
+    for (int n = 0; n < num_descriptions; n++) {
+        names.push_back("svc-" + std::to_string(n));
+        descriptions.push_back(generate_description(n));
+        total_bytes += descriptions.back().length();
+    }
+
+    double best_ms = 0;
+    size_t deps = 0;
+    for (int r = 0; r < rounds; r++) {
+        auto start_time = std::chrono::steady_clock::now();
+        deps = 0;
+        for (int n = 0; n < num_descriptions; n++) {
+            deps += parse_description(names[n], descriptions[n]);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start_time;
+        double ms = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() / 1000.0;
+        if (r == 0 || ms < best_ms) best_ms = ms;
+    }
+
+    std::cout << "Parsed " << num_descriptions << " descriptions (" << total_bytes << " bytes, "
+            << deps << " dependencies)\n";
+    std::cout << "Best of " << rounds << " rounds: " << best_ms << " ms ("
+            << (best_ms * 1000.0 / num_descriptions) << " us per description, "
+            << (total_bytes / 1048576.0) / (best_ms / 1000.0) << " MiB/s)\n";
+    return 0;
+}
@@ -7,6 +7,7 @@
 
 #include "service.h"
 #include "proc-service.h"
+#include "notify-socket.h"
 
 // Tests of process-service related functionality.
 //
@@ -142,6 +143,76 @@ void test_proc_notify_start()
     sset.remove_service(&p);
 }
 
+// Test start with readiness notification via the notification socket, and watchdog
+void test_proc_notify_socket()
+{
+    using namespace std;
+
+    service_set sset;
+
+    string command = "test-command";
+    list<pair<unsigned,unsigned>> command_offsets;
+    command_offsets.emplace_back(0, command.length());
+    std::list<prelim_dep> depends;
+
+    process_service p {&sset, "testproc", std::move(command), command_offsets, depends};
+    init_service_defaults(p);
+    p.set_watchdog_timeout(time_val {5, 0});
+    sset.add_service(&p);
+
+    p.start();
+    sset.process_queues();
+
+    assert(p.get_state() == service_state_t::STARTING);
+    pid_t pid = bp_sys::last_forked_pid;
+
+    // (We don't want to open the real socket, so register with it manually after launch):
+    p.set_notification_socket(true);
+    notify_socket.add_service(&p);
+
+    // Notification may arrive before the exec status:
+    const char msg1[] = "STATUS=Initialising\nREADY=1";
+    notify_socket.process_message(pid, msg1, sizeof(msg1) - 1);
+    assert(p.get_state() == service_state_t::STARTING);
+    assert(p.get_notify_status() == "Initialising");
+
+    base_process_service_test::exec_succeeded(&p);
+    sset.process_queues();
+
+    assert(p.get_state() == service_state_t::STARTED);
+    assert(event_loop.active_timers.size() == 1); // watchdog
+
+    // Messages from other processes are ignored:
+    const char msg2[] = "STATUS=Bogus\n";
+    notify_socket.process_message(pid + 1, msg2, sizeof(msg2) - 1);
+    assert(p.get_notify_status() == "Initialising");
+
+    // Keep-alive restarts the watchdog timer:
+    event_loop.advance_time(time_val {4, 0});
+    const char msg3[] = "WATCHDOG=1\nSTATUS=Running\n";
+    notify_socket.process_message(pid, msg3, sizeof(msg3) - 1);
+    assert(p.get_notify_status() == "Running");
+    event_loop.advance_time(time_val {4, 0});
+    assert(bp_sys::last_sig_sent != SIGKILL);
+
+    // Without keep-alive, the process is killed:
+    event_loop.advance_time(time_val {1, 0});
+    assert(bp_sys::last_sig_sent == SIGKILL);
+    assert(event_loop.active_timers.size() == 0);
+
+    base_process_service_test::handle_signal_exit(&p, SIGKILL);
+    sset.process_queues();
+
+    assert(p.get_state() == service_state_t::STOPPED);
+
+    // Once the process has terminated, the service is no longer registered:
+    const char msg4[] = "STATUS=Stale\n";
+    notify_socket.process_message(pid, msg4, sizeof(msg4) - 1);
+    assert(p.get_notify_status() == "Running");
+
+    sset.remove_service(&p);
+}
+
 // Unexpected termination
 void test_proc_unexpected_term()
 {
@@ -651,6 +722,63 @@ void test_proc_stop_timeout()
     sset.remove_service(&p);
 }
 
+// Test shutdown time limit (process killed when shutdown takes too long)
+void test_proc_shutdown_limit()
+{
+    using namespace std;
+
+    service_set sset;
+    sset.set_shutdown_time_limit(time_val {20, 0});
+
+    string command = "test-command";
+    list<pair<unsigned,unsigned>> command_offsets;
+    command_offsets.emplace_back(0, command.length());
+    std::list<prelim_dep> depends;
+
+    process_service p {&sset, "testproc", std::move(command), command_offsets, depends};
+    init_service_defaults(p);
+    p.set_stop_timeout(time_val {0, 0});
+    sset.add_service(&p);
+
+    p.start();
+    sset.process_queues();
+    base_process_service_test::exec_succeeded(&p);
+    sset.process_queues();
+
+    assert(p.get_state() == service_state_t::STARTED);
+
+    sset.stop_all_services();
+
+    assert(p.get_state() == service_state_t::STOPPING);
+    assert(bp_sys::last_sig_sent == SIGTERM);
+    assert(event_loop.active_timers.size() == 1); // shutdown progress timer
+
+    // Progress is reported at intervals, but the process isn't killed until the time limit:
+    for (int i = 0; i < 3; i++) {
+        event_loop.advance_time(time_val {5, 0});
+        assert(p.get_state() == service_state_t::STOPPING);
+        assert(bp_sys::last_sig_sent == SIGTERM);
+    }
+
+    event_loop.advance_time(time_val {5, 0});
+    assert(p.get_state() == service_state_t::STOPPING);
+    assert(bp_sys::last_sig_sent == SIGKILL);
+
+    base_process_service_test::handle_exit(&p, SIGKILL);
+    sset.process_queues();
+
+    assert(p.get_state() == service_state_t::STOPPED);
+    assert(sset.count_active_services() == 0);
+    assert(event_loop.active_timers.size() == 0);
+
+    auto &stop_times = sset.get_stop_times();
+    assert(stop_times.size() == 1);
+    assert(stop_times[0].name == "testproc");
+    assert(stop_times[0].stop_time == time_val(20, 0));
+
+    sset.remove_service(&p);
+}
+
 // Smooth recovery
 void test_proc_smooth_recovery1()
 {
@@ -793,6 +921,91 @@ void test_proc_smooth_recovery3()
     sset.remove_service(&p);
 }
 
+// Restart backoff: restart delay doubles with each restart, up to a maximum, and resets once the
+// process runs stably
+void test_proc_restart_backoff()
+{
+    using namespace std;
+
+    service_set sset;
+
+    string command = "test-command";
+    list<pair<unsigned,unsigned>> command_offsets;
+    command_offsets.emplace_back(0, command.length());
+    std::list<prelim_dep> depends;
+
+    process_service p {&sset, "testproc", std::move(command), command_offsets, depends};
+    init_service_defaults(p);
+    p.set_smooth_recovery(true);
+    p.set_restart_interval(time_val(10,0), 0);
+    p.set_restart_delay(time_val(0, 100000000));
+    p.set_restart_backoff(time_val(0, 400000000), 0, time_val(10, 0));
+    sset.add_service(&p);
+
+    p.start();
+    sset.process_queues();
+
+    base_process_service_test::exec_succeeded(&p);
+    sset.process_queues();
+
+    assert(p.get_state() == service_state_t::STARTED);
+
+    time_val delay;
+    assert(! p.get_restart_delay(delay));
+
+    // Each restart (with the process failing immediately) should double the delay, up to the maximum:
+    const time_val expected_delays[] = { {0, 100000000}, {0, 200000000}, {0, 400000000},
+            {0, 400000000} };
+
+    for (const time_val &expected : expected_delays) {
+        pid_t instance = bp_sys::last_forked_pid;
+
+        base_process_service_test::handle_exit(&p, 1);
+        sset.process_queues();
+
+        assert(p.get_restart_delay(delay));
+        assert(delay == expected);
+
+        event_loop.advance_time(expected - time_val(0, 1000));
+        sset.process_queues();
+        assert(instance == bp_sys::last_forked_pid);
+
+        event_loop.advance_time(time_val(0, 1000));
+        sset.process_queues();
+        assert(instance + 1 == bp_sys::last_forked_pid);
+        assert(! p.get_restart_delay(delay));
+
+        base_process_service_test::exec_succeeded(&p);
+        sset.process_queues();
+        assert(p.get_state() == service_state_t::STARTED);
+    }
+
+    // Once the process has run for long enough, the backoff resets (and the restart is immediate):
+    event_loop.advance_time(time_val(10, 0));
+    pid_t instance = bp_sys::last_forked_pid;
+    base_process_service_test::handle_exit(&p, 1);
+    sset.process_queues();
+
+    assert(instance + 1 == bp_sys::last_forked_pid);
+    assert(! p.get_restart_delay(delay));
+
+    base_process_service_test::exec_succeeded(&p);
+    sset.process_queues();
+
+    // ... and backoff begins again from the initial delay:
+    base_process_service_test::handle_exit(&p, 1);
+    sset.process_queues();
+    assert(p.get_restart_delay(delay));
+    assert(delay == time_val(0, 200000000));
+
+    p.stop(true);
+    sset.process_queues();
+    assert(p.get_state() == service_state_t::STOPPED);
+    assert(event_loop.active_timers.size() == 0);
+
+    sset.remove_service(&p);
+}
+
 void test_bgproc_smooth_recover()
 {
     using namespace std;
@@ -1252,6 +1465,7 @@ int main(int argc, char **argv)
 {
     RUN_TEST(test_proc_service_start, "   ");
     RUN_TEST(test_proc_notify_start, "    ");
+    RUN_TEST(test_proc_notify_socket, "   ");
     RUN_TEST(test_proc_unexpected_term, " ");
     RUN_TEST(test_proc_term_restart, "    ");
     RUN_TEST(test_proc_term_restart2, "   ");
@@ -1263,9 +1477,11 @@ int main(int argc, char **argv)
     RUN_TEST(test_proc_start_execfail, "  ");
     RUN_TEST(test_proc_notify_fail, "     ");
     RUN_TEST(test_proc_stop_timeout, "    ");
+    RUN_TEST(test_proc_shutdown_limit, "  ");
     RUN_TEST(test_proc_smooth_recovery1, "");
     RUN_TEST(test_proc_smooth_recovery2, "");
     RUN_TEST(test_proc_smooth_recovery3, "");
+    RUN_TEST(test_proc_restart_backoff, " ");
     RUN_TEST(test_bgproc_smooth_recover, "");
     RUN_TEST(test_scripted_stop_timeout, "");
     RUN_TEST(test_scripted_start_fail, "  ");
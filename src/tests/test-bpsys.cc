@@ -190,11 +190,62 @@ ssize_t read(int fd, void *buf, size_t count)
 	return count;
 }
 
+ssize_t recvmsg(int fd, struct msghdr *msg, int flags)
+{
+    read_cond & rrs = read_data[fd];
+    msg->msg_flags = 0;
+    if (rrs.empty()) {
+        if (rrs.is_blocking) {
+            errno = EAGAIN;
+            return -1;
+        }
+        return 0;
+    }
+
+    read_result rr = std::move(rrs.front());
+    rrs.erase(rrs.begin());
+    if (rr.errcode != 0) {
+        errno = rr.errcode;
+        return -1;
+    }
+
+    size_t pos = 0;
+    for (size_t i = 0; i < (size_t)msg->msg_iovlen && pos < rr.data.size(); i++) {
+        size_t count = std::min(msg->msg_iov[i].iov_len, rr.data.size() - pos);
+        std::copy_n(rr.data.begin() + pos, count, (char *)msg->msg_iov[i].iov_base);
+        pos += count;
+    }
+    if (pos < rr.data.size()) {
+        msg->msg_flags |= MSG_TRUNC;
+    }
+    return pos;
+}
+
 ssize_t write(int fd, const void *buf, size_t count)
 {
     return write_hndlr_map[fd]->write(fd, buf, count);
 }
 
+#ifdef __linux__
+int sendmmsg(int fd, struct mmsghdr *msgvec, unsigned vlen, int flags)
+{
+    for (unsigned i = 0; i < vlen; i++) {
+        std::vector<char> dgram;
+        const struct msghdr &msg = msgvec[i].msg_hdr;
+        for (size_t j = 0; j < msg.msg_iovlen; j++) {
+            const char *base = (const char *)msg.msg_iov[j].iov_base;
+            dgram.insert(dgram.end(), base, base + msg.msg_iov[j].iov_len);
+        }
+        ssize_t r = write(fd, dgram.data(), dgram.size());
+        if (r < 0) {
+            return (i == 0) ? -1 : i;
+        }
+        msgvec[i].msg_len = r;
+    }
+    return vlen;
+}
+#endif
+
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
 {
     ssize_t r = 0;
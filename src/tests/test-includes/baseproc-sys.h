@@ -7,6 +7,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/uio.h>
+#include <sys/socket.h>
 
 // Mock system functions for testing.
 
@@ -136,6 +137,12 @@ inline pid_t waitpid(pid_t p, exit_status *statusp, int flags)
 ssize_t read(int fd, void *buf, size_t count);
 ssize_t write(int fd, const void *buf, size_t count);
 ssize_t writev (int fd, const struct iovec *iovec, int count);
+// (each supplied read result is received as a single message):
+ssize_t recvmsg(int fd, struct msghdr *msg, int flags);
+#ifdef __linux__
+// (each message is delivered via a single write to the write handler):
+int sendmmsg(int fd, struct mmsghdr *msgvec, unsigned vlen, int flags);
+#endif
 
 }
 
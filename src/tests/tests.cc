@@ -1,11 +1,21 @@
 #include <iostream>
+#include <fstream>
+#include <iterator>
+#include <sstream>
 
 #include <cerrno>
+#include <cstring>
 #include <cassert>
 
+#include <unistd.h>
+
 #include "service.h"
 #include "test_service.h"
 #include "baseproc-sys.h"
+#include "status-table.h"
+#include "log-journal.h"
+#include "dinit-utmp.h"
+#include "readahead-profile.h"
 
 constexpr static auto REG = dependency_type::REGULAR;
 constexpr static auto WAITS = dependency_type::WAITS_FOR;
@@ -1284,6 +1294,75 @@ void test_other6()
     assert(sset.count_active_services() == 0);
 }
 
+// Recording of service start times during boot
+void test_boot_times()
+{
+    service_set sset;
+
+    test_service *s1 = new test_service(&sset, "test-service-1", service_type_t::INTERNAL, {});
+    test_service *s2 = new test_service(&sset, "test-service-2", service_type_t::INTERNAL, {{s1, REG}});
+    test_service *s3 = new test_service(&sset, "test-service-3", service_type_t::INTERNAL, {});
+
+    sset.add_service(s1);
+    sset.add_service(s2);
+    sset.add_service(s3);
+
+    sset.begin_recording_start_times();
+    sset.start_service(s2);
+    sset.boot_services_started();
+
+    // Boot is not complete until both s1 and s2 have started:
+    assert(sset.is_recording_start_times());
+    s1->started();
+    sset.process_queues();
+    assert(sset.is_recording_start_times());
+    s2->started();
+    sset.process_queues();
+    assert(! sset.is_recording_start_times());
+
+    auto &start_times = sset.get_start_times();
+    assert(start_times.size() == 2);
+    assert(start_times[0].name == "test-service-1");
+    assert(start_times[1].name == "test-service-2");
+
+    // Services started after boot are not recorded:
+    sset.start_service(s3);
+    s3->started();
+    sset.process_queues();
+    assert(sset.get_start_times().size() == 2);
+}
+
+// If a service never finishes starting, boot is considered complete after a time limit.
+void test_boot_times2()
+{
+    service_set sset;
+
+    test_service *s1 = new test_service(&sset, "test-service-1", service_type_t::INTERNAL, {});
+    test_service *s2 = new test_service(&sset, "test-service-2", service_type_t::INTERNAL, {});
+    sset.add_service(s1);
+    sset.add_service(s2);
+
+    sset.begin_recording_start_times();
+    sset.start_service(s1);
+    sset.start_service(s2);
+    sset.boot_services_started();
+    s1->started();
+    sset.process_queues();
+    assert(sset.is_recording_start_times());
+
+    event_loop.advance_time(time_val(max_boot_record_secs - 1, 0));
+    assert(sset.is_recording_start_times());
+    event_loop.advance_time(time_val(1, 0));
+    assert(! sset.is_recording_start_times());
+    assert(sset.get_start_times().size() == 1);
+    assert(sset.get_boot_duration() == time_val(max_boot_record_secs, 0));
+
+    // s2 finishing later has no effect:
+    s2->started();
+    sset.process_queues();
+    assert(sset.get_start_times().size() == 1);
+}
+
 static void flush_log(int fd)
 {
     while (! is_log_flushed()) {
@@ -1365,6 +1444,376 @@ void test_log2()
     close_log();
 }
 
+// Messages concerning a service are rate-limited (per service and log level); the number of suppressed
+// messages is reported later.
+void test_log_rate_limit()
+{
+    service_set sset;
+    init_log(&sset, false /* syslog format */);
+
+    int logfd = bp_sys::allocfd();
+    setup_main_log(logfd);
+    flush_log(logfd);
+
+    auto read_log = [&]() -> std::string {
+        while (! is_log_flushed()) {
+            event_loop.send_fd_event(logfd, dasynq::OUT_EVENTS);
+            event_loop.send_fd_event(STDOUT_FILENO, dasynq::OUT_EVENTS);
+        }
+        std::vector<char> wdata;
+        bp_sys::extract_written_data(logfd, wdata);
+        return std::string(wdata.begin(), wdata.end());
+    };
+
+    std::string expected;
+    for (int i = 0; i < 15; i++) {
+        log_service_msg(loglevel_t::ERROR, std::string("svc-a"), "message ", i);
+        if (i < 10) expected += "dinit: svc-a: message " + std::to_string(i) + "\n";
+    }
+    log_service_msg(loglevel_t::ERROR, std::string("svc-b"), "message");
+    log_service_msg(loglevel_t::WARN, std::string("svc-a"), "warning");
+    expected += "dinit: svc-b: message\ndinit: svc-a: warning\n";
+    assert(read_log() == expected);
+
+    event_loop.advance_time(time_val(10, 0));
+    assert(read_log() == "dinit: svc-a: 5 log message(s) suppressed (rate limit exceeded)\n");
+
+    // Tokens have accrued (one per 2 seconds):
+    for (int i = 0; i < 6; i++) {
+        log_service_msg(loglevel_t::ERROR, std::string("svc-a"), "again");
+    }
+    expected.clear();
+    for (int i = 0; i < 5; i++) {
+        expected += "dinit: svc-a: again\n";
+    }
+    assert(read_log() == expected);
+
+    // Messages which aren't logged (below the level of every log) are not tracked:
+    size_t tracked = log_rate_tracked_services();
+    log_service_msg(loglevel_t::DEBUG, std::string("svc-c"), "debug");
+    assert(read_log().empty());
+    assert(log_rate_tracked_services() == tracked);
+
+    // Services are forgotten once idle, even if no messages were suppressed:
+    log_service_msg(loglevel_t::ERROR, std::string("svc-d"), "message");
+    assert(read_log() == "dinit: svc-d: message\n");
+    assert(log_rate_tracked_services() == tracked + 1);
+    for (int i = 0; i < 3 && log_rate_tracked_services() != 0; i++) {
+        event_loop.advance_time(time_val(10, 0));
+    }
+    assert(log_rate_tracked_services() == 0);
+
+    close_log();
+}
+
+#ifdef __linux__
+// When the main log is a datagram socket, each message is sent as a separate datagram (without the
+// newline), including messages which span the end of the circular buffer. A message which can't be sent
+// doesn't prevent the following messages being sent, and messages are retained while the socket is
+// full.
+void test_log_dgram()
+{
+    service_set sset;
+    init_log(&sset, true /* syslog format */);
+
+    class dgram_writer : public bp_sys::write_handler {
+    public:
+        std::vector<std::string> dgrams;
+        bool full = false;
+
+        ssize_t write(int fd, const void *buf, size_t count) override
+        {
+            std::string dgram((const char *)buf, count);
+            if (full) {
+                errno = EAGAIN;
+                return -1;
+            }
+            if (dgram.find("too large") != std::string::npos) {
+                errno = EMSGSIZE;
+                return -1;
+            }
+            dgrams.push_back(std::move(dgram));
+            return count;
+        }
+    };
+
+    dgram_writer *dw = new dgram_writer();
+    int logfd = bp_sys::allocfd(dw);
+    setup_main_log(logfd, true);
+
+    // Discard messages buffered by earlier tests:
+    while (! is_log_flushed()) {
+        event_loop.send_fd_event(logfd, dasynq::OUT_EVENTS);
+        event_loop.send_fd_event(STDOUT_FILENO, dasynq::OUT_EVENTS);
+    }
+    dw->dgrams.clear();
+
+    // Several rounds, so that messages wrap around the end of the buffer:
+    for (int round = 0; round < 4; round++) {
+        dw->full = true;
+        for (int i = 0; i < 30; i++) {
+            log(loglevel_t::ERROR, "test message ", round * 100 + i, (i == 10) ? " too large" : "");
+        }
+
+        event_loop.send_fd_event(logfd, dasynq::OUT_EVENTS);
+        assert(dw->dgrams.empty());
+        dw->full = false;
+        while (! is_log_flushed()) {
+            event_loop.send_fd_event(logfd, dasynq::OUT_EVENTS);
+            event_loop.send_fd_event(STDOUT_FILENO, dasynq::OUT_EVENTS);
+        }
+
+        assert(dw->dgrams.size() == 29);
+        for (int i = 0, j = 0; i < 30; i++) {
+            if (i == 10) continue;
+            assert(dw->dgrams[j++] == "<27>dinit: test message " + std::to_string(round * 100 + i));
+        }
+        dw->dgrams.clear();
+    }
+
+    close_log();
+}
+#endif
+
+// Messages are recorded in the log journal (including those logged before it is opened), with the
+// service identified for messages which concern a particular service.
+void test_log_journal()
+{
+    char path[] = "/tmp/dinit-test-journal.XXXXXX";
+    int tmpfd = mkstemp(path);
+    assert(tmpfd != -1);
+    close(tmpfd);
+
+    service_set sset;
+    init_log(&sset, true /* syslog format */);
+    set_log_journal_path(path);
+
+    log(loglevel_t::ERROR, "before open");
+    assert(open_log_journal());
+    log_service_msg(loglevel_t::WARN, std::string("svc-one"), "message ", 1);
+    log(loglevel_t::DEBUG, "not recorded");
+    log_service_started("svc-two");
+
+    close_log_journal();
+    set_log_journal_path(nullptr);
+    close_log();
+
+    std::ifstream journal_in(path, std::ios::in | std::ios::binary);
+    std::string data {std::istreambuf_iterator<char>(journal_in), std::istreambuf_iterator<char>()};
+    unlink(path);
+
+    assert(log_journal_check_header(data.data(), data.size()));
+
+    struct {
+        loglevel_t level;
+        const char *svc_name;
+        const char *msg;
+    } expected[] = {
+        { loglevel_t::ERROR, "", "before open" },
+        { loglevel_t::WARN, "svc-one", "message 1" },
+        { loglevel_t::INFO, "svc-two", "started" }
+    };
+
+    size_t offset = log_journal_hdr_size;
+    for (auto &exp : expected) {
+        log_journal_record rec;
+        size_t next = log_journal_read_record(data.data(), data.size(), offset, rec);
+        assert(next != 0);
+        assert(rec.level == (uint8_t)exp.level);
+        const char *rec_name = data.data() + offset + sizeof(rec);
+        assert(std::string(rec_name, rec.svc_name_len) == exp.svc_name);
+        assert(std::string(rec_name + rec.svc_name_len, rec.msg_len) == exp.msg);
+        offset = next;
+    }
+    assert(offset == data.size());
+}
+
+// Once the journal reaches its maximum size, it is renamed (with ".old" appended) and a new journal
+// is begun.
+void test_log_journal_rotate()
+{
+    char path[] = "/tmp/dinit-test-journal.XXXXXX";
+    int tmpfd = mkstemp(path);
+    assert(tmpfd != -1);
+    close(tmpfd);
+    std::string old_path = std::string(path) + log_journal_old_suffix;
+
+    service_set sset;
+    init_log(&sset, true /* syslog format */);
+    set_log_journal_path(path);
+    set_log_journal_max_size(1);
+    assert(open_log_journal());
+
+    // Each record is 24 bytes (header) + 8 (name) + 8 (message, padded) = 40 bytes; 1024 bytes
+    // holds the journal header and 25 records.
+    for (int i = 0; i < 30; i++) {
+        log_service_msg(loglevel_t::WARN, std::string("svc-" + std::to_string(i % 10) + "xyz"), "msg ",
+                i % 10);
+    }
+
+    close_log_journal();
+    set_log_journal_path(nullptr);
+    set_log_journal_max_size(log_journal_default_max_kib);
+    close_log();
+
+    auto read_file = [](const std::string &file_path) -> std::string {
+        std::ifstream in(file_path, std::ios::in | std::ios::binary);
+        return std::string {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    };
+    std::string old_data = read_file(old_path);
+    std::string data = read_file(path);
+    unlink(path);
+    unlink(old_path.c_str());
+
+    auto count_records = [](const std::string &journal_data) -> int {
+        assert(log_journal_check_header(journal_data.data(), journal_data.size()));
+        int count = 0;
+        log_journal_record rec;
+        size_t offset = log_journal_hdr_size;
+        size_t next;
+        while ((next = log_journal_read_record(journal_data.data(), journal_data.size(), offset, rec)) != 0) {
+            offset = next;
+            ++count;
+        }
+        assert(offset == journal_data.size());
+        return count;
+    };
+
+    assert(old_data.size() == log_journal_hdr_size + 25 * 40);
+    assert(count_records(old_data) == 25);
+    assert(count_records(data) == 5);
+}
+
+// Find the status table entry for the named service, searching the first 'count' slots.
+static int find_status_slot(const char *name, int count, status_table_entry &entry)
+{
+    for (int i = 0; i < count; i++) {
+        service_status_table.read_entry(i, entry);
+        if (entry.in_use && entry.name_len == strlen(name) && strncmp(entry.name, name, entry.name_len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool find_status_entry(const char *name, int count, status_table_entry &entry)
+{
+    return find_status_slot(name, count, entry) != -1;
+}
+
+// Status table reflects service state, target state and transitions; entries are released when
+// services are unloaded, and the table grows as needed.
+void test_status_table()
+{
+    assert(service_status_table.init());
+
+    {
+        service_set sset;
+
+        service_record *s1 = new service_record(&sset, "test-service-1", service_type_t::INTERNAL, {});
+        service_record *s2 = new service_record(&sset, "test-service-2", service_type_t::INTERNAL, {{s1, REG}});
+        sset.add_service(s1);
+        sset.add_service(s2);
+
+        status_table_entry entry;
+        assert(find_status_entry("test-service-1", 2, entry));
+        assert(entry.state == (uint8_t)service_state_t::STOPPED);
+        assert(entry.target_state == (uint8_t)service_state_t::STOPPED);
+        assert(entry.pid == -1);
+        assert((entry.seq & 1) == 0);
+
+        event_loop.advance_time(time_val(1, 0));
+        sset.start_service(s2);
+
+        assert(find_status_entry("test-service-1", 2, entry));
+        assert(entry.state == (uint8_t)service_state_t::STARTED);
+        assert(entry.target_state == (uint8_t)service_state_t::STARTED);
+        time_val now;
+        event_loop.get_time(now, clock_type::MONOTONIC);
+        assert(entry.transition_sec == (int64_t)now.seconds() && entry.transition_nsec == (int32_t)now.nseconds());
+
+        sset.stop_service(s2);
+        assert(find_status_entry("test-service-2", 2, entry));
+        assert(entry.state == (uint8_t)service_state_t::STOPPED);
+        assert(entry.target_state == (uint8_t)service_state_t::STOPPED);
+
+        // A replacement record (after reload) takes over the entry of the original:
+        int slot = find_status_slot("test-service-2", 2, entry);
+        service_record *s2r = new service_record(&sset, "test-service-2", service_type_t::INTERNAL, {});
+        s2r->update_status(true);  // (not yet in the set: no entry)
+        assert(find_status_slot("test-service-2", 2, entry) == slot);
+        sset.replace_service(s2, s2r);
+        s2->prepare_for_unload();
+        delete s2;
+        assert(find_status_slot("test-service-2", 2, entry) == slot);
+        assert(find_status_entry("test-service-1", 2, entry));
+
+        // Enough services to require growing the table:
+        for (int i = 0; i < 100; i++) {
+            std::string name = "test-grow-" + std::to_string(i);
+            sset.add_service(new service_record(&sset, name, service_type_t::INTERNAL, {}));
+        }
+
+        assert(find_status_entry("test-grow-99", 102, entry));
+        assert(find_status_entry("test-service-1", 102, entry));
+        assert(entry.state == (uint8_t)service_state_t::STOPPED);
+    }
+
+    // All entries have been released:
+    status_table_entry entry;
+    for (int i = 0; i < 102; i++) {
+        service_status_table.read_entry(i, entry);
+        assert(! entry.in_use);
+    }
+}
+
+#if USE_UTMPX
+// Until the database is writable, utmp updates are queued, with later updates superseding earlier
+// pending updates for the same entry. (The queue is never marked writable here, so the database itself
+// is not touched.)
+void test_utmp_queue()
+{
+    utmp_queue_t queue;
+
+    queue.create_entry("t1", "tty1", 100);
+    queue.create_entry("t2", "tty2", 101);
+    assert(queue.num_pending() == 2);
+
+    // clearing supersedes the pending creation:
+    queue.clear_entry("t1", "tty1");
+    assert(queue.num_pending() == 2);
+
+    // as does re-creating (a different process) for the same entry:
+    queue.create_entry("t1", "tty1", 102);
+    assert(queue.num_pending() == 2);
+
+    // but a different line is a different entry:
+    queue.create_entry("t1", "tty3", 103);
+    assert(queue.num_pending() == 3);
+}
+#endif
+
+// A readahead profile lists absolute paths, one per line; paths which cannot be represented are
+// omitted when writing, and lines which aren't absolute paths are ignored when reading.
+void test_readahead_profile()
+{
+    std::vector<std::string> files = { "/usr/lib/libc.so.6", "/etc/fstab", "relative/path",
+            "/bad\npath", "", "/sbin/agetty" };
+
+    std::ostringstream out;
+    write_readahead_profile(out, files);
+    assert(out.str() == "/usr/lib/libc.so.6\n/etc/fstab\n/sbin/agetty\n");
+
+    std::istringstream in(out.str() + "\n# comment\n/last/file");
+    std::vector<std::string> read_files;
+    read_readahead_profile(in, read_files);
+    assert(read_files.size() == 4);
+    assert(read_files[0] == "/usr/lib/libc.so.6");
+    assert(read_files[1] == "/etc/fstab");
+    assert(read_files[2] == "/sbin/agetty");
+    assert(read_files[3] == "/last/file");
+}
+
 #define RUN_TEST(name, spacing) \
     std::cout << #name "..." spacing << std::flush; \
     name(); \
@@ -1406,6 +1855,19 @@ int main(int argc, char **argv)
     RUN_TEST(test_other4, "               ");
     RUN_TEST(test_other5, "               ");
     RUN_TEST(test_other6, "               ");
+    RUN_TEST(test_boot_times, "           ");
+    RUN_TEST(test_boot_times2, "          ");
     RUN_TEST(test_log1, "                 ");
     RUN_TEST(test_log2, "                 ");
+    RUN_TEST(test_log_rate_limit, "       ");
+#ifdef __linux__
+    RUN_TEST(test_log_dgram, "            ");
+#endif
+    RUN_TEST(test_log_journal, "          ");
+    RUN_TEST(test_log_journal_rotate, "   ");
+    RUN_TEST(test_status_table, "         ");
+#if USE_UTMPX
+    RUN_TEST(test_utmp_queue, "           ");
+#endif
+    RUN_TEST(test_readahead_profile, "    ");
 }